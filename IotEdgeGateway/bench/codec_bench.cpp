@@ -0,0 +1,195 @@
+// Decode cost and size of the same telemetry envelopes as JSON, CBOR and MessagePack,
+// with and without a schema plan, plus the cost of encoding them. Each format's messages
+// are also packed into one block, LZ4-compressed as the uplink does and decompressed
+// again; the round trip must give back the block byte for byte.
+//
+//   cmake -S . -B build -DIOTGW_BUILD_BENCH=ON && cmake --build build --target iotgw_codec_bench
+//   ./build/iotgw_codec_bench [messages] [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "core/device/codec/decode_plan.hpp"
+#include "core/device/codec/envelope_encoder.hpp"
+#include "core/device/codec/telemetry_decoder.hpp"
+#include "core/uplink/lz4_block.hpp"
+
+namespace {
+
+using iotgw::core::device::codec::DecodePlan;
+using iotgw::core::device::codec::FieldRule;
+using iotgw::core::device::codec::PayloadFormat;
+using iotgw::core::device::codec::SchemaType;
+using iotgw::core::device::model::FieldTable;
+using iotgw::core::device::model::FieldValue;
+
+struct Sample {
+    std::string id;
+    std::string type;
+    FieldTable data;
+    const DecodePlan* plan = nullptr;
+};
+
+FieldRule Rule(const char* name, SchemaType type, double min, double max) {
+    FieldRule r;
+    r.name = name;
+    r.type = type;
+    r.has_min = true;
+    r.has_max = true;
+    r.min = min;
+    r.max = max;
+    return r;
+}
+
+template <typename Fn>
+double BestMs(int rounds, Fn fn) {
+    double best = 1e300;
+    for (int r = 0; r < rounds; ++r) {
+        const auto t0 = std::chrono::steady_clock::now();
+        fn();
+        const auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return best;
+}
+
+// Compresses and decompresses `raw`; false if the result differs.
+bool Lz4RoundTrip(const std::string& raw, std::string& packed) {
+    iotgw::core::uplink::Lz4Block lz4;
+    packed.clear();
+    lz4.Compress(raw.data(), raw.size(), packed);
+    std::string back;
+    return iotgw::core::uplink::Lz4Block::Decompress(packed.data(), packed.size(), raw.size(), back) && back == raw;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t messages = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 200000;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    // The shapes of config/devices/schema.yaml: one float sensor, two integer actuators.
+    DecodePlan sensor_plan;
+    sensor_plan.type_const = "sensor";
+    sensor_plan.fields.push_back(Rule("value", SchemaType::kNumber, -40, 125));
+    DecodePlan led_plan;
+    led_plan.type_const = "actuator";
+    led_plan.fields.push_back(Rule("br", SchemaType::kInteger, 0, 100));
+    led_plan.fields.push_back(Rule("on", SchemaType::kInteger, 0, 1));
+    DecodePlan motor_plan;
+    motor_plan.type_const = "actuator";
+    motor_plan.fields.push_back(Rule("dir", SchemaType::kInteger, 0, 1));
+    motor_plan.fields.push_back(Rule("on", SchemaType::kInteger, 0, 1));
+    motor_plan.fields.push_back(Rule("sp", SchemaType::kInteger, 0, 100));
+
+    std::vector<Sample> samples(messages);
+    for (std::size_t i = 0; i < messages; ++i) {
+        Sample& s = samples[i];
+        s.id = "dev-" + std::to_string(i % 1000);
+        switch (i % 3) {
+            case 0:
+                s.type = "sensor";
+                (void)s.data.Set("value", FieldValue::Number(20.0 + static_cast<double>(i % 150) / 10.0));
+                s.plan = &sensor_plan;
+                break;
+            case 1:
+                s.type = "actuator";
+                (void)s.data.Set("on", FieldValue::Number(static_cast<double>(i % 2)));
+                (void)s.data.Set("br", FieldValue::Number(static_cast<double>(i % 101)));
+                s.plan = &led_plan;
+                break;
+            default:
+                s.type = "actuator";
+                (void)s.data.Set("on", FieldValue::Number(1));
+                (void)s.data.Set("sp", FieldValue::Number(static_cast<double>(i % 100)));
+                (void)s.data.Set("dir", FieldValue::Number(static_cast<double>(i % 2)));
+                s.plan = &motor_plan;
+                break;
+        }
+    }
+
+    const PayloadFormat formats[] = {PayloadFormat::kJson, PayloadFormat::kCbor, PayloadFormat::kMsgpack};
+    const std::int64_t ts = 1760000000;
+    std::printf("messages=%zu rounds=%d\n", messages, rounds);
+    std::printf("%-8s %10s %12s %14s %14s\n", "format", "bytes/msg", "encode ns", "decode ns", "validated ns");
+
+    int failures = 0;
+    double json_bytes = 0.0;
+    std::vector<std::string> blocks;
+    for (const PayloadFormat f : formats) {
+        std::vector<std::string> wire(messages);
+        const double encode_ms = BestMs(rounds, [&]() {
+            for (std::size_t i = 0; i < messages; ++i) {
+                wire[i].clear();
+                iotgw::core::device::codec::EncodeEnvelope(f, samples[i].id, samples[i].type, samples[i].data, ts,
+                                                           wire[i]);
+            }
+        });
+
+        std::size_t bytes = 0;
+        for (const auto& w : wire) bytes += w.size();
+        blocks.emplace_back();
+        for (const auto& w : wire) blocks.back() += w;
+
+        iotgw::core::device::codec::DecodedTelemetry out;
+        std::size_t ok = 0;
+        const double decode_ms = BestMs(rounds, [&]() {
+            ok = 0;
+            for (std::size_t i = 0; i < messages; ++i) {
+                ok += iotgw::core::device::codec::DecodePayload(f, wire[i], nullptr, out) ? 1 : 0;
+            }
+        });
+        failures += ok == messages ? 0 : 1;
+
+        const double validated_ms = BestMs(rounds, [&]() {
+            ok = 0;
+            for (std::size_t i = 0; i < messages; ++i) {
+                ok += iotgw::core::device::codec::DecodePayload(f, wire[i], samples[i].plan, out) ? 1 : 0;
+            }
+        });
+        failures += ok == messages ? 0 : 1;
+
+        const double per_msg = static_cast<double>(bytes) / static_cast<double>(messages);
+        if (f == PayloadFormat::kJson) json_bytes = per_msg;
+        const double ns = 1e6 / static_cast<double>(messages);
+        std::printf("%-8s %10.1f %12.1f %14.1f %14.1f  (%.0f%% of json bytes)\n",
+                    iotgw::core::device::codec::PayloadFormatName(f), per_msg, encode_ms * ns, decode_ms * ns,
+                    validated_ms * ns, 100.0 * per_msg / json_bytes);
+    }
+    if (failures != 0) std::printf("DECODE FAILURES: %d\n", failures);
+
+    // Edge cases first: empty, shorter than a match, one long run, incompressible.
+    std::string noise(4096, '\0');
+    std::uint32_t x = 2463534242u;
+    for (auto& ch : noise) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        ch = static_cast<char>(x);
+    }
+    const std::string edge[] = {std::string(), std::string("abc"), std::string(70000, 'a'), noise};
+    int lz4_failures = 0;
+    std::string packed;
+    for (const auto& raw : edge) lz4_failures += Lz4RoundTrip(raw, packed) ? 0 : 1;
+    std::printf("%-8s %10s %12s %14s\n", "lz4", "raw bytes", "ratio", "compress ns/B");
+    for (std::size_t k = 0; k < blocks.size(); ++k) {
+        const std::string& raw = blocks[k];
+        lz4_failures += Lz4RoundTrip(raw, packed) ? 0 : 1;
+        iotgw::core::uplink::Lz4Block lz4;
+        std::string out;
+        const double ms = BestMs(rounds, [&]() {
+            out.clear();
+            lz4.Compress(raw.data(), raw.size(), out);
+        });
+        std::printf("%-8s %10zu %12.2f %14.2f\n", iotgw::core::device::codec::PayloadFormatName(formats[k]),
+                    raw.size(), static_cast<double>(raw.size()) / static_cast<double>(packed.size()),
+                    ms * 1e6 / static_cast<double>(raw.size()));
+    }
+    if (lz4_failures != 0) std::printf("LZ4 ROUND TRIP FAILURES: %d\n", lz4_failures);
+    return failures == 0 && lz4_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// REST routing cost: matches a mix of request paths against the compiled route table
+// (ApiRoutes) and against the former dispatch, which copied the URI and base path into
+// strings and asked each handler in turn, comparing prefixes and cutting ids with substr.
+// Only routing is timed; no handler runs.
+//
+//   cmake -S . -B build -DIOTGW_BUILD_BENCH=ON && cmake --build build --target iotgw_route_bench
+//   ./build/iotgw_route_bench [requests] [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "services/web_services/api/rest_api.hpp"
+
+namespace {
+
+using iotgw::services::web_services::api::RouteParams;
+
+struct Request {
+    const char* method;
+    const char* uri;
+};
+
+// Roughly what the dashboard and integrations send; the last ones match nothing.
+const Request kRequests[] = {
+    {"GET", "/api/status"},
+    {"GET", "/api/devices"},
+    {"GET", "/api/devices/temp_sensor_01"},
+    {"POST", "/api/actuators/led/set"},
+    {"GET", "/api/rules"},
+    {"POST", "/api/rules/overheat_alarm/enable"},
+    {"GET", "/api/metrics"},
+    {"GET", "/api/streams/vib-1/ax"},
+    {"GET", "/api/anomalies"},
+    {"POST", "/api/camera/record/start"},
+    {"GET", "/api/health"},
+    {"GET", "/index.html"},
+    {"GET", "/api/unknown/path"},
+};
+constexpr std::size_t kRequestCount = sizeof(kRequests) / sizeof(kRequests[0]);
+
+bool LegacyStripBasePath(const std::string& uri, const std::string& base_path, std::string& out_rel) {
+    if (uri == base_path) {
+        out_rel = "/";
+        return true;
+    }
+    const std::string prefix = base_path + "/";
+    if (uri.size() >= prefix.size() && uri.compare(0, prefix.size(), prefix) == 0) {
+        out_rel = uri.substr(base_path.size());
+        return true;
+    }
+    return false;
+}
+
+bool IsMethod(struct mg_str m, const char* method) {
+    const std::size_t n = std::strlen(method);
+    return m.len == n && std::memcmp(m.buf, method, n) == 0;
+}
+
+bool StartsWith(const std::string& s, const std::string& prefix) {
+    return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool EndsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The dispatch before the route table, reduced to its matching: returns a route number.
+int LegacyRoute(struct mg_str method, struct mg_str uri_in, std::string& id) {
+    const std::string uri(uri_in.buf, uri_in.len);
+    const std::string base_path = "/api";
+    std::string rel;
+    if (!LegacyStripBasePath(uri, base_path, rel)) return -1;
+    // system
+    if (IsMethod(method, "GET") && rel == "/health") return 0;
+    if (IsMethod(method, "GET") && rel == "/version") return 1;
+    if (IsMethod(method, "GET") && rel == "/metrics") return 2;
+    // devices
+    if (IsMethod(method, "GET") && rel == "/devices") return 3;
+    if (IsMethod(method, "GET") && StartsWith(rel, "/devices/")) {
+        id = rel.substr(std::string("/devices/").size());
+        return 4;
+    }
+    if (IsMethod(method, "POST") && StartsWith(rel, "/actuators/") && EndsWith(rel, "/set")) {
+        const std::string base = std::string("/actuators/");
+        const std::string tail = std::string("/set");
+        id = rel.substr(base.size(), rel.size() - base.size() - tail.size());
+        return 5;
+    }
+    // rules
+    if (IsMethod(method, "GET") && rel == "/rules") return 6;
+    if (IsMethod(method, "POST") && rel == "/rules/reload") return 7;
+    if (IsMethod(method, "POST") && StartsWith(rel, "/rules/") &&
+        (EndsWith(rel, "/enable") || EndsWith(rel, "/disable"))) {
+        const bool enable = EndsWith(rel, "/enable");
+        const std::string base = std::string("/rules/");
+        const std::string tail = enable ? std::string("/enable") : std::string("/disable");
+        id = rel.substr(base.size(), rel.size() - base.size() - tail.size());
+        return 8;
+    }
+    // camera
+    if (IsMethod(method, "GET") && rel == "/camera/status") return 9;
+    if (IsMethod(method, "POST") && rel == "/camera/start") return 10;
+    if (IsMethod(method, "POST") && rel == "/camera/stop") return 11;
+    if (IsMethod(method, "POST") && rel == "/camera/snapshot") return 12;
+    if (IsMethod(method, "POST") && rel == "/camera/record/start") return 13;
+    if (IsMethod(method, "POST") && rel == "/camera/record/stop") return 14;
+    // control
+    if (IsMethod(method, "GET") && rel == "/status") return 15;
+    if (IsMethod(method, "POST") && rel == "/control") return 16;
+    // streams
+    if (IsMethod(method, "GET") && rel == "/anomalies") return 17;
+    if (IsMethod(method, "GET") && rel == "/stream") return 18;
+    if (IsMethod(method, "GET") && (rel == "/streams" || StartsWith(rel, "/streams/"))) {
+        if (rel != "/streams") {
+            const std::string tail = rel.substr(std::string("/streams/").size());
+            const std::size_t slash = tail.find('/');
+            if (slash != std::string::npos) id = tail.substr(0, slash);
+        }
+        return 19;
+    }
+    return -1;
+}
+
+bool TrieRoute(struct mg_str method, struct mg_str uri, RouteParams& params) {
+    static const struct mg_str kBase = mg_str("/api");
+    if (uri.len < kBase.len || std::memcmp(uri.buf, kBase.buf, kBase.len) != 0) return false;
+    const struct mg_str rel = mg_str_n(uri.buf + kBase.len, uri.len - kBase.len);
+    return iotgw::services::web_services::api::ApiRoutes().Match(method, rel, params) != nullptr;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t requests = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    // Requests arrive as views into mongoose's receive buffer.
+    std::vector<struct mg_str> methods;
+    std::vector<struct mg_str> uris;
+    std::vector<std::string> storage;
+    storage.reserve(kRequestCount * 2);
+    for (const auto& r : kRequests) {
+        storage.emplace_back(r.method);
+        methods.push_back(mg_str_n(storage.back().data(), storage.back().size()));
+        storage.emplace_back(r.uri);
+        uris.push_back(mg_str_n(storage.back().data(), storage.back().size()));
+    }
+    std::printf("routes=%zu paths=%zu requests=%zu\n", iotgw::services::web_services::api::ApiRoutes().Size(),
+                kRequestCount, requests);
+
+    using Clock = std::chrono::steady_clock;
+    double best_trie = 1e30;
+    double best_legacy = 1e30;
+    std::size_t trie_hits = 0;
+    std::size_t legacy_hits = 0;
+    for (int r = 0; r < rounds; ++r) {
+        trie_hits = 0;
+        RouteParams params;
+        auto t0 = Clock::now();
+        for (std::size_t i = 0; i < requests; ++i) {
+            const std::size_t k = i % kRequestCount;
+            if (TrieRoute(methods[k], uris[k], params)) trie_hits += 1 + params.count;
+        }
+        best_trie = std::min(best_trie, std::chrono::duration<double, std::nano>(Clock::now() - t0).count());
+
+        legacy_hits = 0;
+        std::string id;
+        t0 = Clock::now();
+        for (std::size_t i = 0; i < requests; ++i) {
+            const std::size_t k = i % kRequestCount;
+            if (LegacyRoute(methods[k], uris[k], id) >= 0) legacy_hits += 1 + (id.empty() ? 0 : 1);
+            id.clear();
+        }
+        best_legacy = std::min(best_legacy, std::chrono::duration<double, std::nano>(Clock::now() - t0).count());
+    }
+
+    const double n = static_cast<double>(requests);
+    std::printf("route table: %.1f ns/request (%zu matches+params)\n", best_trie / n, trie_hits);
+    std::printf("legacy chain: %.1f ns/request (%zu matches+ids)\n", best_legacy / n, legacy_hits);
+    std::printf("speedup: %.1fx\n", best_legacy / best_trie);
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Sustained sample rate of the array ingestion path: decode a block payload into the
+// reused SampleBatch, append it to the stream history and run the window operator;
+// then the cost of one spectral frame (real FFT) per size.
+//
+//   cmake -S . -B build -DIOTGW_BUILD_BENCH=ON && cmake --build build --target iotgw_stream_bench
+//   ./build/iotgw_stream_bench [samples_per_channel] [payloads] [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "core/common/utils/json_writer.hpp"
+#include "core/device/codec/telemetry_decoder.hpp"
+#include "core/stream/fft.hpp"
+#include "core/stream/stream_store.hpp"
+#include "core/stream/window_stats.hpp"
+
+namespace {
+
+using iotgw::core::device::codec::DecodedTelemetry;
+using iotgw::core::device::codec::PayloadFormat;
+using iotgw::core::device::codec::SampleBatch;
+
+const char* const kChannels[] = {"ax", "ay", "az", "current"};
+constexpr std::size_t kChannelCount = 4;
+
+// One 1 kHz vibration block per payload, as a device would publish it.
+std::string MakePayload(std::size_t per_channel, std::size_t seq) {
+    iotgw::core::common::json::Writer w(per_channel * kChannelCount * 10 + 128);
+    w.BeginObject();
+    w.Key("device_id").String("vib-1");
+    w.Key("type").String("sensor");
+    w.Key("rate_hz").Int(1000);
+    w.Key("t0_ms").Int(1760000000000LL + static_cast<std::int64_t>(seq * per_channel));
+    w.Key("data").BeginObject();
+    for (std::size_t c = 0; c < kChannelCount; ++c) {
+        w.Key(kChannels[c]).BeginArray();
+        for (std::size_t i = 0; i < per_channel; ++i) {
+            const double t = static_cast<double>(seq * per_channel + i) / 1000.0;
+            w.Double(std::round(1000.0 * std::sin(2.0 * 3.14159265 * (50.0 + 10.0 * c) * t)) / 1000.0);
+        }
+        w.EndArray();
+    }
+    w.EndObject();
+    w.EndObject();
+    return w.Take();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t per_channel = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000;
+    const std::size_t payloads = argc > 2 ? static_cast<std::size_t>(std::strtoull(argv[2], nullptr, 10)) : 200;
+    const int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    std::vector<std::string> wire(payloads);
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < payloads; ++i) {
+        wire[i] = MakePayload(per_channel, i);
+        bytes += wire[i].size();
+    }
+
+    iotgw::core::stream::StreamStore store(8192, 16);
+    iotgw::core::stream::WindowStats windows(100000);
+    store.AddSink([&windows](const iotgw::core::stream::SampleBlock& b) { windows.OnBlock(b); });
+
+    SampleBatch batch;
+    DecodedTelemetry out;
+    out.samples = &batch;
+
+    double best_decode = 1e300;
+    double best_total = 1e300;
+    std::size_t failures = 0;
+    for (int r = 0; r < rounds; ++r) {
+        double decode_ms = 0.0;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < payloads; ++i) {
+            const auto d0 = std::chrono::steady_clock::now();
+            const bool ok = iotgw::core::device::codec::DecodePayload(PayloadFormat::kJson, wire[i], nullptr, out);
+            decode_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - d0).count();
+            if (!ok || batch.SampleCount() != per_channel * kChannelCount) {
+                ++failures;
+                continue;
+            }
+            store.Ingest(0, "vib-1", batch, 0);
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        best_total = std::min(best_total, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        best_decode = std::min(best_decode, decode_ms);
+    }
+
+    const double samples = static_cast<double>(payloads * per_channel * kChannelCount);
+    std::printf("payloads=%zu channels=%zu samples/channel=%zu bytes/payload=%.0f rounds=%d\n", payloads,
+                kChannelCount, per_channel, static_cast<double>(bytes) / static_cast<double>(payloads), rounds);
+    std::printf("decode only:   %10.2f ns/sample  %12.0f samples/s\n", best_decode * 1e6 / samples,
+                samples / best_decode * 1e3);
+    std::printf("decode+store:  %10.2f ns/sample  %12.0f samples/s\n", best_total * 1e6 / samples,
+                samples / best_total * 1e3);
+    const auto* w = windows.Last(store.Find("vib-1", "ax"));
+    if (w != nullptr) std::printf("last ax window: count=%u rms=%.4f\n", w->count, w->rms);
+
+    for (std::size_t n = 256; n <= 4096; n <<= 1) {
+        iotgw::core::stream::RealFft fft(n);
+        std::vector<float> in(n);
+        std::vector<float> power(fft.Bins());
+        for (std::size_t i = 0; i < n; ++i) in[i] = static_cast<float>(std::sin(0.37 * static_cast<double>(i)));
+        const int reps = static_cast<int>(4000000 / n);
+        const auto f0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; ++i) fft.Power(in.data(), power.data());
+        const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - f0).count();
+        std::printf("real fft n=%-5zu %10.2f us/frame\n", n, us / reps);
+    }
+    if (failures != 0) std::printf("DECODE FAILURES: %zu\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+// WebSocket fan-out under load: starts the gateway's MongooseServer on loopback, opens
+// thousands of local WS clients against it in the same event loop, then broadcasts
+// frames and times how long each takes to reach every client. Memory per connection is
+// the RSS growth while the clients connect, divided by their number; it covers both ends
+// of each connection, the server's share being the smaller part.
+//
+//   cmake -S . -B build -DIOTGW_BUILD_BENCH=ON && cmake --build build --target iotgw_ws_bench
+//   ./build/iotgw_ws_bench [clients] [rounds] [payload_bytes] [port]
+//
+// Each client needs two descriptors; the open-file limit is raised to its hard limit.
+// Past ~500 clients mongoose must use epoll (MG_ENABLE_EPOLL, set by the build on Linux).
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "services/web_services/websocket/websocket_server.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadState {
+    std::size_t opened = 0;
+    std::size_t failed = 0;  // closed before the handshake completed
+    std::size_t lost = 0;    // closed after it
+    std::size_t received = 0;
+    Clock::time_point sent_at;
+    std::vector<double> latencies_us;  // of the current round
+};
+
+void ClientHandler(struct mg_connection* c, int ev, void* ev_data) {
+    auto* st = static_cast<LoadState*>(c->fn_data);
+    if (ev == MG_EV_WS_OPEN) {
+        ++st->opened;
+    } else if (ev == MG_EV_WS_MSG) {
+        ++st->received;
+        st->latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - st->sent_at).count());
+    } else if (ev == MG_EV_CLOSE) {
+        ++(c->is_websocket ? st->lost : st->failed);
+    }
+    (void)ev_data;
+}
+
+long RssKb() {
+    FILE* f = std::fopen("/proc/self/status", "r");
+    if (f == nullptr) return 0;
+    char line[256];
+    long kb = 0;
+    while (std::fgets(line, sizeof(line), f) != nullptr) {
+        if (std::strncmp(line, "VmRSS:", 6) == 0) {
+            kb = std::strtol(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    std::fclose(f);
+    return kb;
+}
+
+void RaiseFdLimit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+    rl.rlim_cur = rl.rlim_max;
+    (void)setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+double Percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0.0;
+    const std::size_t i = std::min(v.size() - 1, static_cast<std::size_t>(p * static_cast<double>(v.size())));
+    std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(i), v.end());
+    return v[i];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t clients = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 2000;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+    const std::size_t payload_bytes = argc > 3 ? static_cast<std::size_t>(std::strtoull(argv[3], nullptr, 10)) : 200;
+    const int port = argc > 4 ? std::atoi(argv[4]) : 18088;
+    RaiseFdLimit();
+
+    iotgw::services::web_services::websocket::MongooseServer::Options opt;
+    opt.listen_addr = "http://127.0.0.1:" + std::to_string(port);
+    opt.send_queue.max_frames = static_cast<std::size_t>(rounds) + 1;  // nothing dropped: every frame is timed
+    iotgw::services::web_services::websocket::MongooseServer server(opt, nullptr);
+    if (!server.Start()) {
+        std::fprintf(stderr, "cannot listen on %s\n", opt.listen_addr.c_str());
+        return 1;
+    }
+
+    LoadState st;
+    const std::string url = "ws://127.0.0.1:" + std::to_string(port) + "/ws";
+    const long rss0 = RssKb();
+    const auto c0 = Clock::now();
+    const std::size_t batch = 256;  // stay within the listen backlog
+    for (std::size_t started = 0; started < clients;) {
+        const std::size_t n = std::min(batch, clients - started);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (mg_ws_connect(server.GetMgr(), url.c_str(), ClientHandler, &st, nullptr) == nullptr) break;
+        }
+        started += n;
+        const auto deadline = Clock::now() + std::chrono::seconds(10);
+        while (st.opened + st.failed < started && Clock::now() < deadline) server.Poll(1);
+    }
+    const double connect_ms = std::chrono::duration<double, std::milli>(Clock::now() - c0).count();
+    // Let the server side finish its handshakes and settle.
+    for (int i = 0; i < 20; ++i) server.Poll(1);
+    const long rss1 = RssKb();
+    const std::size_t open = st.opened - st.lost;
+    std::printf("clients=%zu open=%zu failed=%zu server_side=%zu connect=%.0f ms\n", clients, open, st.failed,
+                server.Subscriptions().Clients(), connect_ms);
+    if (open == 0) return 1;
+    std::printf("memory: %.0f bytes per connection (both ends, rss %ld -> %ld kB)\n",
+                static_cast<double>(rss1 - rss0) * 1024.0 / static_cast<double>(open), rss0, rss1);
+
+    std::string text = "{\"type\":\"bench\",\"pad\":\"";
+    text.append(payload_bytes, 'x');
+    text += "\"}";
+    std::vector<double> all;
+    std::vector<double> fanout_ms;
+    for (int r = 0; r < rounds; ++r) {
+        st.received = 0;
+        st.latencies_us.clear();
+        st.sent_at = Clock::now();
+        server.BroadcastText(text);
+        const double encode_us = std::chrono::duration<double, std::micro>(Clock::now() - st.sent_at).count();
+        const auto deadline = Clock::now() + std::chrono::seconds(10);
+        while (st.received < open && Clock::now() < deadline) server.Poll(0);
+        fanout_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - st.sent_at).count());
+        if (r == 0) std::printf("broadcast call: %.0f us for %zu clients\n", encode_us, open);
+        if (st.received < open) std::printf("round %d: only %zu of %zu clients received\n", r, st.received, open);
+        all.insert(all.end(), st.latencies_us.begin(), st.latencies_us.end());
+    }
+
+    const auto& q = server.SendQueues().GetStats();
+    std::printf("rounds=%d payload=%zu B frames_encoded=%llu enqueued=%llu dropped=%llu\n", rounds, text.size(),
+                static_cast<unsigned long long>(q.frames), static_cast<unsigned long long>(q.enqueued),
+                static_cast<unsigned long long>(q.dropped));
+    std::printf("per-client latency: p50=%.0f us p99=%.0f us max=%.0f us\n", Percentile(all, 0.50),
+                Percentile(all, 0.99), Percentile(all, 1.0));
+    std::printf("fan-out to all clients: p50=%.2f ms max=%.2f ms\n", Percentile(fanout_ms, 0.50),
+                Percentile(fanout_ms, 1.0));
+    return 0;
+}
@@ -2,6 +2,7 @@
 
 #include <cctype>
 #include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -71,6 +72,22 @@ public:
         return default_value;
     }
 
+    bool GetDouble(const std::string& key, double& out) const {
+        std::string s;
+        if (!GetString(key, s) || s.empty()) return false;
+        char* end = nullptr;
+        const double v = std::strtod(s.c_str(), &end);
+        if (end != s.c_str() + s.size()) return false;
+        out = v;
+        return true;
+    }
+
+    double GetDoubleOr(const std::string& key, double default_value) const {
+        double out = 0.0;
+        if (GetDouble(key, out)) return out;
+        return default_value;
+    }
+
     bool GetBool(const std::string& key, bool& out) const {
         std::string s;
         if (!GetString(key, s)) return false;
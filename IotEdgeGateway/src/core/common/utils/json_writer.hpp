@@ -0,0 +1,358 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace iotgw {
+namespace core {
+namespace common {
+namespace json {
+
+// Streaming JSON writer appending into one buffer. Commas are inserted
+// automatically; Key() must precede every value inside an object.
+//
+//   Writer w;
+//   w.BeginObject().Key("id").String(id).Key("online").Bool(true).EndObject();
+//
+// Clear() keeps the allocation, so a long-lived writer serializes without
+// reallocating once it has grown to the largest document.
+class Writer {
+public:
+    Writer() = default;
+    explicit Writer(std::size_t reserve) { buf_.reserve(reserve); }
+
+    // Buffers above this are released on Clear() so one huge reply does not pin memory.
+    static constexpr std::size_t kKeepCapacity = 1 << 20;
+
+    void Clear() {
+        if (buf_.capacity() > kKeepCapacity) std::string().swap(buf_);
+        buf_.clear();
+        need_comma_ = false;
+    }
+    void Reserve(std::size_t n) { buf_.reserve(n); }
+
+    const std::string& str() const { return buf_; }
+    const char* c_str() const { return buf_.c_str(); }
+    std::size_t size() const { return buf_.size(); }
+    std::string Take() {
+        std::string out;
+        out.swap(buf_);
+        need_comma_ = false;
+        return out;
+    }
+
+    Writer& BeginObject() {
+        Separate();
+        buf_.push_back('{');
+        need_comma_ = false;
+        return *this;
+    }
+    Writer& EndObject() {
+        buf_.push_back('}');
+        need_comma_ = true;
+        return *this;
+    }
+    Writer& BeginArray() {
+        Separate();
+        buf_.push_back('[');
+        need_comma_ = false;
+        return *this;
+    }
+    Writer& EndArray() {
+        buf_.push_back(']');
+        need_comma_ = true;
+        return *this;
+    }
+
+    Writer& Key(const char* k) { return Key(k, std::strlen(k)); }
+    Writer& Key(const std::string& k) { return Key(k.data(), k.size()); }
+    Writer& Key(const char* k, std::size_t n) {
+        Separate();
+        AppendQuoted(k, n);
+        buf_.push_back(':');
+        need_comma_ = false;
+        return *this;
+    }
+
+    Writer& String(const char* s) { return String(s, std::strlen(s)); }
+    Writer& String(const std::string& s) { return String(s.data(), s.size()); }
+    Writer& String(const char* s, std::size_t n) {
+        Separate();
+        AppendQuoted(s, n);
+        need_comma_ = true;
+        return *this;
+    }
+
+    // Binary data as a string of lowercase hex digits, e.g. a CBOR payload.
+    Writer& Hex(const char* p, std::size_t n) {
+        static const char kDigits[] = "0123456789abcdef";
+        Separate();
+        const std::size_t base = buf_.size();
+        buf_.resize(base + n * 2 + 2);
+        char* dst = &buf_[base];
+        *dst++ = '\"';
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto c = static_cast<unsigned char>(p[i]);
+            *dst++ = kDigits[c >> 4];
+            *dst++ = kDigits[c & 0x0f];
+        }
+        *dst = '\"';
+        need_comma_ = true;
+        return *this;
+    }
+    Writer& Hex(const std::string& s) { return Hex(s.data(), s.size()); }
+
+    Writer& Bool(bool v) {
+        Separate();
+        if (v) {
+            buf_.append("true", 4);
+        } else {
+            buf_.append("false", 5);
+        }
+        need_comma_ = true;
+        return *this;
+    }
+
+    Writer& Null() {
+        Separate();
+        buf_.append("null", 4);
+        need_comma_ = true;
+        return *this;
+    }
+
+    Writer& Int(std::int64_t v) {
+        Separate();
+        AppendInt(v);
+        need_comma_ = true;
+        return *this;
+    }
+
+    Writer& Uint(std::uint64_t v) {
+        Separate();
+        AppendUint(v);
+        need_comma_ = true;
+        return *this;
+    }
+
+    // Up to 6 decimals with trailing zeros trimmed (23.5, not 23.500000). NaN and
+    // infinities have no JSON form and are written as null.
+    Writer& Double(double v) {
+        Separate();
+        AppendDouble(v);
+        need_comma_ = true;
+        return *this;
+    }
+
+    // Pre-serialized JSON value, e.g. a device payload that is already JSON.
+    Writer& Raw(const std::string& json) { return Raw(json.data(), json.size()); }
+    Writer& Raw(const char* json, std::size_t n) {
+        Separate();
+        if (n == 0) {
+            buf_.append("null", 4);
+        } else {
+            buf_.append(json, n);
+        }
+        need_comma_ = true;
+        return *this;
+    }
+
+    // Escapes `s` into `out` without the surrounding quotes.
+    static void AppendEscaped(std::string& out, const char* s, std::size_t n) {
+        const std::size_t run = CleanRun(s, n);
+        out.append(s, run);
+        if (run == n) return;
+
+        // Worst case is \u00XX for every byte; write through a pointer and trim afterwards.
+        const std::size_t base = out.size();
+        out.resize(base + (n - run) * 6);
+        char* dst = &out[base];
+        std::size_t i = run;
+        while (i < n) {
+            dst = WriteEscapedChar(dst, static_cast<unsigned char>(s[i]));
+            ++i;
+            const std::size_t clean = CleanRun(s + i, n - i);
+            std::memcpy(dst, s + i, clean);
+            dst += clean;
+            i += clean;
+        }
+        out.resize(static_cast<std::size_t>(dst - out.data()));
+    }
+
+private:
+    void Separate() {
+        if (need_comma_) buf_.push_back(',');
+    }
+
+    void AppendQuoted(const char* s, std::size_t n) {
+        buf_.push_back('\"');
+        AppendEscaped(buf_, s, n);
+        buf_.push_back('\"');
+    }
+
+    static bool NeedsEscape(unsigned char c) { return c < 0x20 || c == '\"' || c == '\\'; }
+
+    // Length of the prefix that can be copied verbatim.
+    static std::size_t CleanRun(const char* s, std::size_t n) {
+        std::size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i quote = _mm_set1_epi8('\"');
+        const __m128i bslash = _mm_set1_epi8('\\');
+        const __m128i ctrl_max = _mm_set1_epi8(0x1f);
+        for (; i + 16 <= n; i += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            // Unsigned v <= 0x1f  <=>  max(v, 0x1f) == 0x1f.
+            const __m128i ctrl = _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl_max), ctrl_max);
+            const __m128i hit = _mm_or_si128(ctrl, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)));
+            const int mask = _mm_movemask_epi8(hit);
+            if (mask != 0) return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        const uint8x16_t quote = vdupq_n_u8('\"');
+        const uint8x16_t bslash = vdupq_n_u8('\\');
+        const uint8x16_t ctrl_end = vdupq_n_u8(0x20);
+        for (; i + 16 <= n; i += 16) {
+            const uint8x16_t v = vld1q_u8(reinterpret_cast<const std::uint8_t*>(s + i));
+            const uint8x16_t hit = vorrq_u8(vcltq_u8(v, ctrl_end), vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash)));
+            if (vmaxvq_u8(hit) == 0) continue;
+            // Narrow to 4 bits per byte so the first hit is a count of trailing zeros.
+            const std::uint64_t mask =
+                vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+            return i + static_cast<std::size_t>(__builtin_ctzll(mask) >> 2);
+        }
+#endif
+        for (; i < n; ++i) {
+            if (NeedsEscape(static_cast<unsigned char>(s[i]))) return i;
+        }
+        return n;
+    }
+
+    static char* WriteEscapedChar(char* dst, unsigned char c) {
+        char esc = 0;
+        switch (c) {
+            case '\"':
+                esc = '\"';
+                break;
+            case '\\':
+                esc = '\\';
+                break;
+            case '\b':
+                esc = 'b';
+                break;
+            case '\f':
+                esc = 'f';
+                break;
+            case '\n':
+                esc = 'n';
+                break;
+            case '\r':
+                esc = 'r';
+                break;
+            case '\t':
+                esc = 't';
+                break;
+            default: {
+                static const char hex[] = "0123456789abcdef";
+                dst[0] = '\\';
+                dst[1] = 'u';
+                dst[2] = '0';
+                dst[3] = '0';
+                dst[4] = hex[(c >> 4) & 0x0f];
+                dst[5] = hex[c & 0x0f];
+                return dst + 6;
+            }
+        }
+        dst[0] = '\\';
+        dst[1] = esc;
+        return dst + 2;
+    }
+
+    // Writes the decimal digits of v ending at `end`, returns the first digit.
+    static char* FormatUint(std::uint64_t v, char* end) {
+        static const char kPairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        char* p = end;
+        while (v >= 100) {
+            const std::size_t k = static_cast<std::size_t>(v % 100) * 2;
+            v /= 100;
+            *--p = kPairs[k + 1];
+            *--p = kPairs[k];
+        }
+        if (v >= 10) {
+            const std::size_t k = static_cast<std::size_t>(v) * 2;
+            *--p = kPairs[k + 1];
+            *--p = kPairs[k];
+        } else {
+            *--p = static_cast<char>('0' + v);
+        }
+        return p;
+    }
+
+    void AppendUint(std::uint64_t v) {
+        char tmp[20];
+        char* end = tmp + sizeof(tmp);
+        const char* p = FormatUint(v, end);
+        buf_.append(p, static_cast<std::size_t>(end - p));
+    }
+
+    void AppendInt(std::int64_t v) {
+        if (v < 0) {
+            buf_.push_back('-');
+            AppendUint(static_cast<std::uint64_t>(0) - static_cast<std::uint64_t>(v));
+        } else {
+            AppendUint(static_cast<std::uint64_t>(v));
+        }
+    }
+
+    void AppendDouble(double v) {
+        if (!std::isfinite(v)) {
+            buf_.append("null", 4);
+            return;
+        }
+        // Fixed point in micro-units while it fits an int64 exactly; the rest is rare.
+        const double scaled = std::round(v * 1e6);
+        if (std::fabs(scaled) >= 9.0e15) {
+            char tmp[32];
+            const int n = std::snprintf(tmp, sizeof(tmp), "%.17g", v);
+            if (n > 0) buf_.append(tmp, static_cast<std::size_t>(n));
+            return;
+        }
+        std::int64_t micros = static_cast<std::int64_t>(scaled);
+        if (micros < 0) {
+            buf_.push_back('-');
+            micros = -micros;
+        }
+        AppendUint(static_cast<std::uint64_t>(micros / 1000000));
+        std::int64_t frac = micros % 1000000;
+        if (frac == 0) return;
+        char digits[6];
+        for (int k = 5; k >= 0; --k) {
+            digits[k] = static_cast<char>('0' + frac % 10);
+            frac /= 10;
+        }
+        std::size_t len = 6;
+        while (digits[len - 1] == '0') --len;
+        buf_.push_back('.');
+        buf_.append(digits, len);
+    }
+
+private:
+    std::string buf_;
+    bool need_comma_ = false;
+};
+
+}  // namespace json
+}  // namespace common
+}  // namespace core
+}  // namespace iotgw
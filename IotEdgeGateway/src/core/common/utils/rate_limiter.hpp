@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace iotgw {
+namespace core {
+namespace common {
+namespace rate {
+
+// Token bucket driven by the caller's clock. A rate <= 0 means unlimited.
+class TokenBucket {
+public:
+    TokenBucket() = default;
+    TokenBucket(double rate_per_sec, double burst) { Configure(rate_per_sec, burst); }
+
+    void Configure(double rate_per_sec, double burst) {
+        rate_ = rate_per_sec;
+        burst_ = burst > 0.0 ? burst : std::max(1.0, rate_per_sec);
+        tokens_ = burst_;
+        last_ms_ = 0;
+    }
+
+    bool Unlimited() const { return rate_ <= 0.0; }
+
+    bool Available(std::int64_t now_ms, double n = 1.0) {
+        if (Unlimited()) return true;
+        Refill(now_ms);
+        return tokens_ >= n;
+    }
+
+    bool TryTake(std::int64_t now_ms, double n = 1.0) {
+        if (Unlimited()) return true;
+        Refill(now_ms);
+        if (tokens_ < n) return false;
+        tokens_ -= n;
+        return true;
+    }
+
+private:
+    void Refill(std::int64_t now_ms) {
+        if (last_ms_ == 0 || now_ms < last_ms_) {
+            last_ms_ = now_ms;
+            return;
+        }
+        tokens_ = std::min(burst_, tokens_ + rate_ * static_cast<double>(now_ms - last_ms_) / 1000.0);
+        last_ms_ = now_ms;
+    }
+
+private:
+    double rate_ = 0.0;
+    double burst_ = 0.0;
+    double tokens_ = 0.0;
+    std::int64_t last_ms_ = 0;
+};
+
+}  // namespace rate
+}  // namespace common
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace common {
+namespace slot {
+
+// Values in a dense array addressed by stable handles. Insert, Erase and Get are O(1);
+// iteration touches live values only. A handle outlives its value safely: once the
+// value is erased its slot's generation moves on and Get returns nullptr. Erase moves
+// the last value into the hole, so pointers into the map do not survive it.
+template <typename T>
+class SlotMap {
+public:
+    struct Handle {
+        std::uint32_t index = 0;
+        std::uint32_t generation = 0;  // 0: never valid
+    };
+
+    Handle Insert(T value) {
+        std::uint32_t index = 0;
+        if (!free_.empty()) {
+            index = free_.back();
+            free_.pop_back();
+        } else {
+            index = static_cast<std::uint32_t>(slots_.size());
+            slots_.push_back(Slot());
+        }
+        Slot& s = slots_[index];
+        s.dense = static_cast<std::uint32_t>(values_.size());
+        values_.push_back(std::move(value));
+        owners_.push_back(index);
+        return Handle{index, s.generation};
+    }
+
+    bool Erase(Handle h) {
+        if (Get(h) == nullptr) return false;
+        Slot& s = slots_[h.index];
+        const std::uint32_t last = static_cast<std::uint32_t>(values_.size() - 1);
+        if (s.dense != last) {
+            values_[s.dense] = std::move(values_[last]);
+            owners_[s.dense] = owners_[last];
+            slots_[owners_[s.dense]].dense = s.dense;
+        }
+        values_.pop_back();
+        owners_.pop_back();
+        if (++s.generation == 0) s.generation = 1;
+        free_.push_back(h.index);
+        return true;
+    }
+
+    T* Get(Handle h) {
+        if (h.index >= slots_.size() || h.generation == 0 || slots_[h.index].generation != h.generation) return nullptr;
+        return &values_[slots_[h.index].dense];
+    }
+    const T* Get(Handle h) const { return const_cast<SlotMap*>(this)->Get(h); }
+
+    std::size_t Size() const { return values_.size(); }
+    bool Empty() const { return values_.empty(); }
+
+    typename std::vector<T>::iterator begin() { return values_.begin(); }
+    typename std::vector<T>::iterator end() { return values_.end(); }
+    typename std::vector<T>::const_iterator begin() const { return values_.begin(); }
+    typename std::vector<T>::const_iterator end() const { return values_.end(); }
+
+private:
+    struct Slot {
+        std::uint32_t dense = 0;
+        std::uint32_t generation = 1;
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<T> values_;
+    std::vector<std::uint32_t> owners_;  // slot of each value
+    std::vector<std::uint32_t> free_;
+};
+
+}  // namespace slot
+}  // namespace common
+}  // namespace core
+}  // namespace iotgw
@@ -35,6 +35,13 @@ inline std::string NowIso8601Utc() {
     return oss.str();
 }
 
+// Identifies this run of the process. Counters that restart from zero with it (change
+// versions, event ids) are qualified by it, so a client can tell a restart from progress.
+inline std::uint64_t BootId() {
+    static const std::uint64_t id = static_cast<std::uint64_t>(NowUnixMs());
+    return id;
+}
+
 inline void SleepMs(std::uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
 
 }  // namespace time
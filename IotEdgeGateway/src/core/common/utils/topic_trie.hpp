@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace common {
+namespace topic {
+
+// Levels bound by `+` or `{name}` in a matched pattern. Refers into the matched topic string.
+class TopicCaptures {
+public:
+    static constexpr std::size_t kMaxCaptures = 16;
+
+    std::size_t Size() const { return count_; }
+
+    // Value of the `{name}` level, false if the pattern has no such capture.
+    bool Get(const std::string& name, std::string& out) const {
+        if (topic_ == nullptr || names_ == nullptr) return false;
+        for (std::size_t i = 0; i < count_ && i < names_->size(); ++i) {
+            if ((*names_)[i] != name) continue;
+            out.assign(*topic_, spans_[i].first, spans_[i].second);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    template <typename T>
+    friend class TopicTrie;
+
+    const std::string* topic_ = nullptr;
+    const std::vector<std::string>* names_ = nullptr;
+    std::pair<std::size_t, std::size_t> spans_[kMaxCaptures];
+    std::size_t count_ = 0;
+};
+
+// MQTT topic tree. Patterns use `+` (one level), `#` (remaining levels, last only)
+// and `{name}` (one level, captured by name). A lookup walks one path per
+// pattern shape, so its cost follows the topic depth, not the number of patterns.
+// Matches are reported most specific first: literal, then single-level, then `#`.
+template <typename T>
+class TopicTrie {
+public:
+    bool Insert(const std::string& pattern, T value) {
+        std::vector<std::string> names;
+        Node* n = &root_;
+        std::size_t pos = 0;
+        while (true) {
+            std::size_t end = pattern.find('/', pos);
+            if (end == std::string::npos) end = pattern.size();
+            const std::string level = pattern.substr(pos, end - pos);
+            LevelType type = LevelType::kLiteral;
+            std::string name;
+            if (!ParseLevel(level, type, name)) return false;
+            if (type == LevelType::kMulti) {
+                if (end != pattern.size()) return false;
+                if (!n->multi) n->multi.reset(new Node());
+                n = n->multi.get();
+            } else if (type == LevelType::kSingle) {
+                if (names.size() >= TopicCaptures::kMaxCaptures) return false;
+                names.push_back(std::move(name));
+                if (!n->single) n->single.reset(new Node());
+                n = n->single.get();
+            } else {
+                n = n->Child(level, true);
+            }
+            if (end == pattern.size()) break;
+            pos = end + 1;
+        }
+        Entry e;
+        e.value = std::move(value);
+        e.names = std::move(names);
+        n->entries.push_back(std::move(e));
+        ++size_;
+        return true;
+    }
+
+    // Removes every entry of `pattern` whose value equals `value`. Returns the number removed.
+    std::size_t Erase(const std::string& pattern, const T& value) {
+        const std::size_t removed = EraseAt(root_, pattern, 0, value);
+        size_ -= removed;
+        return removed;
+    }
+
+    void Clear() {
+        root_ = Node();
+        size_ = 0;
+    }
+
+    std::size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    // Calls fn(value, captures) for every pattern matching `topic`.
+    template <typename Fn>
+    void ForEachMatch(const std::string& topic, Fn fn) const {
+        if (topic.empty() || size_ == 0) return;
+        TopicCaptures caps;
+        caps.topic_ = &topic;
+        (void)Walk(root_, topic, 0, caps, [&](const Entry& e, const TopicCaptures& c) {
+            fn(e.value, c);
+            return true;
+        });
+    }
+
+    // Most specific match only.
+    bool MatchBest(const std::string& topic, T& out, TopicCaptures* out_caps = nullptr) const {
+        if (topic.empty() || size_ == 0) return false;
+        TopicCaptures caps;
+        caps.topic_ = &topic;
+        bool found = false;
+        (void)Walk(root_, topic, 0, caps, [&](const Entry& e, const TopicCaptures& c) {
+            out = e.value;
+            if (out_caps != nullptr) *out_caps = c;
+            found = true;
+            return false;
+        });
+        return found;
+    }
+
+    bool Matches(const std::string& topic) const {
+        T unused{};
+        return MatchBest(topic, unused);
+    }
+
+private:
+    enum class LevelType { kLiteral, kSingle, kMulti };
+
+    struct Entry {
+        T value{};
+        std::vector<std::string> names;
+    };
+
+    struct Node {
+        std::vector<std::pair<std::string, std::unique_ptr<Node>>> literal;  // sorted by level
+        std::unique_ptr<Node> single;
+        std::unique_ptr<Node> multi;
+        std::vector<Entry> entries;
+
+        Node* Child(const std::string& level, bool create) {
+            auto it = std::lower_bound(literal.begin(), literal.end(), level,
+                                       [](const std::pair<std::string, std::unique_ptr<Node>>& kv,
+                                          const std::string& key) { return kv.first < key; });
+            if (it != literal.end() && it->first == level) return it->second.get();
+            if (!create) return nullptr;
+            it = literal.emplace(it, level, std::unique_ptr<Node>(new Node()));
+            return it->second.get();
+        }
+
+        // Lookup by topic[pos, pos + len) without building a key string.
+        const Node* Find(const std::string& topic, std::size_t pos, std::size_t len) const {
+            std::size_t lo = 0;
+            std::size_t hi = literal.size();
+            while (lo < hi) {
+                const std::size_t mid = lo + (hi - lo) / 2;
+                const int cmp = literal[mid].first.compare(0, std::string::npos, topic, pos, len);
+                if (cmp == 0) return literal[mid].second.get();
+                if (cmp < 0) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return nullptr;
+        }
+
+        bool Unused() const { return entries.empty() && literal.empty() && !single && !multi; }
+    };
+
+    static bool ParseLevel(const std::string& level, LevelType& type, std::string& name) {
+        type = LevelType::kLiteral;
+        if (level == "#") {
+            type = LevelType::kMulti;
+            return true;
+        }
+        if (level == "+") {
+            type = LevelType::kSingle;
+            return true;
+        }
+        if (level.size() >= 2 && level.front() == '{' && level.back() == '}') {
+            type = LevelType::kSingle;
+            name = level.substr(1, level.size() - 2);
+            return !name.empty();
+        }
+        return level.find_first_of("+#") == std::string::npos;
+    }
+
+    // Visits matches depth first; the visitor returns false to stop.
+    template <typename Visit>
+    static bool Walk(const Node& n, const std::string& topic, std::size_t pos, TopicCaptures& caps, Visit&& visit) {
+        // Wildcards at the first level never match `$SYS`-style topics.
+        const bool wild_ok = !(pos == 0 && topic[0] == '$');
+        if (pos == std::string::npos) {
+            if (!EmitAll(n, caps, visit)) return false;
+            // "a/#" also matches "a".
+            return !n.multi || EmitAll(*n.multi, caps, visit);
+        }
+
+        std::size_t end = topic.find('/', pos);
+        const std::size_t next = (end == std::string::npos) ? std::string::npos : end + 1;
+        if (end == std::string::npos) end = topic.size();
+
+        if (const Node* child = n.Find(topic, pos, end - pos)) {
+            if (!Walk(*child, topic, next, caps, visit)) return false;
+        }
+        if (n.single && wild_ok && caps.count_ < TopicCaptures::kMaxCaptures) {
+            caps.spans_[caps.count_++] = std::make_pair(pos, end - pos);
+            const bool go_on = Walk(*n.single, topic, next, caps, visit);
+            --caps.count_;
+            if (!go_on) return false;
+        }
+        if (n.multi && wild_ok) return EmitAll(*n.multi, caps, visit);
+        return true;
+    }
+
+    template <typename Visit>
+    static bool EmitAll(const Node& n, TopicCaptures& caps, Visit&& visit) {
+        for (const auto& e : n.entries) {
+            caps.names_ = &e.names;
+            if (!visit(e, static_cast<const TopicCaptures&>(caps))) return false;
+        }
+        return true;
+    }
+
+    static std::size_t EraseAt(Node& n, const std::string& pattern, std::size_t pos, const T& value) {
+        if (pos == std::string::npos) {
+            const std::size_t before = n.entries.size();
+            n.entries.erase(std::remove_if(n.entries.begin(), n.entries.end(),
+                                           [&](const Entry& e) { return e.value == value; }),
+                            n.entries.end());
+            return before - n.entries.size();
+        }
+
+        std::size_t end = pattern.find('/', pos);
+        const std::size_t next = (end == std::string::npos) ? std::string::npos : end + 1;
+        if (end == std::string::npos) end = pattern.size();
+        const std::string level = pattern.substr(pos, end - pos);
+        LevelType type = LevelType::kLiteral;
+        std::string name;
+        if (!ParseLevel(level, type, name)) return 0;
+
+        std::unique_ptr<Node>* slot = nullptr;
+        if (type == LevelType::kMulti) {
+            slot = &n.multi;
+        } else if (type == LevelType::kSingle) {
+            slot = &n.single;
+        }
+        if (slot != nullptr) {
+            if (!*slot) return 0;
+            const std::size_t removed = EraseAt(**slot, pattern, next, value);
+            if ((*slot)->Unused()) slot->reset();
+            return removed;
+        }
+
+        Node* child = n.Child(level, false);
+        if (child == nullptr) return 0;
+        const std::size_t removed = EraseAt(*child, pattern, next, value);
+        if (child->Unused()) {
+            n.literal.erase(std::remove_if(n.literal.begin(), n.literal.end(),
+                                           [&](const std::pair<std::string, std::unique_ptr<Node>>& kv) {
+                                               return kv.second.get() == child;
+                                           }),
+                            n.literal.end());
+        }
+        return removed;
+    }
+
+private:
+    Node root_;
+    std::size_t size_ = 0;
+};
+
+// Single filter test, e.g. for one-off checks outside a trie.
+inline bool Matches(const std::string& filter, const std::string& topic) {
+    if (filter.empty() || topic.empty()) return false;
+    if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) return false;
+
+    const std::size_t fn = filter.size();
+    const std::size_t tn = topic.size();
+    std::size_t f = 0;
+    std::size_t t = 0;
+    while (true) {
+        std::size_t fe = filter.find('/', f);
+        if (fe == std::string::npos) fe = fn;
+        if (fe - f == 1 && filter[f] == '#') return true;
+        if (t > tn) return false;
+
+        std::size_t te = topic.find('/', t);
+        if (te == std::string::npos) te = tn;
+        const bool single = (fe - f == 1 && filter[f] == '+') ||
+                            (fe - f >= 3 && filter[f] == '{' && filter[fe - 1] == '}');
+        if (!single && (fe - f != te - t || filter.compare(f, fe - f, topic, t, te - t) != 0)) return false;
+
+        if (fe == fn) return te == tn;
+        f = fe + 1;
+        t = (te == tn) ? tn + 1 : te + 1;
+    }
+}
+
+}  // namespace topic
+}  // namespace common
+}  // namespace core
+}  // namespace iotgw
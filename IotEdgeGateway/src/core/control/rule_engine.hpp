@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <utility>
@@ -14,6 +15,7 @@ namespace rule_engine {
 
 struct Condition {
     std::string sensor_id;
+    std::string event;  // empty: the sensor's value; otherwise an event it raises, e.g. "anomaly"
     std::string op;
     double value = 0.0;
 };
@@ -36,12 +38,18 @@ struct Rule {
 
 class RuleEngine {
 public:
-    void Clear() { rules_.clear(); }
+    void Clear() {
+        rules_.clear();
+        ++revision_;
+    }
     const std::vector<Rule>& Rules() const { return rules_; }
+    // Moves on with every change to Rules().
+    std::uint64_t Revision() const { return revision_; }
 
     bool SetEnabled(const std::string& rule_id, bool enabled) {
         for (auto& r : rules_) {
             if (r.id == rule_id) {
+                if (r.enabled != enabled) ++revision_;
                 r.enabled = enabled;
                 return true;
             }
@@ -55,13 +63,21 @@ public:
 
     void AddRules(std::vector<Rule> rules) {
         for (auto& r : rules) rules_.push_back(std::move(r));
+        ++revision_;
     }
 
     void OnSensorValue(const std::string& sensor_id, double value,
                        const std::function<void(const Rule& rule, const Action& action)>& exec) {
+        OnSensorEvent(sensor_id, std::string(), value, exec);
+    }
+
+    // An event raised for a sensor (e.g. "anomaly", with its score as the value); only
+    // rules whose `when.event` names it are evaluated.
+    void OnSensorEvent(const std::string& sensor_id, const std::string& event, double value,
+                       const std::function<void(const Rule& rule, const Action& action)>& exec) {
         for (const auto& r : rules_) {
             if (!r.enabled) continue;
-            if (r.when.sensor_id != sensor_id) continue;
+            if (r.when.sensor_id != sensor_id || r.when.event != event) continue;
             if (!Eval(r.when, value)) continue;
             for (const auto& a : r.then) exec(r, a);
         }
@@ -72,6 +88,7 @@ private:
 
 private:
     std::vector<Rule> rules_;
+    std::uint64_t revision_ = 0;
 };
 
 inline bool RuleEngine::Eval(const Condition& c, double v) {
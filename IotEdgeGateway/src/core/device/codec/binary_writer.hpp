@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+// Writers for the binary payload formats, appending to `out`. Containers take their
+// element count up front; a map is followed by alternating keys (Str) and values.
+
+// Exact in an int64 and in a double, so it can be written as an integer.
+inline bool IsIntegral(double v) { return std::floor(v) == v && std::fabs(v) < 9.0e15; }
+
+inline bool FitsFloat(double v) { return static_cast<double>(static_cast<float>(v)) == v; }
+
+inline void AppendBe(std::string& out, std::uint64_t v, std::size_t n) {
+    for (std::size_t i = n; i > 0; --i) out.push_back(static_cast<char>((v >> ((i - 1) * 8)) & 0xff));
+}
+
+inline std::uint32_t FloatBits(double v) {
+    const float f = static_cast<float>(v);
+    std::uint32_t bits = 0;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+inline std::uint64_t DoubleBits(double v) {
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+// RFC 8949, preferred (shortest) serialization.
+class CborWriter {
+public:
+    explicit CborWriter(std::string& out) : out_(out) {}
+
+    void Map(std::size_t n) { Head(5, n); }
+    void Array(std::size_t n) { Head(4, n); }
+    void Str(const char* s, std::size_t n) {
+        Head(3, n);
+        out_.append(s, n);
+    }
+    void Bool(bool v) { out_.push_back(static_cast<char>(v ? 0xf5 : 0xf4)); }
+    void Int(std::int64_t v) {
+        if (v >= 0) {
+            Head(0, static_cast<std::uint64_t>(v));
+        } else {
+            Head(1, static_cast<std::uint64_t>(-(v + 1)));
+        }
+    }
+    void Real(double v) {
+        if (FitsFloat(v)) {
+            out_.push_back(static_cast<char>(0xfa));
+            AppendBe(out_, FloatBits(v), 4);
+        } else {
+            out_.push_back(static_cast<char>(0xfb));
+            AppendBe(out_, DoubleBits(v), 8);
+        }
+    }
+
+private:
+    void Head(std::uint8_t major, std::uint64_t arg) {
+        const auto ib = static_cast<std::uint8_t>(major << 5);
+        if (arg < 24) {
+            out_.push_back(static_cast<char>(ib | arg));
+        } else if (arg <= 0xff) {
+            out_.push_back(static_cast<char>(ib | 24));
+            AppendBe(out_, arg, 1);
+        } else if (arg <= 0xffff) {
+            out_.push_back(static_cast<char>(ib | 25));
+            AppendBe(out_, arg, 2);
+        } else if (arg <= 0xffffffffULL) {
+            out_.push_back(static_cast<char>(ib | 26));
+            AppendBe(out_, arg, 4);
+        } else {
+            out_.push_back(static_cast<char>(ib | 27));
+            AppendBe(out_, arg, 8);
+        }
+    }
+
+private:
+    std::string& out_;
+};
+
+class MsgpackWriter {
+public:
+    explicit MsgpackWriter(std::string& out) : out_(out) {}
+
+    void Map(std::size_t n) {
+        if (n < 16) {
+            out_.push_back(static_cast<char>(0x80 | n));
+        } else if (n <= 0xffff) {
+            Tagged(0xde, n, 2);
+        } else {
+            Tagged(0xdf, n, 4);
+        }
+    }
+    void Array(std::size_t n) {
+        if (n < 16) {
+            out_.push_back(static_cast<char>(0x90 | n));
+        } else if (n <= 0xffff) {
+            Tagged(0xdc, n, 2);
+        } else {
+            Tagged(0xdd, n, 4);
+        }
+    }
+    void Str(const char* s, std::size_t n) {
+        if (n < 32) {
+            out_.push_back(static_cast<char>(0xa0 | n));
+        } else if (n <= 0xff) {
+            Tagged(0xd9, n, 1);
+        } else if (n <= 0xffff) {
+            Tagged(0xda, n, 2);
+        } else {
+            Tagged(0xdb, n, 4);
+        }
+        out_.append(s, n);
+    }
+    void Bool(bool v) { out_.push_back(static_cast<char>(v ? 0xc3 : 0xc2)); }
+    void Int(std::int64_t v) {
+        if (v >= 0) {
+            const auto u = static_cast<std::uint64_t>(v);
+            if (u < 0x80) {
+                out_.push_back(static_cast<char>(u));
+            } else if (u <= 0xff) {
+                Tagged(0xcc, u, 1);
+            } else if (u <= 0xffff) {
+                Tagged(0xcd, u, 2);
+            } else if (u <= 0xffffffffULL) {
+                Tagged(0xce, u, 4);
+            } else {
+                Tagged(0xcf, u, 8);
+            }
+            return;
+        }
+        const auto bits = static_cast<std::uint64_t>(v);
+        if (v >= -32) {
+            out_.push_back(static_cast<char>(bits & 0xff));
+        } else if (v >= -128) {
+            Tagged(0xd0, bits, 1);
+        } else if (v >= -32768) {
+            Tagged(0xd1, bits, 2);
+        } else if (v >= INT32_MIN) {
+            Tagged(0xd2, bits, 4);
+        } else {
+            Tagged(0xd3, bits, 8);
+        }
+    }
+    void Real(double v) {
+        if (FitsFloat(v)) {
+            Tagged(0xca, FloatBits(v), 4);
+        } else {
+            Tagged(0xcb, DoubleBits(v), 8);
+        }
+    }
+
+private:
+    void Tagged(std::uint8_t tag, std::uint64_t v, std::size_t n) {
+        out_.push_back(static_cast<char>(tag));
+        AppendBe(out_, v, n);
+    }
+
+private:
+    std::string& out_;
+};
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
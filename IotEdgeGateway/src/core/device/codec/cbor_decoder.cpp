@@ -0,0 +1,301 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "core/device/codec/telemetry_builder.hpp"
+#include "core/device/codec/telemetry_decoder.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+namespace {
+
+constexpr int kMaxDepth = 32;
+constexpr std::uint8_t kBreak = 0xff;
+
+enum Major : std::uint8_t { kUint = 0, kNegInt = 1, kBytes = 2, kText = 3, kArray = 4, kMap = 5, kTag = 6, kSimple = 7 };
+
+// Initial byte of a data item (RFC 8949 3): major type, additional info and its argument.
+struct Head {
+    std::uint8_t major = 0;
+    std::uint8_t info = 0;
+    std::uint64_t arg = 0;
+
+    bool Indefinite() const { return info == 31; }
+};
+
+struct Reader {
+    const std::uint8_t* p;
+    const std::uint8_t* end;
+
+    std::size_t Left() const { return static_cast<std::size_t>(end - p); }
+
+    bool Skip(std::uint64_t n) {
+        if (n > Left()) return false;
+        p += n;
+        return true;
+    }
+
+    bool ReadHead(Head& h) {
+        if (p >= end) return false;
+        const std::uint8_t ib = *p++;
+        h.major = static_cast<std::uint8_t>(ib >> 5);
+        h.info = static_cast<std::uint8_t>(ib & 0x1f);
+        if (h.info < 24) {
+            h.arg = h.info;
+            return true;
+        }
+        if (h.info <= 27) {
+            const std::size_t n = static_cast<std::size_t>(1) << (h.info - 24);
+            if (n > Left()) return false;
+            h.arg = 0;
+            for (std::size_t i = 0; i < n; ++i) h.arg = (h.arg << 8) | p[i];
+            p += n;
+            return true;
+        }
+        // 28..30 are reserved; 31 is indefinite length (or "break" for major 7).
+        h.arg = 0;
+        return h.info == 31 && h.major != kUint && h.major != kNegInt && h.major != kTag;
+    }
+
+    // Head of the next item with any tags (e.g. 1 = epoch time) stripped.
+    bool ReadItemHead(Head& h) {
+        for (int i = 0; i < kMaxDepth; ++i) {
+            if (!ReadHead(h)) return false;
+            if (h.major != kTag) return true;
+        }
+        return false;
+    }
+
+    bool AtBreak() {
+        if (p < end && *p == kBreak) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+};
+
+static double HalfToDouble(std::uint16_t h) {
+    const int exp = (h >> 10) & 0x1f;
+    const int mant = h & 0x3ff;
+    double v = 0.0;
+    if (exp == 0) {
+        v = std::ldexp(mant, -24);
+    } else if (exp != 31) {
+        v = std::ldexp(mant + 1024, exp - 25);
+    } else {
+        v = mant == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    }
+    return (h & 0x8000) ? -v : v;
+}
+
+// Numeric value of an integer or float item.
+static bool NumberOf(const Head& h, double& out) {
+    switch (h.major) {
+        case kUint:
+            out = static_cast<double>(h.arg);
+            return true;
+        case kNegInt:
+            out = -1.0 - static_cast<double>(h.arg);
+            return true;
+        case kSimple:
+            if (h.info == 25) {
+                out = HalfToDouble(static_cast<std::uint16_t>(h.arg));
+                return true;
+            }
+            if (h.info == 26) {
+                const auto bits = static_cast<std::uint32_t>(h.arg);
+                float f = 0.0f;
+                std::memcpy(&f, &bits, sizeof(f));
+                out = f;
+                return true;
+            }
+            if (h.info == 27) {
+                std::memcpy(&out, &h.arg, sizeof(out));
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// Skips the rest of an item whose head has been read.
+static bool SkipBody(Reader& r, const Head& h, int depth) {
+    if (depth > kMaxDepth) return false;
+    switch (h.major) {
+        case kUint:
+        case kNegInt:
+            return true;
+        case kBytes:
+        case kText:
+            if (!h.Indefinite()) return r.Skip(h.arg);
+            while (!r.AtBreak()) {
+                Head chunk;
+                if (!r.ReadHead(chunk) || chunk.major != h.major || chunk.Indefinite() || !r.Skip(chunk.arg)) {
+                    return false;
+                }
+            }
+            return true;
+        case kArray:
+        case kMap: {
+            const int per = h.major == kMap ? 2 : 1;
+            if (h.Indefinite()) {
+                while (!r.AtBreak()) {
+                    for (int k = 0; k < per; ++k) {
+                        Head c;
+                        if (!r.ReadHead(c) || !SkipBody(r, c, depth + 1)) return false;
+                    }
+                }
+                return true;
+            }
+            // Every item takes at least one byte, so a count beyond the input is malformed.
+            if (h.arg > r.Left()) return false;
+            for (std::uint64_t i = 0; i < h.arg * per; ++i) {
+                Head c;
+                if (!r.ReadHead(c) || !SkipBody(r, c, depth + 1)) return false;
+            }
+            return true;
+        }
+        case kTag: {
+            Head c;
+            return r.ReadHead(c) && SkipBody(r, c, depth + 1);
+        }
+        default:
+            return !h.Indefinite();  // a stray "break"
+    }
+}
+
+using Scope = TelemetryBuilder::Scope;
+using ArrayMode = TelemetryBuilder::ArrayMode;
+
+struct CborParser {
+    Reader r;
+    TelemetryBuilder& b;
+
+    bool Malformed() { return b.Fail(Verdict::kMalformed); }
+
+    bool Member(Scope scope, const char* key, std::size_t key_len, const Head& h, int depth) {
+        double v = 0.0;
+        if (NumberOf(h, v)) return b.Number(scope, key, key_len, v);
+        if (h.major == kSimple && (h.info == 20 || h.info == 21)) return b.Bool(scope, key, key_len, h.info == 21);
+        if (h.major == kText && !h.Indefinite()) {
+            if (h.arg > r.Left()) return Malformed();
+            const char* s = reinterpret_cast<const char*>(r.p);
+            r.p += h.arg;
+            const std::size_t len = static_cast<std::size_t>(h.arg);
+            return scope == Scope::kTop ? b.TopString(key, key_len, s, len) : b.Other(scope, key, key_len, true);
+        }
+        if (h.major == kArray) return Array(scope, key, key_len, h, depth);
+        if (!b.Other(scope, key, key_len, h.major == kText)) return false;
+        return SkipBody(r, h, depth) || Malformed();
+    }
+
+    bool Array(Scope scope, const char* key, std::size_t key_len, const Head& h, int depth) {
+        const ArrayMode mode = b.BeginArray(scope, key, key_len);
+        if (mode == ArrayMode::kReject) return false;
+        if (mode == ArrayMode::kSkip) return SkipBody(r, h, depth) || Malformed();
+        if (!h.Indefinite() && h.arg > r.Left()) return Malformed();
+        bool collect = true;
+        for (std::uint64_t i = 0; h.Indefinite() || i < h.arg; ++i) {
+            if (h.Indefinite() && r.AtBreak()) break;
+            Head item;
+            if (!r.ReadItemHead(item)) return Malformed();
+            double v = 0.0;
+            if (collect && !NumberOf(item, v)) {
+                if (b.NonNumericSample() == ArrayMode::kReject) return false;
+                collect = false;
+            }
+            if (collect) {
+                if (!b.Sample(v)) return false;
+            } else if (!SkipBody(r, item, depth + 1)) {
+                return Malformed();
+            }
+        }
+        b.EndArray();
+        return true;
+    }
+
+    // Calls fn(key, key_len, value_head) for every text-keyed member; other members are skipped.
+    template <typename Fn>
+    bool Map(const Head& map, int depth, Fn fn) {
+        if (!map.Indefinite() && map.arg > r.Left()) return Malformed();
+        for (std::uint64_t i = 0; map.Indefinite() || i < map.arg; ++i) {
+            if (map.Indefinite() && r.AtBreak()) return true;
+            Head k;
+            if (!r.ReadItemHead(k)) return Malformed();
+            const char* key = nullptr;
+            std::size_t key_len = 0;
+            if (k.major == kText && !k.Indefinite()) {
+                if (k.arg > r.Left()) return Malformed();
+                key = reinterpret_cast<const char*>(r.p);
+                key_len = static_cast<std::size_t>(k.arg);
+                r.p += k.arg;
+            } else if (!SkipBody(r, k, depth + 1)) {
+                return Malformed();
+            }
+            Head v;
+            if (!r.ReadItemHead(v)) return Malformed();
+            if (key == nullptr) {
+                if (!SkipBody(r, v, depth + 1)) return Malformed();
+                continue;
+            }
+            if (!fn(key, key_len, v)) return false;
+        }
+        return true;
+    }
+
+    bool Run() {
+        Head top;
+        if (!r.ReadItemHead(top)) return Malformed();
+        if (top.major != kMap) {
+            double v = 0.0;
+            if (!NumberOf(top, v) || r.p != r.end) return Malformed();
+            return b.BareNumber(v);
+        }
+        const bool ok = Map(top, 0, [&](const char* key, std::size_t len, const Head& v) {
+            if (TelemetryBuilder::KeyIs(key, len, "data") && v.major == kMap) {
+                b.Envelope();
+                return Map(v, 1, [&](const char* k2, std::size_t l2, const Head& v2) {
+                    return Member(Scope::kData, k2, l2, v2, 2);
+                });
+            }
+            double ts = 0.0;
+            if (TelemetryBuilder::KeyIs(key, len, "ts") && NumberOf(v, ts)) {
+                b.Ts(ts);
+                return true;
+            }
+            return Member(Scope::kTop, key, len, v, 1);
+        });
+        if (!ok) return false;
+        if (r.p != r.end) return Malformed();
+        b.Finish();
+        return true;
+    }
+};
+
+}  // namespace
+
+bool DecodeCborTelemetry(const char* p, std::size_t n, const DecodePlan* plan, DecodedTelemetry& out) {
+    out.Reset();
+    if (p == nullptr || n == 0) {
+        out.verdict = Verdict::kMalformed;
+        return false;
+    }
+    TelemetryBuilder b(plan, out);
+    const auto* u = reinterpret_cast<const std::uint8_t*>(p);
+    CborParser parser{Reader{u, u + n}, b};
+    if (parser.Run()) return true;
+    out.fields.Clear();
+    if (out.samples != nullptr) out.samples->Clear();
+    return false;
+}
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
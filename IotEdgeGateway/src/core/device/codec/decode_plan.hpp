@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+enum class SchemaType : std::uint8_t { kNumber, kInteger, kBoolean, kString };
+
+// Why a payload was rejected. kOk means accepted.
+enum class Verdict : std::uint8_t {
+    kOk,
+    kMalformed,     // not parseable as a telemetry payload
+    kWrongDevice,   // "device_id" differs from the schema's const
+    kWrongType,     // "type" differs from the schema's const
+    kTypeMismatch,  // a field has the wrong JSON type, or an integer field has a fraction
+    kOutOfRange,    // outside min/max
+    kNotInEnum,
+};
+constexpr std::size_t kVerdictCount = 7;
+
+inline const char* VerdictName(Verdict v) {
+    switch (v) {
+        case Verdict::kOk:
+            return "ok";
+        case Verdict::kMalformed:
+            return "malformed";
+        case Verdict::kWrongDevice:
+            return "wrong_device";
+        case Verdict::kWrongType:
+            return "wrong_type";
+        case Verdict::kTypeMismatch:
+            return "type_mismatch";
+        case Verdict::kOutOfRange:
+            return "out_of_range";
+        case Verdict::kNotInEnum:
+            return "not_in_enum";
+    }
+    return "unknown";
+}
+
+struct FieldRule {
+    std::string name;
+    SchemaType type = SchemaType::kNumber;  // of every item when `array`
+    bool array = false;                     // a sample channel: an array of numbers
+    bool has_min = false;
+    bool has_max = false;
+    double min = 0.0;
+    double max = 0.0;
+    std::vector<double> enum_values;
+};
+
+// Compiled form of one device's `payload_schema`; the decoder checks fields as it reads them.
+struct DecodePlan {
+    std::string device_id;
+    std::string device_id_const;  // empty: not checked
+    std::string type_const;
+    std::vector<FieldRule> fields;  // sorted by name, at most FieldTable::kMaxFields
+
+    const FieldRule* Find(const char* name, std::size_t len) const {
+        for (const auto& f : fields) {
+            if (f.name.size() == len && std::memcmp(f.name.data(), name, len) == 0) return &f;
+        }
+        return nullptr;
+    }
+};
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,126 @@
+#include "core/device/codec/envelope_encoder.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "core/common/utils/json_writer.hpp"
+#include "core/device/codec/binary_writer.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+namespace {
+
+template <typename W>
+static void EmitNumber(W& w, double v) {
+    if (IsIntegral(v)) {
+        w.Int(static_cast<std::int64_t>(v));
+    } else {
+        w.Real(v);
+    }
+}
+
+template <typename W>
+static void Emit(W& w, const std::string& device_id, const std::string& type, const model::FieldTable& data,
+                 std::int64_t ts) {
+    w.Map(4);
+    w.Str("device_id", 9);
+    w.Str(device_id.data(), device_id.size());
+    w.Str("type", 4);
+    w.Str(type.data(), type.size());
+    w.Str("data", 4);
+    w.Map(data.Size());
+    for (std::size_t i = 0; i < data.Size(); ++i) {
+        const auto& v = data.ValueAt(i);
+        w.Str(data.NameAt(i), data.NameLenAt(i));
+        if (v.type == model::FieldType::kBool) {
+            w.Bool(v.number != 0.0);
+        } else {
+            EmitNumber(w, v.number);
+        }
+    }
+    w.Str("ts", 2);
+    w.Int(ts);
+}
+
+}  // namespace
+
+void EncodeEnvelope(PayloadFormat format, const std::string& device_id, const std::string& type,
+                    const model::FieldTable& data, std::int64_t ts, std::string& out) {
+    if (format == PayloadFormat::kCbor) {
+        CborWriter w(out);
+        Emit(w, device_id, type, data, ts);
+        return;
+    }
+    if (format == PayloadFormat::kMsgpack) {
+        MsgpackWriter w(out);
+        Emit(w, device_id, type, data, ts);
+        return;
+    }
+
+    iotgw::core::common::json::Writer w(64 + device_id.size() + data.Size() * 24);
+    w.BeginObject();
+    w.Key("device_id").String(device_id);
+    w.Key("type").String(type);
+    w.Key("data").BeginObject();
+    for (std::size_t i = 0; i < data.Size(); ++i) {
+        const auto& v = data.ValueAt(i);
+        w.Key(data.NameAt(i), data.NameLenAt(i));
+        if (v.type == model::FieldType::kBool) {
+            w.Bool(v.number != 0.0);
+        } else if (IsIntegral(v.number)) {
+            w.Int(static_cast<std::int64_t>(v.number));
+        } else {
+            w.Double(v.number);
+        }
+    }
+    w.EndObject();
+    w.Key("ts").Int(ts);
+    w.EndObject();
+    if (out.empty()) {
+        out = w.Take();
+    } else {
+        out.append(w.str());
+    }
+}
+
+void EncodeNumber(PayloadFormat format, double v, std::string& out) {
+    if (format == PayloadFormat::kCbor) {
+        CborWriter w(out);
+        EmitNumber(w, v);
+    } else if (format == PayloadFormat::kMsgpack) {
+        MsgpackWriter w(out);
+        EmitNumber(w, v);
+    } else {
+        iotgw::core::common::json::Writer w;
+        if (IsIntegral(v)) {
+            w.Int(static_cast<std::int64_t>(v));
+        } else {
+            w.Double(v);
+        }
+        out.append(w.str());
+    }
+}
+
+void EncodeJsonEnvelope(const std::string& device_id, const std::string& type, const std::string& data_json,
+                        std::int64_t ts, std::string& out) {
+    iotgw::core::common::json::Writer w(64 + device_id.size() + data_json.size());
+    w.BeginObject();
+    w.Key("device_id").String(device_id);
+    w.Key("type").String(type);
+    w.Key("data").Raw(data_json);
+    w.Key("ts").Int(ts);
+    w.EndObject();
+    if (out.empty()) {
+        out = w.Take();
+    } else {
+        out.append(w.str());
+    }
+}
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "core/device/codec/payload_format.hpp"
+#include "core/device/model/field_table.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+// Unified Device Model envelope {"device_id","type","data":{..},"ts"} in `format`,
+// appended to `out`. Integral numbers are written as integers; in CBOR and
+// MessagePack other numbers use float32 when that is exact, float64 otherwise.
+void EncodeEnvelope(PayloadFormat format, const std::string& device_id, const std::string& type,
+                    const model::FieldTable& data, std::int64_t ts, std::string& out);
+
+// A bare number in `format`, the binary counterpart of a plain "1" command.
+void EncodeNumber(PayloadFormat format, double v, std::string& out);
+
+// JSON envelope around an already serialized `data` value, e.g. a REST body passed through.
+void EncodeJsonEnvelope(const std::string& device_id, const std::string& type, const std::string& data_json,
+                        std::int64_t ts, std::string& out);
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
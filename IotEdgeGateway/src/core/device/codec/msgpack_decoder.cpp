@@ -0,0 +1,316 @@
+#include <cstdint>
+#include <cstring>
+
+#include "core/device/codec/telemetry_builder.hpp"
+#include "core/device/codec/telemetry_decoder.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+namespace {
+
+constexpr int kMaxDepth = 32;
+
+// One MessagePack object. Strings, binaries and extensions are consumed whole
+// (`s`, `len`); for arrays and maps only the header is, `len` being the count.
+struct Item {
+    enum Kind { kNil, kBool, kUint, kInt, kFloat, kStr, kBin, kExt, kArray, kMap };
+    Kind kind = kNil;
+    std::uint64_t u = 0;
+    std::int64_t i = 0;
+    double f = 0.0;
+    bool b = false;
+    const char* s = nullptr;
+    std::size_t len = 0;
+
+    bool Number(double& out) const {
+        switch (kind) {
+            case kUint:
+                out = static_cast<double>(u);
+                return true;
+            case kInt:
+                out = static_cast<double>(i);
+                return true;
+            case kFloat:
+                out = f;
+                return true;
+            default:
+                return false;
+        }
+    }
+};
+
+struct Reader {
+    const std::uint8_t* p;
+    const std::uint8_t* end;
+
+    std::size_t Left() const { return static_cast<std::size_t>(end - p); }
+
+    bool Be(std::size_t n, std::uint64_t& v) {
+        if (n > Left()) return false;
+        v = 0;
+        for (std::size_t k = 0; k < n; ++k) v = (v << 8) | p[k];
+        p += n;
+        return true;
+    }
+
+    bool Bytes(std::uint64_t n, Item& it) {
+        if (n > Left()) return false;
+        it.s = reinterpret_cast<const char*>(p);
+        it.len = static_cast<std::size_t>(n);
+        p += n;
+        return true;
+    }
+
+    bool Sized(Item::Kind kind, std::size_t width, Item& it) {
+        std::uint64_t n = 0;
+        if (!Be(width, n)) return false;
+        it.kind = kind;
+        if (kind == Item::kArray || kind == Item::kMap) {
+            it.len = static_cast<std::size_t>(n);
+            return true;
+        }
+        return Bytes(n, it);
+    }
+
+    bool Ext(std::size_t width, std::uint64_t fixed, Item& it) {
+        std::uint64_t n = fixed;
+        if (width > 0 && !Be(width, n)) return false;
+        it.kind = Item::kExt;
+        return Skip(1) && Bytes(n, it);  // type byte, then data
+    }
+
+    bool Skip(std::size_t n) {
+        if (n > Left()) return false;
+        p += n;
+        return true;
+    }
+
+    bool Read(Item& it) {
+        if (p >= end) return false;
+        const std::uint8_t c = *p++;
+        it = Item();
+        if (c <= 0x7f) {
+            it.kind = Item::kUint;
+            it.u = c;
+            return true;
+        }
+        if (c >= 0xe0) {
+            it.kind = Item::kInt;
+            it.i = static_cast<std::int8_t>(c);
+            return true;
+        }
+        if (c <= 0x8f) {
+            it.kind = Item::kMap;
+            it.len = c & 0x0f;
+            return true;
+        }
+        if (c <= 0x9f) {
+            it.kind = Item::kArray;
+            it.len = c & 0x0f;
+            return true;
+        }
+        if (c <= 0xbf) {
+            it.kind = Item::kStr;
+            return Bytes(c & 0x1f, it);
+        }
+        std::uint64_t v = 0;
+        switch (c) {
+            case 0xc0:
+                it.kind = Item::kNil;
+                return true;
+            case 0xc2:
+            case 0xc3:
+                it.kind = Item::kBool;
+                it.b = c == 0xc3;
+                return true;
+            case 0xc4:
+            case 0xc5:
+            case 0xc6:
+                return Sized(Item::kBin, static_cast<std::size_t>(1) << (c - 0xc4), it);
+            case 0xc7:
+            case 0xc8:
+            case 0xc9:
+                return Ext(static_cast<std::size_t>(1) << (c - 0xc7), 0, it);
+            case 0xca: {
+                if (!Be(4, v)) return false;
+                const auto bits = static_cast<std::uint32_t>(v);
+                float f = 0.0f;
+                std::memcpy(&f, &bits, sizeof(f));
+                it.kind = Item::kFloat;
+                it.f = f;
+                return true;
+            }
+            case 0xcb:
+                if (!Be(8, v)) return false;
+                it.kind = Item::kFloat;
+                std::memcpy(&it.f, &v, sizeof(it.f));
+                return true;
+            case 0xcc:
+            case 0xcd:
+            case 0xce:
+            case 0xcf:
+                it.kind = Item::kUint;
+                return Be(static_cast<std::size_t>(1) << (c - 0xcc), it.u);
+            case 0xd0:
+            case 0xd1:
+            case 0xd2:
+            case 0xd3: {
+                const std::size_t n = static_cast<std::size_t>(1) << (c - 0xd0);
+                if (!Be(n, v)) return false;
+                // Sign-extend from n bytes.
+                const unsigned shift = static_cast<unsigned>(64 - n * 8);
+                it.kind = Item::kInt;
+                it.i = static_cast<std::int64_t>(v << shift) >> shift;
+                return true;
+            }
+            case 0xd4:
+            case 0xd5:
+            case 0xd6:
+            case 0xd7:
+            case 0xd8:
+                return Ext(0, static_cast<std::uint64_t>(1) << (c - 0xd4), it);
+            case 0xd9:
+            case 0xda:
+            case 0xdb:
+                return Sized(Item::kStr, static_cast<std::size_t>(1) << (c - 0xd9), it);
+            case 0xdc:
+            case 0xdd:
+                return Sized(Item::kArray, c == 0xdc ? 2 : 4, it);
+            case 0xde:
+            case 0xdf:
+                return Sized(Item::kMap, c == 0xde ? 2 : 4, it);
+            default:
+                return false;  // 0xc1 is never used
+        }
+    }
+};
+
+// Skips the elements of an array or map whose header has been read.
+static bool SkipContents(Reader& r, const Item& it, int depth) {
+    if (it.kind != Item::kArray && it.kind != Item::kMap) return true;
+    if (depth > kMaxDepth) return false;
+    // Every element takes at least one byte, so a count beyond the input is malformed.
+    if (it.len > r.Left()) return false;
+    const std::size_t n = it.kind == Item::kMap ? it.len * 2 : it.len;
+    for (std::size_t k = 0; k < n; ++k) {
+        Item c;
+        if (!r.Read(c) || !SkipContents(r, c, depth + 1)) return false;
+    }
+    return true;
+}
+
+using Scope = TelemetryBuilder::Scope;
+using ArrayMode = TelemetryBuilder::ArrayMode;
+
+struct MsgpackParser {
+    Reader r;
+    TelemetryBuilder& b;
+
+    bool Malformed() { return b.Fail(Verdict::kMalformed); }
+
+    bool Member(Scope scope, const char* key, std::size_t key_len, const Item& v, int depth) {
+        double num = 0.0;
+        if (v.Number(num)) return b.Number(scope, key, key_len, num);
+        if (v.kind == Item::kBool) return b.Bool(scope, key, key_len, v.b);
+        if (v.kind == Item::kStr) {
+            return scope == Scope::kTop ? b.TopString(key, key_len, v.s, v.len) : b.Other(scope, key, key_len, true);
+        }
+        if (v.kind == Item::kArray) return Array(scope, key, key_len, v, depth);
+        if (!b.Other(scope, key, key_len, false)) return false;
+        return SkipContents(r, v, depth) || Malformed();
+    }
+
+    bool Array(Scope scope, const char* key, std::size_t key_len, const Item& arr, int depth) {
+        const ArrayMode mode = b.BeginArray(scope, key, key_len);
+        if (mode == ArrayMode::kReject) return false;
+        if (mode == ArrayMode::kSkip) return SkipContents(r, arr, depth) || Malformed();
+        if (arr.len > r.Left()) return Malformed();
+        bool collect = true;
+        for (std::size_t i = 0; i < arr.len; ++i) {
+            Item item;
+            if (!r.Read(item)) return Malformed();
+            double v = 0.0;
+            if (collect && !item.Number(v)) {
+                if (b.NonNumericSample() == ArrayMode::kReject) return false;
+                collect = false;
+            }
+            if (collect) {
+                if (!b.Sample(v)) return false;
+            } else if (!SkipContents(r, item, depth + 1)) {
+                return Malformed();
+            }
+        }
+        b.EndArray();
+        return true;
+    }
+
+    // Calls fn(key, key_len, value) for every string-keyed member; other members are skipped.
+    template <typename Fn>
+    bool Map(const Item& map, int depth, Fn fn) {
+        if (map.len > r.Left()) return Malformed();
+        for (std::size_t i = 0; i < map.len; ++i) {
+            Item k;
+            Item v;
+            if (!r.Read(k) || !SkipContents(r, k, depth + 1) || !r.Read(v)) return Malformed();
+            if (k.kind != Item::kStr) {
+                if (!SkipContents(r, v, depth + 1)) return Malformed();
+                continue;
+            }
+            if (!fn(k.s, k.len, v)) return false;
+        }
+        return true;
+    }
+
+    bool Run() {
+        Item top;
+        if (!r.Read(top)) return Malformed();
+        if (top.kind != Item::kMap) {
+            double v = 0.0;
+            if (!top.Number(v) || r.p != r.end) return Malformed();
+            return b.BareNumber(v);
+        }
+        const bool ok = Map(top, 0, [&](const char* key, std::size_t len, const Item& v) {
+            if (TelemetryBuilder::KeyIs(key, len, "data") && v.kind == Item::kMap) {
+                b.Envelope();
+                return Map(v, 1, [&](const char* k2, std::size_t l2, const Item& v2) {
+                    return Member(Scope::kData, k2, l2, v2, 2);
+                });
+            }
+            double ts = 0.0;
+            if (TelemetryBuilder::KeyIs(key, len, "ts") && v.Number(ts)) {
+                b.Ts(ts);
+                return true;
+            }
+            return Member(Scope::kTop, key, len, v, 1);
+        });
+        if (!ok) return false;
+        if (r.p != r.end) return Malformed();
+        b.Finish();
+        return true;
+    }
+};
+
+}  // namespace
+
+bool DecodeMsgpackTelemetry(const char* p, std::size_t n, const DecodePlan* plan, DecodedTelemetry& out) {
+    out.Reset();
+    if (p == nullptr || n == 0) {
+        out.verdict = Verdict::kMalformed;
+        return false;
+    }
+    TelemetryBuilder b(plan, out);
+    const auto* u = reinterpret_cast<const std::uint8_t*>(p);
+    MsgpackParser parser{Reader{u, u + n}, b};
+    if (parser.Run()) return true;
+    out.fields.Clear();
+    if (out.samples != nullptr) out.samples->Clear();
+    return false;
+}
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+// Wire format of device payloads. All three carry the same Unified Device Model
+// envelope and decode into the same FieldTable.
+enum class PayloadFormat : std::uint8_t { kJson, kCbor, kMsgpack };
+
+inline const char* PayloadFormatName(PayloadFormat f) {
+    switch (f) {
+        case PayloadFormat::kJson:
+            return "json";
+        case PayloadFormat::kCbor:
+            return "cbor";
+        case PayloadFormat::kMsgpack:
+            return "msgpack";
+    }
+    return "json";
+}
+
+inline bool ParsePayloadFormat(const std::string& s, PayloadFormat& out) {
+    if (s == "json") {
+        out = PayloadFormat::kJson;
+    } else if (s == "cbor") {
+        out = PayloadFormat::kCbor;
+    } else if (s == "msgpack" || s == "messagepack") {
+        out = PayloadFormat::kMsgpack;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
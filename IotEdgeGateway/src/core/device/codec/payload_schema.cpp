@@ -0,0 +1,136 @@
+#include "core/device/codec/payload_schema.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/device/model/field_table.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+namespace {
+
+static bool ParseDouble(const std::string& s, double& out) {
+    if (s.empty()) return false;
+    char* end = nullptr;
+    out = std::strtod(s.c_str(), &end);
+    return end == s.c_str() + s.size();
+}
+
+static bool ParseSchemaType(const std::string& s, SchemaType& out) {
+    if (s == "number") {
+        out = SchemaType::kNumber;
+    } else if (s == "integer") {
+        out = SchemaType::kInteger;
+    } else if (s == "boolean") {
+        out = SchemaType::kBoolean;
+    } else if (s == "string") {
+        out = SchemaType::kString;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Next key level after `prefix`, e.g. "value" for "<prefix>value.type".
+static std::string LevelAfter(const std::string& key, const std::string& prefix) {
+    if (key.compare(0, prefix.size(), prefix) != 0) return {};
+    const std::size_t end = key.find('.', prefix.size());
+    if (end == std::string::npos) return {};
+    return key.substr(prefix.size(), end - prefix.size());
+}
+
+static bool GetNumberEither(const iotgw::core::common::config::ConfigManager& cfg, const std::string& base,
+                            const char* a, const char* b, double& out) {
+    std::string s;
+    if (!(cfg.GetString(base + a, s) || cfg.GetString(base + b, s))) return false;
+    return ParseDouble(s, out);
+}
+
+}  // namespace
+
+std::size_t PayloadSchema::Compile(const iotgw::core::common::config::ConfigManager& cfg,
+                                   std::vector<std::string>& errors) {
+    static const std::string kDevices = "devices.";
+    std::set<std::string> ids;
+    for (const auto& kv : cfg.Data()) {
+        const std::string id = LevelAfter(kv.first, kDevices);
+        if (!id.empty() && kv.first.compare(kDevices.size() + id.size(), 16, ".payload_schema.") == 0) ids.insert(id);
+    }
+
+    plans_.clear();
+    for (const auto& id : ids) {
+        const std::string props = kDevices + id + ".payload_schema.properties.";
+        DecodePlan plan;
+        plan.device_id = id;
+        (void)cfg.GetString(props + "device_id.const", plan.device_id_const);
+        (void)cfg.GetString(props + "type.const", plan.type_const);
+
+        const std::string data_props = props + "data.properties.";
+        std::set<std::string> names;
+        for (const auto& kv : cfg.Data()) {
+            std::string name = LevelAfter(kv.first, data_props);
+            if (!name.empty()) names.insert(std::move(name));
+        }
+
+        for (const auto& name : names) {
+            // A sample channel is `type: array` with the per-sample rule under `items`.
+            std::string base = data_props + name + ".";
+            FieldRule f;
+            f.name = name;
+            std::string type_name = cfg.GetStringOr(base + "type", "number");
+            if (type_name == "array") {
+                f.array = true;
+                base += "items.";
+                type_name = cfg.GetStringOr(base + "type", "number");
+            }
+            if (!ParseSchemaType(type_name, f.type) ||
+                (f.array && f.type != SchemaType::kNumber && f.type != SchemaType::kInteger)) {
+                errors.push_back(id + "." + name + ": unsupported type '" + (f.array ? "array of " : "") + type_name +
+                                 "'");
+                continue;
+            }
+            if (name.size() > model::FieldTable::kMaxNameLen) {
+                errors.push_back(id + "." + name + ": field name longer than " +
+                                 std::to_string(model::FieldTable::kMaxNameLen));
+                continue;
+            }
+            if (plan.fields.size() >= model::FieldTable::kMaxFields) {
+                errors.push_back(id + "." + name + ": more than " + std::to_string(model::FieldTable::kMaxFields) +
+                                 " fields");
+                continue;
+            }
+            f.has_min = GetNumberEither(cfg, base, "min", "minimum", f.min);
+            f.has_max = GetNumberEither(cfg, base, "max", "maximum", f.max);
+            for (std::size_t i = 0;; ++i) {
+                std::string s;
+                if (!cfg.GetString(base + "enum[" + std::to_string(i) + "]", s)) break;
+                double v = 0.0;
+                if (!ParseDouble(s, v)) {
+                    errors.push_back(id + "." + name + ": non-numeric enum value '" + s + "'");
+                    continue;
+                }
+                f.enum_values.push_back(v);
+            }
+            plan.fields.push_back(std::move(f));
+        }
+        plans_.emplace(id, std::move(plan));
+    }
+    return plans_.size();
+}
+
+const DecodePlan* PayloadSchema::Find(const std::string& device_id) const {
+    const auto it = plans_.find(device_id);
+    return it == plans_.end() ? nullptr : &it->second;
+}
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core/common/config/config_manager.hpp"
+#include "core/device/codec/decode_plan.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+// Decode plans for every device described by config/devices/schema.yaml.
+class PayloadSchema {
+public:
+    // Reads `devices.<id>.payload_schema`. Fields the decoder cannot hold (unknown type,
+    // name too long, too many) are reported in `errors` and left out of the plan.
+    std::size_t Compile(const iotgw::core::common::config::ConfigManager& cfg, std::vector<std::string>& errors);
+
+    // Stable for the lifetime of this object.
+    const DecodePlan* Find(const std::string& device_id) const;
+
+    std::size_t Size() const { return plans_.size(); }
+
+private:
+    std::unordered_map<std::string, DecodePlan> plans_;
+};
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
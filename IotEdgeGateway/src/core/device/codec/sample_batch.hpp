@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+// Numeric arrays of a payload's `data`, one channel per member, e.g.
+//   {"device_id":"vib-1","rate_hz":1000,"t0_ms":1760000000000,"data":{"ax":[0.1,0.2,..],"ay":[..]}}
+// Samples of all channels share one value buffer that is reused across payloads,
+// so steady-state decoding does not allocate.
+class SampleBatch {
+public:
+    static constexpr std::size_t kMaxChannels = 8;
+    static constexpr std::size_t kMaxNameLen = 15;
+    static constexpr std::size_t kMaxSamples = 1u << 16;  // per payload, all channels together
+
+    struct Channel {
+        char name[kMaxNameLen + 1] = {};
+        std::uint8_t name_len = 0;
+        std::size_t offset = 0;  // into the value buffer
+        std::size_t count = 0;
+    };
+
+    void Clear() {
+        channel_count_ = 0;
+        values_.clear();
+        rate_hz = 0.0;
+        t0_ms = 0;
+    }
+
+    bool Empty() const { return channel_count_ == 0; }
+    std::size_t ChannelCount() const { return channel_count_; }
+    const Channel& ChannelAt(std::size_t i) const { return channels_[i]; }
+    const float* Values(const Channel& c) const { return values_.data() + c.offset; }
+    std::size_t SampleCount() const { return values_.size(); }
+
+    // False when the channel table is full or the name too long; the array is then skipped.
+    bool Begin(const char* name, std::size_t len) {
+        if (channel_count_ >= kMaxChannels || len == 0 || len > kMaxNameLen) return false;
+        Channel& c = channels_[channel_count_];
+        std::memcpy(c.name, name, len);
+        c.name[len] = '\0';
+        c.name_len = static_cast<std::uint8_t>(len);
+        c.offset = values_.size();
+        c.count = 0;
+        return true;
+    }
+
+    bool Push(float v) {
+        if (values_.size() >= kMaxSamples) return false;
+        values_.push_back(v);
+        ++channels_[channel_count_].count;
+        return true;
+    }
+
+    // Commits the channel opened by Begin(); an empty array leaves no channel behind.
+    void End() {
+        if (channels_[channel_count_].count > 0) ++channel_count_;
+    }
+
+    double rate_hz = 0.0;    // envelope "rate_hz"; 0: all samples of a channel share one timestamp
+    std::int64_t t0_ms = 0;  // envelope "t0_ms", time of the first sample; 0: derived from arrival
+
+private:
+    Channel channels_[kMaxChannels];
+    std::size_t channel_count_ = 0;
+    std::vector<float> values_;
+};
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
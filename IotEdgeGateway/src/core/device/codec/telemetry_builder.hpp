@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "core/device/codec/decode_plan.hpp"
+#include "core/device/codec/telemetry_decoder.hpp"
+#include "core/device/model/field_table.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+// Format-independent half of the telemetry decoders. A JSON, CBOR or MessagePack
+// parser walks its own encoding and reports envelope members here; this class
+// applies the plan and fills DecodedTelemetry. Every call returns false once the
+// payload is rejected, with the reason in `out.verdict`.
+class TelemetryBuilder {
+public:
+    enum class Scope { kTop, kData };
+
+    // What the parser does with an array member.
+    enum class ArrayMode { kReject, kSkip, kCollect };
+
+    TelemetryBuilder(const DecodePlan* plan, DecodedTelemetry& out) : plan_(plan), out_(out), batch_(out.samples) {}
+
+    bool Fail(Verdict v) {
+        out_.verdict = v;
+        return false;
+    }
+
+    static bool KeyIs(const char* key, std::size_t len, const char* name) {
+        return std::strlen(name) == len && std::memcmp(key, name, len) == 0;
+    }
+
+    bool Number(Scope scope, const char* key, std::size_t len, double v) {
+        if (batch_ != nullptr && scope == Scope::kTop && Timing(key, len, v)) return true;
+        // NaN and infinities only come from binary floats; they have no place in the table.
+        if (!std::isfinite(v)) return Other(scope, key, len, false);
+        const FieldRule* rule = nullptr;
+        if (!Lookup(scope, key, len, rule)) return true;
+        if (rule != nullptr && rule->array) return Fail(Verdict::kTypeMismatch);
+        if (rule != nullptr && !CheckNumber(*rule, v)) return false;
+        (void)Table(scope).Set(key, len, model::FieldValue::Number(v));
+        return true;
+    }
+
+    bool Bool(Scope scope, const char* key, std::size_t len, bool v) {
+        const FieldRule* rule = nullptr;
+        if (!Lookup(scope, key, len, rule)) return true;
+        if (rule != nullptr && rule->type != SchemaType::kBoolean) return Fail(Verdict::kTypeMismatch);
+        (void)Table(scope).Set(key, len, model::FieldValue::Bool(v));
+        return true;
+    }
+
+    // A member the table does not hold (string, null, container). The caller skips its contents.
+    bool Other(Scope scope, const char* key, std::size_t len, bool is_string) {
+        const FieldRule* rule = nullptr;
+        if (!Lookup(scope, key, len, rule)) return true;
+        if (rule != nullptr && rule->array) return Fail(Verdict::kTypeMismatch);
+        if (rule != nullptr && !(is_string && rule->type == SchemaType::kString)) return Fail(Verdict::kTypeMismatch);
+        return true;
+    }
+
+    // Array member. kCollect: the parser feeds each item to Sample() and then calls
+    // EndArray(); kSkip: it skips the contents; kReject: the payload is rejected.
+    ArrayMode BeginArray(Scope scope, const char* key, std::size_t len) {
+        const FieldRule* rule = nullptr;
+        if (plan_ != nullptr) {
+            rule = plan_->Find(key, len);
+            if (rule == nullptr) {
+                if (scope == Scope::kData) ++out_.unknown_fields;
+                return ArrayMode::kSkip;
+            }
+            if (!rule->array) {
+                (void)Fail(Verdict::kTypeMismatch);
+                return ArrayMode::kReject;
+            }
+        }
+        if (batch_ == nullptr || scope != Scope::kData || !batch_->Begin(key, len)) return ArrayMode::kSkip;
+        array_rule_ = rule;
+        array_items_ = 0;
+        return ArrayMode::kCollect;
+    }
+
+    bool Sample(double v) {
+        if (!std::isfinite(v)) return Fail(Verdict::kTypeMismatch);
+        if (array_rule_ != nullptr && !CheckNumber(*array_rule_, v)) return false;
+        if (!batch_->Push(static_cast<float>(v))) return Fail(Verdict::kMalformed);
+        last_sample_ = v;
+        ++array_items_;
+        return true;
+    }
+
+    // An item that is not a number. An array that starts with one is not a channel
+    // and is skipped (kSkip); a schema channel or a mixed array rejects the payload.
+    ArrayMode NonNumericSample() {
+        if (array_rule_ == nullptr && array_items_ == 0) return ArrayMode::kSkip;
+        (void)Fail(Verdict::kTypeMismatch);
+        return ArrayMode::kReject;
+    }
+
+    void EndArray() {
+        const std::size_t n = batch_->ChannelCount();
+        batch_->End();
+        if (batch_->ChannelCount() == n) return;
+        const auto& c = batch_->ChannelAt(n);
+        (void)out_.fields.Set(c.name, c.name_len, model::FieldValue::Number(last_sample_));
+    }
+
+    // Top-level string member; "device_id" and "type" are checked against the plan's consts.
+    bool TopString(const char* key, std::size_t len, const char* s, std::size_t slen) {
+        if (plan_ != nullptr) {
+            if (KeyIs(key, len, "device_id")) {
+                return ConstMatches(plan_->device_id_const, s, slen, Verdict::kWrongDevice);
+            }
+            if (KeyIs(key, len, "type")) return ConstMatches(plan_->type_const, s, slen, Verdict::kWrongType);
+        }
+        return Other(Scope::kTop, key, len, true);
+    }
+
+    void Ts(double ts) { out_.ts = static_cast<std::int64_t>(ts); }
+    void Envelope() { out_.envelope = true; }
+
+    // Payload that is a single number, stored as "value".
+    bool BareNumber(double v) {
+        if (!std::isfinite(v)) return Fail(Verdict::kTypeMismatch);
+        if (plan_ != nullptr) {
+            const FieldRule* rule = plan_->Find("value", 5);
+            if (rule == nullptr || rule->array) return Fail(Verdict::kTypeMismatch);
+            if (!CheckNumber(*rule, v)) return false;
+        }
+        (void)out_.fields.Set("value", 5, model::FieldValue::Number(v));
+        return true;
+    }
+
+    // `data` wins over flat fields of the same name, wherever either appears.
+    void Finish() {
+        for (std::size_t i = 0; i < flat_.Size(); ++i) {
+            if (out_.fields.Find(flat_.NameAt(i), flat_.NameLenAt(i)) == nullptr) {
+                (void)out_.fields.Set(flat_.NameAt(i), flat_.NameLenAt(i), flat_.ValueAt(i));
+            }
+        }
+    }
+
+private:
+    model::FieldTable& Table(Scope scope) { return scope == Scope::kData ? out_.fields : flat_; }
+
+    // False if the member is not kept: with a plan, only the plan's fields are.
+    bool Lookup(Scope scope, const char* key, std::size_t len, const FieldRule*& rule) {
+        if (plan_ == nullptr) return true;
+        rule = plan_->Find(key, len);
+        if (rule == nullptr && scope == Scope::kData) ++out_.unknown_fields;
+        return rule != nullptr;
+    }
+
+    bool CheckNumber(const FieldRule& rule, double v) {
+        if (rule.type == SchemaType::kBoolean || rule.type == SchemaType::kString) return Fail(Verdict::kTypeMismatch);
+        if (rule.type == SchemaType::kInteger && std::floor(v) != v) return Fail(Verdict::kTypeMismatch);
+        if ((rule.has_min && v < rule.min) || (rule.has_max && v > rule.max)) return Fail(Verdict::kOutOfRange);
+        if (!rule.enum_values.empty() &&
+            std::find(rule.enum_values.begin(), rule.enum_values.end(), v) == rule.enum_values.end()) {
+            return Fail(Verdict::kNotInEnum);
+        }
+        return true;
+    }
+
+    // Top-level "rate_hz" and "t0_ms" time the batch's samples.
+    bool Timing(const char* key, std::size_t len, double v) {
+        if (KeyIs(key, len, "rate_hz")) {
+            batch_->rate_hz = std::isfinite(v) && v > 0.0 ? v : 0.0;
+            return true;
+        }
+        if (KeyIs(key, len, "t0_ms")) {
+            batch_->t0_ms = std::isfinite(v) && v > 0.0 ? static_cast<std::int64_t>(v) : 0;
+            return true;
+        }
+        return false;
+    }
+
+    bool ConstMatches(const std::string& expected, const char* s, std::size_t len, Verdict on_mismatch) {
+        if (expected.empty() || (expected.size() == len && std::memcmp(expected.data(), s, len) == 0)) return true;
+        return Fail(on_mismatch);
+    }
+
+private:
+    const DecodePlan* plan_;
+    DecodedTelemetry& out_;
+    SampleBatch* batch_;
+    const FieldRule* array_rule_ = nullptr;
+    std::size_t array_items_ = 0;
+    double last_sample_ = 0.0;
+    model::FieldTable flat_;
+};
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
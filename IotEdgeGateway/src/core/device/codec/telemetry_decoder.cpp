@@ -0,0 +1,268 @@
+#include "core/device/codec/telemetry_decoder.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "core/device/codec/telemetry_builder.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+namespace {
+
+constexpr int kMaxDepth = 32;
+
+struct Cursor {
+    const char* p;
+    const char* end;
+
+    bool AtEnd() const { return p >= end; }
+    char Peek() const { return p < end ? *p : '\0'; }
+
+    void SkipWs() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    }
+
+    bool Consume(char c) {
+        SkipWs();
+        if (p < end && *p == c) {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+
+    bool Literal(const char* word, std::size_t len) {
+        if (static_cast<std::size_t>(end - p) < len || std::memcmp(p, word, len) != 0) return false;
+        p += len;
+        return true;
+    }
+};
+
+// Raw bytes between the quotes; escapes are left as-is (keys we look up never contain any).
+static bool ParseString(Cursor& c, const char*& s, std::size_t& len) {
+    c.SkipWs();
+    if (c.Peek() != '\"') return false;
+    ++c.p;
+    s = c.p;
+    while (c.p < c.end && *c.p != '\"') {
+        if (*c.p == '\\') ++c.p;
+        ++c.p;
+    }
+    if (c.p >= c.end) return false;
+    len = static_cast<std::size_t>(c.p - s);
+    ++c.p;
+    return true;
+}
+
+static bool ParseNumber(Cursor& c, double& out) {
+    c.SkipWs();
+    char buf[40];
+    std::size_t n = 0;
+    while (c.p < c.end && n + 1 < sizeof(buf)) {
+        const char ch = *c.p;
+        if (!((ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.' || ch == 'e' || ch == 'E')) break;
+        buf[n++] = ch;
+        ++c.p;
+    }
+    if (n == 0) return false;
+    buf[n] = '\0';
+    char* stop = nullptr;
+    out = std::strtod(buf, &stop);
+    return stop == buf + n;
+}
+
+static bool SkipValue(Cursor& c, int depth);
+
+static bool SkipContainer(Cursor& c, char close, int depth) {
+    if (depth > kMaxDepth) return false;
+    ++c.p;
+    if (c.Consume(close)) return true;
+    while (true) {
+        if (close == '}') {
+            const char* s = nullptr;
+            std::size_t len = 0;
+            if (!ParseString(c, s, len) || !c.Consume(':')) return false;
+        }
+        if (!SkipValue(c, depth + 1)) return false;
+        if (c.Consume(',')) continue;
+        return c.Consume(close);
+    }
+}
+
+static bool SkipValue(Cursor& c, int depth) {
+    c.SkipWs();
+    switch (c.Peek()) {
+        case '{':
+            return SkipContainer(c, '}', depth);
+        case '[':
+            return SkipContainer(c, ']', depth);
+        case '\"': {
+            const char* s = nullptr;
+            std::size_t len = 0;
+            return ParseString(c, s, len);
+        }
+        case 't':
+            return c.Literal("true", 4);
+        case 'f':
+            return c.Literal("false", 5);
+        case 'n':
+            return c.Literal("null", 4);
+        default: {
+            double ignored = 0.0;
+            return ParseNumber(c, ignored);
+        }
+    }
+}
+
+static bool IsNumberStart(char ch) { return ch == '-' || (ch >= '0' && ch <= '9'); }
+
+using Scope = TelemetryBuilder::Scope;
+using ArrayMode = TelemetryBuilder::ArrayMode;
+
+struct JsonParser {
+    Cursor c;
+    TelemetryBuilder& b;
+
+    bool Malformed() { return b.Fail(Verdict::kMalformed); }
+
+    bool Member(Scope scope, const char* key, std::size_t key_len, int depth) {
+        c.SkipWs();
+        const char ch = c.Peek();
+        if (ch == 't' || ch == 'f') {
+            const bool v = ch == 't';
+            if (!(v ? c.Literal("true", 4) : c.Literal("false", 5))) return Malformed();
+            return b.Bool(scope, key, key_len, v);
+        }
+        if (IsNumberStart(ch)) {
+            double v = 0.0;
+            if (!ParseNumber(c, v)) return Malformed();
+            return b.Number(scope, key, key_len, v);
+        }
+        if (ch == '\"') {
+            const char* s = nullptr;
+            std::size_t len = 0;
+            if (!ParseString(c, s, len)) return Malformed();
+            return scope == Scope::kTop ? b.TopString(key, key_len, s, len) : b.Other(scope, key, key_len, true);
+        }
+        if (ch == '[') return Array(scope, key, key_len, depth);
+        if (!b.Other(scope, key, key_len, false)) return false;
+        return SkipValue(c, depth) || Malformed();
+    }
+
+    bool Array(Scope scope, const char* key, std::size_t key_len, int depth) {
+        const ArrayMode mode = b.BeginArray(scope, key, key_len);
+        if (mode == ArrayMode::kReject) return false;
+        if (mode == ArrayMode::kSkip) return SkipValue(c, depth) || Malformed();
+        ++c.p;  // '['
+        bool collect = true;
+        if (!c.Consume(']')) {
+            while (true) {
+                c.SkipWs();
+                if (collect && !IsNumberStart(c.Peek())) {
+                    if (b.NonNumericSample() == ArrayMode::kReject) return false;
+                    collect = false;
+                }
+                if (collect) {
+                    double v = 0.0;
+                    if (!ParseNumber(c, v)) return Malformed();
+                    if (!b.Sample(v)) return false;
+                } else if (!SkipValue(c, depth + 1)) {
+                    return Malformed();
+                }
+                if (c.Consume(',')) continue;
+                if (c.Consume(']')) break;
+                return Malformed();
+            }
+        }
+        b.EndArray();
+        return true;
+    }
+
+    bool DataObject() {
+        ++c.p;  // '{'
+        if (c.Consume('}')) return true;
+        while (true) {
+            const char* key = nullptr;
+            std::size_t len = 0;
+            if (!ParseString(c, key, len) || !c.Consume(':')) return Malformed();
+            if (!Member(Scope::kData, key, len, 2)) return false;
+            if (c.Consume(',')) continue;
+            return c.Consume('}') || Malformed();
+        }
+    }
+
+    bool Run() {
+        c.SkipWs();
+        if (c.Peek() != '{') {
+            double v = 0.0;
+            if (!ParseNumber(c, v)) return Malformed();
+            c.SkipWs();
+            if (!c.AtEnd()) return Malformed();
+            return b.BareNumber(v);
+        }
+
+        ++c.p;
+        if (!c.Consume('}')) {
+            while (true) {
+                const char* key = nullptr;
+                std::size_t len = 0;
+                if (!ParseString(c, key, len) || !c.Consume(':')) return Malformed();
+                c.SkipWs();
+                const char ch = c.Peek();
+                if (TelemetryBuilder::KeyIs(key, len, "data") && ch == '{') {
+                    if (!DataObject()) return false;
+                    b.Envelope();
+                } else if (TelemetryBuilder::KeyIs(key, len, "ts") && IsNumberStart(ch)) {
+                    double ts = 0.0;
+                    if (!ParseNumber(c, ts)) return Malformed();
+                    b.Ts(ts);
+                } else if (!Member(Scope::kTop, key, len, 1)) {
+                    return false;
+                }
+                if (c.Consume(',')) continue;
+                if (c.Consume('}')) break;
+                return Malformed();
+            }
+        }
+        b.Finish();
+        return true;
+    }
+};
+
+}  // namespace
+
+bool DecodeTelemetry(const char* p, std::size_t n, const DecodePlan* plan, DecodedTelemetry& out) {
+    out.Reset();
+    if (p == nullptr || n == 0) {
+        out.verdict = Verdict::kMalformed;
+        return false;
+    }
+    TelemetryBuilder b(plan, out);
+    JsonParser parser{Cursor{p, p + n}, b};
+    if (parser.Run()) return true;
+    // A rejected payload contributes nothing.
+    out.fields.Clear();
+    if (out.samples != nullptr) out.samples->Clear();
+    return false;
+}
+
+bool DecodePayload(PayloadFormat format, const char* p, std::size_t n, const DecodePlan* plan,
+                   DecodedTelemetry& out) {
+    switch (format) {
+        case PayloadFormat::kCbor:
+            return DecodeCborTelemetry(p, n, plan, out);
+        case PayloadFormat::kMsgpack:
+            return DecodeMsgpackTelemetry(p, n, plan, out);
+        case PayloadFormat::kJson:
+            break;
+    }
+    return DecodeTelemetry(p, n, plan, out);
+}
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "core/device/codec/decode_plan.hpp"
+#include "core/device/codec/payload_format.hpp"
+#include "core/device/codec/sample_batch.hpp"
+#include "core/device/model/field_table.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace codec {
+
+struct DecodedTelemetry {
+    model::FieldTable fields;
+    std::int64_t ts = 0;    // envelope "ts", 0 if absent
+    bool envelope = false;  // payload had a "data" object
+    Verdict verdict = Verdict::kOk;
+    std::uint32_t unknown_fields = 0;  // `data` members the plan does not list (skipped)
+    SampleBatch* samples = nullptr;    // caller-owned; numeric arrays of `data` are collected here when set
+
+    // Clears the result for the next payload; an attached batch stays attached, emptied.
+    void Reset() {
+        SampleBatch* batch = samples;
+        *this = DecodedTelemetry();
+        samples = batch;
+        if (samples != nullptr) samples->Clear();
+    }
+};
+
+// Single pass over a telemetry payload. Accepted forms:
+//   {"device_id":..,"type":..,"data":{"value":25.5,"on":true},"ts":..}  (Unified Device Model envelope)
+//   {"value":25.5}                                                   (flat, legacy devices)
+//   25.5                                                             (bare number, stored as "value")
+// Numbers and booleans of `data` are extracted; flat top-level scalars fill in
+// names `data` does not have. Strings, nulls and nested containers are skipped,
+// except numeric arrays of `data` when `out.samples` is set: each becomes a sample
+// channel, timed by the top-level "rate_hz" and "t0_ms", and its last sample is
+// also stored as a field of the same name.
+//
+// With a plan, only its fields are kept and each is checked against type, range and
+// enum as it is read; "device_id"/"type" must equal the plan's consts. The first
+// violation rejects the whole payload: false, empty fields, and `verdict` says why.
+bool DecodeTelemetry(const char* p, std::size_t n, const DecodePlan* plan, DecodedTelemetry& out);
+inline bool DecodeTelemetry(const char* p, std::size_t n, DecodedTelemetry& out) {
+    return DecodeTelemetry(p, n, nullptr, out);
+}
+inline bool DecodeTelemetry(const std::string& payload, const DecodePlan* plan, DecodedTelemetry& out) {
+    return DecodeTelemetry(payload.data(), payload.size(), plan, out);
+}
+inline bool DecodeTelemetry(const std::string& payload, DecodedTelemetry& out) {
+    return DecodeTelemetry(payload.data(), payload.size(), nullptr, out);
+}
+
+// The same envelope in binary form: a map with text keys (or a bare number), with
+// the same plan checks. Integer-keyed maps are not supported; their members are skipped.
+bool DecodeCborTelemetry(const char* p, std::size_t n, const DecodePlan* plan, DecodedTelemetry& out);
+bool DecodeMsgpackTelemetry(const char* p, std::size_t n, const DecodePlan* plan, DecodedTelemetry& out);
+
+bool DecodePayload(PayloadFormat format, const char* p, std::size_t n, const DecodePlan* plan,
+                   DecodedTelemetry& out);
+inline bool DecodePayload(PayloadFormat format, const std::string& payload, const DecodePlan* plan,
+                          DecodedTelemetry& out) {
+    return DecodePayload(format, payload.data(), payload.size(), plan, out);
+}
+
+}  // namespace codec
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,313 @@
+#include "core/device/derived/expression.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <utility>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace derived {
+
+constexpr std::size_t Expression::kMaxStack;
+
+namespace {
+
+static bool IsIdentChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+}  // namespace
+
+// Recursive descent straight into postfix code, tracking the stack depth it needs.
+class ExpressionParser {
+public:
+    ExpressionParser(const std::string& text, Expression& out) : s_(text), out_(out) {}
+
+    bool Run(std::string& error) {
+        if (!Sum()) return Fail(error);
+        Skip();
+        if (pos_ != s_.size()) {
+            msg_ = "unexpected '" + std::string(1, s_[pos_]) + "'";
+            return Fail(error);
+        }
+        return true;
+    }
+
+private:
+    using Op = Expression::Op;
+
+    bool Fail(std::string& error) {
+        error = msg_ + " at offset " + std::to_string(pos_);
+        return false;
+    }
+
+    void Skip() {
+        while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t')) ++pos_;
+    }
+
+    bool Eat(char c) {
+        Skip();
+        if (pos_ < s_.size() && s_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool Expect(char c) {
+        if (Eat(c)) return true;
+        msg_ = std::string("expected '") + c + "'";
+        return false;
+    }
+
+    bool Emit(Op op, std::uint32_t input = 0, double number = 0.0) {
+        Expression::Instr in;
+        in.op = op;
+        in.input = input;
+        in.number = number;
+        out_.code_.push_back(in);
+        // Operands push one value, unary ops keep the depth, binary ops pop one.
+        if (op == Op::kConst || op == Op::kInput) {
+            if (++depth_ > Expression::kMaxStack) {
+                msg_ = "expression too deep";
+                return false;
+            }
+        } else if (op == Op::kAdd || op == Op::kSub || op == Op::kMul || op == Op::kDiv || op == Op::kPow ||
+                   op == Op::kMin || op == Op::kMax) {
+            --depth_;
+        }
+        return true;
+    }
+
+    // sum := product (('+' | '-') product)*
+    bool Sum() {
+        if (!Product()) return false;
+        while (true) {
+            if (Eat('+')) {
+                if (!Product() || !Emit(Op::kAdd)) return false;
+            } else if (Eat('-')) {
+                if (!Product() || !Emit(Op::kSub)) return false;
+            } else {
+                return true;
+            }
+        }
+    }
+
+    // product := unary (('*' | '/') unary)*
+    bool Product() {
+        if (!Unary()) return false;
+        while (true) {
+            if (Eat('*')) {
+                if (!Unary() || !Emit(Op::kMul)) return false;
+            } else if (Eat('/')) {
+                if (!Unary() || !Emit(Op::kDiv)) return false;
+            } else {
+                return true;
+            }
+        }
+    }
+
+    // unary := '-' unary | power
+    bool Unary() {
+        if (Eat('-')) return Unary() && Emit(Op::kNeg);
+        if (Eat('+')) return Unary();
+        return Power();
+    }
+
+    // power := primary ('^' unary)?
+    bool Power() {
+        if (!Primary()) return false;
+        if (Eat('^')) return Unary() && Emit(Op::kPow);
+        return true;
+    }
+
+    bool Primary() {
+        Skip();
+        if (pos_ >= s_.size()) {
+            msg_ = "unexpected end";
+            return false;
+        }
+        const char c = s_[pos_];
+        if (c == '(') {
+            ++pos_;
+            return Sum() && Expect(')');
+        }
+        if ((c >= '0' && c <= '9') || c == '.') return Number();
+        if (c == '`') {
+            std::string device;
+            if (!Quoted(device)) return false;
+            return Reference(std::move(device));
+        }
+        if (!IsIdentChar(c)) {
+            msg_ = "unexpected '" + std::string(1, c) + "'";
+            return false;
+        }
+        const std::size_t start = pos_;
+        while (pos_ < s_.size() && IsIdentChar(s_[pos_])) ++pos_;
+        std::string name = s_.substr(start, pos_ - start);
+        Skip();
+        if (pos_ < s_.size() && s_[pos_] == '(') return Call(name);
+        return Reference(std::move(name));
+    }
+
+    bool Number() {
+        const char* begin = s_.c_str() + pos_;
+        char* end = nullptr;
+        const double v = std::strtod(begin, &end);
+        if (end == begin) {
+            msg_ = "bad number";
+            return false;
+        }
+        pos_ += static_cast<std::size_t>(end - begin);
+        return Emit(Op::kConst, 0, v);
+    }
+
+    bool Quoted(std::string& out) {
+        const std::size_t close = s_.find('`', pos_ + 1);
+        if (close == std::string::npos || close == pos_ + 1) {
+            msg_ = "bad quoted id";
+            return false;
+        }
+        out = s_.substr(pos_ + 1, close - pos_ - 1);
+        pos_ = close + 1;
+        return true;
+    }
+
+    bool Reference(std::string device) {
+        std::string field = "value";
+        if (pos_ < s_.size() && s_[pos_] == '.') {
+            const std::size_t start = ++pos_;
+            while (pos_ < s_.size() && IsIdentChar(s_[pos_])) ++pos_;
+            if (pos_ == start) {
+                msg_ = "missing field name";
+                return false;
+            }
+            field = s_.substr(start, pos_ - start);
+        }
+        auto& inputs = out_.inputs_;
+        std::uint32_t idx = 0;
+        while (idx < inputs.size() && !(inputs[idx].device == device && inputs[idx].field == field)) ++idx;
+        if (idx == inputs.size()) {
+            FieldRef r;
+            r.device = std::move(device);
+            r.field = std::move(field);
+            inputs.push_back(std::move(r));
+        }
+        return Emit(Op::kInput, idx);
+    }
+
+    bool Call(const std::string& name) {
+        ++pos_;  // '('
+        Op op = Op::kAbs;
+        bool binary = false;
+        if (name == "abs") {
+            op = Op::kAbs;
+        } else if (name == "sqrt") {
+            op = Op::kSqrt;
+        } else if (name == "exp") {
+            op = Op::kExp;
+        } else if (name == "log" || name == "ln") {
+            op = Op::kLog;
+        } else if (name == "min") {
+            op = Op::kMin;
+            binary = true;
+        } else if (name == "max") {
+            op = Op::kMax;
+            binary = true;
+        } else if (name == "pow") {
+            op = Op::kPow;
+            binary = true;
+        } else {
+            msg_ = "unknown function " + name;
+            return false;
+        }
+        if (!Sum()) return false;
+        if (binary && !(Expect(',') && Sum())) return false;
+        return Expect(')') && Emit(op);
+    }
+
+private:
+    const std::string& s_;
+    Expression& out_;
+    std::size_t pos_ = 0;
+    std::size_t depth_ = 0;
+    std::string msg_;
+};
+
+bool Expression::Compile(const std::string& text, Expression& out, std::string& error) {
+    Expression e;
+    e.text_ = text;
+    ExpressionParser p(text, e);
+    if (!p.Run(error)) {
+        out = Expression();
+        return false;
+    }
+    out = std::move(e);
+    return true;
+}
+
+double Expression::Evaluate(const double* inputs) const {
+    double stack[kMaxStack];
+    std::size_t sp = 0;
+    for (const auto& in : code_) {
+        switch (in.op) {
+            case Op::kConst:
+                stack[sp++] = in.number;
+                break;
+            case Op::kInput:
+                stack[sp++] = inputs[in.input];
+                break;
+            case Op::kAdd:
+                --sp;
+                stack[sp - 1] += stack[sp];
+                break;
+            case Op::kSub:
+                --sp;
+                stack[sp - 1] -= stack[sp];
+                break;
+            case Op::kMul:
+                --sp;
+                stack[sp - 1] *= stack[sp];
+                break;
+            case Op::kDiv:
+                --sp;
+                stack[sp - 1] /= stack[sp];
+                break;
+            case Op::kPow:
+                --sp;
+                stack[sp - 1] = std::pow(stack[sp - 1], stack[sp]);
+                break;
+            case Op::kMin:
+                --sp;
+                stack[sp - 1] = std::fmin(stack[sp - 1], stack[sp]);
+                break;
+            case Op::kMax:
+                --sp;
+                stack[sp - 1] = std::fmax(stack[sp - 1], stack[sp]);
+                break;
+            case Op::kNeg:
+                stack[sp - 1] = -stack[sp - 1];
+                break;
+            case Op::kAbs:
+                stack[sp - 1] = std::fabs(stack[sp - 1]);
+                break;
+            case Op::kSqrt:
+                stack[sp - 1] = std::sqrt(stack[sp - 1]);
+                break;
+            case Op::kExp:
+                stack[sp - 1] = std::exp(stack[sp - 1]);
+                break;
+            case Op::kLog:
+                stack[sp - 1] = std::log(stack[sp - 1]);
+                break;
+        }
+    }
+    return sp == 1 ? stack[0] : NAN;
+}
+
+}  // namespace derived
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
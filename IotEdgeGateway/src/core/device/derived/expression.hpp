@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace derived {
+
+// A field of a device read by an expression, e.g. `temp` (its "value") or `meter_1.power`.
+struct FieldRef {
+    std::string device;
+    std::string field;
+};
+
+// Arithmetic over device fields, compiled once into postfix code:
+//   numbers, + - * / ^ (right-associative), unary minus, parentheses,
+//   abs(x) sqrt(x) exp(x) log(x) min(a, b) max(a, b) pow(a, b),
+//   references `device` or `device.field`; ids with other characters than
+//   letters, digits and '_' are quoted in backticks: `vib-1`.rms
+class Expression {
+public:
+    static constexpr std::size_t kMaxStack = 32;
+
+    // On failure `error` says what and where, and `out` is left empty.
+    static bool Compile(const std::string& text, Expression& out, std::string& error);
+
+    // Distinct references in order of first use; Evaluate reads inputs[i] for Inputs()[i].
+    const std::vector<FieldRef>& Inputs() const { return inputs_; }
+    const std::string& Text() const { return text_; }
+    bool Empty() const { return code_.empty(); }
+
+    double Evaluate(const double* inputs) const;
+
+private:
+    enum class Op : std::uint8_t {
+        kConst,
+        kInput,
+        kAdd,
+        kSub,
+        kMul,
+        kDiv,
+        kPow,
+        kNeg,
+        kAbs,
+        kSqrt,
+        kExp,
+        kLog,
+        kMin,
+        kMax,
+    };
+
+    struct Instr {
+        Op op = Op::kConst;
+        std::uint32_t input = 0;
+        double number = 0.0;
+    };
+
+    friend class ExpressionParser;
+
+private:
+    std::string text_;
+    std::vector<Instr> code_;
+    std::vector<FieldRef> inputs_;
+};
+
+}  // namespace derived
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
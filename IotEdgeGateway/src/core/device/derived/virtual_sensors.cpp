@@ -0,0 +1,174 @@
+#include "core/device/derived/virtual_sensors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace derived {
+
+constexpr std::uint32_t VirtualSensors::kNone;
+
+std::uint32_t VirtualSensors::SlotOf(const std::string& device, const std::string& field, bool create) {
+    auto& list = by_device_[device];
+    for (const std::uint32_t s : list) {
+        if (slots_[s].field == field) return s;
+    }
+    if (!create) {
+        if (list.empty()) by_device_.erase(device);
+        return kNone;
+    }
+    const auto s = static_cast<std::uint32_t>(slots_.size());
+    Slot slot;
+    slot.device = device;
+    slot.field = field;
+    slots_.push_back(std::move(slot));
+    list.push_back(s);
+    return s;
+}
+
+bool VirtualSensors::Add(const std::string& id, const std::string& expression, std::string& error) {
+    if (id.empty()) {
+        error = "empty id";
+        return false;
+    }
+    if (Has(id)) {
+        error = "duplicate id " + id;
+        return false;
+    }
+    Node n;
+    n.id = id;
+    if (!Expression::Compile(expression, n.expr, error)) return false;
+    const auto index = static_cast<std::uint32_t>(nodes_.size());
+    for (const auto& ref : n.expr.Inputs()) {
+        const std::uint32_t s = SlotOf(ref.device, ref.field, true);
+        slots_[s].readers.push_back(index);
+        n.slots.push_back(s);
+    }
+    by_id_.emplace(id, index);
+    nodes_.push_back(std::move(n));
+    return true;
+}
+
+std::size_t VirtualSensors::Build(std::vector<std::string>& errors) {
+    const std::size_t n = nodes_.size();
+
+    // Kahn's algorithm over "reads the value of" edges between virtual sensors.
+    std::vector<std::uint32_t> pending(n, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (const std::uint32_t s : nodes_[i].slots) {
+            const auto it = by_id_.find(slots_[s].device);
+            if (it == by_id_.end()) continue;
+            if (slots_[s].field != "value") {
+                errors.push_back(nodes_[i].id + ": virtual sensor " + slots_[s].device + " has only `value`");
+            }
+            ++pending[i];
+        }
+    }
+    std::vector<std::uint32_t> order;
+    order.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (pending[i] == 0) order.push_back(static_cast<std::uint32_t>(i));
+    }
+    for (std::size_t k = 0; k < order.size(); ++k) {
+        const std::uint32_t own = SlotOf(nodes_[order[k]].id, "value", false);
+        if (own == kNone) continue;
+        for (const std::uint32_t r : slots_[own].readers) {
+            if (--pending[r] == 0) order.push_back(r);
+        }
+    }
+
+    std::vector<std::uint32_t> rank(n, kNone);
+    for (std::size_t k = 0; k < order.size(); ++k) rank[order[k]] = static_cast<std::uint32_t>(k);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (rank[i] == kNone) errors.push_back(nodes_[i].id + ": on or fed by a dependency cycle, dropped");
+    }
+
+    std::vector<Node> sorted;
+    sorted.reserve(order.size());
+    for (const std::uint32_t i : order) sorted.push_back(std::move(nodes_[i]));
+    nodes_ = std::move(sorted);
+    by_id_.clear();
+    for (std::size_t k = 0; k < nodes_.size(); ++k) by_id_.emplace(nodes_[k].id, static_cast<std::uint32_t>(k));
+    for (auto& slot : slots_) {
+        std::vector<std::uint32_t> readers;
+        for (const std::uint32_t r : slot.readers) {
+            if (rank[r] != kNone) readers.push_back(rank[r]);
+        }
+        std::sort(readers.begin(), readers.end());
+        slot.readers = std::move(readers);
+    }
+    for (auto& node : nodes_) node.own_slot = SlotOf(node.id, "value", false);
+
+    marked_.assign((nodes_.size() + 63) / 64, 0);
+    marked_count_ = 0;
+    return nodes_.size();
+}
+
+void VirtualSensors::SetSlot(std::uint32_t slot, double value) {
+    auto& s = slots_[slot];
+    s.value = value;
+    s.known = true;
+    ++stats_.updates;
+    for (const std::uint32_t r : s.readers) {
+        std::uint64_t& word = marked_[r / 64];
+        const std::uint64_t bit = static_cast<std::uint64_t>(1) << (r % 64);
+        if ((word & bit) != 0) continue;
+        word |= bit;
+        ++marked_count_;
+    }
+}
+
+std::size_t VirtualSensors::Update(const std::string& device_id, const model::FieldTable& fields) {
+    const auto it = by_device_.find(device_id);
+    if (it == by_device_.end()) return 0;
+    const std::size_t before = marked_count_;
+    for (const std::uint32_t s : it->second) {
+        const auto* v = fields.Find(slots_[s].field);
+        if (v == nullptr || (slots_[s].known && slots_[s].value == v->number)) continue;
+        SetSlot(s, v->number);
+    }
+    return marked_count_ - before;
+}
+
+std::size_t VirtualSensors::Flush(const Handler& on_value) {
+    std::size_t produced = 0;
+    // A sensor only marks sensors of higher rank, so one upward pass sees every mark.
+    for (std::size_t w = 0; w < marked_.size() && marked_count_ != 0; ++w) {
+        while (marked_[w] != 0) {
+            const auto bit = static_cast<std::size_t>(__builtin_ctzll(marked_[w]));
+            marked_[w] &= marked_[w] - 1;
+            --marked_count_;
+            const Node& node = nodes_[w * 64 + bit];
+
+            scratch_.resize(node.slots.size());
+            bool ready = true;
+            for (std::size_t i = 0; i < node.slots.size() && ready; ++i) {
+                const auto& s = slots_[node.slots[i]];
+                ready = s.known;
+                scratch_[i] = s.value;
+            }
+            const double v = ready ? node.expr.Evaluate(scratch_.data()) : 0.0;
+            if (!ready || !std::isfinite(v)) {
+                ++stats_.skipped;
+                continue;
+            }
+            ++stats_.evaluations;
+            ++produced;
+            if (on_value) on_value(node.id, v);
+            if (node.own_slot != kNone && !(slots_[node.own_slot].known && slots_[node.own_slot].value == v)) {
+                SetSlot(node.own_slot, v);
+            }
+        }
+    }
+    return produced;
+}
+
+}  // namespace derived
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core/device/derived/expression.hpp"
+#include "core/device/model/field_table.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace derived {
+
+// Sensors computed from other sensors, e.g. a dew point from `temp` and `humi`. Their
+// expressions may read other virtual sensors (their "value"), which makes a DAG.
+//
+// Recomputation is incremental: Update() records the fields of a device that changed
+// and marks only the sensors depending on them; Flush() evaluates each marked sensor
+// once, in topological order, so a sensor reached by several paths (or several changed
+// inputs) in one ingest is computed once, after all of its inputs.
+class VirtualSensors {
+public:
+    using Handler = std::function<void(const std::string& id, double value)>;
+
+    struct Stats {
+        std::uint64_t updates = 0;      // input fields that changed
+        std::uint64_t evaluations = 0;  // sensors recomputed
+        std::uint64_t skipped = 0;      // marked but an input is still unknown, or the result is not finite
+    };
+
+    // Compiles the expression; the graph is ordered by Build().
+    bool Add(const std::string& id, const std::string& expression, std::string& error);
+    // Orders the sensors by dependency. Sensors on a cycle (or fed by one) are
+    // dropped and reported in `errors`. Returns the number kept.
+    std::size_t Build(std::vector<std::string>& errors);
+
+    std::size_t Size() const { return nodes_.size(); }
+    const std::string& IdAt(std::size_t i) const { return nodes_[i].id; }
+    const Expression& ExpressionAt(std::size_t i) const { return nodes_[i].expr; }
+    bool Has(const std::string& id) const { return by_id_.find(id) != by_id_.end(); }
+
+    // Whether any sensor reads this device, to skip Update() cheaply.
+    bool Reads(const std::string& device_id) const { return by_device_.find(device_id) != by_device_.end(); }
+
+    // Takes the current fields of a device; returns how many sensors it marked.
+    std::size_t Update(const std::string& device_id, const model::FieldTable& fields);
+    // Recomputes every marked sensor once, inputs first; returns how many produced a value.
+    std::size_t Flush(const Handler& on_value);
+
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    static constexpr std::uint32_t kNone = static_cast<std::uint32_t>(-1);
+
+    struct Node {
+        std::string id;
+        Expression expr;
+        std::vector<std::uint32_t> slots;  // input slot of each expression input
+        std::uint32_t own_slot = kNone;    // its "value" as read by other sensors
+    };
+
+    // One distinct device field read by any expression, with its last value.
+    struct Slot {
+        std::string device;
+        std::string field;
+        double value = 0.0;
+        bool known = false;
+        std::vector<std::uint32_t> readers;  // nodes reading it
+    };
+
+    std::uint32_t SlotOf(const std::string& device, const std::string& field, bool create);
+    void SetSlot(std::uint32_t slot, double value);
+
+private:
+    std::vector<Node> nodes_;  // in topological order once built, so an index is a rank
+    std::vector<Slot> slots_;
+    std::unordered_map<std::string, std::uint32_t> by_id_;
+    std::unordered_map<std::string, std::vector<std::uint32_t>> by_device_;  // slots of a device
+    // Marked nodes by rank; a bitmap walked upward, since marking only ever adds later ranks.
+    std::vector<std::uint64_t> marked_;
+    std::size_t marked_count_ = 0;
+    std::vector<double> scratch_;
+    Stats stats_;
+};
+
+}  // namespace derived
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
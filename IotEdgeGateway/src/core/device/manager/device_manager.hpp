@@ -1,11 +1,18 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "core/common/utils/json_writer.hpp"
+#include "core/common/utils/topic_trie.hpp"
+#include "core/device/codec/decode_plan.hpp"
+#include "core/device/codec/payload_format.hpp"
+#include "core/device/codec/sample_batch.hpp"
 #include "core/device/model/device_entity.hpp"
 
 namespace iotgw {
@@ -13,37 +20,256 @@ namespace core {
 namespace device {
 namespace manager {
 
+// Index of a device in the registry. Devices are never removed, so a handle stays valid.
+using DeviceHandle = std::size_t;
+constexpr DeviceHandle kInvalidDevice = static_cast<DeviceHandle>(-1);
+
+enum class RouteType { kTelemetry, kCommand };
+
+// What a topic means to the gateway.
+struct TopicRoute {
+    RouteType type = RouteType::kTelemetry;
+    DeviceHandle device = kInvalidDevice;  // invalid when a template names a device that is not registered yet
+    std::string device_id;
+    std::string device_kind;
+    codec::PayloadFormat format = codec::PayloadFormat::kJson;  // the template's, for template routes
+    bool from_template = false;
+};
+
+// Report-by-exception. A report whose fields all stay within the band around the
+// values last passed on is absorbed: it only refreshes the device's liveness.
+// The band of a number is max(absolute, percent of the last value); any change of
+// a bool passes. With both at 0 only exact repeats are absorbed.
+struct Deadband {
+    bool enabled = false;
+    double absolute = 0.0;
+    double percent = 0.0;
+    std::int64_t max_silence_ms = 0;  // an unchanged report still passes after this long; 0: never
+};
+
+// Ingestion counters across all devices.
+struct IngestStats {
+    std::uint64_t accepted = 0;
+    std::uint64_t suppressed = 0;  // accepted but within the deadband
+    std::uint64_t validated = 0;       // accepted payloads checked against a plan
+    std::uint64_t unknown_fields = 0;  // `data` members not in the plan, skipped
+    std::uint64_t rejected[codec::kVerdictCount] = {};  // by codec::Verdict
+};
+
+// A device listing: filters and one page. Pages follow id order, so the cursor (the
+// last id of the previous page) stays valid while devices come and go online.
+struct DeviceQuery {
+    enum class Online { kAny, kOnline, kOffline };
+
+    std::string kind;       // empty: any
+    std::string transport;  // empty: any
+    Online online = Online::kAny;
+    std::string after;      // cursor: ids greater than this; empty: from the first
+    std::size_t limit = 0;  // 0: no limit
+};
+
+// Members of a device that a listing renders; see DeviceRegistry::ParseFieldMask.
+using DeviceFieldMask = std::uint32_t;
+constexpr DeviceFieldMask kAllDeviceFields = ~DeviceFieldMask(0);
+
 class DeviceRegistry {
 public:
+    // Looks up a decode plan by device id. Plans are resolved once per device, on
+    // registration, and must outlive the registry.
+    using PlanLookup = std::function<const codec::DecodePlan*(const std::string& device_id)>;
+    void SetPlanLookup(PlanLookup lookup);
+
+    // Receives the sample channels (numeric arrays of `data`) of every accepted payload
+    // that has any. Without a handler such arrays are skipped. The batch is reused for
+    // the next payload, so the handler must consume it before returning.
+    using SampleHandler =
+        std::function<void(DeviceHandle h, const codec::SampleBatch& batch, std::int64_t now_ms)>;
+    void SetSampleHandler(SampleHandler handler) { sample_handler_ = std::move(handler); }
+
+    // For devices without a deadband of their own, including ones discovered later.
+    void SetDefaultDeadband(const Deadband& db);
+    const Deadband& DefaultDeadband() const { return default_deadband_; }
+    bool SetDeadband(DeviceHandle h, const Deadband& db);
+
+    // How stale liveness may be in a rendered copy: reports that change nothing but
+    // `last_seen_ms` and the counters move the revision at most once per this many ms.
+    // 0: every report does.
+    void SetLivenessResolution(std::int64_t ms) { liveness_resolution_ms_ = ms > 0 ? ms : 0; }
+
     bool Register(model::DeviceEntity device);
     bool Has(const std::string& id) const;
 
+    DeviceHandle Find(const std::string& id) const;
+    const model::DeviceEntity* At(DeviceHandle h) const;
+
+    // Pattern with an `{id}` level and optionally `{kind}`, e.g. "iotgw/dev/{kind}/{id}".
+    // Without `{kind}` the template's `device_kind` is used. Devices it discovers
+    // speak `format` unless their own config says otherwise.
+    bool AddTopicTemplate(const std::string& pattern, RouteType type, const std::string& device_kind = "",
+                          codec::PayloadFormat format = codec::PayloadFormat::kJson);
+
+    // Device topics win over templates; among templates the most specific pattern wins.
+    bool Resolve(const std::string& topic, TopicRoute& out) const;
+
     bool Get(const std::string& id, model::DeviceEntity& out) const;
     std::vector<model::DeviceEntity> List() const;
 
+    // Both return false when the payload is rejected by the device's plan; the device
+    // is still marked online, but its fields keep their previous values. `out_changed`
+    // is cleared when an accepted report falls within the device's deadband, which
+    // leaves everything but liveness alone. `out_fields` gets the fields decoded from this
+    // report when it was accepted and passed on, and is empty otherwise: unlike the device's
+    // merged table, it holds no values from earlier reports.
     bool UpdateFromTelemetryTopic(const std::string& topic, const std::string& payload, std::int64_t now_ms,
-                                  std::string& out_device_id);
+                                  std::string& out_device_id, bool* out_changed = nullptr,
+                                  model::FieldTable* out_fields = nullptr);
     bool UpsertMqttDeviceFromTopic(const std::string& topic, const std::string& payload, std::int64_t now_ms,
-                                   std::string& out_device_id);
+                                   std::string& out_device_id, bool* out_changed = nullptr,
+                                   model::FieldTable* out_fields = nullptr);
+
+    // Marks the online devices not seen for `timeout_ms` offline and returns how many;
+    // their next report brings them back. Costs the number of online devices.
+    std::size_t ExpireOnline(std::int64_t now_ms, std::int64_t timeout_ms);
+
+    // Stores a value the gateway computed itself (a virtual sensor) as the device's "value".
+    bool SetValue(DeviceHandle h, double value, std::int64_t now_ms);
 
     bool GetCommandTopic(const std::string& device_id, std::string& out_topic) const;
     bool GetTelemetryTopic(const std::string& device_id, std::string& out_topic) const;
+    // Wire format of the device's telemetry and commands; json for unknown devices.
+    codec::PayloadFormat PayloadFormatOf(DeviceHandle h) const;
+    const codec::DecodePlan* PlanOf(DeviceHandle h) const;
+
+    // Devices sorted by id, as a JSON array.
+    void WriteJsonList(iotgw::core::common::json::Writer& w) const;
+    // `handles` as a JSON array, with only the members in `mask`.
+    void WriteJsonList(const std::vector<DeviceHandle>& handles, DeviceFieldMask mask,
+                       iotgw::core::common::json::Writer& w) const;
+    bool WriteJsonOne(const std::string& id, iotgw::core::common::json::Writer& w) const;
+
+    // Devices matching `q`, in id order, appended to `out`. Walks the smallest of the
+    // kind, transport and online indexes the query names, from the cursor on, and stops
+    // at the limit; the devices it skips are only those of that index that fail the other
+    // filters. Returns true if more matches follow the page.
+    bool Select(const DeviceQuery& q, std::vector<DeviceHandle>& out) const;
+
+    // Parses a comma-separated member list such as "id,kind,status.last_seen_ms": top
+    // level members, "status" or "status.<member>", and "fields". False on an unknown name.
+    static bool ParseFieldMask(const std::string& list, DeviceFieldMask& out);
+
+    const IngestStats& GetIngestStats() const { return stats_; }
 
-    std::string ToJsonList() const;
-    bool ToJsonOne(const std::string& id, std::string& out_json) const;
+    // Change tracking for push feeds. Every update that changes a field value or the online
+    // flag takes the next registry-wide version, stamped on the device and on each field
+    // (or the flag) it changed.
+    std::uint64_t Version() const { return version_; }
+    std::uint64_t VersionOf(DeviceHandle h) const;
+    // Version of the field in slot `index` of the device's field table; 0 if never changed.
+    std::uint64_t FieldVersionOf(DeviceHandle h, std::size_t index) const;
+    // Version of the last online/offline transition; 0 if never seen.
+    std::uint64_t OnlineVersionOf(DeviceHandle h) const;
+    // Devices changed after `version`, most recent first, appended to `out`; costs
+    // the number of such devices, not the registry size.
+    void ChangedSince(std::uint64_t version, std::vector<DeviceHandle>& out) const;
+
+    // Revision of what WriteJsonList/WriteJsonOne render: moves on with every change to
+    // the device's fields, payload, topic or online state. Liveness and counters alone move
+    // it once per liveness resolution, so a rendered copy may show `last_seen_ms`,
+    // `suppressed` and `rejected` up to that much behind.
+    std::uint64_t Revision() const { return revision_; }
+    std::uint64_t RevisionOf(DeviceHandle h) const { return h < ingest_.size() ? ingest_[h].revision : 0; }
+
+private:
+    void WriteDevice(DeviceHandle h, DeviceFieldMask mask, iotgw::core::common::json::Writer& w) const;
 
 private:
-    static std::string JsonEscape(const std::string& s);
-    static std::string JsonQuote(const std::string& s);
-    static std::string Bool(bool v);
-    static std::string Number(std::int64_t v);
+    struct RouteEntry {
+        RouteType type = RouteType::kTelemetry;
+        DeviceHandle device = kInvalidDevice;
+        std::size_t template_index = 0;
+
+        bool operator==(const RouteEntry& o) const {
+            return type == o.type && device == o.device && template_index == o.template_index;
+        }
+    };
+
+    struct TopicTemplate {
+        std::string pattern;
+        RouteType type = RouteType::kTelemetry;
+        std::string device_kind;
+        codec::PayloadFormat format = codec::PayloadFormat::kJson;
+    };
+
+    // How a device's payloads are decoded, resolved on registration.
+    struct Ingest {
+        const codec::DecodePlan* plan = nullptr;
+        codec::PayloadFormat format = codec::PayloadFormat::kJson;
+        bool explicit_format = false;  // set by the device's own config
+        Deadband deadband;
+        bool own_deadband = false;
+        std::int64_t last_pass_ms = 0;  // last report passed on
+        std::uint64_t version = 0;
+        std::uint64_t field_versions[model::FieldTable::kMaxFields] = {};
+        std::uint64_t online_version = 0;
+        // Neighbours in the list of devices ordered by version.
+        DeviceHandle newer = kInvalidDevice;
+        DeviceHandle older = kInvalidDevice;
+        std::uint64_t revision = 0;
+        std::int64_t revised_ms = 0;  // report time of the last revision
+        const std::string* id = nullptr;  // key in by_id_
+    };
+
+    // Handle ordered by device id, for the secondary indexes. `id` is the device's key
+    // in by_id_, whose nodes never move.
+    struct IdKey {
+        const std::string* id = nullptr;
+        DeviceHandle h = kInvalidDevice;
+
+        bool operator<(const IdKey& o) const { return *id < *o.id; }
+    };
+    using IdIndex = std::set<IdKey>;
 
-    std::string DeviceToJson(const model::DeviceEntity& d) const;
+    void BindTopic(const std::string& topic, RouteType type, DeviceHandle h);
+    void UnbindTopic(const std::string& topic, RouteType type, DeviceHandle h);
+    bool Touch(DeviceHandle h, const std::string& topic, const std::string& payload, std::int64_t now_ms,
+               std::string& out_device_id, bool* out_changed, model::FieldTable* out_fields);
+    void Bump(DeviceHandle h) { ingest_[h].revision = ++revision_; }
+    // Bumps for a report: always if it `changed` what is rendered, else per liveness resolution.
+    void Revise(DeviceHandle h, std::int64_t now_ms, bool changed);
+    IdKey KeyOf(DeviceHandle h) const { return IdKey{ingest_[h].id, h}; }
+    static void IndexErase(std::unordered_map<std::string, IdIndex>& index, const std::string& value, IdKey key);
+    void MarkOnline(DeviceHandle h);
+    // Makes `v` the registry's and the device's version and moves the device to the head
+    // of the version list.
+    void Stamp(DeviceHandle h, std::uint64_t v);
+    // Merges `fields` into the device's table and versions what actually changed.
+    void MergeFields(DeviceHandle h, const model::FieldTable& fields);
+    bool WithinDeadband(DeviceHandle h, const model::FieldTable& fields, const std::string& payload,
+                        std::int64_t now_ms) const;
+    // Handles ordered by id; rebuilt only after a device is added.
+    const std::vector<DeviceHandle>& SortedHandles() const;
 
 private:
-    std::unordered_map<std::string, model::DeviceEntity> by_id_;
-    std::unordered_map<std::string, std::string> telemetry_topic_to_id_;
-    std::unordered_map<std::string, std::string> command_topic_to_id_;
+    std::vector<model::DeviceEntity> devices_;
+    std::vector<Ingest> ingest_;  // by handle
+    PlanLookup plan_lookup_;
+    SampleHandler sample_handler_;
+    Deadband default_deadband_;
+    codec::SampleBatch samples_;  // decode scratch, reused
+    IngestStats stats_;
+    std::uint64_t version_ = 0;
+    std::uint64_t revision_ = 0;
+    std::int64_t liveness_resolution_ms_ = 0;
+    DeviceHandle newest_ = kInvalidDevice;
+    std::unordered_map<std::string, DeviceHandle> by_id_;
+    mutable std::vector<DeviceHandle> sorted_;
+    // Secondary indexes for listings, each ordered by id.
+    std::unordered_map<std::string, IdIndex> by_kind_;
+    std::unordered_map<std::string, IdIndex> by_transport_;
+    IdIndex online_;
+    IdIndex offline_;
+    std::vector<TopicTemplate> templates_;
+    iotgw::core::common::topic::TopicTrie<RouteEntry> routes_;
 };
 
 }  // namespace manager
@@ -1,77 +1,436 @@
 #include "core/device/manager/device_manager.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "core/device/codec/telemetry_decoder.hpp"
+
 namespace iotgw {
 namespace core {
 namespace device {
 namespace manager {
 
+namespace {
+
+// Bits of DeviceFieldMask.
+enum : DeviceFieldMask {
+    kMemberId = 1u << 0,
+    kMemberKind = 1u << 1,
+    kMemberTransport = 1u << 2,
+    kMemberTelemetryTopic = 1u << 3,
+    kMemberCommandTopic = 1u << 4,
+    kMemberPayloadFormat = 1u << 5,
+    kMemberOnline = 1u << 6,
+    kMemberLastSeen = 1u << 7,
+    kMemberLastTopic = 1u << 8,
+    kMemberLastPayload = 1u << 9,
+    kMemberRejected = 1u << 10,
+    kMemberLastReject = 1u << 11,
+    kMemberSuppressed = 1u << 12,
+    kMemberFields = 1u << 13,
+};
+constexpr DeviceFieldMask kMemberStatus = kMemberOnline | kMemberLastSeen | kMemberLastTopic | kMemberLastPayload |
+                                          kMemberRejected | kMemberLastReject | kMemberSuppressed;
+
+struct MemberName {
+    const char* name;
+    DeviceFieldMask bits;
+};
+
+const MemberName kMemberNames[] = {
+    {"id", kMemberId},
+    {"kind", kMemberKind},
+    {"transport", kMemberTransport},
+    {"telemetry_topic", kMemberTelemetryTopic},
+    {"command_topic", kMemberCommandTopic},
+    {"payload_format", kMemberPayloadFormat},
+    {"status", kMemberStatus},
+    {"status.online", kMemberOnline},
+    {"status.last_seen_ms", kMemberLastSeen},
+    {"status.last_topic", kMemberLastTopic},
+    {"status.last_payload", kMemberLastPayload},
+    {"status.rejected", kMemberRejected},
+    {"status.last_reject", kMemberLastReject},
+    {"status.suppressed", kMemberSuppressed},
+    {"fields", kMemberFields},
+};
+
+}  // namespace
+
 bool DeviceRegistry::Register(model::DeviceEntity device) {
     if (device.id.empty()) return false;
-    const std::string id = device.id;
-    auto it = by_id_.find(id);
+    const auto it = by_id_.find(device.id);
+    DeviceHandle h = kInvalidDevice;
     if (it != by_id_.end()) {
-        const std::string old_telemetry = it->second.telemetry_topic;
-        const std::string old_command = it->second.command_topic;
+        h = it->second;
+        auto& d = devices_[h];
+        UnbindTopic(d.telemetry_topic, RouteType::kTelemetry, h);
+        UnbindTopic(d.command_topic, RouteType::kCommand, h);
 
-        it->second.kind = std::move(device.kind);
-        it->second.transport = std::move(device.transport);
-        it->second.telemetry_topic = std::move(device.telemetry_topic);
-        it->second.command_topic = std::move(device.command_topic);
-
-        if (!old_telemetry.empty() && old_telemetry != it->second.telemetry_topic) {
-            telemetry_topic_to_id_.erase(old_telemetry);
+        const IdKey key = KeyOf(h);
+        if (d.kind != device.kind) {
+            IndexErase(by_kind_, d.kind, key);
+            by_kind_[device.kind].insert(key);
         }
-        if (!old_command.empty() && old_command != it->second.command_topic) {
-            command_topic_to_id_.erase(old_command);
+        if (d.transport != device.transport) {
+            IndexErase(by_transport_, d.transport, key);
+            by_transport_[device.transport].insert(key);
         }
+        d.kind = std::move(device.kind);
+        d.transport = std::move(device.transport);
+        d.telemetry_topic = std::move(device.telemetry_topic);
+        d.command_topic = std::move(device.command_topic);
+        if (!device.payload_format.empty()) d.payload_format = std::move(device.payload_format);
     } else {
-        by_id_.emplace(id, std::move(device));
+        h = devices_.size();
+        Ingest in;
+        in.id = &by_id_.emplace(device.id, h).first->first;
+        in.plan = plan_lookup_ ? plan_lookup_(device.id) : nullptr;
+        in.deadband = default_deadband_;
+        ingest_.push_back(in);
+        const IdKey key = KeyOf(h);
+        by_kind_[device.kind].insert(key);
+        by_transport_[device.transport].insert(key);
+        (device.status.online ? online_ : offline_).insert(key);
+        devices_.push_back(std::move(device));
     }
 
-    const auto& d = by_id_.find(id)->second;
-    if (!d.telemetry_topic.empty()) telemetry_topic_to_id_[d.telemetry_topic] = id;
-    if (!d.command_topic.empty()) command_topic_to_id_[d.command_topic] = id;
+    auto& in = ingest_[h];
+    in.explicit_format = codec::ParsePayloadFormat(devices_[h].payload_format, in.format);
+    if (!in.explicit_format) in.format = codec::PayloadFormat::kJson;
+
+    const auto& d = devices_[h];
+    BindTopic(d.telemetry_topic, RouteType::kTelemetry, h);
+    BindTopic(d.command_topic, RouteType::kCommand, h);
+    Bump(h);
+    return true;
+}
+
+void DeviceRegistry::SetPlanLookup(PlanLookup lookup) {
+    plan_lookup_ = std::move(lookup);
+    for (DeviceHandle h = 0; h < devices_.size(); ++h) {
+        ingest_[h].plan = plan_lookup_ ? plan_lookup_(devices_[h].id) : nullptr;
+    }
+}
+
+void DeviceRegistry::SetDefaultDeadband(const Deadband& db) {
+    default_deadband_ = db;
+    for (auto& in : ingest_) {
+        if (!in.own_deadband) in.deadband = db;
+    }
+}
+
+bool DeviceRegistry::SetDeadband(DeviceHandle h, const Deadband& db) {
+    if (h >= ingest_.size()) return false;
+    ingest_[h].deadband = db;
+    ingest_[h].own_deadband = true;
     return true;
 }
 
 bool DeviceRegistry::Has(const std::string& id) const { return by_id_.find(id) != by_id_.end(); }
 
-bool DeviceRegistry::Get(const std::string& id, model::DeviceEntity& out) const {
+DeviceHandle DeviceRegistry::Find(const std::string& id) const {
     const auto it = by_id_.find(id);
-    if (it == by_id_.end()) return false;
-    out = it->second;
+    return it == by_id_.end() ? kInvalidDevice : it->second;
+}
+
+const model::DeviceEntity* DeviceRegistry::At(DeviceHandle h) const {
+    return h < devices_.size() ? &devices_[h] : nullptr;
+}
+
+bool DeviceRegistry::Get(const std::string& id, model::DeviceEntity& out) const {
+    const auto* d = At(Find(id));
+    if (d == nullptr) return false;
+    out = *d;
     return true;
 }
 
 std::vector<model::DeviceEntity> DeviceRegistry::List() const {
     std::vector<model::DeviceEntity> out;
-    out.reserve(by_id_.size());
-    for (const auto& kv : by_id_) out.push_back(kv.second);
-    std::sort(out.begin(), out.end(),
-              [](const model::DeviceEntity& a, const model::DeviceEntity& b) { return a.id < b.id; });
+    out.reserve(devices_.size());
+    for (const DeviceHandle h : SortedHandles()) out.push_back(devices_[h]);
     return out;
 }
 
-bool DeviceRegistry::UpdateFromTelemetryTopic(const std::string& topic, const std::string& payload, std::int64_t now_ms,
-                                              std::string& out_device_id) {
-    const auto it = telemetry_topic_to_id_.find(topic);
-    if (it == telemetry_topic_to_id_.end()) return false;
-    const auto dit = by_id_.find(it->second);
-    if (dit == by_id_.end()) return false;
-    dit->second.status.online = true;
-    dit->second.status.last_seen_ms = now_ms;
-    dit->second.status.last_payload = payload;
-    dit->second.status.last_topic = topic;
-    out_device_id = dit->second.id;
+const std::vector<DeviceHandle>& DeviceRegistry::SortedHandles() const {
+    if (sorted_.size() == devices_.size()) return sorted_;
+    sorted_.resize(devices_.size());
+    for (DeviceHandle h = 0; h < devices_.size(); ++h) sorted_[h] = h;
+    std::sort(sorted_.begin(), sorted_.end(),
+              [this](DeviceHandle a, DeviceHandle b) { return devices_[a].id < devices_[b].id; });
+    return sorted_;
+}
+
+void DeviceRegistry::IndexErase(std::unordered_map<std::string, IdIndex>& index, const std::string& value,
+                                IdKey key) {
+    const auto it = index.find(value);
+    if (it == index.end()) return;
+    it->second.erase(key);
+    if (it->second.empty()) index.erase(it);
+}
+
+void DeviceRegistry::MarkOnline(DeviceHandle h) {
+    auto& status = devices_[h].status;
+    if (status.online) return;
+    status.online = true;
+    offline_.erase(KeyOf(h));
+    online_.insert(KeyOf(h));
+    ingest_[h].online_version = version_ + 1;
+    Stamp(h, version_ + 1);
+}
+
+std::size_t DeviceRegistry::ExpireOnline(std::int64_t now_ms, std::int64_t timeout_ms) {
+    if (timeout_ms <= 0) return 0;
+    std::size_t expired = 0;
+    for (auto it = online_.begin(); it != online_.end();) {
+        const DeviceHandle h = it->h;
+        auto& status = devices_[h].status;
+        if (now_ms - status.last_seen_ms < timeout_ms) {
+            ++it;
+            continue;
+        }
+        status.online = false;
+        offline_.insert(*it);
+        it = online_.erase(it);
+        ingest_[h].online_version = version_ + 1;
+        Stamp(h, version_ + 1);
+        Bump(h);
+        ++expired;
+    }
+    return expired;
+}
+
+bool DeviceRegistry::Select(const DeviceQuery& q, std::vector<DeviceHandle>& out) const {
+    static const IdIndex kNone;
+    const IdIndex* index = nullptr;  // nullptr: all devices
+    const auto narrow = [&index](const IdIndex& candidate) {
+        if (index == nullptr || candidate.size() < index->size()) index = &candidate;
+    };
+    if (!q.kind.empty()) {
+        const auto it = by_kind_.find(q.kind);
+        narrow(it == by_kind_.end() ? kNone : it->second);
+    }
+    if (!q.transport.empty()) {
+        const auto it = by_transport_.find(q.transport);
+        narrow(it == by_transport_.end() ? kNone : it->second);
+    }
+    if (q.online == DeviceQuery::Online::kOnline) narrow(online_);
+    if (q.online == DeviceQuery::Online::kOffline) narrow(offline_);
+
+    std::size_t taken = 0;
+    // False once a match beyond the page turns up.
+    const auto take = [&](DeviceHandle h) {
+        const auto& d = devices_[h];
+        if (!q.kind.empty() && d.kind != q.kind) return true;
+        if (!q.transport.empty() && d.transport != q.transport) return true;
+        if (q.online != DeviceQuery::Online::kAny && d.status.online != (q.online == DeviceQuery::Online::kOnline)) {
+            return true;
+        }
+        if (q.limit > 0 && taken == q.limit) return false;
+        out.push_back(h);
+        ++taken;
+        return true;
+    };
+    if (index == nullptr) {
+        const auto& sorted = SortedHandles();
+        auto it = sorted.begin();
+        if (!q.after.empty()) {
+            it = std::upper_bound(sorted.begin(), sorted.end(), q.after,
+                                  [this](const std::string& id, DeviceHandle h) { return id < devices_[h].id; });
+        }
+        for (; it != sorted.end(); ++it) {
+            if (!take(*it)) return true;
+        }
+        return false;
+    }
+    auto it = q.after.empty() ? index->begin() : index->upper_bound(IdKey{&q.after, kInvalidDevice});
+    for (; it != index->end(); ++it) {
+        if (!take(it->h)) return true;
+    }
+    return false;
+}
+
+bool DeviceRegistry::ParseFieldMask(const std::string& list, DeviceFieldMask& out) {
+    out = 0;
+    std::size_t start = 0;
+    while (start <= list.size()) {
+        std::size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        const std::size_t len = end - start;
+        if (len > 0) {
+            DeviceFieldMask bits = 0;
+            for (const auto& m : kMemberNames) {
+                if (std::strlen(m.name) == len && list.compare(start, len, m.name) == 0) bits = m.bits;
+            }
+            if (bits == 0) return false;
+            out |= bits;
+        }
+        start = end + 1;
+    }
+    return out != 0;
+}
+
+void DeviceRegistry::BindTopic(const std::string& topic, RouteType type, DeviceHandle h) {
+    if (topic.empty()) return;
+    RouteEntry e;
+    e.type = type;
+    e.device = h;
+    (void)routes_.Insert(topic, e);
+}
+
+void DeviceRegistry::UnbindTopic(const std::string& topic, RouteType type, DeviceHandle h) {
+    if (topic.empty()) return;
+    RouteEntry e;
+    e.type = type;
+    e.device = h;
+    (void)routes_.Erase(topic, e);
+}
+
+bool DeviceRegistry::AddTopicTemplate(const std::string& pattern, RouteType type, const std::string& device_kind,
+                                      codec::PayloadFormat format) {
+    if (pattern.find("{id}") == std::string::npos) return false;
+    RouteEntry e;
+    e.type = type;
+    e.template_index = templates_.size();
+    if (!routes_.Insert(pattern, e)) return false;
+
+    TopicTemplate t;
+    t.pattern = pattern;
+    t.type = type;
+    t.device_kind = device_kind;
+    t.format = format;
+    templates_.push_back(std::move(t));
+    return true;
+}
+
+bool DeviceRegistry::Resolve(const std::string& topic, TopicRoute& out) const {
+    RouteEntry e;
+    iotgw::core::common::topic::TopicCaptures caps;
+    if (!routes_.MatchBest(topic, e, &caps)) return false;
+
+    out = TopicRoute();
+    out.type = e.type;
+    if (e.device != kInvalidDevice) {
+        out.device = e.device;
+        out.device_id = devices_[e.device].id;
+        out.device_kind = devices_[e.device].kind;
+        return true;
+    }
+
+    const auto& t = templates_[e.template_index];
+    if (!caps.Get("id", out.device_id) || out.device_id.empty()) return false;
+    if (!caps.Get("kind", out.device_kind) || out.device_kind.empty()) out.device_kind = t.device_kind;
+    out.format = t.format;
+    out.device = Find(out.device_id);
+    out.from_template = true;
+    return true;
+}
+
+bool DeviceRegistry::WithinDeadband(DeviceHandle h, const model::FieldTable& fields, const std::string& payload,
+                                    std::int64_t now_ms) const {
+    const auto& in = ingest_[h];
+    const Deadband& db = in.deadband;
+    if (!db.enabled || in.last_pass_ms == 0) return false;
+    if (db.max_silence_ms > 0 && now_ms - in.last_pass_ms >= db.max_silence_ms) return false;
+    const auto& last = devices_[h].status;
+    // Nothing decoded to compare: only a byte-identical repeat is unchanged.
+    if (fields.Empty()) return payload == last.last_payload;
+    for (std::size_t i = 0; i < fields.Size(); ++i) {
+        const auto& v = fields.ValueAt(i);
+        const auto* prev = last.fields.Find(fields.NameAt(i), fields.NameLenAt(i));
+        if (prev == nullptr || prev->type != v.type) return false;
+        if (v.type == model::FieldType::kBool) {
+            if (prev->number != v.number) return false;
+            continue;
+        }
+        const double band = std::max(db.absolute, db.percent * 0.01 * std::fabs(prev->number));
+        if (!(std::fabs(v.number - prev->number) <= band)) return false;
+    }
     return true;
 }
 
+void DeviceRegistry::Revise(DeviceHandle h, std::int64_t now_ms, bool changed) {
+    auto& in = ingest_[h];
+    if (!changed && liveness_resolution_ms_ > 0 && in.revised_ms != 0 &&
+        now_ms - in.revised_ms < liveness_resolution_ms_) {
+        return;
+    }
+    in.revised_ms = now_ms;
+    Bump(h);
+}
+
+bool DeviceRegistry::Touch(DeviceHandle h, const std::string& topic, const std::string& payload, std::int64_t now_ms,
+                           std::string& out_device_id, bool* out_changed, model::FieldTable* out_fields) {
+    if (out_changed != nullptr) *out_changed = true;
+    if (out_fields != nullptr) out_fields->Clear();
+    if (h >= devices_.size()) return false;
+    auto& d = devices_[h];
+    bool changed = !d.status.online;
+    MarkOnline(h);
+    d.status.last_seen_ms = now_ms;
+
+    out_device_id = d.id;
+
+    auto& in = ingest_[h];
+    const codec::DecodePlan* plan = in.plan;
+    codec::DecodedTelemetry decoded;
+    if (sample_handler_) decoded.samples = &samples_;
+    if (!codec::DecodePayload(in.format, payload, plan, decoded)) {
+        changed = changed || payload != d.status.last_payload || topic != d.status.last_topic;
+        d.status.last_payload = payload;
+        d.status.last_topic = topic;
+        // Without a plan, payloads the decoder does not understand were never an error.
+        if (plan == nullptr) {
+            Revise(h, now_ms, changed);
+            return true;
+        }
+        ++stats_.rejected[static_cast<std::size_t>(decoded.verdict)];
+        ++d.status.rejected;
+        const char* reason = codec::VerdictName(decoded.verdict);
+        changed = changed || d.status.last_reject != reason;
+        d.status.last_reject = reason;
+        Revise(h, now_ms, changed);
+        return false;
+    }
+    ++stats_.accepted;
+    if (plan != nullptr) ++stats_.validated;
+    stats_.unknown_fields += decoded.unknown_fields;
+    // Sample blocks are never absorbed: each carries new samples.
+    const bool has_samples = decoded.samples != nullptr && !samples_.Empty();
+    if (!has_samples && WithinDeadband(h, decoded.fields, payload, now_ms)) {
+        ++stats_.suppressed;
+        ++d.status.suppressed;
+        if (out_changed != nullptr) *out_changed = false;
+        Revise(h, now_ms, changed);
+        return true;
+    }
+    in.last_pass_ms = now_ms;
+    changed = changed || payload != d.status.last_payload || topic != d.status.last_topic;
+    d.status.last_payload = payload;
+    d.status.last_topic = topic;
+    const std::uint64_t before = in.version;
+    MergeFields(h, decoded.fields);
+    Revise(h, now_ms, changed || in.version != before);
+    if (out_fields != nullptr) *out_fields = decoded.fields;
+    if (decoded.ts != 0) d.status.reported_ts = decoded.ts;
+    if (has_samples) sample_handler_(h, samples_, now_ms);
+    return true;
+}
+
+bool DeviceRegistry::UpdateFromTelemetryTopic(const std::string& topic, const std::string& payload, std::int64_t now_ms,
+                                              std::string& out_device_id, bool* out_changed,
+                                              model::FieldTable* out_fields) {
+    if (out_fields != nullptr) out_fields->Clear();
+    TopicRoute r;
+    if (!Resolve(topic, r) || r.from_template || r.type != RouteType::kTelemetry) return false;
+    return Touch(r.device, topic, payload, now_ms, out_device_id, out_changed, out_fields);
+}
+
 static std::string LastPathSegment(const std::string& topic) {
     if (topic.empty()) return {};
     const auto pos = topic.find_last_of('/');
@@ -81,167 +440,202 @@ static std::string LastPathSegment(const std::string& topic) {
 }
 
 bool DeviceRegistry::UpsertMqttDeviceFromTopic(const std::string& topic, const std::string& payload,
-                                               std::int64_t now_ms, std::string& out_device_id) {
-    if (UpdateFromTelemetryTopic(topic, payload, now_ms, out_device_id)) return true;
-
-    const std::string guessed_id = LastPathSegment(topic);
-    if (guessed_id.empty()) return false;
+                                               std::int64_t now_ms, std::string& out_device_id,
+                                               bool* out_changed, model::FieldTable* out_fields) {
+    if (out_fields != nullptr) out_fields->Clear();
+    TopicRoute r;
+    if (Resolve(topic, r)) {
+        // Commands echoed back by the broker are not telemetry.
+        if (r.type != RouteType::kTelemetry) return false;
+        if (!r.from_template) {
+            return Touch(r.device, topic, payload, now_ms, out_device_id, out_changed, out_fields);
+        }
+    } else {
+        // No route: guess the id from the last level, as before templates existed.
+        r.device_id = LastPathSegment(topic);
+        r.device_kind = "unknown";
+        r.device = Find(r.device_id);
+    }
+    if (r.device_id.empty()) return false;
 
-    if (!Has(guessed_id)) {
+    if (r.device == kInvalidDevice) {
         model::DeviceEntity d;
-        d.id = guessed_id;
-        d.kind = "unknown";
+        d.id = r.device_id;
+        d.kind = r.device_kind.empty() ? "unknown" : r.device_kind;
         d.transport = "mqtt";
         d.telemetry_topic = topic;
         (void)Register(std::move(d));
+        r.device = Find(r.device_id);
     } else {
-        auto it = by_id_.find(guessed_id);
-        if (it != by_id_.end()) {
-            if (!it->second.telemetry_topic.empty()) {
-                telemetry_topic_to_id_.erase(it->second.telemetry_topic);
-            }
-            it->second.telemetry_topic = topic;
-            telemetry_topic_to_id_[topic] = guessed_id;
+        auto& d = devices_[r.device];
+        UnbindTopic(d.telemetry_topic, RouteType::kTelemetry, r.device);
+        d.telemetry_topic = topic;
+        BindTopic(d.telemetry_topic, RouteType::kTelemetry, r.device);
+    }
+    // Later messages resolve through the device's own topic, so it keeps the template's format.
+    if (r.device != kInvalidDevice && !ingest_[r.device].explicit_format) ingest_[r.device].format = r.format;
+    return Touch(r.device, topic, payload, now_ms, out_device_id, out_changed, out_fields);
+}
+
+bool DeviceRegistry::SetValue(DeviceHandle h, double value, std::int64_t now_ms) {
+    if (h >= devices_.size()) return false;
+    auto& d = devices_[h];
+    const bool changed = !d.status.online;
+    MarkOnline(h);
+    d.status.last_seen_ms = now_ms;
+    model::FieldTable fields;
+    if (!fields.Set("value", model::FieldValue::Number(value))) {
+        Revise(h, now_ms, changed);
+        return false;
+    }
+    const std::uint64_t before = ingest_[h].version;
+    MergeFields(h, fields);
+    Revise(h, now_ms, changed || ingest_[h].version != before);
+    return d.status.fields.Find("value") != nullptr;
+}
+
+void DeviceRegistry::MergeFields(DeviceHandle h, const model::FieldTable& fields) {
+    auto& table = devices_[h].status.fields;
+    auto& in = ingest_[h];
+    const std::uint64_t v = version_ + 1;
+    bool changed = false;
+    for (std::size_t i = 0; i < fields.Size(); ++i) {
+        const char* name = fields.NameAt(i);
+        const std::size_t len = fields.NameLenAt(i);
+        const auto& value = fields.ValueAt(i);
+        std::size_t k = table.IndexOf(name, len);
+        if (k != model::FieldTable::kNotFound && table.ValueAt(k).type == value.type &&
+            table.ValueAt(k).number == value.number) {
+            continue;
         }
+        if (!table.Set(name, len, value)) continue;
+        if (k == model::FieldTable::kNotFound) k = table.Size() - 1;
+        in.field_versions[k] = v;
+        changed = true;
     }
+    if (changed) Stamp(h, v);
+}
+
+void DeviceRegistry::Stamp(DeviceHandle h, std::uint64_t v) {
+    auto& in = ingest_[h];
+    version_ = v;
+    in.version = v;
+    if (newest_ == h) return;
+    // Move to the head of the version list.
+    if (in.newer != kInvalidDevice) ingest_[in.newer].older = in.older;
+    if (in.older != kInvalidDevice) ingest_[in.older].newer = in.newer;
+    in.newer = kInvalidDevice;
+    in.older = newest_;
+    if (newest_ != kInvalidDevice) ingest_[newest_].newer = h;
+    newest_ = h;
+}
+
+std::uint64_t DeviceRegistry::VersionOf(DeviceHandle h) const { return h < ingest_.size() ? ingest_[h].version : 0; }
+
+std::uint64_t DeviceRegistry::OnlineVersionOf(DeviceHandle h) const {
+    return h < ingest_.size() ? ingest_[h].online_version : 0;
+}
 
-    return UpdateFromTelemetryTopic(topic, payload, now_ms, out_device_id);
+std::uint64_t DeviceRegistry::FieldVersionOf(DeviceHandle h, std::size_t index) const {
+    if (h >= ingest_.size() || index >= model::FieldTable::kMaxFields) return 0;
+    return ingest_[h].field_versions[index];
+}
+
+void DeviceRegistry::ChangedSince(std::uint64_t version, std::vector<DeviceHandle>& out) const {
+    for (DeviceHandle h = newest_; h != kInvalidDevice && ingest_[h].version > version; h = ingest_[h].older) {
+        out.push_back(h);
+    }
 }
 
 bool DeviceRegistry::GetCommandTopic(const std::string& device_id, std::string& out_topic) const {
-    const auto it = by_id_.find(device_id);
-    if (it == by_id_.end()) return false;
-    if (it->second.command_topic.empty()) return false;
-    out_topic = it->second.command_topic;
+    const auto* d = At(Find(device_id));
+    if (d == nullptr || d->command_topic.empty()) return false;
+    out_topic = d->command_topic;
     return true;
 }
 
 bool DeviceRegistry::GetTelemetryTopic(const std::string& device_id, std::string& out_topic) const {
-    const auto it = by_id_.find(device_id);
-    if (it == by_id_.end()) return false;
-    if (it->second.telemetry_topic.empty()) return false;
-    out_topic = it->second.telemetry_topic;
+    const auto* d = At(Find(device_id));
+    if (d == nullptr || d->telemetry_topic.empty()) return false;
+    out_topic = d->telemetry_topic;
     return true;
 }
 
-std::string DeviceRegistry::JsonEscape(const std::string& s) {
-    std::string out;
-    out.reserve(s.size() + 8);
-    for (const char c : s) {
-        switch (c) {
-            case '\"':
-                out += "\\\"";
-                break;
-            case '\\':
-                out += "\\\\";
-                break;
-            case '\b':
-                out += "\\b";
-                break;
-            case '\f':
-                out += "\\f";
-                break;
-            case '\n':
-                out += "\\n";
-                break;
-            case '\r':
-                out += "\\r";
-                break;
-            case '\t':
-                out += "\\t";
-                break;
-            default:
-                if (static_cast<unsigned char>(c) < 0x20) {
-                    const char hex[] = "0123456789abcdef";
-                    out += "\\u00";
-                    out += hex[(c >> 4) & 0x0f];
-                    out += hex[c & 0x0f];
-                } else {
-                    out += c;
-                }
-        }
-    }
-    return out;
+codec::PayloadFormat DeviceRegistry::PayloadFormatOf(DeviceHandle h) const {
+    return h < ingest_.size() ? ingest_[h].format : codec::PayloadFormat::kJson;
 }
 
-std::string DeviceRegistry::JsonQuote(const std::string& s) {
-    std::string out;
-    out.reserve(s.size() + 2);
-    out.push_back('\"');
-    out += JsonEscape(s);
-    out.push_back('\"');
-    return out;
+const codec::DecodePlan* DeviceRegistry::PlanOf(DeviceHandle h) const {
+    return h < ingest_.size() ? ingest_[h].plan : nullptr;
 }
 
-std::string DeviceRegistry::Bool(bool v) { return v ? "true" : "false"; }
-std::string DeviceRegistry::Number(std::int64_t v) { return std::to_string(v); }
-
-std::string DeviceRegistry::DeviceToJson(const model::DeviceEntity& d) const {
-    std::string out;
-    out.reserve(256);
-    out.push_back('{');
-    out += JsonQuote("id");
-    out.push_back(':');
-    out += JsonQuote(d.id);
-    out.push_back(',');
-    out += JsonQuote("kind");
-    out.push_back(':');
-    out += JsonQuote(d.kind);
-    out.push_back(',');
-    out += JsonQuote("transport");
-    out.push_back(':');
-    out += JsonQuote(d.transport);
-    out.push_back(',');
-    out += JsonQuote("telemetry_topic");
-    out.push_back(':');
-    out += JsonQuote(d.telemetry_topic);
-    out.push_back(',');
-    out += JsonQuote("command_topic");
-    out.push_back(':');
-    out += JsonQuote(d.command_topic);
-    out.push_back(',');
-    out += JsonQuote("status");
-    out.push_back(':');
-    out.push_back('{');
-    out += JsonQuote("online");
-    out.push_back(':');
-    out += Bool(d.status.online);
-    out.push_back(',');
-    out += JsonQuote("last_seen_ms");
-    out.push_back(':');
-    out += Number(d.status.last_seen_ms);
-    out.push_back(',');
-    out += JsonQuote("last_topic");
-    out.push_back(':');
-    out += JsonQuote(d.status.last_topic);
-    out.push_back(',');
-    out += JsonQuote("last_payload");
-    out.push_back(':');
-    out += JsonQuote(d.status.last_payload);
-    out.push_back('}');
-    out.push_back('}');
-    return out;
+void DeviceRegistry::WriteDevice(DeviceHandle h, DeviceFieldMask mask, iotgw::core::common::json::Writer& w) const {
+    const auto& d = devices_[h];
+    const codec::PayloadFormat format = ingest_[h].format;
+    w.BeginObject();
+    if (mask & kMemberId) w.Key("id").String(d.id);
+    if (mask & kMemberKind) w.Key("kind").String(d.kind);
+    if (mask & kMemberTransport) w.Key("transport").String(d.transport);
+    if (mask & kMemberTelemetryTopic) w.Key("telemetry_topic").String(d.telemetry_topic);
+    if (mask & kMemberCommandTopic) w.Key("command_topic").String(d.command_topic);
+    if (mask & kMemberPayloadFormat) w.Key("payload_format").String(codec::PayloadFormatName(format));
+    if (mask & kMemberStatus) {
+        w.Key("status").BeginObject();
+        if (mask & kMemberOnline) w.Key("online").Bool(d.status.online);
+        if (mask & kMemberLastSeen) w.Key("last_seen_ms").Int(d.status.last_seen_ms);
+        if (mask & kMemberLastTopic) w.Key("last_topic").String(d.status.last_topic);
+        if (mask & kMemberLastPayload) {
+            // Binary payloads are shown as hex.
+            w.Key("last_payload");
+            if (format == codec::PayloadFormat::kJson) {
+                w.String(d.status.last_payload);
+            } else {
+                w.Hex(d.status.last_payload);
+            }
+        }
+        if (mask & kMemberRejected) w.Key("rejected").Uint(d.status.rejected);
+        if (mask & kMemberLastReject) w.Key("last_reject").String(d.status.last_reject);
+        if (mask & kMemberSuppressed) w.Key("suppressed").Uint(d.status.suppressed);
+        w.EndObject();
+    }
+    if (mask & kMemberFields) {
+        w.Key("fields").BeginObject();
+        for (std::size_t i = 0; i < d.status.fields.Size(); ++i) {
+            const auto& v = d.status.fields.ValueAt(i);
+            w.Key(d.status.fields.NameAt(i), d.status.fields.NameLenAt(i));
+            if (v.type == model::FieldType::kBool) {
+                w.Bool(v.number != 0.0);
+            } else {
+                w.Double(v.number);
+            }
+        }
+        w.EndObject();
+    }
+    w.EndObject();
 }
 
-std::string DeviceRegistry::ToJsonList() const {
-    const auto list = List();
-    std::string out;
-    out.reserve(256 + list.size() * 128);
-    out.push_back('[');
-    bool first = true;
-    for (const auto& d : list) {
-        if (!first) out.push_back(',');
-        first = false;
-        out += DeviceToJson(d);
+void DeviceRegistry::WriteJsonList(iotgw::core::common::json::Writer& w) const {
+    const auto& sorted = SortedHandles();
+    w.Reserve(w.size() + 256 + sorted.size() * 256);
+    w.BeginArray();
+    for (const DeviceHandle h : sorted) WriteDevice(h, kAllDeviceFields, w);
+    w.EndArray();
+}
+
+void DeviceRegistry::WriteJsonList(const std::vector<DeviceHandle>& handles, DeviceFieldMask mask,
+                                   iotgw::core::common::json::Writer& w) const {
+    w.Reserve(w.size() + 64 + handles.size() * (mask == kAllDeviceFields ? 256 : 64));
+    w.BeginArray();
+    for (const DeviceHandle h : handles) {
+        if (h < devices_.size()) WriteDevice(h, mask, w);
     }
-    out.push_back(']');
-    return out;
+    w.EndArray();
 }
 
-bool DeviceRegistry::ToJsonOne(const std::string& id, std::string& out_json) const {
-    model::DeviceEntity d;
-    if (!Get(id, d)) return false;
-    out_json = DeviceToJson(d);
+bool DeviceRegistry::WriteJsonOne(const std::string& id, iotgw::core::common::json::Writer& w) const {
+    const DeviceHandle h = Find(id);
+    if (h == kInvalidDevice) return false;
+    WriteDevice(h, kAllDeviceFields, w);
     return true;
 }
 
@@ -16,6 +16,7 @@ struct DeviceEntity {
     std::string transport;
     std::string telemetry_topic;
     std::string command_topic;
+    std::string payload_format;  // "json", "cbor" or "msgpack"; empty: from the topic template, else json
     DeviceStatus status;
 };
 
@@ -3,6 +3,8 @@
 #include <cstdint>
 #include <string>
 
+#include "core/device/model/field_table.hpp"
+
 namespace iotgw {
 namespace core {
 namespace device {
@@ -13,6 +15,14 @@ struct DeviceStatus {
     std::int64_t last_seen_ms = 0;
     std::string last_payload;
     std::string last_topic;
+    // Decoded once at ingestion; readers never parse last_payload.
+    FieldTable fields;
+    std::int64_t reported_ts = 0;  // device-side "ts" of the last envelope
+    // Payloads refused by the device's schema; they keep the device online but leave `fields` alone.
+    std::uint64_t rejected = 0;
+    std::string last_reject;
+    // Reports absorbed by the deadband; they refresh only online/last_seen_ms.
+    std::uint64_t suppressed = 0;
 };
 
 }  // namespace model
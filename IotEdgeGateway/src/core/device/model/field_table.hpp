@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace model {
+
+enum class FieldType : std::uint8_t { kNumber, kBool };
+
+struct FieldValue {
+    FieldType type = FieldType::kNumber;
+    double number = 0.0;  // bools are stored as 0/1 as well
+
+    static FieldValue Number(double v) {
+        FieldValue f;
+        f.number = v;
+        return f;
+    }
+    static FieldValue Bool(bool v) {
+        FieldValue f;
+        f.type = FieldType::kBool;
+        f.number = v ? 1.0 : 0.0;
+        return f;
+    }
+};
+
+// Decoded scalar fields of a device's telemetry, in fixed inline slots.
+// Updates merge by name, so a partial report keeps the other fields.
+class FieldTable {
+public:
+    static constexpr std::size_t kMaxFields = 8;
+    static constexpr std::size_t kMaxNameLen = 15;
+    static constexpr std::size_t kNotFound = kMaxFields;
+
+    // False if the name is too long or every slot is taken by another name.
+    bool Set(const char* name, std::size_t len, FieldValue v) {
+        if (len == 0 || len > kMaxNameLen) return false;
+        Slot* s = FindSlot(name, len);
+        if (s == nullptr) {
+            if (count_ >= kMaxFields) return false;
+            s = &slots_[count_++];
+            std::memcpy(s->name, name, len);
+            s->name[len] = '\0';
+            s->len = static_cast<std::uint8_t>(len);
+        }
+        s->value = v;
+        return true;
+    }
+    bool Set(const std::string& name, FieldValue v) { return Set(name.data(), name.size(), v); }
+
+    const FieldValue* Find(const char* name, std::size_t len) const {
+        for (std::size_t i = 0; i < count_; ++i) {
+            if (slots_[i].len == len && std::memcmp(slots_[i].name, name, len) == 0) return &slots_[i].value;
+        }
+        return nullptr;
+    }
+    const FieldValue* Find(const std::string& name) const { return Find(name.data(), name.size()); }
+
+    // Slot of the field, kNotFound if absent. Slots keep their index until Clear().
+    std::size_t IndexOf(const char* name, std::size_t len) const {
+        for (std::size_t i = 0; i < count_; ++i) {
+            if (slots_[i].len == len && std::memcmp(slots_[i].name, name, len) == 0) return i;
+        }
+        return kNotFound;
+    }
+
+    bool GetNumber(const std::string& name, double& out) const {
+        const FieldValue* v = Find(name);
+        if (v == nullptr) return false;
+        out = v->number;
+        return true;
+    }
+
+    // Copies every field of `other` over this table.
+    void Merge(const FieldTable& other) {
+        for (std::size_t i = 0; i < other.count_; ++i) {
+            (void)Set(other.slots_[i].name, other.slots_[i].len, other.slots_[i].value);
+        }
+    }
+
+    std::size_t Size() const { return count_; }
+    bool Empty() const { return count_ == 0; }
+    void Clear() { count_ = 0; }
+
+    const char* NameAt(std::size_t i) const { return slots_[i].name; }
+    std::size_t NameLenAt(std::size_t i) const { return slots_[i].len; }
+    const FieldValue& ValueAt(std::size_t i) const { return slots_[i].value; }
+
+private:
+    struct Slot {
+        char name[kMaxNameLen + 1] = {};
+        std::uint8_t len = 0;
+        FieldValue value;
+    };
+
+    Slot* FindSlot(const char* name, std::size_t len) {
+        for (std::size_t i = 0; i < count_; ++i) {
+            if (slots_[i].len == len && std::memcmp(slots_[i].name, name, len) == 0) return &slots_[i];
+        }
+        return nullptr;
+    }
+
+private:
+    Slot slots_[kMaxFields];
+    std::size_t count_ = 0;
+};
+
+}  // namespace model
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -4,6 +4,9 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "core/common/logger/logger.hpp"
 #include "mongoose.h"
@@ -24,30 +27,64 @@ public:
         std::uint16_t keepalive_sec = 30;
         bool clean_session = true;
         std::uint8_t version = 4;
+        // 0 disables automatic reconnection.
+        std::int64_t reconnect_interval_ms = 5000;
+
+        // MQTT 5 only: upper bound on outbound topic aliases (the broker's CONNACK limit also applies).
+        std::uint16_t topic_alias_max = 64;
+        // Subscriptions become "$share/<group>/<filter>" so several gateways can split one stream.
+        std::string share_group;
+    };
+
+    struct Stats {
+        std::uint64_t publishes = 0;
+        std::uint64_t publish_bytes = 0;
+        std::uint64_t alias_hits = 0;
     };
 
     using MessageHandler = std::function<void(const std::string& topic, const std::string& payload)>;
 
     explicit MqttClient(struct mg_mgr* mgr, std::shared_ptr<iotgw::core::common::log::Logger> logger);
+    ~MqttClient();
+
+    MqttClient(const MqttClient&) = delete;
+    MqttClient& operator=(const MqttClient&) = delete;
 
     bool Connect(const Options& opt);
     bool Subscribe(const std::string& topic, std::uint8_t qos = 0);
-    bool Publish(const std::string& topic, const std::string& payload, std::uint8_t qos = 0, bool retain = false);
+    // expiry_sec > 0 sets the MQTT 5 message expiry interval; ignored on MQTT 3.1.1.
+    bool Publish(const std::string& topic, const std::string& payload, std::uint8_t qos = 0, bool retain = false,
+                 std::uint32_t expiry_sec = 0);
 
     void SetMessageHandler(MessageHandler handler);
     bool IsOpen() const;
 
+    // Bytes queued in the connection's send buffer, used for flow control.
+    std::size_t PendingBytes() const;
+
+    std::uint8_t Version() const;
+    // PUBLISH packet bytes handed to the connection, to compare wire cost across protocol versions.
+    const Stats& GetStats() const;
+
+    // Re-establishes a dropped connection after reconnect_interval_ms.
+    void Poll(std::int64_t now_ms);
+
 private:
     static void EventHandler(struct mg_connection* c, int ev, void* ev_data);
     void HandleEvent(struct mg_connection* c, int ev, void* ev_data);
+    bool Open();
+    void SendSubscribe(struct mg_connection* c, const std::string& topic, std::uint8_t qos);
 
 private:
     struct mg_mgr* mgr_ = nullptr;
     struct mg_connection* conn_ = nullptr;
     Options opt_;
-    std::string pending_sub_topic_;
-    std::uint8_t pending_sub_qos_ = 0;
+    std::vector<std::pair<std::string, std::uint8_t>> subs_;
     bool open_ = false;
+    std::int64_t closed_at_ms_ = 0;
+    std::uint16_t alias_limit_ = 0;
+    std::unordered_map<std::string, std::uint16_t> aliases_;
+    Stats stats_;
     MessageHandler on_msg_;
     std::shared_ptr<iotgw::core::common::log::Logger> logger_;
 };
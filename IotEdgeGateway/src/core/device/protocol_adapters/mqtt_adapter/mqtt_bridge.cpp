@@ -0,0 +1,225 @@
+#include "core/device/protocol_adapters/mqtt_adapter/mqtt_bridge.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace protocol_adapters {
+namespace mqtt {
+
+constexpr std::int64_t MqttBridge::kEchoWindowMs;
+constexpr std::size_t MqttBridge::kMaxEchoes;
+
+MqttBridge::MqttBridge(std::shared_ptr<iotgw::core::common::log::Logger> logger) : logger_(std::move(logger)) {}
+
+void MqttBridge::AddEndpoint(const std::string& name, Endpoint ep) {
+    EndpointState st;
+    st.bucket.Configure(ep.max_msgs_per_sec, 0.0);
+    st.ep = std::move(ep);
+    endpoints_[name] = std::move(st);
+}
+
+bool MqttBridge::HasEndpoint(const std::string& name) const { return endpoints_.find(name) != endpoints_.end(); }
+
+bool MqttBridge::AddRule(Rule rule) {
+    if (rule.from.empty() || rule.to.empty() || rule.topic_filter.empty()) return false;
+    if (!HasEndpoint(rule.to)) {
+        if (logger_) logger_->Warn("MQTT bridge " + rule.name + ": unknown target broker " + rule.to);
+        return false;
+    }
+    if (rule.queue_limit == 0) rule.queue_limit = 1;
+    if (rule.name.empty()) rule.name = rule.from + "->" + rule.to;
+
+    if (!routes_[rule.from].Insert(rule.topic_filter, bridges_.size())) {
+        if (logger_) logger_->Warn("MQTT bridge " + rule.name + ": invalid topic filter " + rule.topic_filter);
+        return false;
+    }
+
+    Bridge b;
+    b.bucket.Configure(rule.max_msgs_per_sec, 0.0);
+    b.rule = std::move(rule);
+    if (logger_) {
+        logger_->Info("MQTT bridge " + b.rule.name + ": " + b.rule.from + " " + b.rule.topic_filter + " -> " +
+                      b.rule.to);
+    }
+    bridges_.push_back(std::move(b));
+    return true;
+}
+
+bool MqttBridge::AddSubscription(const std::string& endpoint, const std::string& filter) {
+    const auto it = endpoints_.find(endpoint);
+    if (it == endpoints_.end() || filter.empty()) return false;
+    return it->second.subscriptions.Insert(filter, 0);
+}
+
+std::vector<std::string> MqttBridge::FiltersFrom(const std::string& from) const {
+    std::vector<std::string> out;
+    for (const auto& b : bridges_) {
+        if (b.rule.from == from) out.push_back(b.rule.topic_filter);
+    }
+    return out;
+}
+
+std::string MqttBridge::RewriteTopic(const Rule& rule, const std::string& topic) {
+    if (rule.from_prefix.empty()) return rule.to_prefix + topic;
+    if (topic.compare(0, rule.from_prefix.size(), rule.from_prefix) != 0) return topic;
+    return rule.to_prefix + topic.substr(rule.from_prefix.size());
+}
+
+bool MqttBridge::OnMessage(const std::string& from, const std::string& topic, const std::string& payload,
+                           std::int64_t now_ms) {
+    const auto rit = routes_.find(from);
+    if (rit == routes_.end()) return false;
+    if (IsForwardedCopy(from, topic, payload, now_ms)) return false;
+
+    bool matched = false;
+    rit->second.ForEachMatch(topic, [&](std::size_t index, const iotgw::core::common::topic::TopicCaptures&) {
+        auto& b = bridges_[index];
+        matched = true;
+
+        Message m;
+        if (b.rule.transform) {
+            if (!b.rule.transform(topic, payload, m.payload)) {
+                ++b.stats.dropped;
+                return;
+            }
+        } else {
+            m.payload = payload;
+        }
+        if (b.queue.size() >= b.rule.queue_limit) {
+            b.queue.pop_front();
+            ++b.stats.dropped;
+        }
+        m.topic = RewriteTopic(b.rule, topic);
+        m.enqueued_ms = now_ms;
+        b.queue.push_back(std::move(m));
+        ++b.stats.enqueued;
+        b.stats.queued = b.queue.size();
+    });
+    return matched;
+}
+
+bool MqttBridge::Echoes(const std::string& endpoint, const EndpointState& st, const std::string& topic) const {
+    if (!st.ep.echoes) return false;
+    bool match = false;
+    const auto mark = [&match](int, const iotgw::core::common::topic::TopicCaptures&) { match = true; };
+    st.subscriptions.ForEachMatch(topic, mark);
+    if (match) return true;
+    const auto rit = routes_.find(endpoint);
+    if (rit == routes_.end()) return false;
+    rit->second.ForEachMatch(topic, [&match](std::size_t, const iotgw::core::common::topic::TopicCaptures&) {
+        match = true;
+    });
+    return match;
+}
+
+std::uint64_t MqttBridge::Fingerprint(const std::string& topic, const std::string& payload) {
+    // FNV-1a over topic, a separator and payload.
+    std::uint64_t h = 1469598103934665603ULL;
+    const auto mix = [&h](const std::string& s) {
+        for (const char ch : s) {
+            h ^= static_cast<unsigned char>(ch);
+            h *= 1099511628211ULL;
+        }
+    };
+    mix(topic);
+    h ^= 0xff;
+    h *= 1099511628211ULL;
+    mix(payload);
+    return h;
+}
+
+void MqttBridge::ForgetSent(EndpointState& st, std::int64_t now_ms) {
+    while (!st.sent.empty() &&
+           (st.sent.size() > kMaxEchoes || (now_ms > 0 && now_ms - st.sent.front().second > kEchoWindowMs))) {
+        const auto it = st.sent_count.find(st.sent.front().first);
+        if (it != st.sent_count.end() && --it->second == 0) st.sent_count.erase(it);
+        st.sent.pop_front();
+    }
+}
+
+bool MqttBridge::IsForwardedCopy(const std::string& endpoint, const std::string& topic, const std::string& payload,
+                                 std::int64_t now_ms) {
+    const auto eit = endpoints_.find(endpoint);
+    if (eit == endpoints_.end()) return false;
+    auto& st = eit->second;
+    ForgetSent(st, now_ms);
+    const auto it = st.sent_count.find(Fingerprint(topic, payload));
+    if (it == st.sent_count.end()) return false;
+    if (--it->second == 0) st.sent_count.erase(it);
+    return true;
+}
+
+void MqttBridge::Poll(std::int64_t now_ms) {
+    const std::size_t n = bridges_.size();
+    if (n == 0) return;
+
+    for (std::size_t k = 0; k < n; ++k) {
+        auto& b = bridges_[(rr_start_ + k) % n];
+        if (b.queue.empty()) continue;
+
+        auto it = endpoints_.find(b.rule.to);
+        if (it == endpoints_.end()) continue;
+        auto& st = it->second;
+        if (!st.ep.publish || (st.ep.is_open && !st.ep.is_open())) continue;
+
+        std::size_t sent = 0;
+        while (!b.queue.empty() && sent < kMaxPerPoll) {
+            const bool congested = st.ep.max_pending_bytes > 0 && st.ep.pending_bytes &&
+                                   st.ep.pending_bytes() >= st.ep.max_pending_bytes;
+            if (congested) break;
+            if (!b.bucket.Available(now_ms) || !st.bucket.Available(now_ms)) break;
+
+            const Message& m = b.queue.front();
+            std::uint32_t expiry_sec = 0;
+            if (b.rule.message_expiry_sec > 0 && m.enqueued_ms > 0) {
+                const std::int64_t age_sec = (now_ms - m.enqueued_ms) / 1000;
+                if (age_sec >= b.rule.message_expiry_sec) {
+                    b.queue.pop_front();
+                    ++b.stats.expired;
+                    continue;
+                }
+                expiry_sec = b.rule.message_expiry_sec - static_cast<std::uint32_t>(std::max<std::int64_t>(0, age_sec));
+            }
+            if (!st.ep.publish(m.topic, m.payload, b.rule.qos, expiry_sec)) break;
+            (void)b.bucket.TryTake(now_ms);
+            (void)st.bucket.TryTake(now_ms);
+            if (Echoes(b.rule.to, st, m.topic)) {
+                const std::uint64_t fp = Fingerprint(m.topic, m.payload);
+                st.sent.emplace_back(fp, now_ms);
+                ++st.sent_count[fp];
+                ForgetSent(st, now_ms);
+            }
+            b.queue.pop_front();
+            ++b.stats.forwarded;
+            ++sent;
+        }
+        b.stats.queued = b.queue.size();
+    }
+    rr_start_ = (rr_start_ + 1) % n;
+}
+
+bool MqttBridge::GetStats(const std::string& rule_name, Stats& out) const {
+    for (const auto& b : bridges_) {
+        if (b.rule.name == rule_name) {
+            out = b.stats;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> MqttBridge::RuleNames() const {
+    std::vector<std::string> out;
+    out.reserve(bridges_.size());
+    for (const auto& b : bridges_) out.push_back(b.rule.name);
+    return out;
+}
+
+}  // namespace mqtt
+}  // namespace protocol_adapters
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
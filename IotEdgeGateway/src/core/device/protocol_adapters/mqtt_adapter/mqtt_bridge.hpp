@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/common/logger/logger.hpp"
+#include "core/common/utils/rate_limiter.hpp"
+#include "core/common/utils/topic_trie.hpp"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace protocol_adapters {
+namespace mqtt {
+
+// Forwards messages between named broker connections.
+// Every rule owns a bounded outbound queue and a rate limit, and every endpoint
+// has its own throughput limit and send-buffer high-water mark, so a slow link
+// only ever fills (and drops from) its own queues.
+// The bridge remembers what it published on an endpoint that subscribes to the topic
+// (a rule from that endpoint, or a filter given to AddSubscription) for a while, so the
+// copy that comes back there is recognised by topic and payload and not forwarded again,
+// whatever the prefixes. Messages no subscription would echo are not remembered, so an
+// identical message that genuinely arrives there later still passes.
+class MqttBridge {
+public:
+    struct Endpoint {
+        std::function<bool(const std::string& topic, const std::string& payload, std::uint8_t qos,
+                           std::uint32_t expiry_sec)>
+            publish;
+        std::function<bool()> is_open;
+        std::function<std::size_t()> pending_bytes;
+        std::size_t max_pending_bytes = 0;
+        double max_msgs_per_sec = 0.0;
+        // False if what is published here never comes back as a message (an in-process broker).
+        bool echoes = true;
+    };
+
+    struct Rule {
+        std::string name;
+        std::string from;
+        std::string to;
+        std::string topic_filter;
+        std::string from_prefix;
+        std::string to_prefix;
+        std::uint8_t qos = 0;
+        std::size_t queue_limit = 1000;
+        double max_msgs_per_sec = 0.0;
+        // Queued messages older than this are dropped; the remainder is sent as MQTT 5 message expiry.
+        std::uint32_t message_expiry_sec = 0;
+        // Re-encodes the payload before it is queued, e.g. into the uplink's wire format.
+        // Returning false drops the message (counted in `dropped`).
+        std::function<bool(const std::string& topic, const std::string& payload, std::string& out)> transform;
+    };
+
+    struct Stats {
+        std::uint64_t enqueued = 0;
+        std::uint64_t forwarded = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t expired = 0;
+        std::size_t queued = 0;
+    };
+
+    explicit MqttBridge(std::shared_ptr<iotgw::core::common::log::Logger> logger = nullptr);
+
+    void AddEndpoint(const std::string& name, Endpoint ep);
+    bool HasEndpoint(const std::string& name) const;
+    bool AddRule(Rule rule);
+    // A filter the endpoint's connection subscribes to besides its rules' (FiltersFrom),
+    // e.g. the gateway's own telemetry subscription; published messages matching it echo.
+    bool AddSubscription(const std::string& endpoint, const std::string& filter);
+
+    // Topic filters that must be subscribed on `from` for its rules to see traffic.
+    std::vector<std::string> FiltersFrom(const std::string& from) const;
+
+    // Queues the message on every matching rule of `from`. Returns true if any rule matched;
+    // false also for a copy of a message the bridge published on `from`, which is dropped.
+    bool OnMessage(const std::string& from, const std::string& topic, const std::string& payload,
+                   std::int64_t now_ms = 0);
+
+    // True if the message arriving on `endpoint` is a copy of one the bridge published
+    // there. Each published message is recognised once.
+    bool IsForwardedCopy(const std::string& endpoint, const std::string& topic, const std::string& payload,
+                         std::int64_t now_ms);
+
+    // Drains queues within the rate and buffer budgets. Never blocks.
+    void Poll(std::int64_t now_ms);
+
+    bool GetStats(const std::string& rule_name, Stats& out) const;
+    std::vector<std::string> RuleNames() const;
+
+    static std::string RewriteTopic(const Rule& rule, const std::string& topic);
+
+private:
+    struct Message {
+        std::string topic;
+        std::string payload;
+        std::int64_t enqueued_ms = 0;
+    };
+
+    struct EndpointState {
+        Endpoint ep;
+        iotgw::core::common::rate::TokenBucket bucket;
+        // Fingerprints of messages published here, oldest first, and how many of each are pending.
+        std::deque<std::pair<std::uint64_t, std::int64_t>> sent;
+        std::unordered_map<std::uint64_t, std::uint32_t> sent_count;
+        iotgw::core::common::topic::TopicTrie<int> subscriptions;  // besides the rules'
+    };
+
+    struct Bridge {
+        Rule rule;
+        std::deque<Message> queue;
+        iotgw::core::common::rate::TokenBucket bucket;
+        Stats stats;
+    };
+
+    static constexpr std::size_t kMaxPerPoll = 256;
+    // How long and how many published messages are remembered per endpoint.
+    static constexpr std::int64_t kEchoWindowMs = 30000;
+    static constexpr std::size_t kMaxEchoes = 4096;
+
+    // Whether a message published on `endpoint` under `topic` comes back there.
+    bool Echoes(const std::string& endpoint, const EndpointState& st, const std::string& topic) const;
+    static std::uint64_t Fingerprint(const std::string& topic, const std::string& payload);
+    static void ForgetSent(EndpointState& st, std::int64_t now_ms);
+
+private:
+    std::unordered_map<std::string, EndpointState> endpoints_;
+    std::vector<Bridge> bridges_;
+    // Source endpoint -> rule filters, valued by index into bridges_.
+    std::unordered_map<std::string, iotgw::core::common::topic::TopicTrie<std::size_t>> routes_;
+    std::size_t rr_start_ = 0;
+    std::shared_ptr<iotgw::core::common::log::Logger> logger_;
+};
+
+}  // namespace mqtt
+}  // namespace protocol_adapters
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,284 @@
+#include "core/device/protocol_adapters/mqtt_adapter/mqtt_broker.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace protocol_adapters {
+namespace mqtt {
+
+namespace {
+
+// Size of the fixed header (command byte + remaining length varint), 0 if malformed.
+static std::size_t FixedHeaderSize(const struct mg_str& dgram) {
+    const auto* b = reinterpret_cast<const unsigned char*>(dgram.buf);
+    std::size_t i = 1;
+    while (i < dgram.len && i < 5) {
+        if ((b[i] & 0x80) == 0) return i + 1;
+        ++i;
+    }
+    return 0;
+}
+
+static std::uint16_t ReadU16(const unsigned char* p) {
+    return static_cast<std::uint16_t>((static_cast<unsigned>(p[0]) << 8) | p[1]);
+}
+
+// Walks the topic list of a SUBSCRIBE/UNSUBSCRIBE payload. Returns the next offset or 0 at the end.
+static std::size_t NextTopic(const struct mg_str& dgram, std::size_t pos, bool with_qos, std::string& topic,
+                             std::uint8_t& qos) {
+    if (pos + 2 > dgram.len) return 0;
+    const auto* b = reinterpret_cast<const unsigned char*>(dgram.buf);
+    const std::size_t n = ReadU16(b + pos);
+    const std::size_t end = pos + 2 + n + (with_qos ? 1 : 0);
+    if (end > dgram.len) return 0;
+    topic.assign(dgram.buf + pos + 2, n);
+    qos = with_qos ? static_cast<std::uint8_t>(b[pos + 2 + n] & 0x03) : 0;
+    return end;
+}
+
+}  // namespace
+
+MqttBroker::MqttBroker(struct mg_mgr* mgr, std::shared_ptr<iotgw::core::common::log::Logger> logger)
+    : mgr_(mgr), logger_(std::move(logger)) {}
+
+MqttBroker::~MqttBroker() {
+    if (mgr_ == nullptr) return;
+    for (struct mg_connection* c = mgr_->conns; c != nullptr; c = c->next) {
+        if (c->fn_data == this) c->fn_data = nullptr;
+    }
+}
+
+bool MqttBroker::Start(const Options& opt) {
+    if (mgr_ == nullptr) return false;
+    opt_ = opt;
+    listener_ = mg_mqtt_listen(mgr_, opt_.listen_url.c_str(), EventHandler, this);
+    if (listener_ == nullptr) {
+        if (logger_) logger_->Error("MQTT broker listen failed: " + opt_.listen_url);
+        return false;
+    }
+    if (logger_) logger_->Info("MQTT broker listening: " + opt_.listen_url);
+    return true;
+}
+
+bool MqttBroker::IsListening() const { return listener_ != nullptr; }
+
+bool MqttBroker::Publish(const std::string& topic, const std::string& payload, std::uint8_t qos, bool retain) {
+    (void)qos;
+    if (listener_ == nullptr || topic.empty()) return false;
+    Deliver(topic, payload, retain);
+    return true;
+}
+
+void MqttBroker::SetMessageHandler(MessageHandler handler) { on_msg_ = std::move(handler); }
+
+std::size_t MqttBroker::ClientCount() const { return clients_.size(); }
+
+void MqttBroker::EventHandler(struct mg_connection* c, int ev, void* ev_data) {
+    auto* self = static_cast<MqttBroker*>(c->fn_data);
+    if (self != nullptr) self->HandleEvent(c, ev, ev_data);
+}
+
+void MqttBroker::HandleEvent(struct mg_connection* c, int ev, void* ev_data) {
+    if (ev == MG_EV_MQTT_CMD) {
+        const auto* mm = static_cast<const mg_mqtt_message*>(ev_data);
+        if (mm == nullptr) return;
+        // Nothing but CONNECT before a CONNECT was accepted (a refused one leaves it draining).
+        if (mm->cmd != MQTT_CMD_CONNECT && std::find(clients_.begin(), clients_.end(), c) == clients_.end()) {
+            mg_error(c, "MQTT packet before CONNECT");
+            return;
+        }
+        switch (mm->cmd) {
+            case MQTT_CMD_CONNECT:
+                OnConnect(c, mm);
+                break;
+            case MQTT_CMD_SUBSCRIBE:
+                OnSubscribe(c, mm);
+                break;
+            case MQTT_CMD_UNSUBSCRIBE:
+                OnUnsubscribe(c, mm);
+                break;
+            case MQTT_CMD_PUBLISH:
+                OnPublish(c, mm);
+                break;
+            case MQTT_CMD_PUBREL:
+                OnPubrel(c, mm);
+                break;
+            case MQTT_CMD_PINGREQ:
+                mg_mqtt_send_header(c, MQTT_CMD_PINGRESP, 0, 0);
+                break;
+            case MQTT_CMD_DISCONNECT:
+                c->is_draining = 1;
+                break;
+            default:
+                break;
+        }
+    } else if (ev == MG_EV_CLOSE) {
+        if (c == listener_) {
+            listener_ = nullptr;
+            if (logger_) logger_->Warn("MQTT broker stopped");
+            return;
+        }
+        RemoveConnection(c);
+    }
+}
+
+void MqttBroker::OnConnect(struct mg_connection* c, const struct mg_mqtt_message* mm) {
+    const std::size_t off = FixedHeaderSize(mm->dgram);
+    if (off == 0 || off + 2 > mm->dgram.len) {
+        mg_error(c, "malformed MQTT CONNECT");
+        return;
+    }
+    const auto* b = reinterpret_cast<const unsigned char*>(mm->dgram.buf);
+    const std::size_t level_at = off + 2 + ReadU16(b + off);
+    const bool supported = level_at < mm->dgram.len && b[level_at] == 4;
+
+    const std::uint8_t connack[] = {0, static_cast<std::uint8_t>(supported ? 0 : 1)};
+    mg_mqtt_send_header(c, MQTT_CMD_CONNACK, 0, sizeof(connack));
+    mg_send(c, connack, sizeof(connack));
+    if (!supported) {
+        c->is_draining = 1;
+        return;
+    }
+    clients_.push_back(c);
+}
+
+void MqttBroker::OnSubscribe(struct mg_connection* c, const struct mg_mqtt_message* mm) {
+    const std::size_t off = FixedHeaderSize(mm->dgram);
+    if (off == 0 || off + 2 > mm->dgram.len) return;
+
+    std::vector<std::uint8_t> granted;
+    std::vector<std::string> added;
+    std::string filter;
+    std::uint8_t qos = 0;
+    std::size_t pos = off + 2;
+    while ((pos = NextTopic(mm->dgram, pos, true, filter, qos)) != 0) {
+        const bool exists = std::any_of(subs_.begin(), subs_.end(), [&](const Subscription& s) {
+            return s.conn == c && s.filter == filter;
+        });
+        if (!exists) {
+            if (!sub_routes_.Insert(filter, c)) {
+                granted.push_back(0x80);
+                continue;
+            }
+            Subscription s;
+            s.conn = c;
+            s.filter = filter;
+            subs_.push_back(std::move(s));
+        }
+        granted.push_back(0);
+        added.push_back(filter);
+        if (logger_) logger_->Debug("MQTT broker subscribe: " + filter);
+    }
+
+    const std::uint16_t id = mg_htons(mm->id);
+    mg_mqtt_send_header(c, MQTT_CMD_SUBACK, 0, static_cast<std::uint32_t>(granted.size() + 2));
+    mg_send(c, &id, sizeof(id));
+    mg_send(c, granted.data(), granted.size());
+
+    for (const auto& kv : retained_) {
+        for (const auto& f : added) {
+            if (!iotgw::core::common::topic::Matches(f, kv.first)) continue;
+            mg_mqtt_opts pub{};
+            pub.topic = mg_str_n(kv.first.data(), kv.first.size());
+            pub.message = mg_str_n(kv.second.data(), kv.second.size());
+            pub.retain = true;
+            (void)mg_mqtt_pub(c, &pub);
+            break;
+        }
+    }
+}
+
+void MqttBroker::OnUnsubscribe(struct mg_connection* c, const struct mg_mqtt_message* mm) {
+    const std::size_t off = FixedHeaderSize(mm->dgram);
+    if (off == 0 || off + 2 > mm->dgram.len) return;
+
+    std::string filter;
+    std::uint8_t qos = 0;
+    std::size_t pos = off + 2;
+    while ((pos = NextTopic(mm->dgram, pos, false, filter, qos)) != 0) {
+        (void)sub_routes_.Erase(filter, c);
+        subs_.erase(std::remove_if(subs_.begin(), subs_.end(),
+                                   [&](const Subscription& s) { return s.conn == c && s.filter == filter; }),
+                    subs_.end());
+    }
+
+    const std::uint16_t id = mg_htons(mm->id);
+    mg_mqtt_send_header(c, MQTT_CMD_UNSUBACK, 0, sizeof(id));
+    mg_send(c, &id, sizeof(id));
+}
+
+void MqttBroker::OnPublish(struct mg_connection* c, const struct mg_mqtt_message* mm) {
+    if (mm->qos > 2) {
+        mg_error(c, "malformed MQTT PUBLISH");
+        return;
+    }
+    // A QoS 2 retransmission of an id not yet released was already passed on.
+    bool deliver = mm->topic.len > 0;
+    if (mm->qos == 2) {
+        const auto key = std::make_pair(c, mm->id);
+        if (std::find(awaiting_rel_.begin(), awaiting_rel_.end(), key) != awaiting_rel_.end()) {
+            deliver = false;
+        } else {
+            awaiting_rel_.push_back(key);
+        }
+    }
+    if (deliver) {
+        const std::string topic(mm->topic.buf, mm->topic.len);
+        const std::string payload(mm->data.buf, mm->data.len);
+        const bool retain = mm->dgram.len > 0 && (static_cast<unsigned char>(mm->dgram.buf[0]) & 0x01) != 0;
+
+        Deliver(topic, payload, retain);
+        if (on_msg_) on_msg_(topic, payload);
+    }
+}
+
+void MqttBroker::OnPubrel(struct mg_connection* c, const struct mg_mqtt_message* mm) {
+    const auto key = std::make_pair(c, mm->id);
+    awaiting_rel_.erase(std::remove(awaiting_rel_.begin(), awaiting_rel_.end(), key), awaiting_rel_.end());
+}
+
+void MqttBroker::Deliver(const std::string& topic, const std::string& payload, bool retain) {
+    if (retain) {
+        if (payload.empty()) {
+            retained_.erase(topic);
+        } else {
+            retained_[topic] = payload;
+        }
+    }
+
+    // Overlapping subscriptions of one client still get a single copy.
+    std::vector<struct mg_connection*> targets;
+    sub_routes_.ForEachMatch(topic, [&](struct mg_connection* c, const iotgw::core::common::topic::TopicCaptures&) {
+        targets.push_back(c);
+    });
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+    mg_mqtt_opts pub{};
+    pub.topic = mg_str_n(topic.data(), topic.size());
+    pub.message = mg_str_n(payload.data(), payload.size());
+    for (auto* c : targets) (void)mg_mqtt_pub(c, &pub);
+}
+
+void MqttBroker::RemoveConnection(struct mg_connection* c) {
+    for (const auto& s : subs_) {
+        if (s.conn == c) (void)sub_routes_.Erase(s.filter, c);
+    }
+    subs_.erase(std::remove_if(subs_.begin(), subs_.end(), [&](const Subscription& s) { return s.conn == c; }),
+                subs_.end());
+    clients_.erase(std::remove(clients_.begin(), clients_.end(), c), clients_.end());
+    awaiting_rel_.erase(std::remove_if(awaiting_rel_.begin(), awaiting_rel_.end(),
+                                       [c](const std::pair<struct mg_connection*, std::uint16_t>& p) {
+                                           return p.first == c;
+                                       }),
+                        awaiting_rel_.end());
+}
+
+}  // namespace mqtt
+}  // namespace protocol_adapters
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
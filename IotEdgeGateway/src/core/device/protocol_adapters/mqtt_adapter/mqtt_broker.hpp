@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/common/logger/logger.hpp"
+#include "core/common/utils/topic_trie.hpp"
+#include "mongoose.h"
+
+namespace iotgw {
+namespace core {
+namespace device {
+namespace protocol_adapters {
+namespace mqtt {
+
+// In-process MQTT 3.1.1 broker for local devices.
+// Messages published by local clients are fanned out to local subscribers and
+// handed to the gateway through the message handler without a socket hop.
+// Delivery to subscribers is QoS 0. mongoose acknowledges inbound QoS 1 and 2 publishes
+// (PUBACK, PUBREC/PUBCOMP) itself; a QoS 2 message is passed on once even if retransmitted.
+// Connections that have not had a CONNECT accepted are closed on any other packet.
+class MqttBroker {
+public:
+    struct Options {
+        std::string listen_url = "mqtt://0.0.0.0:1883";
+    };
+
+    using MessageHandler = std::function<void(const std::string& topic, const std::string& payload)>;
+
+    explicit MqttBroker(struct mg_mgr* mgr, std::shared_ptr<iotgw::core::common::log::Logger> logger);
+    ~MqttBroker();
+
+    MqttBroker(const MqttBroker&) = delete;
+    MqttBroker& operator=(const MqttBroker&) = delete;
+
+    bool Start(const Options& opt);
+    bool IsListening() const;
+
+    // Deliver a message to local subscribers (gateway -> device direction).
+    bool Publish(const std::string& topic, const std::string& payload, std::uint8_t qos = 0, bool retain = false);
+
+    void SetMessageHandler(MessageHandler handler);
+
+    std::size_t ClientCount() const;
+
+private:
+    struct Subscription {
+        struct mg_connection* conn = nullptr;
+        std::string filter;
+    };
+
+    static void EventHandler(struct mg_connection* c, int ev, void* ev_data);
+    void HandleEvent(struct mg_connection* c, int ev, void* ev_data);
+
+    void OnConnect(struct mg_connection* c, const struct mg_mqtt_message* mm);
+    void OnSubscribe(struct mg_connection* c, const struct mg_mqtt_message* mm);
+    void OnUnsubscribe(struct mg_connection* c, const struct mg_mqtt_message* mm);
+    void OnPublish(struct mg_connection* c, const struct mg_mqtt_message* mm);
+    void OnPubrel(struct mg_connection* c, const struct mg_mqtt_message* mm);
+
+    void Deliver(const std::string& topic, const std::string& payload, bool retain);
+    void RemoveConnection(struct mg_connection* c);
+
+private:
+    struct mg_mgr* mgr_ = nullptr;
+    struct mg_connection* listener_ = nullptr;
+    Options opt_;
+    std::vector<struct mg_connection*> clients_;
+    std::vector<Subscription> subs_;
+    iotgw::core::common::topic::TopicTrie<struct mg_connection*> sub_routes_;
+    std::unordered_map<std::string, std::string> retained_;
+    // QoS 2 packet ids delivered but not yet released by PUBREL.
+    std::vector<std::pair<struct mg_connection*, std::uint16_t>> awaiting_rel_;
+    MessageHandler on_msg_;
+    std::shared_ptr<iotgw::core::common::log::Logger> logger_;
+};
+
+}  // namespace mqtt
+}  // namespace protocol_adapters
+}  // namespace device
+}  // namespace core
+}  // namespace iotgw
@@ -1,20 +1,97 @@
 #include "core/device/protocol_adapters/mqtt_adapter/mqtt_adapter.hpp"
 
+#include <algorithm>
+#include <string>
 #include <utility>
 
+#include "core/common/utils/time_utils.hpp"
+
 namespace iotgw {
 namespace core {
 namespace device {
 namespace protocol_adapters {
 namespace mqtt {
 
+namespace {
+
+static bool ReadVarint(const unsigned char* b, std::size_t len, std::size_t& pos, std::uint32_t& out) {
+    out = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (pos >= len) return false;
+        const unsigned char byte = b[pos++];
+        out |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static bool HasId(const unsigned char* ids, std::size_t n, unsigned char id) {
+    return std::find(ids, ids + n, id) != ids + n;
+}
+
+// Topic Alias Maximum of an MQTT 5 CONNACK, 0 if absent or malformed. mongoose parses
+// properties for PUBLISH only, so the CONNACK property block is walked here.
+static std::uint16_t ConnackTopicAliasMaximum(const struct mg_str& dgram) {
+    // Property identifiers by value encoding (MQTT 5.0, 2.2.2.2).
+    static const unsigned char kByte[] = {0x01, 0x17, 0x19, 0x24, 0x25, 0x28, 0x29, 0x2A};
+    static const unsigned char kTwoByte[] = {0x13, 0x21, 0x22, 0x23};
+    static const unsigned char kFourByte[] = {0x02, 0x11, 0x18, 0x27};
+    static const unsigned char kLengthPrefixed[] = {0x03, 0x08, 0x09, 0x12, 0x15, 0x16, 0x1A, 0x1C, 0x1F};
+    const unsigned char kVarint = 0x0B;
+    const unsigned char kUserProperty = 0x26;  // two length-prefixed strings
+
+    const auto* b = reinterpret_cast<const unsigned char*>(dgram.buf);
+    const std::size_t len = dgram.len;
+    std::size_t pos = 1;
+    std::uint32_t n = 0;
+    if (!ReadVarint(b, len, pos, n)) return 0;  // remaining length
+    pos += 2;                                   // acknowledge flags, reason code
+    if (!ReadVarint(b, len, pos, n) || pos > len || n > len - pos) return 0;
+    const std::size_t end = pos + n;
+    const auto u16_at = [b](std::size_t at) { return (static_cast<std::size_t>(b[at]) << 8) | b[at + 1]; };
+    while (pos < end) {
+        const unsigned char id = b[pos++];
+        if (id == MQTT_PROP_TOPIC_ALIAS_MAXIMUM) {
+            return pos + 2 <= end ? static_cast<std::uint16_t>(u16_at(pos)) : 0;
+        }
+        if (HasId(kByte, sizeof(kByte), id)) {
+            pos += 1;
+        } else if (HasId(kTwoByte, sizeof(kTwoByte), id)) {
+            pos += 2;
+        } else if (HasId(kFourByte, sizeof(kFourByte), id)) {
+            pos += 4;
+        } else if (id == kVarint) {
+            std::uint32_t v = 0;
+            if (!ReadVarint(b, end, pos, v)) return 0;
+        } else if (HasId(kLengthPrefixed, sizeof(kLengthPrefixed), id) || id == kUserProperty) {
+            for (int k = id == kUserProperty ? 2 : 1; k > 0; --k) {
+                if (pos + 2 > end) return 0;
+                pos += 2 + u16_at(pos);
+            }
+        } else {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
 MqttClient::MqttClient(struct mg_mgr* mgr, std::shared_ptr<iotgw::core::common::log::Logger> logger)
     : mgr_(mgr), logger_(std::move(logger)) {}
 
+MqttClient::~MqttClient() {
+    // The manager may outlive us; detach so its close events do not reach a dead object.
+    if (conn_ != nullptr) conn_->fn_data = nullptr;
+}
+
 bool MqttClient::Connect(const Options& opt) {
     if (mgr_ == nullptr) return false;
     opt_ = opt;
+    return Open();
+}
 
+bool MqttClient::Open() {
     mg_mqtt_opts mo{};
     mo.user = mg_str(opt_.user.c_str());
     mo.pass = mg_str(opt_.pass.c_str());
@@ -25,6 +102,7 @@ bool MqttClient::Connect(const Options& opt) {
 
     conn_ = mg_mqtt_connect(mgr_, opt_.url.c_str(), &mo, EventHandler, this);
     if (conn_ == nullptr) {
+        closed_at_ms_ = iotgw::core::common::time::NowUnixMs();
         if (logger_) logger_->Error("MQTT connect failed: " + opt_.url);
         return false;
     }
@@ -34,29 +112,72 @@ bool MqttClient::Connect(const Options& opt) {
 
 bool MqttClient::Subscribe(const std::string& topic, std::uint8_t qos) {
     if (topic.empty()) return false;
-    pending_sub_topic_ = topic;
-    pending_sub_qos_ = qos;
+    for (auto& s : subs_) {
+        if (s.first == topic) {
+            s.second = qos;
+            if (conn_ != nullptr && open_) SendSubscribe(conn_, topic, qos);
+            return true;
+        }
+    }
+    subs_.emplace_back(topic, qos);
 
     if (conn_ == nullptr || !open_) return true;
+    SendSubscribe(conn_, topic, qos);
+    return true;
+}
 
+void MqttClient::SendSubscribe(struct mg_connection* c, const std::string& topic, std::uint8_t qos) {
+    const std::string filter = opt_.share_group.empty() ? topic : ("$share/" + opt_.share_group + "/" + topic);
     mg_mqtt_opts sub{};
-    sub.topic = mg_str(pending_sub_topic_.c_str());
-    sub.qos = pending_sub_qos_;
-    mg_mqtt_sub(conn_, &sub);
-    if (logger_) logger_->Info("MQTT subscribed: " + pending_sub_topic_);
-    return true;
+    sub.topic = mg_str(filter.c_str());
+    sub.qos = qos;
+    mg_mqtt_sub(c, &sub);
+    if (logger_) logger_->Info("MQTT subscribed: " + filter);
 }
 
-bool MqttClient::Publish(const std::string& topic, const std::string& payload, std::uint8_t qos, bool retain) {
+bool MqttClient::Publish(const std::string& topic, const std::string& payload, std::uint8_t qos, bool retain,
+                         std::uint32_t expiry_sec) {
     if (conn_ == nullptr || !open_) return false;
     if (topic.empty()) return false;
 
+    mg_mqtt_prop props[2]{};
+    std::size_t num_props = 0;
+
     mg_mqtt_opts pub{};
-    pub.topic = mg_str(topic.c_str());
-    pub.message = mg_str(payload.c_str());
+    pub.topic = mg_str_n(topic.data(), topic.size());
+    pub.message = mg_str_n(payload.data(), payload.size());
     pub.qos = qos;
     pub.retain = retain;
+
+    if (opt_.version == 5) {
+        // The first publish on a topic binds an alias; later ones send an empty topic plus the alias.
+        const auto it = aliases_.find(topic);
+        if (it != aliases_.end()) {
+            props[num_props].id = MQTT_PROP_TOPIC_ALIAS;
+            props[num_props].iv = it->second;
+            ++num_props;
+            pub.topic = mg_str_n("", 0);
+            ++stats_.alias_hits;
+        } else if (aliases_.size() < alias_limit_) {
+            const auto alias = static_cast<std::uint16_t>(aliases_.size() + 1);
+            aliases_.emplace(topic, alias);
+            props[num_props].id = MQTT_PROP_TOPIC_ALIAS;
+            props[num_props].iv = alias;
+            ++num_props;
+        }
+        if (expiry_sec > 0) {
+            props[num_props].id = MQTT_PROP_MESSAGE_EXPIRY_INTERVAL;
+            props[num_props].iv = expiry_sec;
+            ++num_props;
+        }
+        pub.props = props;
+        pub.num_props = num_props;
+    }
+
+    const std::size_t before = conn_->send.len;
     (void)mg_mqtt_pub(conn_, &pub);
+    ++stats_.publishes;
+    stats_.publish_bytes += conn_->send.len - before;
     return true;
 }
 
@@ -64,13 +185,32 @@ void MqttClient::SetMessageHandler(MessageHandler handler) { on_msg_ = std::move
 
 bool MqttClient::IsOpen() const { return open_; }
 
+std::size_t MqttClient::PendingBytes() const { return conn_ != nullptr ? conn_->send.len : 0; }
+
+std::uint8_t MqttClient::Version() const { return opt_.version; }
+
+const MqttClient::Stats& MqttClient::GetStats() const { return stats_; }
+
+void MqttClient::Poll(std::int64_t now_ms) {
+    if (conn_ != nullptr || mgr_ == nullptr || opt_.url.empty()) return;
+    if (opt_.reconnect_interval_ms <= 0 || now_ms - closed_at_ms_ < opt_.reconnect_interval_ms) return;
+    (void)Open();
+}
+
 void MqttClient::EventHandler(struct mg_connection* c, int ev, void* ev_data) {
     auto* self = static_cast<MqttClient*>(c->fn_data);
     if (self != nullptr) self->HandleEvent(c, ev, ev_data);
 }
 
 void MqttClient::HandleEvent(struct mg_connection* c, int ev, void* ev_data) {
-    if (ev == MG_EV_MQTT_OPEN) {
+    if (ev == MG_EV_MQTT_CMD) {
+        auto* mm = static_cast<mg_mqtt_message*>(ev_data);
+        if (mm == nullptr || mm->cmd != MQTT_CMD_CONNACK || opt_.version != 5) return;
+        // Aliases are per connection and only usable up to the broker's Topic Alias Maximum (0 if absent).
+        aliases_.clear();
+        alias_limit_ = std::min<std::uint16_t>(ConnackTopicAliasMaximum(mm->dgram), opt_.topic_alias_max);
+        if (logger_) logger_->Info("MQTT 5 topic aliases: " + std::to_string(alias_limit_));
+    } else if (ev == MG_EV_MQTT_OPEN) {
         const int* code = static_cast<const int*>(ev_data);
         open_ = (code != nullptr && *code == 0);
         if (!open_) {
@@ -78,13 +218,7 @@ void MqttClient::HandleEvent(struct mg_connection* c, int ev, void* ev_data) {
             return;
         }
         if (logger_) logger_->Info("MQTT connected");
-        if (!pending_sub_topic_.empty()) {
-            mg_mqtt_opts sub{};
-            sub.topic = mg_str(pending_sub_topic_.c_str());
-            sub.qos = pending_sub_qos_;
-            mg_mqtt_sub(c, &sub);
-            if (logger_) logger_->Info("MQTT subscribed: " + pending_sub_topic_);
-        }
+        for (const auto& s : subs_) SendSubscribe(c, s.first, s.second);
     } else if (ev == MG_EV_MQTT_MSG) {
         const auto* mm = static_cast<const mg_mqtt_message*>(ev_data);
         if (mm == nullptr) return;
@@ -95,6 +229,9 @@ void MqttClient::HandleEvent(struct mg_connection* c, int ev, void* ev_data) {
         if (c == conn_) {
             open_ = false;
             conn_ = nullptr;
+            aliases_.clear();
+            alias_limit_ = 0;
+            closed_at_ms_ = iotgw::core::common::time::NowUnixMs();
             if (logger_) logger_->Warn("MQTT disconnected");
         }
     }
@@ -0,0 +1,157 @@
+#include "core/stream/anomaly_detector.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+namespace {
+
+constexpr float kMadToSigma = 1.4826f;  // MAD of a normal distribution is 0.6745 sigma
+// Spread never taken below this fraction of the level, so a sensor that sat at one
+// value through warmup does not flag its first quantization step.
+constexpr float kRelativeFloor = 1e-3f;
+
+static float Floor(float level) { return kRelativeFloor * (std::fabs(level) + 1.0f); }
+
+static float Sign(float v) { return v > 0.0f ? 1.0f : (v < 0.0f ? -1.0f : 0.0f); }
+
+}  // namespace
+
+constexpr std::uint32_t AnomalyDetector::kNoSensor;
+constexpr std::size_t AnomalyDetector::kRecentEvents;
+
+AnomalyDetector::AnomalyDetector(const AnomalyConfig& cfg) : cfg_(cfg) {
+    if (!(cfg_.alpha > 0.0 && cfg_.alpha < 1.0)) cfg_.alpha = AnomalyConfig().alpha;
+    mean_.assign(cfg_.max_sensors, 0.0f);
+    var_.assign(cfg_.max_sensors, 0.0f);
+    median_.assign(cfg_.max_sensors, 0.0f);
+    mad_.assign(cfg_.max_sensors, 0.0f);
+    count_.assign(cfg_.max_sensors, 0);
+    outliers_.assign(cfg_.max_sensors, 0);
+}
+
+std::uint32_t AnomalyDetector::Attach(const std::string& name) {
+    const auto it = by_name_.find(name);
+    if (it != by_name_.end()) return it->second;
+    if (names_.size() >= cfg_.max_sensors) {
+        ++stats_.refused;
+        return kNoSensor;
+    }
+    const auto s = static_cast<std::uint32_t>(names_.size());
+    names_.push_back(name);
+    by_name_.emplace(name, s);
+    return s;
+}
+
+double AnomalyDetector::StddevOf(std::uint32_t sensor) const { return std::sqrt(var_[sensor]); }
+
+bool AnomalyDetector::Observe(std::uint32_t sensor, double x, std::int64_t ts_us) {
+    const float v = static_cast<float>(x);
+    SampleBlock b;
+    b.values = &v;
+    b.count = 1;
+    b.t0_us = ts_us;
+    return ObserveBlock(sensor, b) > 0;
+}
+
+std::size_t AnomalyDetector::ObserveBlock(std::uint32_t sensor, const SampleBlock& block) {
+    if (sensor >= names_.size() || block.count == 0) return 0;
+    const float* v = block.values;
+    const std::size_t n = block.count;
+    stats_.samples += n;
+
+    std::size_t flagged = 0;
+    if (count_[sensor] >= cfg_.warmup) {
+        const float m = mean_[sensor];
+        const float med = median_[sensor];
+        const float inv_s = 1.0f / std::max(std::sqrt(var_[sensor]), Floor(m));
+        const float inv_r = 1.0f / std::max(kMadToSigma * mad_[sensor], Floor(med));
+        const auto zt = static_cast<float>(cfg_.z_threshold);
+        const auto rt = static_cast<float>(cfg_.mad_threshold);
+        if (flags_.size() < n) flags_.resize(n);
+        std::uint8_t* flags = flags_.data();
+        for (std::size_t k = 0; k < n; ++k) {
+            const bool out = (std::fabs(v[k] - m) * inv_s > zt) & (std::fabs(v[k] - med) * inv_r > rt);
+            flags[k] = static_cast<std::uint8_t>(out);
+            flagged += flags[k];
+        }
+        if (flagged > 0) {
+            std::size_t worst = 0;
+            float worst_r = -1.0f;
+            for (std::size_t k = 0; k < n; ++k) {
+                const float r = std::fabs(v[k] - med) * inv_r;
+                if (flags[k] != 0 && r > worst_r) {
+                    worst_r = r;
+                    worst = k;
+                }
+            }
+            AnomalyEvent e;
+            e.sensor = sensor;
+            e.value = v[worst];
+            e.z = (v[worst] - m) * inv_s;
+            e.robust_z = (v[worst] - med) * inv_r;
+            e.ts_us = block.TimeAt(worst);
+            e.flagged = static_cast<std::uint32_t>(flagged);
+            stats_.outliers += flagged;
+            outliers_[sensor] += e.flagged;
+            Emit(e);
+        }
+    }
+
+    for (std::size_t k = 0; k < n; ++k) Update(sensor, v[k]);
+    return flagged;
+}
+
+void AnomalyDetector::Update(std::uint32_t s, float x) {
+    const std::uint32_t n = count_[s];
+    if (n == 0) {
+        mean_[s] = x;
+        median_[s] = x;
+        var_[s] = 0.0f;
+        mad_[s] = 0.0f;
+        count_[s] = 1;
+        return;
+    }
+    // Plain averages until 1/n drops below alpha, so the estimates settle quickly.
+    const float a = std::max(static_cast<float>(cfg_.alpha), 1.0f / static_cast<float>(n + 1));
+    float sigma = std::max(std::sqrt(var_[s]), Floor(mean_[s]));
+    if (n >= cfg_.warmup) {
+        const auto limit = static_cast<float>(cfg_.z_threshold) * sigma;
+        x = std::min(std::max(x, mean_[s] - limit), mean_[s] + limit);
+    }
+
+    const float d = x - mean_[s];
+    mean_[s] += a * d;
+    var_[s] = (1.0f - a) * (var_[s] + a * d * d);
+
+    // Signed steps settle where half the samples lie on either side: the median, and
+    // for the absolute deviation from it, the MAD.
+    sigma = std::max(std::max(kMadToSigma * mad_[s], std::sqrt(var_[s])), Floor(median_[s]));
+    const float step = a * sigma;
+    median_[s] += step * Sign(x - median_[s]);
+    mad_[s] = std::max(0.0f, mad_[s] + step * Sign(std::fabs(x - median_[s]) - mad_[s]));
+    if (n < std::numeric_limits<std::uint32_t>::max()) count_[s] = n + 1;
+}
+
+void AnomalyDetector::Emit(const AnomalyEvent& e) {
+    recent_[recent_next_ % kRecentEvents] = e;
+    ++recent_next_;
+    ++stats_.events;
+    if (on_event_) on_event_(e);
+}
+
+std::vector<AnomalyEvent> AnomalyDetector::Recent() const {
+    std::vector<AnomalyEvent> out;
+    const std::size_t n = std::min(recent_next_, kRecentEvents);
+    out.reserve(n);
+    for (std::size_t i = recent_next_ - n; i < recent_next_; ++i) out.push_back(recent_[i % kRecentEvents]);
+    return out;
+}
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
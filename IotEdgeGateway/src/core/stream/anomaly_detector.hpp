@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/stream/stream_store.hpp"
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+struct AnomalyConfig {
+    double alpha = 0.02;          // weight of a new sample in the running estimates
+    double z_threshold = 4.0;     // |x - ewma| / ewm stddev
+    double mad_threshold = 5.0;   // |x - median| / (1.4826 * MAD)
+    std::uint32_t warmup = 50;    // samples per sensor before anything is flagged
+    std::size_t max_sensors = 65536;
+};
+
+// A sample both estimators call an outlier. For a block only its worst sample is reported.
+struct AnomalyEvent {
+    std::uint32_t sensor = 0;
+    double value = 0.0;
+    double z = 0.0;          // EWMA z-score
+    double robust_z = 0.0;   // MAD z-score
+    std::int64_t ts_us = 0;
+    std::uint32_t flagged = 0;  // outliers in the block that produced the event
+};
+
+// Online outlier detection with O(1) state per sensor: an exponentially weighted
+// mean and variance plus a running median and MAD estimated by signed steps. A
+// sample is an outlier when both its z-score and its robust z-score exceed their
+// thresholds, so a noisy sensor needs a genuinely unusual value, not just a wide
+// swing. Outliers are clipped before they update the estimates.
+//
+// State for `max_sensors` is allocated up front (about 24 bytes per sensor), so
+// memory does not grow with the fleet; sensors beyond the budget are refused.
+class AnomalyDetector {
+public:
+    static constexpr std::uint32_t kNoSensor = static_cast<std::uint32_t>(-1);
+    static constexpr std::size_t kRecentEvents = 64;
+
+    using Handler = std::function<void(const AnomalyEvent& e)>;
+
+    struct Stats {
+        std::uint64_t samples = 0;
+        std::uint64_t outliers = 0;
+        std::uint64_t events = 0;
+        std::uint64_t refused = 0;  // sensors beyond max_sensors
+    };
+
+    explicit AnomalyDetector(const AnomalyConfig& cfg = AnomalyConfig());
+
+    void SetHandler(Handler h) { on_event_ = std::move(h); }
+    const AnomalyConfig& Config() const { return cfg_; }
+
+    // Sensor slot by name, created on first use; kNoSensor once the budget is used up.
+    std::uint32_t Attach(const std::string& name);
+    std::size_t Size() const { return names_.size(); }
+    const std::string& NameOf(std::uint32_t sensor) const { return names_[sensor]; }
+
+    // One reading. True if it was an outlier (the handler has been called).
+    bool Observe(std::uint32_t sensor, double x, std::int64_t ts_us);
+
+    // A block of one sensor's samples. Every sample is scored against the estimates
+    // as they were before the block, in one branch-free pass, then the estimates are
+    // advanced through the block. Returns the number of outliers.
+    std::size_t ObserveBlock(std::uint32_t sensor, const SampleBlock& block);
+
+    std::uint32_t CountOf(std::uint32_t sensor) const { return count_[sensor]; }
+    double MeanOf(std::uint32_t sensor) const { return mean_[sensor]; }
+    double StddevOf(std::uint32_t sensor) const;
+    double MedianOf(std::uint32_t sensor) const { return median_[sensor]; }
+    double MadOf(std::uint32_t sensor) const { return mad_[sensor]; }
+    std::uint32_t OutliersOf(std::uint32_t sensor) const { return outliers_[sensor]; }
+
+    // Most recent events, oldest first.
+    std::vector<AnomalyEvent> Recent() const;
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    void Update(std::uint32_t s, float x);
+    void Emit(const AnomalyEvent& e);
+
+private:
+    AnomalyConfig cfg_;
+    std::unordered_map<std::string, std::uint32_t> by_name_;
+    std::vector<std::string> names_;
+    // Structure of arrays, all sized max_sensors.
+    std::vector<float> mean_;
+    std::vector<float> var_;
+    std::vector<float> median_;
+    std::vector<float> mad_;
+    std::vector<std::uint32_t> count_;
+    std::vector<std::uint32_t> outliers_;
+    std::vector<std::uint8_t> flags_;  // scratch for ObserveBlock
+    AnomalyEvent recent_[kRecentEvents];
+    std::size_t recent_next_ = 0;
+    Stats stats_;
+    Handler on_event_;
+};
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
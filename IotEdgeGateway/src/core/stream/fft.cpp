@@ -0,0 +1,145 @@
+#include "core/stream/fft.hpp"
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// (a, b) <- (a + w*b, a - w*b) for `count` butterflies; a, b and w are split into re/im arrays.
+static void Butterflies(float* ar, float* ai, float* br, float* bi, const float* wr, const float* wi,
+                        std::size_t count) {
+    std::size_t j = 0;
+#if defined(__SSE2__)
+    for (; j + 4 <= count; j += 4) {
+        const __m128 xr = _mm_loadu_ps(br + j);
+        const __m128 xi = _mm_loadu_ps(bi + j);
+        const __m128 cr = _mm_loadu_ps(wr + j);
+        const __m128 ci = _mm_loadu_ps(wi + j);
+        const __m128 tr = _mm_sub_ps(_mm_mul_ps(cr, xr), _mm_mul_ps(ci, xi));
+        const __m128 ti = _mm_add_ps(_mm_mul_ps(cr, xi), _mm_mul_ps(ci, xr));
+        const __m128 ur = _mm_loadu_ps(ar + j);
+        const __m128 ui = _mm_loadu_ps(ai + j);
+        _mm_storeu_ps(ar + j, _mm_add_ps(ur, tr));
+        _mm_storeu_ps(ai + j, _mm_add_ps(ui, ti));
+        _mm_storeu_ps(br + j, _mm_sub_ps(ur, tr));
+        _mm_storeu_ps(bi + j, _mm_sub_ps(ui, ti));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; j + 4 <= count; j += 4) {
+        const float32x4_t xr = vld1q_f32(br + j);
+        const float32x4_t xi = vld1q_f32(bi + j);
+        const float32x4_t cr = vld1q_f32(wr + j);
+        const float32x4_t ci = vld1q_f32(wi + j);
+        const float32x4_t tr = vfmsq_f32(vmulq_f32(cr, xr), ci, xi);
+        const float32x4_t ti = vfmaq_f32(vmulq_f32(cr, xi), ci, xr);
+        const float32x4_t ur = vld1q_f32(ar + j);
+        const float32x4_t ui = vld1q_f32(ai + j);
+        vst1q_f32(ar + j, vaddq_f32(ur, tr));
+        vst1q_f32(ai + j, vaddq_f32(ui, ti));
+        vst1q_f32(br + j, vsubq_f32(ur, tr));
+        vst1q_f32(bi + j, vsubq_f32(ui, ti));
+    }
+#endif
+    for (; j < count; ++j) {
+        const float tr = wr[j] * br[j] - wi[j] * bi[j];
+        const float ti = wr[j] * bi[j] + wi[j] * br[j];
+        br[j] = ar[j] - tr;
+        bi[j] = ai[j] - ti;
+        ar[j] += tr;
+        ai[j] += ti;
+    }
+}
+
+}  // namespace
+
+RealFft::RealFft(std::size_t n) {
+    n_ = 4;
+    while (n_ < n) n_ <<= 1;
+    m_ = n_ / 2;
+
+    unsigned bits = 0;
+    while ((static_cast<std::size_t>(1) << bits) < m_) ++bits;
+    rev_.resize(m_);
+    for (std::size_t i = 0; i < m_; ++i) {
+        std::uint32_t r = 0;
+        for (unsigned b = 0; b < bits; ++b) r |= static_cast<std::uint32_t>(((i >> b) & 1u) << (bits - 1 - b));
+        rev_[i] = r;
+    }
+
+    tw_re_.resize(m_);
+    tw_im_.resize(m_);
+    for (std::size_t half = 1; half < m_; half <<= 1) {
+        for (std::size_t j = 0; j < half; ++j) {
+            const double a = -kPi * static_cast<double>(j) / static_cast<double>(half);
+            tw_re_[half - 1 + j] = static_cast<float>(std::cos(a));
+            tw_im_[half - 1 + j] = static_cast<float>(std::sin(a));
+        }
+    }
+
+    split_re_.resize(m_);
+    split_im_.resize(m_);
+    for (std::size_t k = 0; k < m_; ++k) {
+        const double a = -2.0 * kPi * static_cast<double>(k) / static_cast<double>(n_);
+        split_re_[k] = static_cast<float>(std::cos(a));
+        split_im_[k] = static_cast<float>(std::sin(a));
+    }
+
+    re_.resize(m_);
+    im_.resize(m_);
+}
+
+void RealFft::Transform() {
+    float* re = re_.data();
+    float* im = im_.data();
+    for (std::size_t half = 1; half < m_; half <<= 1) {
+        const float* wr = tw_re_.data() + half - 1;
+        const float* wi = tw_im_.data() + half - 1;
+        for (std::size_t k = 0; k < m_; k += 2 * half) {
+            Butterflies(re + k, im + k, re + k + half, im + k + half, wr, wi, half);
+        }
+    }
+}
+
+void RealFft::Power(const float* in, float* power) {
+    // Even samples become the real parts, odd ones the imaginary parts, in bit-reversed order.
+    for (std::size_t i = 0; i < m_; ++i) {
+        re_[rev_[i]] = in[2 * i];
+        im_[rev_[i]] = in[2 * i + 1];
+    }
+    Transform();
+
+    // X[k] = E[k] + W^k O[k], where E and O are the spectra of the even and odd samples:
+    // E[k] = (Z[k] + conj(Z[m-k])) / 2, O[k] = (Z[k] - conj(Z[m-k])) / 2i.
+    const float dc = re_[0] + im_[0];
+    const float nyquist = re_[0] - im_[0];
+    power[0] = dc * dc;
+    power[m_] = nyquist * nyquist;
+    for (std::size_t k = 1; k < m_; ++k) {
+        const float ar = re_[k];
+        const float ai = im_[k];
+        const float br = re_[m_ - k];
+        const float bi = -im_[m_ - k];
+        const float er = 0.5f * (ar + br);
+        const float ei = 0.5f * (ai + bi);
+        const float orr = 0.5f * (ai - bi);
+        const float oi = -0.5f * (ar - br);
+        const float xr = er + split_re_[k] * orr - split_im_[k] * oi;
+        const float xi = ei + split_re_[k] * oi + split_im_[k] * orr;
+        power[k] = xr * xr + xi * xi;
+    }
+}
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+// Forward FFT of a real signal of n = 2^k samples, computed as an n/2-point complex
+// FFT (radix-2, decimation in time) plus a split pass. Bit-reversal order and all
+// twiddles are precomputed; butterflies run 4 at a time with SSE2 or NEON where
+// available. Not thread-safe: the work buffers are members.
+class RealFft {
+public:
+    // `n` is rounded up to a power of two, at least 4.
+    explicit RealFft(std::size_t n);
+
+    std::size_t Size() const { return n_; }
+    std::size_t Bins() const { return n_ / 2 + 1; }
+
+    // |X[k]|^2 for k = 0..n/2 of the n samples at `in`, into `power` (Bins() values).
+    void Power(const float* in, float* power);
+
+private:
+    void Transform();  // in-place complex FFT of re_/im_
+
+private:
+    std::size_t n_;
+    std::size_t m_;  // complex points, n/2
+    std::vector<std::uint32_t> rev_;
+    // Stage twiddles exp(-i*pi*j/half), j < half, for half = 1, 2, 4, .. at offset half-1.
+    std::vector<float> tw_re_;
+    std::vector<float> tw_im_;
+    // Split twiddles exp(-2*pi*i*k/n), k < m.
+    std::vector<float> split_re_;
+    std::vector<float> split_im_;
+    std::vector<float> re_;
+    std::vector<float> im_;
+};
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+// Most recent samples of one channel in a ring allocated up front. Timestamps are
+// not stored per sample: every appended block keeps its start time and period,
+// and a sample's time is computed from the block it came in.
+class SampleRing {
+public:
+    // Block descriptors kept; samples whose block has been forgotten are no longer readable.
+    static constexpr std::size_t kMaxBlocks = 64;
+
+    // `capacity` is rounded up to a power of two.
+    explicit SampleRing(std::size_t capacity) {
+        std::size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        values_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    std::size_t Capacity() const { return values_.size(); }
+    std::uint64_t Total() const { return next_; }  // samples ever appended
+    std::size_t Size() const { return static_cast<std::size_t>(next_ - Oldest()); }
+
+    void Append(const float* v, std::size_t n, std::int64_t t0_us, std::int64_t period_us) {
+        if (n == 0) return;
+        PushBlock(Block{next_, t0_us, period_us});
+        // Only the tail of a block larger than the ring survives.
+        const std::size_t keep = std::min(n, values_.size());
+        const std::uint64_t first = next_ + (n - keep);
+        const std::size_t at = static_cast<std::size_t>(first) & mask_;
+        const std::size_t head = std::min(keep, values_.size() - at);
+        std::memcpy(values_.data() + at, v + (n - keep), head * sizeof(float));
+        std::memcpy(values_.data(), v + (n - keep) + head, (keep - head) * sizeof(float));
+        next_ += n;
+        DropOverwrittenBlocks();
+    }
+
+    // The last `n` readable samples (fewer if there are not as many), oldest first,
+    // with their times in microseconds; `ts_us` may be null. Returns the count.
+    std::size_t CopyLast(std::size_t n, float* values, std::int64_t* ts_us) const {
+        const std::uint64_t oldest = Oldest();
+        const std::uint64_t start = next_ - std::min<std::uint64_t>(n, next_ - oldest);
+        std::size_t b = 0;
+        for (std::uint64_t i = start; i < next_; ++i) {
+            const std::size_t k = static_cast<std::size_t>(i - start);
+            values[k] = values_[static_cast<std::size_t>(i) & mask_];
+            if (ts_us == nullptr) continue;
+            while (b + 1 < block_count_ && BlockAt(b + 1).first <= i) ++b;
+            const Block& blk = BlockAt(b);
+            ts_us[k] = blk.t0_us + blk.period_us * static_cast<std::int64_t>(i - blk.first);
+        }
+        return static_cast<std::size_t>(next_ - start);
+    }
+
+private:
+    struct Block {
+        std::uint64_t first;  // index of its first sample
+        std::int64_t t0_us;
+        std::int64_t period_us;
+    };
+
+    const Block& BlockAt(std::size_t i) const { return blocks_[(block_head_ + i) % kMaxBlocks]; }
+
+    std::uint64_t Oldest() const {
+        const std::uint64_t by_ring = next_ > values_.size() ? next_ - values_.size() : 0;
+        const std::uint64_t by_block = block_count_ > 0 ? BlockAt(0).first : next_;
+        return std::max(by_ring, by_block);
+    }
+
+    void PushBlock(const Block& b) {
+        if (block_count_ == kMaxBlocks) {
+            block_head_ = (block_head_ + 1) % kMaxBlocks;
+            --block_count_;
+        }
+        blocks_[(block_head_ + block_count_) % kMaxBlocks] = b;
+        ++block_count_;
+    }
+
+    // A block is still needed while any of its samples is in the ring.
+    void DropOverwrittenBlocks() {
+        const std::uint64_t by_ring = next_ > values_.size() ? next_ - values_.size() : 0;
+        while (block_count_ > 1 && BlockAt(1).first <= by_ring) {
+            block_head_ = (block_head_ + 1) % kMaxBlocks;
+            --block_count_;
+        }
+    }
+
+private:
+    std::vector<float> values_;
+    std::size_t mask_ = 0;
+    Block blocks_[kMaxBlocks] = {};
+    std::size_t block_head_ = 0;
+    std::size_t block_count_ = 0;
+    std::uint64_t next_ = 0;
+};
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
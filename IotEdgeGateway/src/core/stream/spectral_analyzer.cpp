@@ -0,0 +1,128 @@
+#include "core/stream/spectral_analyzer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+}  // namespace
+
+constexpr std::size_t SpectralFeatures::kMaxBands;
+
+SpectralAnalyzer::SpectralAnalyzer(const SpectralConfig& cfg) : fft_(cfg.fft_size) {
+    const std::size_t n = fft_.Size();
+    hop_ = cfg.hop > 0 && cfg.hop <= n ? cfg.hop : n / 2;
+    bands_ = cfg.bands;
+    if (bands_.size() > SpectralFeatures::kMaxBands) bands_.resize(SpectralFeatures::kMaxBands);
+
+    window_.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        const double w = 0.5 - 0.5 * std::cos(2.0 * kPi * static_cast<double>(i) / static_cast<double>(n));
+        window_[i] = static_cast<float>(w);
+        window_sum_ += w;
+        window_power_ += w * w;
+    }
+    frame_.resize(n);
+    power_.resize(fft_.Bins());
+}
+
+void SpectralAnalyzer::OnBlock(const SampleBlock& b) {
+    if (b.period_us <= 0 || b.count == 0) return;
+    if (b.stream >= state_.size()) state_.resize(static_cast<std::size_t>(b.stream) + 1);
+    State& s = state_[b.stream];
+    const std::size_t n = fft_.Size();
+    if (s.ring.empty()) s.ring.resize(n);
+    if (s.period_us != b.period_us) {
+        s.period_us = b.period_us;
+        s.write = 0;
+        s.filled = 0;
+        s.since = 0;
+    }
+
+    // Copy up to the ring's end or the next frame, whichever comes first: the first
+    // frame is due once the ring is full, later ones every hop samples.
+    std::size_t i = 0;
+    while (i < b.count) {
+        std::size_t chunk = std::min(b.count - i, n - s.write);
+        chunk = std::min(chunk, s.filled < n ? n - s.filled : hop_ - s.since);
+        std::memcpy(s.ring.data() + s.write, b.values + i, chunk * sizeof(float));
+        s.write = (s.write + chunk) % n;
+        s.filled = std::min(n, s.filled + chunk);
+        s.since += chunk;
+        i += chunk;
+        if (s.filled == n && s.since >= hop_) {
+            Frame(b.stream, s, b.TimeAt(i - 1));
+            s.since = 0;
+        }
+    }
+}
+
+void SpectralAnalyzer::Frame(StreamId stream, State& s, std::int64_t ts_us) {
+    const std::size_t n = fft_.Size();
+    // Oldest sample first.
+    const std::size_t head = n - s.write;
+    std::memcpy(frame_.data(), s.ring.data() + s.write, head * sizeof(float));
+    std::memcpy(frame_.data() + head, s.ring.data(), s.write * sizeof(float));
+
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i) sum += frame_[i];
+    const auto mean = static_cast<float>(sum / static_cast<double>(n));
+    double sum_sq = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const float x = frame_[i] - mean;
+        sum_sq += static_cast<double>(x) * x;
+        frame_[i] = x * window_[i];
+    }
+    fft_.Power(frame_.data(), power_.data());
+
+    // One-sided mean-square spectrum: bins between DC and Nyquist count twice, and
+    // dividing by n * sum(w^2) undoes the window, so the bins sum to the mean square.
+    const std::size_t bins = fft_.Bins();
+    const double scale = 1.0 / (static_cast<double>(n) * window_power_);
+    const double fs = 1e6 / static_cast<double>(s.period_us);
+    const double bin_hz = fs / static_cast<double>(n);
+
+    SpectralFeatures& f = s.last;
+    f = SpectralFeatures();
+    f.ts_us = ts_us;
+    f.sample_rate_hz = fs;
+    f.rms = std::sqrt(sum_sq / static_cast<double>(n));
+    f.band_count = bands_.size();
+
+    std::size_t peak = 1;
+    for (std::size_t k = 0; k < bins; ++k) {
+        const double p = power_[k] * scale * ((k == 0 || k == bins - 1) ? 1.0 : 2.0);
+        const double hz = static_cast<double>(k) * bin_hz;
+        for (std::size_t j = 0; j < bands_.size(); ++j) {
+            if (hz >= bands_[j].min_hz && hz < bands_[j].max_hz) f.band_energy[j] += p;
+        }
+        if (k >= 1 && power_[k] > power_[peak]) peak = k;
+    }
+
+    // Parabolic interpolation of the magnitude around the peak bin.
+    double delta = 0.0;
+    if (peak > 0 && peak + 1 < bins) {
+        const double a = std::sqrt(power_[peak - 1]);
+        const double b = std::sqrt(power_[peak]);
+        const double c = std::sqrt(power_[peak + 1]);
+        const double d = a - 2.0 * b + c;
+        if (d < 0.0) delta = 0.5 * (a - c) / d;
+    }
+    f.peak_hz = (static_cast<double>(peak) + delta) * bin_hz;
+    f.peak_amplitude = 2.0 * std::sqrt(power_[peak]) / window_sum_;
+
+    s.has_last = true;
+    ++frames_;
+    if (on_frame_) on_frame_(stream, f);
+}
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
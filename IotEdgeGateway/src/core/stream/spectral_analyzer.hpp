@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "core/stream/fft.hpp"
+#include "core/stream/stream_store.hpp"
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+struct SpectralBand {
+    double min_hz = 0.0;  // inclusive
+    double max_hz = 0.0;  // exclusive
+};
+
+struct SpectralConfig {
+    std::size_t fft_size = 1024;  // samples per frame, a power of two
+    std::size_t hop = 512;        // new samples between frames
+    std::vector<SpectralBand> bands;
+};
+
+// Features of one frame of a stream.
+struct SpectralFeatures {
+    static constexpr std::size_t kMaxBands = 8;
+
+    std::int64_t ts_us = 0;  // time of the frame's last sample
+    double sample_rate_hz = 0.0;
+    double rms = 0.0;             // of the frame with its mean removed
+    double peak_hz = 0.0;         // strongest bin above DC, interpolated
+    double peak_amplitude = 0.0;  // of the peak bin; up to 15% low between bins (Hann)
+    std::size_t band_count = 0;
+    double band_energy[kMaxBands] = {};  // mean square per band; all bins together sum to rms^2
+};
+
+// Sliding-window spectra over evenly sampled streams. Each stream keeps its last
+// fft_size samples; every `hop` new samples the frame has its mean removed, is Hann
+// windowed and transformed, and the features are handed to the handler. Blocks
+// without a sample period are ignored; a change of period restarts the stream.
+class SpectralAnalyzer {
+public:
+    using Handler = std::function<void(StreamId stream, const SpectralFeatures& f)>;
+
+    explicit SpectralAnalyzer(const SpectralConfig& cfg);
+
+    void SetHandler(Handler h) { on_frame_ = std::move(h); }
+    std::size_t FftSize() const { return fft_.Size(); }
+    std::size_t Hop() const { return hop_; }
+    std::uint64_t Frames() const { return frames_; }
+
+    void OnBlock(const SampleBlock& b);
+
+    // Features of the latest frame of a stream; null before its first one.
+    const SpectralFeatures* Last(StreamId stream) const {
+        if (stream >= state_.size() || !state_[stream].has_last) return nullptr;
+        return &state_[stream].last;
+    }
+
+private:
+    struct State {
+        std::vector<float> ring;  // fft_size samples, allocated on first use
+        std::size_t write = 0;
+        std::size_t filled = 0;
+        std::size_t since = 0;  // samples since the last frame
+        std::int64_t period_us = 0;
+        bool has_last = false;
+        SpectralFeatures last;
+    };
+
+    void Frame(StreamId stream, State& s, std::int64_t ts_us);
+
+private:
+    RealFft fft_;
+    std::size_t hop_;
+    std::vector<SpectralBand> bands_;
+    std::vector<float> window_;  // Hann
+    double window_sum_ = 0.0;
+    double window_power_ = 0.0;  // sum of squares
+    std::vector<float> frame_;   // scratch
+    std::vector<float> power_;   // scratch
+    std::vector<State> state_;   // by StreamId
+    std::uint64_t frames_ = 0;
+    Handler on_frame_;
+};
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
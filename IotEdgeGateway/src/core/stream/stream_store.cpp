@@ -0,0 +1,69 @@
+#include "core/stream/stream_store.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+StreamId StreamStore::Resolve(std::size_t device_key, const std::string& device_id, const char* channel,
+                              std::size_t len) {
+    if (device_key >= by_device_.size()) by_device_.resize(device_key + 1);
+    auto& ids = by_device_[device_key];
+    for (const StreamId id : ids) {
+        const auto& name = streams_[id].channel;
+        if (name.size() == len && std::memcmp(name.data(), channel, len) == 0) return id;
+    }
+    if (streams_.size() >= max_streams_) return kInvalidStream;
+    const auto id = static_cast<StreamId>(streams_.size());
+    streams_.push_back(Stream{device_id, std::string(channel, len), SampleRing(capacity_)});
+    ids.push_back(id);
+    return id;
+}
+
+StreamId StreamStore::Find(const std::string& device_id, const std::string& channel) const {
+    for (std::size_t i = 0; i < streams_.size(); ++i) {
+        if (streams_[i].device_id == device_id && streams_[i].channel == channel) return static_cast<StreamId>(i);
+    }
+    return kInvalidStream;
+}
+
+void StreamStore::Append(StreamId id, const float* values, std::size_t n, std::int64_t t0_us,
+                         std::int64_t period_us) {
+    if (id >= streams_.size() || n == 0) return;
+    streams_[id].ring.Append(values, n, t0_us, period_us);
+    ++stats_.blocks;
+    stats_.samples += n;
+
+    SampleBlock block;
+    block.stream = id;
+    block.values = values;
+    block.count = n;
+    block.t0_us = t0_us;
+    block.period_us = period_us;
+    for (const auto& sink : sinks_) sink(block);
+}
+
+void StreamStore::Ingest(std::size_t device_key, const std::string& device_id,
+                         const device::codec::SampleBatch& batch, std::int64_t now_ms) {
+    const std::int64_t period_us =
+        batch.rate_hz > 0.0 ? static_cast<std::int64_t>(std::llround(1e6 / batch.rate_hz)) : 0;
+    for (std::size_t i = 0; i < batch.ChannelCount(); ++i) {
+        const auto& c = batch.ChannelAt(i);
+        const StreamId id = Resolve(device_key, device_id, c.name, c.name_len);
+        if (id == kInvalidStream) {
+            ++stats_.refused;
+            continue;
+        }
+        const std::int64_t t0_us = batch.t0_ms > 0
+                                       ? batch.t0_ms * 1000
+                                       : now_ms * 1000 - period_us * static_cast<std::int64_t>(c.count - 1);
+        Append(id, batch.Values(c), c.count, t0_us, period_us);
+    }
+}
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/device/codec/sample_batch.hpp"
+#include "core/stream/sample_ring.hpp"
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+// Index of a stream (one channel of one device). Streams are never removed.
+using StreamId = std::uint32_t;
+constexpr StreamId kInvalidStream = static_cast<StreamId>(-1);
+
+// Evenly spaced samples of one stream, handed to sinks without copying; valid during the call only.
+struct SampleBlock {
+    StreamId stream = kInvalidStream;
+    const float* values = nullptr;
+    std::size_t count = 0;
+    std::int64_t t0_us = 0;  // time of values[0]
+    std::int64_t period_us = 0;
+
+    std::int64_t TimeAt(std::size_t i) const { return t0_us + period_us * static_cast<std::int64_t>(i); }
+};
+
+// High-rate sample channels. Every stream keeps its recent history in a fixed
+// ring, and each ingested block is passed whole to the registered sinks
+// (window operators, detectors) in arrival order.
+class StreamStore {
+public:
+    using Sink = std::function<void(const SampleBlock& block)>;
+
+    struct Stats {
+        std::uint64_t samples = 0;
+        std::uint64_t blocks = 0;
+        std::uint64_t refused = 0;  // blocks for new streams beyond max_streams
+    };
+
+    // `capacity` samples of history per stream (rounded up to a power of two).
+    explicit StreamStore(std::size_t capacity = 4096, std::size_t max_streams = 256)
+        : capacity_(capacity), max_streams_(max_streams) {}
+
+    // Only affects streams created afterwards.
+    void Configure(std::size_t capacity, std::size_t max_streams) {
+        capacity_ = capacity;
+        max_streams_ = max_streams;
+    }
+
+    void AddSink(Sink sink) { sinks_.push_back(std::move(sink)); }
+
+    // Stream of a device's channel, created on first use; kInvalidStream once max_streams exist.
+    // `device_key` is a small dense number for the device (its registry handle) that indexes the lookup.
+    StreamId Resolve(std::size_t device_key, const std::string& device_id, const char* channel, std::size_t len);
+    StreamId Find(const std::string& device_id, const std::string& channel) const;
+
+    void Append(StreamId id, const float* values, std::size_t n, std::int64_t t0_us, std::int64_t period_us);
+
+    // Every channel of a decoded batch. Samples are `1/rate_hz` apart starting at "t0_ms";
+    // without it the last sample is taken to have arrived at `now_ms`.
+    void Ingest(std::size_t device_key, const std::string& device_id, const device::codec::SampleBatch& batch,
+                std::int64_t now_ms);
+
+    std::size_t Size() const { return streams_.size(); }
+    const std::string& DeviceOf(StreamId id) const { return streams_[id].device_id; }
+    const std::string& ChannelOf(StreamId id) const { return streams_[id].channel; }
+    const SampleRing& History(StreamId id) const { return streams_[id].ring; }
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct Stream {
+        std::string device_id;
+        std::string channel;
+        SampleRing ring;
+    };
+
+private:
+    std::size_t capacity_;
+    std::size_t max_streams_;
+    std::vector<Stream> streams_;
+    std::vector<std::vector<StreamId>> by_device_;  // by device_key
+    std::vector<Sink> sinks_;
+    Stats stats_;
+};
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "core/stream/stream_store.hpp"
+
+namespace iotgw {
+namespace core {
+namespace stream {
+
+// Summary of one tumbling window of a stream.
+struct Window {
+    std::int64_t start_us = 0;
+    std::uint32_t count = 0;
+    float min = 0.0f;
+    float max = 0.0f;
+    double mean = 0.0;
+    double rms = 0.0;
+};
+
+// Tumbling windows of `window_us` aligned to multiples of it, summarized per stream.
+// A window closes when a sample at or past its end arrives. Register OnBlock() as a
+// StreamStore sink; state is a few words per stream.
+class WindowStats {
+public:
+    using Handler = std::function<void(StreamId stream, const Window& w)>;
+
+    explicit WindowStats(std::int64_t window_us) : window_us_(window_us > 0 ? window_us : 1000000) {}
+
+    std::int64_t WindowUs() const { return window_us_; }
+    void SetHandler(Handler h) { on_window_ = std::move(h); }
+
+    void OnBlock(const SampleBlock& b) {
+        if (b.stream >= state_.size()) state_.resize(static_cast<std::size_t>(b.stream) + 1);
+        State& s = state_[b.stream];
+        std::size_t i = 0;
+        while (i < b.count) {
+            const std::int64_t t = b.TimeAt(i);
+            if (s.count == 0 || t >= s.end_us || t < s.start_us) {
+                if (s.count > 0) Close(b.stream, s);
+                const std::int64_t phase = ((t % window_us_) + window_us_) % window_us_;
+                s.start_us = t - phase;
+                s.end_us = s.start_us + window_us_;
+            }
+            // Samples up to the window's end are summed in one tight loop.
+            std::size_t n = b.count - i;
+            if (b.period_us > 0) {
+                const auto left = static_cast<std::size_t>((s.end_us - t + b.period_us - 1) / b.period_us);
+                n = std::min(n, left);
+            }
+            Accumulate(s, b.values + i, n);
+            i += n;
+        }
+    }
+
+    // Last completed window of a stream; null before the first one closes.
+    const Window* Last(StreamId stream) const {
+        if (stream >= state_.size() || !state_[stream].has_last) return nullptr;
+        return &state_[stream].last;
+    }
+
+private:
+    struct State {
+        std::int64_t start_us = 0;
+        std::int64_t end_us = 0;
+        std::uint32_t count = 0;
+        float min = 0.0f;
+        float max = 0.0f;
+        double sum = 0.0;
+        double sum_sq = 0.0;
+        bool has_last = false;
+        Window last;
+    };
+
+    static void Accumulate(State& s, const float* v, std::size_t n) {
+        float lo = s.count > 0 ? s.min : v[0];
+        float hi = s.count > 0 ? s.max : v[0];
+        double sum = 0.0;
+        double sum_sq = 0.0;
+        for (std::size_t k = 0; k < n; ++k) {
+            const double x = v[k];
+            sum += x;
+            sum_sq += x * x;
+            lo = std::min(lo, v[k]);
+            hi = std::max(hi, v[k]);
+        }
+        s.min = lo;
+        s.max = hi;
+        s.sum += sum;
+        s.sum_sq += sum_sq;
+        s.count += static_cast<std::uint32_t>(n);
+    }
+
+    void Close(StreamId stream, State& s) {
+        Window& w = s.last;
+        w.start_us = s.start_us;
+        w.count = s.count;
+        w.min = s.min;
+        w.max = s.max;
+        w.mean = s.sum / s.count;
+        w.rms = std::sqrt(s.sum_sq / s.count);
+        s.has_last = true;
+        s.count = 0;
+        s.sum = 0.0;
+        s.sum_sq = 0.0;
+        if (on_window_) on_window_(stream, w);
+    }
+
+private:
+    std::int64_t window_us_;
+    std::vector<State> state_;  // by StreamId
+    Handler on_window_;
+};
+
+}  // namespace stream
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,120 @@
+#include "core/uplink/lz4_block.hpp"
+
+#include <cstring>
+
+namespace iotgw {
+namespace core {
+namespace uplink {
+
+constexpr unsigned Lz4Block::kHashBits;
+
+namespace {
+
+// Format limits: matches are at least 4 bytes and reach back at most 64 KiB; the last
+// 5 bytes are always literals and no match starts within the last 12.
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kLastLiterals = 5;
+constexpr std::size_t kMatchSafety = 12;
+constexpr std::size_t kMaxOffset = 65535;
+
+static std::uint32_t Load32(const char* p) {
+    std::uint32_t v = 0;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static std::uint32_t Hash(std::uint32_t v, unsigned bits) { return (v * 2654435761u) >> (32 - bits); }
+
+// Length continuation bytes after a nibble of 15.
+static void PutLength(std::size_t len, std::string& out) {
+    while (len >= 255) {
+        out.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    out.push_back(static_cast<char>(len));
+}
+
+static void PutSequence(const char* lit, std::size_t lit_len, std::size_t offset, std::size_t match_len,
+                        std::string& out) {
+    const std::size_t ml = match_len >= kMinMatch ? match_len - kMinMatch : 0;
+    const auto token = static_cast<unsigned char>(((lit_len >= 15 ? 15 : lit_len) << 4) | (ml >= 15 ? 15 : ml));
+    out.push_back(static_cast<char>(token));
+    if (lit_len >= 15) PutLength(lit_len - 15, out);
+    out.append(lit, lit_len);
+    if (match_len == 0) return;  // the last sequence has literals only
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (ml >= 15) PutLength(ml - 15, out);
+}
+
+}  // namespace
+
+void Lz4Block::Compress(const char* in, std::size_t n, std::string& out) {
+    out.reserve(out.size() + n + n / 255 + 16);
+    std::size_t anchor = 0;
+    if (n > kMatchSafety) {
+        std::memset(table_, 0xff, sizeof(table_));
+        const std::size_t match_limit = n - kMatchSafety;
+        std::size_t i = 0;
+        while (i < match_limit) {
+            const std::uint32_t seq = Load32(in + i);
+            const std::uint32_t h = Hash(seq, kHashBits);
+            const std::uint32_t cand = table_[h];
+            table_[h] = static_cast<std::uint32_t>(i);
+            if (cand == 0xffffffffu || i - cand > kMaxOffset || Load32(in + cand) != seq) {
+                ++i;
+                continue;
+            }
+            // Extend forward, keeping the last literals out of the match.
+            std::size_t len = kMinMatch;
+            const std::size_t end = n - kLastLiterals;
+            while (i + len < end && in[cand + len] == in[i + len]) ++len;
+            PutSequence(in + anchor, i - anchor, i - cand, len, out);
+            i += len;
+            anchor = i;
+        }
+    }
+    PutSequence(in + anchor, n - anchor, 0, 0, out);
+}
+
+bool Lz4Block::Decompress(const char* in, std::size_t n, std::size_t raw_size, std::string& out) {
+    const std::size_t base = out.size();
+    std::size_t i = 0;
+    while (i < n) {
+        const auto token = static_cast<unsigned char>(in[i++]);
+        std::size_t lit = token >> 4;
+        if (lit == 15) {
+            unsigned char b = 255;
+            while (b == 255) {
+                if (i >= n) return false;
+                b = static_cast<unsigned char>(in[i++]);
+                lit += b;
+            }
+        }
+        if (lit > n - i || out.size() - base + lit > raw_size) return false;
+        out.append(in + i, lit);
+        i += lit;
+        if (i == n) break;  // last sequence
+        if (n - i < 2) return false;
+        const std::size_t offset = static_cast<unsigned char>(in[i]) | (static_cast<unsigned char>(in[i + 1]) << 8);
+        i += 2;
+        std::size_t len = (token & 0x0f) + kMinMatch;
+        if ((token & 0x0f) == 15) {
+            unsigned char b = 255;
+            while (b == 255) {
+                if (i >= n) return false;
+                b = static_cast<unsigned char>(in[i++]);
+                len += b;
+            }
+        }
+        if (offset == 0 || offset > out.size() - base || out.size() - base + len > raw_size) return false;
+        // Byte by byte: a match may overlap the bytes it produces.
+        std::size_t from = out.size() - offset;
+        for (std::size_t k = 0; k < len; ++k) out.push_back(out[from + k]);
+    }
+    return out.size() - base == raw_size;
+}
+
+}  // namespace uplink
+}  // namespace core
+}  // namespace iotgw
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace iotgw {
+namespace core {
+namespace uplink {
+
+// LZ4 block format (no frame header), so any LZ4 library can decode it with the raw
+// size known, e.g. LZ4_decompress_safe. Greedy single-pass matching through a 4K-entry
+// hash table; fast and dependency-free rather than maximal.
+class Lz4Block {
+public:
+    // Appends the compressed form of `n` bytes at `in` to `out`.
+    void Compress(const char* in, std::size_t n, std::string& out);
+
+    // Appends `raw_size` decoded bytes to `out`; false on corrupt input.
+    static bool Decompress(const char* in, std::size_t n, std::size_t raw_size, std::string& out);
+
+private:
+    static constexpr unsigned kHashBits = 12;
+    std::uint32_t table_[1u << kHashBits];
+};
+
+}  // namespace uplink
+}  // namespace core
+}  // namespace iotgw
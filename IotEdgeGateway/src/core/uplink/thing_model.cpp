@@ -0,0 +1,252 @@
+#include "core/uplink/thing_model.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "mongoose.h"
+
+#include "core/device/codec/binary_writer.hpp"
+
+namespace iotgw {
+namespace core {
+namespace uplink {
+
+namespace {
+
+constexpr char kPackPostMethod[] = "thing.event.property.pack.post";
+constexpr std::int64_t kCodeSuccess = 200;
+
+static void WriteValue(iotgw::core::common::json::Writer& w, double v, bool is_bool) {
+    if (is_bool) {
+        w.Int(v != 0.0 ? 1 : 0);  // thing-model bool properties are 0/1
+    } else if (device::codec::IsIntegral(v)) {
+        w.Int(static_cast<std::int64_t>(v));
+    } else {
+        w.Double(v);
+    }
+}
+
+// Reply ids are strings by the protocol; some platforms echo them as numbers.
+static bool ReplyId(const std::string& payload, std::uint32_t& out) {
+    const struct mg_str json = mg_str_n(payload.data(), payload.size());
+    char* s = mg_json_get_str(json, "$.id");
+    if (s != nullptr) {
+        char* end = nullptr;
+        const unsigned long v = std::strtoul(s, &end, 10);
+        const bool ok = end != s && *end == '\0';
+        mg_free(s);
+        out = static_cast<std::uint32_t>(v);
+        return ok;
+    }
+    const long v = mg_json_get_long(json, "$.id", -1);
+    if (v < 0) return false;
+    out = static_cast<std::uint32_t>(v);
+    return true;
+}
+
+}  // namespace
+
+ThingModelUplink::ThingModelUplink(const ThingModelOptions& opt) : opt_(opt) {
+    if (opt_.post_interval_ms <= 0) opt_.post_interval_ms = 5000;
+    if (opt_.max_devices_per_post == 0) opt_.max_devices_per_post = 50;
+    if (opt_.queue_limit == 0) opt_.queue_limit = 100;
+    if (opt_.max_in_flight == 0) opt_.max_in_flight = 1;
+    if (opt_.reply_timeout_ms <= 0) opt_.reply_timeout_ms = 10000;
+    const std::string base = "/sys/" + opt_.gateway.product_key + "/" + opt_.gateway.device_name;
+    post_topic_ = base + "/thing/event/property/pack/post";
+    reply_topic_ = post_topic_ + "_reply";
+    bucket_.Configure(opt_.max_posts_per_sec, 0.0);
+}
+
+void ThingModelUplink::Map(const std::string& device_id, ThingMapping mapping) {
+    mappings_[device_id] = std::move(mapping);
+}
+
+void ThingModelUplink::Resolve(Device& d, const std::string& device_id) {
+    d.resolved = true;
+    const auto it = mappings_.find(device_id);
+    if (it != mappings_.end()) {
+        d.mapped = true;
+        d.identity = it->second.identity;
+        if (d.identity.device_name.empty()) d.identity.device_name = device_id;
+        if (d.identity.product_key.empty()) d.identity.product_key = opt_.default_product_key;
+        for (const auto& p : it->second.properties) {
+            Property prop;
+            prop.field = p.first;
+            prop.identifier = p.second.empty() ? p.first : p.second;
+            d.properties.push_back(std::move(prop));
+        }
+    } else if (!opt_.default_product_key.empty()) {
+        d.mapped = true;
+        d.identity.product_key = opt_.default_product_key;
+        d.identity.device_name = device_id;
+    }
+    d.auto_properties = d.mapped && d.properties.empty();
+    if (d.identity.product_key.empty()) d.mapped = false;
+}
+
+void ThingModelUplink::Observe(device::manager::DeviceHandle h, const std::string& device_id,
+                               const device::model::FieldTable& fields, std::int64_t now_ms) {
+    if (h == device::manager::kInvalidDevice) return;
+    if (h >= devices_.size()) devices_.resize(h + 1);
+    Device& d = devices_[h];
+    if (!d.resolved) Resolve(d, device_id);
+    if (!d.mapped) return;
+
+    bool any = false;
+    for (std::size_t i = 0; i < fields.Size(); ++i) {
+        const std::string name(fields.NameAt(i), fields.NameLenAt(i));
+        Property* prop = nullptr;
+        for (auto& p : d.properties) {
+            if (p.field == name) {
+                prop = &p;
+                break;
+            }
+        }
+        if (prop == nullptr) {
+            if (!d.auto_properties) continue;
+            Property p;
+            p.field = name;
+            p.identifier = name;
+            d.properties.push_back(std::move(p));
+            prop = &d.properties.back();
+        }
+        const auto& v = fields.ValueAt(i);
+        prop->value = v.number;
+        prop->is_bool = v.type == device::model::FieldType::kBool;
+        prop->time = now_ms;
+        prop->set = true;
+        any = true;
+    }
+    if (any && !d.pending) {
+        d.pending = true;
+        pending_.push_back(h);
+    }
+}
+
+void ThingModelUplink::Enqueue(Post post) {
+    if (queue_.size() >= opt_.queue_limit) {
+        queue_.pop_front();
+        ++stats_.dropped;
+    }
+    queue_.push_back(std::move(post));
+}
+
+void ThingModelUplink::BuildPosts() {
+    for (std::size_t begin = 0; begin < pending_.size(); begin += opt_.max_devices_per_post) {
+        const std::size_t end = std::min(pending_.size(), begin + opt_.max_devices_per_post);
+        Post post;
+        post.id = next_id_++;
+        writer_.Clear();
+        writer_.BeginObject();
+        writer_.Key("id").String(std::to_string(post.id));
+        writer_.Key("version").String("1.0");
+        writer_.Key("params").BeginObject();
+        writer_.Key("properties").BeginObject().EndObject();
+        writer_.Key("subDevices").BeginArray();
+        for (std::size_t i = begin; i < end; ++i) {
+            Device& d = devices_[pending_[i]];
+            d.pending = false;
+            writer_.BeginObject();
+            writer_.Key("identity").BeginObject();
+            writer_.Key("productKey").String(d.identity.product_key);
+            writer_.Key("deviceName").String(d.identity.device_name);
+            writer_.EndObject();
+            writer_.Key("properties").BeginObject();
+            for (auto& p : d.properties) {
+                if (!p.set) continue;
+                writer_.Key(p.identifier).BeginObject();
+                writer_.Key("value");
+                WriteValue(writer_, p.value, p.is_bool);
+                writer_.Key("time").Int(p.time);
+                writer_.EndObject();
+                p.set = false;
+                ++post.properties;
+            }
+            writer_.EndObject();
+            writer_.EndObject();
+        }
+        writer_.EndArray();
+        writer_.EndObject();
+        writer_.Key("method").String(kPackPostMethod);
+        writer_.EndObject();
+        post.payload = writer_.str();
+        Enqueue(std::move(post));
+    }
+    pending_.clear();
+}
+
+void ThingModelUplink::Poll(std::int64_t now_ms, const Publish& publish) {
+    // Unanswered posts go back to the front of the queue, oldest first.
+    for (std::size_t i = in_flight_.size(); i-- > 0;) {
+        if (now_ms - in_flight_[i].sent_ms < opt_.reply_timeout_ms) continue;
+        ++stats_.timeouts;
+        Post post = std::move(in_flight_[i]);
+        in_flight_.erase(in_flight_.begin() + static_cast<std::ptrdiff_t>(i));
+        if (post.attempts > opt_.max_retries) {
+            ++stats_.dropped;
+            continue;
+        }
+        ++stats_.retries;
+        queue_.push_front(std::move(post));
+    }
+
+    if (!pending_.empty() && (last_build_ms_ == 0 || now_ms - last_build_ms_ >= opt_.post_interval_ms)) {
+        BuildPosts();
+        last_build_ms_ = now_ms;
+    }
+
+    while (!queue_.empty() && in_flight_.size() < opt_.max_in_flight && bucket_.Available(now_ms)) {
+        Post& post = queue_.front();
+        if (!publish || !publish(post_topic_, post.payload)) break;
+        (void)bucket_.TryTake(now_ms);
+        ++stats_.posts;
+        if (post.attempts == 0) stats_.properties += post.properties;
+        ++post.attempts;
+        post.sent_ms = now_ms;
+        in_flight_.push_back(std::move(post));
+        queue_.pop_front();
+    }
+}
+
+bool ThingModelUplink::OnMessage(const std::string& topic, const std::string& payload) {
+    if (topic != reply_topic_) return false;
+    std::uint32_t id = 0;
+    if (!ReplyId(payload, id)) {
+        ++stats_.unknown_replies;
+        return true;
+    }
+    const auto match = [id](const Post& p) { return p.id == id; };
+    const auto in_flight = std::find_if(in_flight_.begin(), in_flight_.end(), match);
+    // A reply that overtook its retry settles the queued copy as well.
+    const auto queued = in_flight == in_flight_.end() ? std::find_if(queue_.begin(), queue_.end(), match)
+                                                      : queue_.end();
+    if (in_flight == in_flight_.end() && queued == queue_.end()) {
+        ++stats_.unknown_replies;  // late reply to a post already dropped
+        return true;
+    }
+    const long code = mg_json_get_long(mg_str_n(payload.data(), payload.size()), "$.code", 0);
+    stats_.last_code = code;
+    if (code == kCodeSuccess) {
+        ++stats_.acked;
+    } else {
+        ++stats_.rejected;
+    }
+    if (in_flight != in_flight_.end()) {
+        in_flight_.erase(in_flight);
+    } else {
+        queue_.erase(queued);
+    }
+    return true;
+}
+
+ThingModelUplink::Stats ThingModelUplink::GetStats() const {
+    Stats s = stats_;
+    s.queued = queue_.size();
+    s.in_flight = in_flight_.size();
+    return s;
+}
+
+}  // namespace uplink
+}  // namespace core
+}  // namespace iotgw
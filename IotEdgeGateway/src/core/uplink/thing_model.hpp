@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/common/utils/json_writer.hpp"
+#include "core/common/utils/rate_limiter.hpp"
+#include "core/device/manager/device_manager.hpp"
+#include "core/device/model/field_table.hpp"
+
+namespace iotgw {
+namespace core {
+namespace uplink {
+
+// A device on the cloud platform: its ProductKey / DeviceName pair.
+struct ThingIdentity {
+    std::string product_key;
+    std::string device_name;
+};
+
+// Registry device -> thing-model sub-device. An empty `properties` posts every field
+// under an identifier of the same name.
+struct ThingMapping {
+    ThingIdentity identity;
+    std::vector<std::pair<std::string, std::string>> properties;  // field -> identifier
+};
+
+struct ThingModelOptions {
+    ThingIdentity gateway;            // topics are /sys/<product_key>/<device_name>/...
+    std::string default_product_key;  // unmapped devices post as <this>/<device id>; empty skips them
+    std::int64_t post_interval_ms = 5000;
+    std::size_t max_devices_per_post = 50;
+    std::size_t queue_limit = 100;  // posts waiting for the link; the oldest is dropped
+    double max_posts_per_sec = 5.0;
+    std::size_t max_in_flight = 16;  // posts awaiting a reply
+    std::int64_t reply_timeout_ms = 10000;
+    std::uint32_t max_retries = 1;
+};
+
+// Cloud thing-model uplink in the Alink JSON protocol. Reports of mapped devices are
+// coalesced to the latest value per property; every `post_interval_ms` the gateway
+// sends them for all its sub-devices in one property pack post:
+//
+//   /sys/<pk>/<dn>/thing/event/property/pack/post
+//   {"id":"17","version":"1.0","params":{"properties":{},"subDevices":[
+//     {"identity":{"productKey":"a1..","deviceName":"temp"},
+//      "properties":{"CurrentTemperature":{"value":23.5,"time":1760000000000}}}]},
+//    "method":"thing.event.property.pack.post"}
+//
+// Posts go through their own bounded queue and rate limit, separate from the MQTT
+// bridge. The cloud answers on .../pack/post_reply with the same id; a post without
+// a reply within `reply_timeout_ms` is sent again up to `max_retries` times.
+class ThingModelUplink {
+public:
+    using Publish = std::function<bool(const std::string& topic, const std::string& payload)>;
+
+    struct Stats {
+        std::uint64_t posts = 0;  // publishes, retries included
+        std::uint64_t properties = 0;
+        std::uint64_t acked = 0;     // replies with code 200
+        std::uint64_t rejected = 0;  // replies with another code
+        std::uint64_t timeouts = 0;
+        std::uint64_t retries = 0;
+        std::uint64_t dropped = 0;  // queue overflow or retries exhausted
+        std::uint64_t unknown_replies = 0;
+        std::int64_t last_code = 0;
+        std::size_t queued = 0;
+        std::size_t in_flight = 0;
+    };
+
+    explicit ThingModelUplink(const ThingModelOptions& opt);
+
+    // Must precede the device's first report.
+    void Map(const std::string& device_id, ThingMapping mapping);
+
+    // Takes the values of the device's mapped fields carried by one report; `fields` must
+    // hold that report's fields only, as each one is posted with `now_ms` as its time.
+    void Observe(device::manager::DeviceHandle h, const std::string& device_id,
+                 const device::model::FieldTable& fields, std::int64_t now_ms);
+
+    // Builds due posts, sends queued ones within the rate limit and expires unanswered ones.
+    void Poll(std::int64_t now_ms, const Publish& publish);
+
+    // Consumes a reply; false if `topic` is not the reply topic.
+    bool OnMessage(const std::string& topic, const std::string& payload);
+
+    const std::string& PostTopic() const { return post_topic_; }
+    const std::string& ReplyTopic() const { return reply_topic_; }
+    const ThingModelOptions& Options() const { return opt_; }
+    Stats GetStats() const;
+
+private:
+    struct Property {
+        std::string identifier;
+        std::string field;
+        double value = 0.0;
+        std::int64_t time = 0;
+        bool is_bool = false;
+        bool set = false;
+    };
+
+    struct Device {
+        bool resolved = false;
+        bool mapped = false;
+        bool pending = false;
+        bool auto_properties = false;
+        ThingIdentity identity;
+        std::vector<Property> properties;
+    };
+
+    struct Post {
+        std::uint32_t id = 0;
+        std::string payload;
+        std::uint32_t attempts = 0;
+        std::int64_t sent_ms = 0;
+        std::size_t properties = 0;
+    };
+
+    void Resolve(Device& d, const std::string& device_id);
+    void BuildPosts();
+    void Enqueue(Post post);
+
+private:
+    ThingModelOptions opt_;
+    std::string post_topic_;
+    std::string reply_topic_;
+    std::unordered_map<std::string, ThingMapping> mappings_;
+    std::vector<Device> devices_;  // by DeviceHandle
+    std::vector<device::manager::DeviceHandle> pending_;
+    std::int64_t last_build_ms_ = 0;
+    std::uint32_t next_id_ = 1;
+    std::deque<Post> queue_;
+    std::vector<Post> in_flight_;
+    iotgw::core::common::rate::TokenBucket bucket_;
+    iotgw::core::common::json::Writer writer_;
+    Stats stats_;
+};
+
+}  // namespace uplink
+}  // namespace core
+}  // namespace iotgw
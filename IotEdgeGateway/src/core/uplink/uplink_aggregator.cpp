@@ -0,0 +1,236 @@
+#include "core/uplink/uplink_aggregator.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/common/utils/json_writer.hpp"
+#include "core/device/codec/binary_writer.hpp"
+
+namespace iotgw {
+namespace core {
+namespace uplink {
+
+namespace {
+
+constexpr char kLz4Magic[] = "LZ4B";
+
+template <typename W>
+static void EmitNumber(W& w, double v) {
+    if (device::codec::IsIntegral(v)) {
+        w.Int(static_cast<std::int64_t>(v));
+    } else {
+        w.Real(v);
+    }
+}
+
+static void WriteJsonNumber(iotgw::core::common::json::Writer& w, double v) {
+    if (device::codec::IsIntegral(v)) {
+        w.Int(static_cast<std::int64_t>(v));
+    } else {
+        w.Double(v);
+    }
+}
+
+}  // namespace
+
+UplinkAggregator::UplinkAggregator(const AggregatorOptions& opt) : opt_(opt) {
+    if (opt_.interval_ms <= 0) opt_.interval_ms = 60000;
+    if (opt_.max_devices_per_batch == 0) opt_.max_devices_per_batch = 200;
+}
+
+void UplinkAggregator::Observe(device::manager::DeviceHandle h, const std::string& device_id,
+                               const std::string& type, const device::model::FieldTable& fields,
+                               std::int64_t now_ms) {
+    if (h == device::manager::kInvalidDevice) return;
+    // After an idle stretch the interval starts with its first report.
+    if (pending_.empty() && now_ms - window_start_ms_ >= opt_.interval_ms) window_start_ms_ = now_ms;
+    if (h >= devices_.size()) devices_.resize(h + 1);
+    DeviceAgg& d = devices_[h];
+    if (!d.pending) {
+        d.pending = true;
+        d.id = device_id;
+        d.type = type;
+        d.field_count = 0;
+        d.samples = 0;
+        pending_.push_back(h);
+    }
+    d.last_ts = now_ms;
+
+    for (std::size_t i = 0; i < fields.Size(); ++i) {
+        const char* name = fields.NameAt(i);
+        const std::size_t len = fields.NameLenAt(i);
+        const auto& v = fields.ValueAt(i);
+        FieldAgg* f = nullptr;
+        for (std::size_t k = 0; k < d.field_count; ++k) {
+            if (d.fields[k].len == len && std::memcmp(d.fields[k].name, name, len) == 0) {
+                f = &d.fields[k];
+                break;
+            }
+        }
+        if (f == nullptr) {
+            if (d.field_count >= device::model::FieldTable::kMaxFields) continue;
+            f = &d.fields[d.field_count++];
+            std::memcpy(f->name, name, len);
+            f->name[len] = '\0';
+            f->len = static_cast<std::uint8_t>(len);
+            f->count = 0;
+            f->sum = 0.0;
+            f->min = v.number;
+            f->max = v.number;
+        }
+        f->is_bool = v.type == device::model::FieldType::kBool;
+        f->min = std::min(f->min, v.number);
+        f->max = std::max(f->max, v.number);
+        f->sum += v.number;
+        f->last = v.number;
+        ++f->count;
+        ++d.samples;
+        ++stats_.samples;
+    }
+}
+
+template <typename W>
+void UplinkAggregator::EncodeBatch(W& w, std::size_t begin, std::size_t end, std::int64_t ts) {
+    w.Map(4);
+    w.Str("type", 4);
+    w.Str("batch", 5);
+    w.Str("ts", 2);
+    w.Int(ts);
+    w.Str("interval_ms", 11);
+    w.Int(opt_.interval_ms);
+    w.Str("devices", 7);
+    w.Array(end - begin);
+    for (std::size_t i = begin; i < end; ++i) {
+        const DeviceAgg& d = devices_[pending_[i]];
+        w.Map(4);
+        w.Str("device_id", 9);
+        w.Str(d.id.data(), d.id.size());
+        w.Str("type", 4);
+        w.Str(d.type.data(), d.type.size());
+        w.Str("data", 4);
+        w.Map(d.field_count);
+        for (std::size_t k = 0; k < d.field_count; ++k) {
+            const FieldAgg& f = d.fields[k];
+            const double avg = f.sum / static_cast<double>(f.count);
+            w.Str(f.name, f.len);
+            if (f.is_bool) {
+                w.Map(3);
+                w.Str("last", 4);
+                w.Bool(f.last != 0.0);
+                w.Str("avg", 3);
+                EmitNumber(w, avg);
+            } else {
+                w.Map(5);
+                w.Str("min", 3);
+                EmitNumber(w, f.min);
+                w.Str("max", 3);
+                EmitNumber(w, f.max);
+                w.Str("avg", 3);
+                EmitNumber(w, avg);
+                w.Str("last", 4);
+                EmitNumber(w, f.last);
+            }
+            w.Str("count", 5);
+            w.Int(f.count);
+        }
+        w.Str("ts", 2);
+        w.Int(d.last_ts);
+    }
+}
+
+void UplinkAggregator::EncodeJsonBatch(std::size_t begin, std::size_t end, std::int64_t ts, std::string& out) {
+    iotgw::core::common::json::Writer w(128 + (end - begin) * 160);
+    w.BeginObject();
+    w.Key("type").String("batch");
+    w.Key("ts").Int(ts);
+    w.Key("interval_ms").Int(opt_.interval_ms);
+    w.Key("devices").BeginArray();
+    for (std::size_t i = begin; i < end; ++i) {
+        const DeviceAgg& d = devices_[pending_[i]];
+        w.BeginObject();
+        w.Key("device_id").String(d.id);
+        w.Key("type").String(d.type);
+        w.Key("data").BeginObject();
+        for (std::size_t k = 0; k < d.field_count; ++k) {
+            const FieldAgg& f = d.fields[k];
+            const double avg = f.sum / static_cast<double>(f.count);
+            w.Key(f.name, f.len).BeginObject();
+            if (f.is_bool) {
+                w.Key("last").Bool(f.last != 0.0);
+                w.Key("avg");
+                WriteJsonNumber(w, avg);
+            } else {
+                w.Key("min");
+                WriteJsonNumber(w, f.min);
+                w.Key("max");
+                WriteJsonNumber(w, f.max);
+                w.Key("avg");
+                WriteJsonNumber(w, avg);
+                w.Key("last");
+                WriteJsonNumber(w, f.last);
+            }
+            w.Key("count").Uint(f.count);
+            w.EndObject();
+        }
+        w.EndObject();
+        w.Key("ts").Int(d.last_ts);
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+    out.append(w.str());
+}
+
+bool UplinkAggregator::Send(const Publish& publish) {
+    stats_.raw_bytes += batch_.size();
+    const std::string* payload = &batch_;
+    if (opt_.compress) {
+        packed_.assign(kLz4Magic, 4);
+        const auto raw = static_cast<std::uint32_t>(batch_.size());
+        for (int i = 0; i < 4; ++i) packed_.push_back(static_cast<char>((raw >> (8 * i)) & 0xff));
+        lz4_.Compress(batch_.data(), batch_.size(), packed_);
+        if (packed_.size() < batch_.size()) payload = &packed_;
+    }
+    if (!publish || !publish(*payload)) {
+        ++stats_.failed;
+        return false;
+    }
+    ++stats_.batches;
+    stats_.payload_bytes += payload->size();
+    return true;
+}
+
+std::size_t UplinkAggregator::Poll(std::int64_t now_ms, const Publish& publish) {
+    if (pending_.empty() || now_ms - window_start_ms_ < opt_.interval_ms) return 0;
+    return Flush(now_ms, publish);
+}
+
+std::size_t UplinkAggregator::Flush(std::int64_t now_ms, const Publish& publish) {
+    std::size_t sent = 0;
+    for (std::size_t begin = 0; begin < pending_.size(); begin += opt_.max_devices_per_batch) {
+        const std::size_t end = std::min(pending_.size(), begin + opt_.max_devices_per_batch);
+        batch_.clear();
+        if (opt_.format == device::codec::PayloadFormat::kCbor) {
+            device::codec::CborWriter w(batch_);
+            EncodeBatch(w, begin, end, now_ms);
+        } else if (opt_.format == device::codec::PayloadFormat::kMsgpack) {
+            device::codec::MsgpackWriter w(batch_);
+            EncodeBatch(w, begin, end, now_ms);
+        } else {
+            EncodeJsonBatch(begin, end, now_ms, batch_);
+        }
+        if (Send(publish)) {
+            ++sent;
+            stats_.devices += end - begin;
+            for (std::size_t i = begin; i < end; ++i) stats_.published_samples += devices_[pending_[i]].samples;
+        }
+    }
+    for (const auto h : pending_) devices_[h].pending = false;
+    pending_.clear();
+    window_start_ms_ = now_ms;
+    return sent;
+}
+
+}  // namespace uplink
+}  // namespace core
+}  // namespace iotgw
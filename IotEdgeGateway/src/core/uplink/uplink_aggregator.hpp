@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "core/device/codec/payload_format.hpp"
+#include "core/device/manager/device_manager.hpp"
+#include "core/device/model/field_table.hpp"
+#include "core/uplink/lz4_block.hpp"
+
+namespace iotgw {
+namespace core {
+namespace uplink {
+
+struct AggregatorOptions {
+    std::int64_t interval_ms = 60000;
+    device::codec::PayloadFormat format = device::codec::PayloadFormat::kJson;
+    bool compress = false;
+    std::size_t max_devices_per_batch = 200;  // larger intervals go out as several batches
+};
+
+// Edge aggregation for the cloud uplink. Every report of a device is folded into
+// per-field min/max/sum/last/count; at the end of each interval all devices that
+// reported go out in batched envelopes:
+//
+//   {"type":"batch","ts":<interval end>,"interval_ms":60000,"devices":[
+//     {"device_id":"temp","type":"sensor","data":{"value":{"min":..,"max":..,"avg":..,"last":..,"count":..}},
+//      "ts":<last report>}, ..]}
+//
+// Bool fields carry "last", "count" and "avg" (the share of reports that were true).
+// With `compress`, a batch is sent as "LZ4B" + raw size (uint32, little-endian) + an
+// LZ4 block, unless that is not smaller than the batch itself.
+class UplinkAggregator {
+public:
+    using Publish = std::function<bool(const std::string& payload)>;
+
+    struct Stats {
+        std::uint64_t samples = 0;  // field values folded
+        std::uint64_t batches = 0;
+        std::uint64_t failed = 0;  // batches the publisher refused; their data is dropped
+        std::uint64_t devices = 0;
+        std::uint64_t published_samples = 0;  // samples folded into published batches
+        std::uint64_t raw_bytes = 0;      // encoded batches before compression
+        std::uint64_t payload_bytes = 0;  // what was published
+    };
+
+    explicit UplinkAggregator(const AggregatorOptions& opt);
+
+    // Folds the fields of one report of a device.
+    void Observe(device::manager::DeviceHandle h, const std::string& device_id, const std::string& type,
+                 const device::model::FieldTable& fields, std::int64_t now_ms);
+
+    // Publishes the interval's batches once it has elapsed; returns the number published.
+    std::size_t Poll(std::int64_t now_ms, const Publish& publish);
+    // Publishes whatever has been folded so far and starts a new interval.
+    std::size_t Flush(std::int64_t now_ms, const Publish& publish);
+
+    const AggregatorOptions& Options() const { return opt_; }
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct FieldAgg {
+        char name[device::model::FieldTable::kMaxNameLen + 1] = {};
+        std::uint8_t len = 0;
+        bool is_bool = false;
+        std::uint32_t count = 0;
+        double min = 0.0;
+        double max = 0.0;
+        double sum = 0.0;
+        double last = 0.0;
+    };
+
+    struct DeviceAgg {
+        std::string id;
+        std::string type;
+        std::int64_t last_ts = 0;
+        std::size_t field_count = 0;
+        std::uint64_t samples = 0;
+        FieldAgg fields[device::model::FieldTable::kMaxFields];
+        bool pending = false;
+    };
+
+    template <typename W>
+    void EncodeBatch(W& w, std::size_t begin, std::size_t end, std::int64_t ts);
+    void EncodeJsonBatch(std::size_t begin, std::size_t end, std::int64_t ts, std::string& out);
+    bool Send(const Publish& publish);
+
+private:
+    AggregatorOptions opt_;
+    std::vector<DeviceAgg> devices_;  // by DeviceHandle
+    std::vector<device::manager::DeviceHandle> pending_;
+    std::int64_t window_start_ms_ = 0;
+    std::string batch_;   // scratch
+    std::string packed_;  // scratch
+    Lz4Block lz4_;
+    Stats stats_;
+};
+
+}  // namespace uplink
+}  // namespace core
+}  // namespace iotgw
@@ -2,11 +2,14 @@
 #include "version.hpp"
 
 #include <sys/stat.h>
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
+#include <cmath>
 #include <csignal>
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -17,14 +20,27 @@
 
 #include "core/common/config/config_manager.hpp"
 #include "core/common/logger/logger.hpp"
-#include "core/common/utils/json_utils.hpp"
+#include "core/common/utils/json_writer.hpp"
 #include "core/common/utils/time_utils.hpp"
 #include "core/control/rule_engine.hpp"
+#include "core/device/codec/envelope_encoder.hpp"
+#include "core/device/codec/payload_schema.hpp"
+#include "core/device/codec/telemetry_decoder.hpp"
+#include "core/device/derived/virtual_sensors.hpp"
 #include "core/device/manager/device_manager.hpp"
 #include "core/device/protocol_adapters/mqtt_adapter/mqtt_adapter.hpp"
+#include "core/device/protocol_adapters/mqtt_adapter/mqtt_bridge.hpp"
+#include "core/device/protocol_adapters/mqtt_adapter/mqtt_broker.hpp"
+#include "core/stream/anomaly_detector.hpp"
+#include "core/stream/spectral_analyzer.hpp"
+#include "core/stream/stream_store.hpp"
+#include "core/stream/window_stats.hpp"
+#include "core/uplink/thing_model.hpp"
+#include "core/uplink/uplink_aggregator.hpp"
 #include "services/system_services/camera/camera_manager.hpp"
 #include "services/system_services/update/update_manager.hpp"
 #include "services/web_services/api/rest_api.hpp"
+#include "services/web_services/websocket/state_feed.hpp"
 #include "services/web_services/websocket/websocket_server.hpp"
 
 namespace iotgw {
@@ -85,6 +101,12 @@ static std::string ToLower(std::string s) {
     return s;
 }
 
+static void ReplaceAll(std::string& s, const std::string& from, const std::string& to) {
+    for (std::size_t pos = s.find(from); pos != std::string::npos; pos = s.find(from, pos + to.size())) {
+        s.replace(pos, from.size(), to);
+    }
+}
+
 static bool ParseLogLevel(const std::string& s, iotgw::core::common::log::Level& out) {
     const std::string t = ToLower(s);
     if (t == "trace") {
@@ -127,17 +149,6 @@ static bool TryParseDoubleStrict(const std::string& s, double& out) {
     return true;
 }
 
-static bool TryParseSensorValue(const std::string& payload, double& out) {
-    if (TryParseDoubleStrict(payload, out)) return true;
-    if (payload.empty()) return false;
-    double v = 0.0;
-    if (mg_json_get_num(mg_str(payload.c_str()), "$.value", &v)) {
-        out = v;
-        return true;
-    }
-    return false;
-}
-
 static bool LoadRulesFromFile(const std::string& file_path, const std::string& category,
                               std::vector<iotgw::core::control::rule_engine::Rule>& out_rules) {
     iotgw::core::common::config::ConfigManager rcfg;
@@ -158,6 +169,7 @@ static bool LoadRulesFromFile(const std::string& file_path, const std::string& c
         if (rcfg.GetBool(base + "enabled", enabled)) r.enabled = enabled;
 
         (void)rcfg.GetString(base + "when.sensor_id", r.when.sensor_id);
+        (void)rcfg.GetString(base + "when.event", r.when.event);
         (void)rcfg.GetString(base + "when.op", r.when.op);
 
         std::string value_s;
@@ -188,6 +200,130 @@ static bool LoadRulesFromFile(const std::string& file_path, const std::string& c
     return true;
 }
 
+// `<base>deadband_enabled`, `deadband`, `deadband_pct` and `max_silence_s` over `def`;
+// false if none is set. Setting any band enables it unless `deadband_enabled` says otherwise.
+static bool LoadDeadband(const iotgw::core::common::config::ConfigManager& cfg, const std::string& base,
+                         const iotgw::core::device::manager::Deadband& def,
+                         iotgw::core::device::manager::Deadband& out) {
+    out = def;
+    bool any = false;
+    double v = 0.0;
+    if (cfg.GetDouble(base + "deadband", v)) {
+        out.absolute = v;
+        any = true;
+    }
+    if (cfg.GetDouble(base + "deadband_pct", v)) {
+        out.percent = v;
+        any = true;
+    }
+    if (cfg.GetDouble(base + "max_silence_s", v)) {
+        out.max_silence_ms = static_cast<std::int64_t>(v * 1000.0);
+        any = true;
+    }
+    if (any) out.enabled = true;
+    bool enabled = false;
+    if (cfg.GetBool(base + "deadband_enabled", enabled)) {
+        out.enabled = enabled;
+        any = true;
+    }
+    return any;
+}
+
+static void LoadUplinkOptions(const iotgw::core::common::config::ConfigManager& cfg,
+                              iotgw::core::common::log::Logger& logger,
+                              iotgw::core::uplink::AggregatorOptions& out) {
+    const double interval_s = cfg.GetDoubleOr("uplink.interval_s", static_cast<double>(out.interval_ms) / 1000.0);
+    if (interval_s > 0.0) out.interval_ms = static_cast<std::int64_t>(interval_s * 1000.0);
+    const std::string format_name = cfg.GetStringOr("uplink.format", "json");
+    if (!iotgw::core::device::codec::ParsePayloadFormat(format_name, out.format)) {
+        logger.Warn("unknown uplink format '" + format_name + "', using json");
+        out.format = iotgw::core::device::codec::PayloadFormat::kJson;
+    }
+    out.compress = cfg.GetBoolOr("uplink.compress", out.compress);
+    const std::int64_t max_devices = cfg.GetInt64Or("uplink.max_devices_per_batch", 0);
+    if (max_devices > 0) out.max_devices_per_batch = static_cast<std::size_t>(max_devices);
+}
+
+// Per-client bounds of the WebSocket broadcast queues and the default update rate.
+static void LoadWsSendQueueOptions(const iotgw::core::common::config::ConfigManager& cfg,
+                                   iotgw::core::common::log::Logger& logger,
+                                   iotgw::services::web_services::websocket::WsSendQueues::Options& out) {
+    const std::string base = "network.websocket.";
+    const std::int64_t frames = cfg.GetInt64Or(base + "queue_frames", 0);
+    if (frames > 0) out.max_frames = static_cast<std::size_t>(frames);
+    const std::int64_t kb = cfg.GetInt64Or(base + "queue_kb", 0);
+    if (kb > 0) out.max_bytes = static_cast<std::size_t>(kb) * 1024;
+    const std::int64_t high_water_kb = cfg.GetInt64Or(base + "send_buffer_kb", 0);
+    if (high_water_kb > 0) out.send_high_water = static_cast<std::size_t>(high_water_kb) * 1024;
+    out.max_rate_hz = cfg.GetDoubleOr(base + "max_rate_hz", out.max_rate_hz);
+    const std::string policy = cfg.GetStringOr(base + "overflow", "drop_oldest");
+    if (!iotgw::services::web_services::websocket::ParseOverflowPolicy(policy, out.policy)) {
+        logger.Warn("unknown websocket overflow policy '" + policy + "', using drop_oldest");
+        out.policy = iotgw::services::web_services::websocket::OverflowPolicy::kDropOldest;
+    }
+}
+
+static void LoadEventStreamOptions(const iotgw::core::common::config::ConfigManager& cfg,
+                                   iotgw::services::web_services::sse::EventStream::Options& out) {
+    const std::string base = "network.sse.";
+    if (!cfg.GetBoolOr(base + "enabled", true)) {
+        out.log_size = 0;
+        return;
+    }
+    const std::int64_t log_size = cfg.GetInt64Or(base + "log_size", 0);
+    if (log_size > 0) out.log_size = static_cast<std::size_t>(log_size);
+    const std::int64_t high_water_kb = cfg.GetInt64Or(base + "send_buffer_kb", 0);
+    if (high_water_kb > 0) out.send_high_water = static_cast<std::size_t>(high_water_kb) * 1024;
+    const std::int64_t clients = cfg.GetInt64Or(base + "max_clients", 0);
+    if (clients > 0) out.max_clients = static_cast<std::size_t>(clients);
+    const double heartbeat_s = cfg.GetDoubleOr(base + "heartbeat_s", 0.0);
+    if (heartbeat_s > 0.0) out.heartbeat_ms = static_cast<std::int64_t>(heartbeat_s * 1000.0);
+}
+
+static void LoadThingModelOptions(const iotgw::core::common::config::ConfigManager& cfg,
+                                  iotgw::core::uplink::ThingModelOptions& out) {
+    const std::string base = "cloud.thing_model.";
+    out.gateway.product_key = cfg.GetStringOr(base + "product_key", "");
+    out.gateway.device_name = cfg.GetStringOr(base + "device_name", "");
+    out.default_product_key = cfg.GetStringOr(base + "default_product_key", "");
+    double v = 0.0;
+    if (cfg.GetDouble(base + "post_interval_s", v) && v > 0.0) {
+        out.post_interval_ms = static_cast<std::int64_t>(v * 1000.0);
+    }
+    if (cfg.GetDouble(base + "reply_timeout_s", v) && v > 0.0) {
+        out.reply_timeout_ms = static_cast<std::int64_t>(v * 1000.0);
+    }
+    out.max_posts_per_sec = cfg.GetDoubleOr(base + "max_posts_per_sec", out.max_posts_per_sec);
+    const std::int64_t max_devices = cfg.GetInt64Or(base + "max_devices_per_post", 0);
+    if (max_devices > 0) out.max_devices_per_post = static_cast<std::size_t>(max_devices);
+    const std::int64_t queue_limit = cfg.GetInt64Or(base + "queue_limit", 0);
+    if (queue_limit > 0) out.queue_limit = static_cast<std::size_t>(queue_limit);
+    const std::int64_t max_in_flight = cfg.GetInt64Or(base + "max_in_flight", 0);
+    if (max_in_flight > 0) out.max_in_flight = static_cast<std::size_t>(max_in_flight);
+    const std::int64_t retries = cfg.GetInt64Or(base + "max_retries", out.max_retries);
+    if (retries >= 0) out.max_retries = static_cast<std::uint32_t>(retries);
+}
+
+// `thing_model` of config/devices/thing-model.yaml: registry device -> cloud sub-device and property identifiers.
+static void LoadThingMappings(const iotgw::core::common::config::ConfigManager& cfg,
+                              iotgw::core::uplink::ThingModelUplink& out) {
+    for (std::size_t i = 0;; ++i) {
+        const std::string base = std::string("thing_model[") + std::to_string(i) + "].";
+        std::string id;
+        if (!(cfg.GetString(base + "id", id) && !id.empty())) break;
+        iotgw::core::uplink::ThingMapping m;
+        m.identity.product_key = cfg.GetStringOr(base + "product_key", "");
+        m.identity.device_name = cfg.GetStringOr(base + "device_name", "");
+        for (std::size_t j = 0;; ++j) {
+            const std::string pbase = base + "properties[" + std::to_string(j) + "].";
+            std::string field;
+            if (!(cfg.GetString(pbase + "field", field) && !field.empty())) break;
+            m.properties.emplace_back(field, cfg.GetStringOr(pbase + "identifier", field));
+        }
+        out.Map(id, std::move(m));
+    }
+}
+
 static void LoadDevicesFromConfig(const iotgw::core::common::config::ConfigManager& cfg,
                                   const std::string& topic_prefix, iotgw::core::device::manager::DeviceRegistry& out) {
     std::size_t i = 0;
@@ -199,9 +335,12 @@ static void LoadDevicesFromConfig(const iotgw::core::common::config::ConfigManag
         d.id = id;
         d.kind = "sensor";
         (void)cfg.GetString(base + "protocol", d.transport);
+        (void)cfg.GetString(base + "format", d.payload_format);
         d.telemetry_topic =
             topic_prefix.empty() ? (std::string("telemetry/") + id) : (topic_prefix + "telemetry/" + id);
         (void)out.Register(std::move(d));
+        iotgw::core::device::manager::Deadband db;
+        if (LoadDeadband(cfg, base, out.DefaultDeadband(), db)) (void)out.SetDeadband(out.Find(id), db);
         ++i;
     }
 
@@ -214,6 +353,7 @@ static void LoadDevicesFromConfig(const iotgw::core::common::config::ConfigManag
         d.id = id;
         d.kind = "actuator";
         (void)cfg.GetString(base + "protocol", d.transport);
+        (void)cfg.GetString(base + "format", d.payload_format);
         d.command_topic = topic_prefix.empty() ? (std::string("cmd/") + id) : (topic_prefix + "cmd/" + id);
         d.telemetry_topic = topic_prefix.empty() ? (std::string("state/") + id) : (topic_prefix + "state/" + id);
         (void)out.Register(std::move(d));
@@ -221,6 +361,173 @@ static void LoadDevicesFromConfig(const iotgw::core::common::config::ConfigManag
     }
 }
 
+// `virtual_sensors` of config/devices/virtual.yaml: registered as sensors whose value the gateway computes.
+static void LoadVirtualSensors(const iotgw::core::common::config::ConfigManager& cfg,
+                               iotgw::core::device::derived::VirtualSensors& out,
+                               iotgw::core::device::manager::DeviceRegistry& registry,
+                               iotgw::core::common::log::Logger& logger) {
+    for (std::size_t i = 0;; ++i) {
+        const std::string base = std::string("virtual_sensors[") + std::to_string(i) + "].";
+        std::string id;
+        if (!(cfg.GetString(base + "id", id) && !id.empty())) break;
+        std::string error;
+        if (registry.Has(id)) {
+            logger.Warn("virtual sensor " + id + ": a device with this id already exists");
+        } else if (!out.Add(id, cfg.GetStringOr(base + "expr", ""), error)) {
+            logger.Warn("virtual sensor " + id + ": " + error);
+        }
+    }
+    std::vector<std::string> errors;
+    (void)out.Build(errors);
+    for (const auto& e : errors) logger.Warn("virtual sensor " + e);
+    for (std::size_t i = 0; i < out.Size(); ++i) {
+        iotgw::core::device::model::DeviceEntity d;
+        d.id = out.IdAt(i);
+        d.kind = "sensor";
+        d.transport = "virtual";
+        (void)registry.Register(std::move(d));
+    }
+}
+
+// Built-in routes for the topic layout above, then `mqtt.topic_templates`.
+static void LoadTopicTemplates(const iotgw::core::common::config::ConfigManager& cfg, const std::string& topic_prefix,
+                               iotgw::core::device::manager::DeviceRegistry& out,
+                               iotgw::core::common::log::Logger& logger) {
+    using iotgw::core::device::manager::RouteType;
+    (void)out.AddTopicTemplate(topic_prefix + "telemetry/{id}", RouteType::kTelemetry, "sensor");
+    (void)out.AddTopicTemplate(topic_prefix + "state/{id}", RouteType::kTelemetry, "actuator");
+    (void)out.AddTopicTemplate(topic_prefix + "cmd/{id}", RouteType::kCommand, "actuator");
+
+    for (std::size_t i = 0;; ++i) {
+        const std::string base = std::string("mqtt.topic_templates[") + std::to_string(i) + "].";
+        std::string pattern;
+        if (!(cfg.GetString(base + "pattern", pattern) && !pattern.empty())) break;
+        const std::string route = ToLower(cfg.GetStringOr(base + "route", "telemetry"));
+        const RouteType type = (route == "command" || route == "cmd") ? RouteType::kCommand : RouteType::kTelemetry;
+        const std::string format_name = cfg.GetStringOr(base + "format", "json");
+        iotgw::core::device::codec::PayloadFormat format = iotgw::core::device::codec::PayloadFormat::kJson;
+        if (!iotgw::core::device::codec::ParsePayloadFormat(format_name, format)) {
+            logger.Warn("unknown payload format '" + format_name + "' in topic template " + pattern);
+        }
+        if (!out.AddTopicTemplate(pattern, type, cfg.GetStringOr(base + "kind", ""), format)) {
+            logger.Warn("invalid topic template (needs {id}): " + pattern);
+        }
+    }
+}
+
+struct NamedMqttClient {
+    std::string name;
+    std::string config_base;
+    std::unique_ptr<iotgw::core::device::protocol_adapters::mqtt::MqttClient> client;
+};
+
+// MQTT 5 negotiation, topic aliases and shared subscriptions.
+static void LoadProtocolOptions(const iotgw::core::common::config::ConfigManager& cfg, const std::string& base,
+                                iotgw::core::device::protocol_adapters::mqtt::MqttClient::Options& out) {
+    const std::int64_t version = cfg.GetInt64Or(base + "version", out.version);
+    if (version == 3 || version == 4 || version == 5) out.version = static_cast<std::uint8_t>(version);
+    const std::int64_t alias_max = cfg.GetInt64Or(base + "topic_alias_max", out.topic_alias_max);
+    if (alias_max >= 0 && alias_max <= 65535) out.topic_alias_max = static_cast<std::uint16_t>(alias_max);
+    (void)cfg.GetString(base + "share_group", out.share_group);
+}
+
+static bool LoadBrokerOptions(const iotgw::core::common::config::ConfigManager& cfg, const std::string& base,
+                              iotgw::core::device::protocol_adapters::mqtt::MqttClient::Options& out) {
+    std::string host;
+    std::int64_t port = 0;
+    if (!(cfg.GetString(base + "broker_host", host) && !host.empty() && cfg.GetInt64(base + "broker_port", port) &&
+          port > 0 && port <= 65535)) {
+        return false;
+    }
+    out.url = std::string("mqtt://") + host + ":" + std::to_string(static_cast<int>(port));
+    (void)cfg.GetString(base + "client_id", out.client_id);
+    (void)cfg.GetString(base + "username", out.user);
+    (void)cfg.GetString(base + "password", out.pass);
+
+    std::int64_t keepalive = 0;
+    if (cfg.GetInt64(base + "keepalive_sec", keepalive) && keepalive > 0 && keepalive <= 65535) {
+        out.keepalive_sec = static_cast<std::uint16_t>(keepalive);
+    }
+    bool clean = true;
+    if (cfg.GetBool(base + "clean_session", clean)) out.clean_session = clean;
+    LoadProtocolOptions(cfg, base, out);
+    return true;
+}
+
+static iotgw::core::device::protocol_adapters::mqtt::MqttBridge::Endpoint MakeClientEndpoint(
+    const iotgw::core::common::config::ConfigManager& cfg, const std::string& base,
+    iotgw::core::device::protocol_adapters::mqtt::MqttClient& client) {
+    iotgw::core::device::protocol_adapters::mqtt::MqttBridge::Endpoint ep;
+    auto* c = &client;
+    ep.publish = [c](const std::string& topic, const std::string& payload, std::uint8_t qos,
+                     std::uint32_t expiry_sec) { return c->Publish(topic, payload, qos, false, expiry_sec); };
+    ep.is_open = [c]() { return c->IsOpen(); };
+    ep.pending_bytes = [c]() { return c->PendingBytes(); };
+    ep.max_pending_bytes =
+        static_cast<std::size_t>(std::max<std::int64_t>(0, cfg.GetInt64Or(base + "max_pending_bytes", 0)));
+    ep.max_msgs_per_sec = static_cast<double>(cfg.GetInt64Or(base + "max_msgs_per_sec", 0));
+    return ep;
+}
+
+// Telemetry re-encoded for the uplink: decoded with the device's own format and plan, then
+// written as an envelope in `format`. Messages that do not decode are not forwarded.
+static std::function<bool(const std::string&, const std::string&, std::string&)> MakeUplinkTranscoder(
+    const iotgw::core::device::manager::DeviceRegistry& registry, iotgw::core::device::codec::PayloadFormat format) {
+    const auto* reg = &registry;
+    return [reg, format](const std::string& topic, const std::string& payload, std::string& out) {
+        namespace codec = iotgw::core::device::codec;
+        iotgw::core::device::manager::TopicRoute route;
+        if (!reg->Resolve(topic, route) || route.device == iotgw::core::device::manager::kInvalidDevice ||
+            route.type != iotgw::core::device::manager::RouteType::kTelemetry) {
+            return false;
+        }
+        codec::DecodedTelemetry decoded;
+        if (!codec::DecodePayload(reg->PayloadFormatOf(route.device), payload, reg->PlanOf(route.device), decoded)) {
+            return false;
+        }
+        const std::int64_t ts = decoded.ts != 0 ? decoded.ts : iotgw::core::common::time::NowUnixMs() / 1000;
+        codec::EncodeEnvelope(format, route.device_id, route.device_kind, decoded.fields, ts, out);
+        return true;
+    };
+}
+
+static void LoadBridgeRules(const iotgw::core::common::config::ConfigManager& cfg,
+                            const iotgw::core::device::manager::DeviceRegistry& registry,
+                            iotgw::core::device::protocol_adapters::mqtt::MqttBridge& out,
+                            iotgw::core::common::log::Logger& logger) {
+    for (std::size_t i = 0;; ++i) {
+        const std::string base = std::string("mqtt.bridges[") + std::to_string(i) + "].";
+        iotgw::core::device::protocol_adapters::mqtt::MqttBridge::Rule r;
+        if (!(cfg.GetString(base + "topic", r.topic_filter) && !r.topic_filter.empty())) break;
+        (void)cfg.GetString(base + "name", r.name);
+        r.from = cfg.GetStringOr(base + "from", "default");
+        (void)cfg.GetString(base + "to", r.to);
+        (void)cfg.GetString(base + "from_prefix", r.from_prefix);
+        (void)cfg.GetString(base + "to_prefix", r.to_prefix);
+        // Bridged messages go out at QoS 0 or 1; a higher level is served as 1, not dropped to 0.
+        const std::int64_t qos = cfg.GetInt64Or(base + "qos", 0);
+        if (qos > 1) {
+            logger.Warn("bridge " + r.topic_filter + ": qos " + std::to_string(qos) + " not supported, using 1");
+        }
+        r.qos = static_cast<std::uint8_t>(qos >= 1 ? 1 : 0);
+        r.queue_limit =
+            static_cast<std::size_t>(std::max<std::int64_t>(1, cfg.GetInt64Or(base + "queue_limit", 1000)));
+        r.max_msgs_per_sec = static_cast<double>(cfg.GetInt64Or(base + "max_msgs_per_sec", 0));
+        r.message_expiry_sec =
+            static_cast<std::uint32_t>(std::max<std::int64_t>(0, cfg.GetInt64Or(base + "message_expiry_sec", 0)));
+        std::string format_name;
+        if (cfg.GetString(base + "payload_format", format_name) && !format_name.empty()) {
+            iotgw::core::device::codec::PayloadFormat format = iotgw::core::device::codec::PayloadFormat::kJson;
+            if (iotgw::core::device::codec::ParsePayloadFormat(format_name, format)) {
+                r.transform = MakeUplinkTranscoder(registry, format);
+            } else {
+                logger.Warn("unknown payload format '" + format_name + "' in bridge " + r.topic_filter);
+            }
+        }
+        (void)out.AddRule(std::move(r));
+    }
+}
+
 }  // namespace
 
 int GatewayCore::Run(const Args& args) {
@@ -310,6 +617,9 @@ int GatewayCore::Run(const Args& args) {
         }
     }
 
+    LoadWsSendQueueOptions(cfg, *logger, web_opt.send_queue);
+    LoadEventStreamOptions(cfg, web_opt.event_stream);
+
     std::string www_root;
     if (cfg.GetString("paths.www_root", www_root) && !www_root.empty()) {
         web_opt.www_root = www_root;
@@ -323,8 +633,11 @@ int GatewayCore::Run(const Args& args) {
         logger->Error("Failed to start web server on " + web_opt.listen_addr);
     }
 
+    // Declared before the registry, which keeps pointers to its plans.
+    iotgw::core::device::codec::PayloadSchema payload_schema;
     iotgw::core::device::manager::DeviceRegistry device_registry;
     iotgw::core::control::rule_engine::RuleEngine rule_engine;
+    iotgw::core::device::derived::VirtualSensors virtual_sensors;
 
     {
         iotgw::core::common::config::ConfigManager dcfg;
@@ -337,7 +650,95 @@ int GatewayCore::Run(const Args& args) {
             topic_prefix.clear();
         }
 
+        // Off unless `ingest.deadband_enabled`; sensors.yaml may set a device's own.
+        iotgw::core::device::manager::Deadband db;
+        (void)LoadDeadband(cfg, "ingest.", iotgw::core::device::manager::Deadband(), db);
+        db.enabled = cfg.GetBoolOr("ingest.deadband_enabled", false);
+        device_registry.SetDefaultDeadband(db);
+        device_registry.SetLivenessResolution(
+            static_cast<std::int64_t>(cfg.GetDoubleOr("ingest.liveness_resolution_s", 10.0) * 1000.0));
+
         LoadDevicesFromConfig(dcfg, topic_prefix, device_registry);
+        LoadTopicTemplates(cfg, topic_prefix, device_registry, *logger);
+    }
+    {
+        iotgw::core::common::config::ConfigManager vcfg;
+        if (vcfg.LoadYamlFile(config_root + "/devices/virtual.yaml")) {
+            LoadVirtualSensors(vcfg, virtual_sensors, device_registry, *logger);
+            logger->Info("Virtual sensors: " + std::to_string(virtual_sensors.Size()));
+        }
+    }
+
+    if (cfg.GetBoolOr("mqtt.payload_validation", true)) {
+        iotgw::core::common::config::ConfigManager scfg;
+        if (scfg.LoadYamlFile(config_root + "/devices/schema.yaml")) {
+            std::vector<std::string> errors;
+            const std::size_t n = payload_schema.Compile(scfg, errors);
+            for (const auto& e : errors) logger->Warn("schema.yaml: " + e);
+            logger->Info("Payload schema compiled for " + std::to_string(n) + " devices");
+            device_registry.SetPlanLookup(
+                [&payload_schema](const std::string& id) { return payload_schema.Find(id); });
+        }
+    }
+
+    // Sample channels of array payloads: recent history per channel plus windowed summaries.
+    const std::int64_t history_samples = cfg.GetInt64Or("streams.history_samples", 4096);
+    const std::int64_t max_streams = cfg.GetInt64Or("streams.max_streams", 256);
+    const std::int64_t window_ms = cfg.GetInt64Or("streams.window_ms", 1000);
+    iotgw::core::stream::StreamStore stream_store(
+        static_cast<std::size_t>(history_samples > 0 ? history_samples : 4096),
+        static_cast<std::size_t>(max_streams > 0 ? max_streams : 256));
+    iotgw::core::stream::WindowStats stream_windows(window_ms * 1000);
+    stream_store.AddSink(
+        [&stream_windows](const iotgw::core::stream::SampleBlock& block) { stream_windows.OnBlock(block); });
+    // Online outlier detection over every sensor's "value" and every sample channel.
+    iotgw::core::stream::AnomalyConfig anomaly_cfg;
+    anomaly_cfg.alpha = cfg.GetDoubleOr("anomaly.alpha", anomaly_cfg.alpha);
+    anomaly_cfg.z_threshold = cfg.GetDoubleOr("anomaly.z_threshold", anomaly_cfg.z_threshold);
+    anomaly_cfg.mad_threshold = cfg.GetDoubleOr("anomaly.mad_threshold", anomaly_cfg.mad_threshold);
+    anomaly_cfg.warmup = static_cast<std::uint32_t>(cfg.GetInt64Or("anomaly.warmup", anomaly_cfg.warmup));
+    anomaly_cfg.max_sensors =
+        static_cast<std::size_t>(std::max<std::int64_t>(1, cfg.GetInt64Or("anomaly.max_sensors", 65536)));
+    const bool anomaly_enabled = cfg.GetBoolOr("anomaly.enabled", true);
+    iotgw::core::stream::AnomalyDetector anomaly_detector(anomaly_cfg);
+    std::vector<std::uint32_t> anomaly_slots;         // by DeviceHandle
+    std::vector<std::uint32_t> anomaly_stream_slots;  // by StreamId
+    if (anomaly_enabled) {
+        stream_store.AddSink([&](const iotgw::core::stream::SampleBlock& block) {
+            if (block.stream >= anomaly_stream_slots.size()) {
+                anomaly_stream_slots.resize(block.stream + 1, iotgw::core::stream::AnomalyDetector::kNoSensor);
+            }
+            auto& slot = anomaly_stream_slots[block.stream];
+            if (slot == iotgw::core::stream::AnomalyDetector::kNoSensor) {
+                slot = anomaly_detector.Attach(stream_store.DeviceOf(block.stream) + "/" +
+                                               stream_store.ChannelOf(block.stream));
+            }
+            (void)anomaly_detector.ObserveBlock(slot, block);
+        });
+    }
+    // Spectral features of sample channels (vibration etc.); only the features leave the gateway.
+    iotgw::core::stream::SpectralConfig spectral_cfg;
+    spectral_cfg.fft_size =
+        static_cast<std::size_t>(std::max<std::int64_t>(4, cfg.GetInt64Or("spectral.fft_size", 1024)));
+    spectral_cfg.hop = static_cast<std::size_t>(std::max<std::int64_t>(0, cfg.GetInt64Or("spectral.hop", 512)));
+    for (std::size_t i = 0; i < iotgw::core::stream::SpectralFeatures::kMaxBands; ++i) {
+        const std::string base = std::string("spectral.bands[") + std::to_string(i) + "].";
+        iotgw::core::stream::SpectralBand band;
+        if (!cfg.GetDouble(base + "max_hz", band.max_hz)) break;
+        band.min_hz = cfg.GetDoubleOr(base + "min_hz", 0.0);
+        spectral_cfg.bands.push_back(band);
+    }
+    const bool spectral_enabled = cfg.GetBoolOr("spectral.enabled", true);
+    iotgw::core::stream::SpectralAnalyzer spectral(spectral_cfg);
+    if (spectral_enabled) {
+        stream_store.AddSink([&spectral](const iotgw::core::stream::SampleBlock& block) { spectral.OnBlock(block); });
+    }
+    if (cfg.GetBoolOr("streams.enabled", true)) {
+        device_registry.SetSampleHandler([&](iotgw::core::device::manager::DeviceHandle h,
+                                             const iotgw::core::device::codec::SampleBatch& batch,
+                                             std::int64_t now_ms) {
+            stream_store.Ingest(h, device_registry.At(h)->id, batch, now_ms);
+        });
     }
 
     {
@@ -352,33 +753,344 @@ int GatewayCore::Run(const Args& args) {
     bool mqtt_enabled = false;
     (void)cfg.GetBool("mqtt.enabled", mqtt_enabled);
 
+    iotgw::core::device::protocol_adapters::mqtt::MqttBroker mqtt_broker(web_server.GetMgr(), logger);
+    bool broker_enabled = false;
+    (void)cfg.GetBool("mqtt.embedded_broker.enabled", broker_enabled);
+
+    // Named upstream connections besides the default one, e.g. a cloud uplink on its own broker.
+    std::vector<NamedMqttClient> named_clients;
+    iotgw::core::device::protocol_adapters::mqtt::MqttBridge mqtt_bridge(logger);
+    mqtt_bridge.AddEndpoint("default", MakeClientEndpoint(cfg, "mqtt.", mqtt_client));
+    {
+        iotgw::core::device::protocol_adapters::mqtt::MqttBridge::Endpoint ep;
+        ep.publish = [&mqtt_broker](const std::string& topic, const std::string& payload, std::uint8_t qos,
+                                    std::uint32_t) { return mqtt_broker.Publish(topic, payload, qos, false); };
+        ep.is_open = [&mqtt_broker]() { return mqtt_broker.IsListening(); };
+        ep.echoes = false;  // MqttBroker::Publish only reaches local subscribers, not the message handler
+        mqtt_bridge.AddEndpoint("embedded", std::move(ep));
+    }
+    for (std::size_t i = 0;; ++i) {
+        const std::string base = std::string("mqtt.brokers[") + std::to_string(i) + "].";
+        std::string name;
+        if (!(cfg.GetString(base + "name", name) && !name.empty())) break;
+        if (mqtt_bridge.HasEndpoint(name)) {
+            logger->Warn("duplicate MQTT broker name: " + name);
+            continue;
+        }
+        NamedMqttClient nc;
+        nc.name = name;
+        nc.config_base = base;
+        nc.client.reset(new iotgw::core::device::protocol_adapters::mqtt::MqttClient(web_server.GetMgr(), logger));
+        mqtt_bridge.AddEndpoint(name, MakeClientEndpoint(cfg, base, *nc.client));
+        named_clients.push_back(std::move(nc));
+    }
+
+    for (std::size_t i = 0;; ++i) {
+        iotgw::core::device::protocol_adapters::mqtt::MqttBridge::Rule r;
+        if (!(cfg.GetString("mqtt.embedded_broker.bridge_topics[" + std::to_string(i) + "]", r.topic_filter) &&
+              !r.topic_filter.empty())) {
+            break;
+        }
+        r.name = "embedded_uplink_" + std::to_string(i);
+        r.from = "embedded";
+        r.to = "default";
+        (void)mqtt_bridge.AddRule(std::move(r));
+    }
+    LoadBridgeRules(cfg, device_registry, mqtt_bridge, *logger);
+
     std::string mqtt_topic_prefix;
     if (!((cfg.GetString("mqtt.topic_prefix", mqtt_topic_prefix) && !mqtt_topic_prefix.empty()) ||
           (cfg.GetString("topics.prefix", mqtt_topic_prefix) && !mqtt_topic_prefix.empty()))) {
         mqtt_topic_prefix.clear();
     }
 
+    // Edge aggregation: the cloud gets one batched envelope per interval instead of every report.
+    const bool uplink_enabled = cfg.GetBoolOr("uplink.enabled", false);
+    iotgw::core::uplink::AggregatorOptions uplink_options;
+    LoadUplinkOptions(cfg, *logger, uplink_options);
+    iotgw::core::uplink::UplinkAggregator uplink(uplink_options);
+    const std::string uplink_topic = cfg.GetStringOr("uplink.topic", mqtt_topic_prefix + "uplink/batch");
+    const std::int64_t uplink_qos = cfg.GetInt64Or("uplink.qos", 1);
+    iotgw::core::device::protocol_adapters::mqtt::MqttClient* uplink_client = &mqtt_client;
+    {
+        const std::string broker = cfg.GetStringOr("uplink.broker", "default");
+        if (broker != "default") {
+            uplink_client = nullptr;
+            for (auto& nc : named_clients) {
+                if (nc.name == broker) uplink_client = nc.client.get();
+            }
+            if (uplink_client == nullptr && uplink_enabled) logger->Warn("uplink: unknown MQTT broker " + broker);
+        }
+    }
+    const auto publish_uplink = [&](const std::string& payload) {
+        if (uplink_client == nullptr || !uplink_client->IsOpen()) return false;
+        return uplink_client->Publish(uplink_topic, payload, static_cast<std::uint8_t>(uplink_qos == 0 ? 0 : 1));
+    };
+
+    // Cloud thing-model (Alink) property posts, on their own queue and rate limit.
+    // With `broker: embedded` a local stand-in can play the cloud's reply topics.
+    const bool thing_enabled = cfg.GetBoolOr("cloud.thing_model.enabled", false);
+    iotgw::core::uplink::ThingModelOptions thing_options;
+    LoadThingModelOptions(cfg, thing_options);
+    iotgw::core::uplink::ThingModelUplink thing_model(thing_options);
+    const std::string thing_broker = cfg.GetStringOr("cloud.thing_model.broker", "default");
+    iotgw::core::device::protocol_adapters::mqtt::MqttClient* thing_client = nullptr;
+    if (thing_enabled) {
+        iotgw::core::common::config::ConfigManager tcfg;
+        if (tcfg.LoadYamlFile(config_root + "/devices/thing-model.yaml")) LoadThingMappings(tcfg, thing_model);
+        if (thing_options.gateway.product_key.empty() || thing_options.gateway.device_name.empty()) {
+            logger->Warn("cloud.thing_model: product_key and device_name are required");
+        }
+        if (thing_broker == "default") {
+            thing_client = &mqtt_client;
+        } else if (thing_broker != "embedded") {
+            for (auto& nc : named_clients) {
+                if (nc.name == thing_broker) thing_client = nc.client.get();
+            }
+            if (thing_client == nullptr) logger->Warn("cloud.thing_model: unknown MQTT broker " + thing_broker);
+        }
+    }
+    const auto publish_thing = [&](const std::string& topic, const std::string& payload) {
+        if (thing_broker == "embedded") return mqtt_broker.IsListening() && mqtt_broker.Publish(topic, payload);
+        if (thing_client == nullptr || !thing_client->IsOpen()) return false;
+        return thing_client->Publish(topic, payload, 1);
+    };
+
     const std::string rules_automation_file = config_root + "/rules/automation-rules.yaml";
     const std::string rules_alarm_file = config_root + "/rules/alarm-rules.yaml";
 
     iotgw::services::system_services::camera::CameraManager camera_manager;
 
+    // Dashboard state push: each client gets the fields changed since the version it acknowledged.
+    iotgw::services::web_services::websocket::StateFeed::Options feed_opt;
+    feed_opt.min_interval_ms = cfg.GetInt64Or("network.websocket.state_interval_ms", feed_opt.min_interval_ms);
+    iotgw::services::web_services::websocket::StateFeed state_feed(device_registry, feed_opt);
+
     iotgw::services::web_services::api::ApiContext api_ctx;
     api_ctx.base_path = cfg.GetStringOr("network.http_api.base_path", "/api");
     api_ctx.version = v;
+    api_ctx.ws_path = web_opt.ws_path;
     api_ctx.rules_automation_file = rules_automation_file;
     api_ctx.rules_alarm_file = rules_alarm_file;
     api_ctx.mqtt_topic_prefix = mqtt_topic_prefix;
     api_ctx.device_registry = &device_registry;
     api_ctx.rule_engine = &rule_engine;
     api_ctx.mqtt_client = &mqtt_client;
+    api_ctx.mqtt_broker = &mqtt_broker;
     api_ctx.camera_manager = &camera_manager;
+    api_ctx.virtual_sensors = &virtual_sensors;
+    api_ctx.stream_store = &stream_store;
+    api_ctx.stream_windows = &stream_windows;
+    api_ctx.anomaly_detector = &anomaly_detector;
+    api_ctx.spectral = spectral_enabled ? &spectral : nullptr;
+    api_ctx.uplink = uplink_enabled ? &uplink : nullptr;
+    api_ctx.thing_model = thing_enabled ? &thing_model : nullptr;
+    api_ctx.state_feed = &state_feed;
+    api_ctx.ws_subscriptions = &web_server.Subscriptions();
+    api_ctx.ws_send_queues = &web_server.SendQueues();
+    api_ctx.event_stream = &web_server.Events();
     api_ctx.logger = logger;
 
+    (void)iotgw::services::web_services::api::ApiRoutes();  // compile the route table before the first request
     web_server.SetHttpHandler([&](struct mg_connection* c, struct mg_http_message* hm) -> bool {
         return iotgw::services::web_services::api::HandleHttpRequest(c, hm, api_ctx);
     });
 
+    // Commands go to devices on the embedded broker and to the upstream broker, whichever is available.
+    const auto publish_command = [&](const std::string& topic, const std::string& payload) -> bool {
+        bool ok = false;
+        if (mqtt_broker.IsListening()) ok = mqtt_broker.Publish(topic, payload, 0, false) || ok;
+        if (mqtt_client.IsOpen()) ok = mqtt_client.Publish(topic, payload, 0, false) || ok;
+        return ok;
+    };
+
+    // WS frames are serialized into one reused buffer.
+    iotgw::core::common::json::Writer ws_writer;
+
+    const auto run_rule_action = [&](const iotgw::core::control::rule_engine::Rule& rule,
+                                     const iotgw::core::control::rule_engine::Action& action) {
+        if (action.type == "actuator_set") {
+            const std::string act_id = action.actuator_id;
+            if (act_id.empty()) return;
+            std::string cmd_topic;
+            if (!device_registry.GetCommandTopic(act_id, cmd_topic)) {
+                cmd_topic =
+                    mqtt_topic_prefix.empty() ? (std::string("cmd/") + act_id) : (mqtt_topic_prefix + "cmd/" + act_id);
+            }
+            std::string vout = action.value;
+            // Binary devices get the number in their own format.
+            const auto act = device_registry.Find(act_id);
+            const auto fmt = device_registry.PayloadFormatOf(act);
+            double num = 0.0;
+            if (fmt != iotgw::core::device::codec::PayloadFormat::kJson && TryParseDoubleStrict(vout, num)) {
+                vout.clear();
+                iotgw::core::device::codec::EncodeNumber(fmt, num, vout);
+            }
+            if (!cmd_topic.empty()) {
+                (void)publish_command(cmd_topic, vout);
+            }
+        } else if (action.type == "log") {
+            const std::string lvl2 = ToLower(action.level);
+            const std::string msg2 = action.message.empty() ? (std::string("rule_fired: ") + rule.id) : action.message;
+            if (lvl2 == "warn" || lvl2 == "warning") {
+                logger->Warn(msg2);
+            } else if (lvl2 == "error") {
+                logger->Error(msg2);
+            } else if (lvl2 == "debug") {
+                logger->Debug(msg2);
+            } else {
+                logger->Info(msg2);
+            }
+        }
+    };
+
+    // Outliers become "anomaly" events of the sensor (score = robust z-score) for rules,
+    // and are pushed to the WS feed.
+    anomaly_detector.SetHandler([&](const iotgw::core::stream::AnomalyEvent& e) {
+        const std::string& sensor = anomaly_detector.NameOf(e.sensor);
+        rule_engine.OnSensorEvent(sensor, "anomaly", std::fabs(e.robust_z), run_rule_action);
+        ws_writer.Clear();
+        ws_writer.BeginObject();
+        ws_writer.Key("type").String("anomaly");
+        ws_writer.Key("sensor").String(sensor);
+        ws_writer.Key("value").Double(e.value);
+        ws_writer.Key("z").Double(e.z);
+        ws_writer.Key("robust_z").Double(e.robust_z);
+        ws_writer.Key("ts").Int(e.ts_us / 1000);
+        ws_writer.EndObject();
+        web_server.Publish("", sensor.substr(0, sensor.find('/')), ws_writer.str());
+    });
+
+    // Each frame's features go upstream as derived telemetry, to rules as "{device}/{channel}/rms"
+    // and ".../peak_hz" values, and to the WS feed.
+    const std::string spectral_topic = cfg.GetStringOr("spectral.topic", mqtt_topic_prefix + "features/{id}/{channel}");
+    iotgw::core::common::json::Writer spectral_writer;
+    spectral.SetHandler([&](iotgw::core::stream::StreamId id, const iotgw::core::stream::SpectralFeatures& f) {
+        const std::string& device_id = stream_store.DeviceOf(id);
+        const std::string& channel = stream_store.ChannelOf(id);
+        spectral_writer.Clear();
+        spectral_writer.BeginObject();
+        spectral_writer.Key("type").String("features");
+        spectral_writer.Key("device_id").String(device_id);
+        spectral_writer.Key("channel").String(channel);
+        spectral_writer.Key("ts").Int(f.ts_us / 1000);
+        spectral_writer.Key("sample_rate_hz").Double(f.sample_rate_hz);
+        spectral_writer.Key("fft_size").Uint(spectral.FftSize());
+        spectral_writer.Key("rms").Double(f.rms);
+        spectral_writer.Key("peak_hz").Double(f.peak_hz);
+        spectral_writer.Key("peak_amplitude").Double(f.peak_amplitude);
+        spectral_writer.Key("bands").BeginArray();
+        for (std::size_t j = 0; j < f.band_count; ++j) spectral_writer.Double(f.band_energy[j]);
+        spectral_writer.EndArray();
+        spectral_writer.EndObject();
+        std::string topic = spectral_topic;
+        ReplaceAll(topic, "{id}", device_id);
+        ReplaceAll(topic, "{channel}", channel);
+        if (mqtt_client.IsOpen() && !topic.empty()) (void)mqtt_client.Publish(topic, spectral_writer.str(), 0, false);
+        web_server.Publish(topic, device_id, spectral_writer.str(), topic);
+
+        const std::string sensor = device_id + "/" + channel;
+        rule_engine.OnSensorValue(sensor + "/rms", f.rms, run_rule_action);
+        rule_engine.OnSensorValue(sensor + "/peak_hz", f.peak_hz, run_rule_action);
+    });
+
+    // A sensor's new "value", real or virtual, goes to the anomaly detector and the rules.
+    const auto on_sensor_value = [&](iotgw::core::device::manager::DeviceHandle device_handle,
+                                     const std::string& device_id, double sensor_value, std::int64_t now_ms) {
+        if (anomaly_enabled) {
+            if (device_handle >= anomaly_slots.size()) {
+                anomaly_slots.resize(device_handle + 1, iotgw::core::stream::AnomalyDetector::kNoSensor);
+            }
+            auto& slot = anomaly_slots[device_handle];
+            if (slot == iotgw::core::stream::AnomalyDetector::kNoSensor) slot = anomaly_detector.Attach(device_id);
+            (void)anomaly_detector.Observe(slot, sensor_value, now_ms * 1000);
+        }
+        rule_engine.OnSensorValue(device_id, sensor_value, run_rule_action);
+    };
+
+    // Virtual sensors depending on the fields that changed are recomputed once each, inputs first.
+    iotgw::core::common::json::Writer virtual_writer;
+    const auto update_virtual_sensors = [&](const iotgw::core::device::model::DeviceEntity& device,
+                                            std::int64_t now_ms) {
+        if (!virtual_sensors.Reads(device.id) || virtual_sensors.Update(device.id, device.status.fields) == 0) return;
+        (void)virtual_sensors.Flush([&](const std::string& id, double value) {
+            const auto h = device_registry.Find(id);
+            (void)device_registry.SetValue(h, value, now_ms);
+            if (device_registry.At(h) != nullptr) {
+                iotgw::core::device::model::FieldTable computed;
+                (void)computed.Set("value", iotgw::core::device::model::FieldValue::Number(value));
+                if (uplink_enabled) uplink.Observe(h, id, device_registry.At(h)->kind, computed, now_ms);
+                if (thing_enabled) thing_model.Observe(h, id, computed, now_ms);
+            }
+            on_sensor_value(h, id, value, now_ms);
+            virtual_writer.Clear();
+            virtual_writer.BeginObject();
+            virtual_writer.Key("type").String("virtual");
+            virtual_writer.Key("device_id").String(id);
+            virtual_writer.Key("value").Double(value);
+            virtual_writer.Key("ts").Int(now_ms);
+            virtual_writer.EndObject();
+            web_server.Publish("", id, virtual_writer.str(), id);
+        });
+    };
+
+    // False when the report fell within the device's deadband: it refreshed liveness only,
+    // and goes no further (rules, virtual sensors, WS, uplink).
+    const auto on_mqtt_message = [&](const std::string& topic, const std::string& payload) -> bool {
+        const auto now_ms = iotgw::core::common::time::NowUnixMs();
+        std::string device_id;
+        bool changed = true;
+        iotgw::core::device::model::FieldTable reported;
+        const bool accepted =
+            device_registry.UpsertMqttDeviceFromTopic(topic, payload, now_ms, device_id, &changed, &reported);
+        if (accepted && !changed) return false;
+
+        // The registry decoded the payload on ingestion; rules read the typed "value" field of
+        // this report only. A report without one (rejected, undecodable or carrying other fields)
+        // must not feed the previous value to the rules and the detector again.
+        const auto device_handle = device_registry.Find(device_id);
+        const auto* device = accepted ? device_registry.At(device_handle) : nullptr;
+        if (device != nullptr) {
+            // Only what this report carried: the merged table would count earlier fields again.
+            if (uplink_enabled) uplink.Observe(device_handle, device_id, device->kind, reported, now_ms);
+            if (thing_enabled) thing_model.Observe(device_handle, device_id, reported, now_ms);
+        }
+        double sensor_value = 0.0;
+        if (device != nullptr && reported.GetNumber("value", sensor_value)) {
+            on_sensor_value(device_handle, device_id, sensor_value, now_ms);
+        }
+        // Rule actions may have registered devices since; look the device up again.
+        if (accepted && device_registry.At(device_handle) != nullptr) {
+            update_virtual_sensors(*device_registry.At(device_handle), now_ms);
+        }
+
+        ws_writer.Clear();
+        ws_writer.BeginObject().Key("type").String("mqtt_msg").Key("topic").String(topic);
+        const auto fmt = device_registry.PayloadFormatOf(device_registry.Find(device_id));
+        if (fmt == iotgw::core::device::codec::PayloadFormat::kJson) {
+            ws_writer.Key("payload").String(payload);
+        } else {
+            ws_writer.Key("payload").Hex(payload);
+            ws_writer.Key("payload_format").String(iotgw::core::device::codec::PayloadFormatName(fmt));
+        }
+        ws_writer.EndObject();
+        web_server.Publish(topic, device_id, ws_writer.str(), topic);
+        return true;
+    };
+
+    if (broker_enabled) {
+        iotgw::core::device::protocol_adapters::mqtt::MqttBroker::Options bo;
+        bo.listen_url = cfg.GetStringOr("mqtt.embedded_broker.listen_url", bo.listen_url);
+        (void)mqtt_broker.Start(bo);
+
+        // Local devices are dispatched in-process; bridge rules forward selected topics upstream.
+        mqtt_broker.SetMessageHandler([&](const std::string& topic, const std::string& payload) {
+            if (thing_enabled && thing_broker == "embedded" && thing_model.OnMessage(topic, payload)) return;
+            if (!on_mqtt_message(topic, payload)) return;
+            (void)mqtt_bridge.OnMessage("embedded", topic, payload, iotgw::core::common::time::NowUnixMs());
+        });
+    }
+
     if (mqtt_enabled) {
         iotgw::core::device::protocol_adapters::mqtt::MqttClient::Options mo;
         std::string mqtt_host;
@@ -412,6 +1124,7 @@ int GatewayCore::Run(const Args& args) {
             (void)cfg.GetBool("client.clean_session", clean);
         }
         mo.clean_session = clean;
+        LoadProtocolOptions(cfg, "mqtt.", mo);
 
         (void)mqtt_client.Connect(mo);
 
@@ -426,60 +1139,83 @@ int GatewayCore::Run(const Args& args) {
                 sub_topic = topic_prefix + "#";
             }
         }
-        if (!sub_topic.empty()) (void)mqtt_client.Subscribe(sub_topic, 0);
+        if (!sub_topic.empty()) {
+            (void)mqtt_client.Subscribe(sub_topic, 0);
+            (void)mqtt_bridge.AddSubscription("default", sub_topic);
+        }
+        for (const auto& f : mqtt_bridge.FiltersFrom("default")) (void)mqtt_client.Subscribe(f, 0);
+        if (thing_enabled && thing_client == &mqtt_client) {
+            (void)mqtt_client.Subscribe(thing_model.ReplyTopic(), 1);
+            (void)mqtt_bridge.AddSubscription("default", thing_model.ReplyTopic());
+        }
 
         mqtt_client.SetMessageHandler([&](const std::string& topic, const std::string& payload) {
-            const auto now_ms = iotgw::core::common::time::NowUnixMs();
-            std::string device_id;
-            (void)device_registry.UpsertMqttDeviceFromTopic(topic, payload, now_ms, device_id);
-
-            double sensor_value = 0.0;
-            bool has_value = TryParseSensorValue(payload, sensor_value);
-            if (has_value && !device_id.empty()) {
-                rule_engine.OnSensorValue(device_id, sensor_value,
-                                          [&](const iotgw::core::control::rule_engine::Rule& rule,
-                                              const iotgw::core::control::rule_engine::Action& action) {
-                                              if (action.type == "actuator_set") {
-                                                  const std::string act_id = action.actuator_id;
-                                                  if (act_id.empty()) return;
-                                                  std::string cmd_topic;
-                                                  if (!device_registry.GetCommandTopic(act_id, cmd_topic)) {
-                                                      cmd_topic = mqtt_topic_prefix.empty()
-                                                                      ? (std::string("cmd/") + act_id)
-                                                                      : (mqtt_topic_prefix + "cmd/" + act_id);
-                                                  }
-                                                  const std::string vout = action.value;
-                                                  if (!cmd_topic.empty() && mqtt_client.IsOpen()) {
-                                                      (void)mqtt_client.Publish(cmd_topic, vout, 0, false);
-                                                  }
-                                              } else if (action.type == "log") {
-                                                  const std::string lvl2 = ToLower(action.level);
-                                                  const std::string msg2 = action.message.empty()
-                                                                               ? (std::string("rule_fired: ") + rule.id)
-                                                                               : action.message;
-                                                  if (lvl2 == "warn" || lvl2 == "warning") {
-                                                      logger->Warn(msg2);
-                                                  } else if (lvl2 == "error") {
-                                                      logger->Error(msg2);
-                                                  } else if (lvl2 == "debug") {
-                                                      logger->Debug(msg2);
-                                                  } else {
-                                                      logger->Info(msg2);
-                                                  }
-                                              }
-                                          });
+            // Copies the bridge forwarded upstream were already handled when they arrived locally.
+            if (mqtt_bridge.IsForwardedCopy("default", topic, payload, iotgw::core::common::time::NowUnixMs())) {
+                return;
             }
+            if (thing_enabled && thing_client == &mqtt_client && thing_model.OnMessage(topic, payload)) return;
+            if (!on_mqtt_message(topic, payload)) return;
+            (void)mqtt_bridge.OnMessage("default", topic, payload, iotgw::core::common::time::NowUnixMs());
+        });
+    }
 
-            const std::string frame = iotgw::core::common::json::Object({
-                {"type", iotgw::core::common::json::Quote("mqtt_msg")},
-                {"topic", iotgw::core::common::json::Quote(topic)},
-                {"payload", iotgw::core::common::json::Quote(payload)},
-            });
-            web_server.BroadcastText(frame);
+    for (auto& nc : named_clients) {
+        const std::string name = nc.name;
+        auto& client = *nc.client;
+        iotgw::core::device::protocol_adapters::mqtt::MqttClient::Options no;
+        if (!LoadBrokerOptions(cfg, nc.config_base, no)) {
+            logger->Warn("MQTT broker " + name + ": missing broker_host/broker_port");
+            continue;
+        }
+        for (const auto& f : mqtt_bridge.FiltersFrom(name)) (void)client.Subscribe(f, 0);
+        const bool thing_replies = thing_enabled && thing_client == &client;
+        if (thing_replies) {
+            (void)client.Subscribe(thing_model.ReplyTopic(), 1);
+            (void)mqtt_bridge.AddSubscription(name, thing_model.ReplyTopic());
+        }
+        client.SetMessageHandler([&mqtt_bridge, &thing_model, thing_replies, name](const std::string& topic,
+                                                                                 const std::string& payload) {
+            if (thing_replies && thing_model.OnMessage(topic, payload)) return;
+            (void)mqtt_bridge.OnMessage(name, topic, payload, iotgw::core::common::time::NowUnixMs());
         });
+        (void)client.Connect(no);
     }
 
+    web_server.SetWsCloseHandler([&state_feed](struct mg_connection* c) { state_feed.Remove(c); });
+
+    // RPC replies get their own writer: a call (actuator.set) may publish, and publishing
+    // fills ws_writer before the reply is sent.
+    iotgw::core::common::json::Writer rpc_writer;
     web_server.SetWsMessageHandler([&](struct mg_connection* c, const std::string& msg) {
+        if (iotgw::services::web_services::api::HandleRpcMessage(c, msg, api_ctx, rpc_writer)) {
+            (void)web_server.SendText(c, rpc_writer.str());
+            return;
+        }
+        const struct mg_str json = mg_str_n(msg.data(), msg.size());
+        std::string msg_type;
+        char* mt = mg_json_get_str(json, "$.type");
+        if (mt != nullptr) {
+            msg_type = mt;
+            mg_free(mt);
+        }
+        if (msg_type == "state_sync" || msg_type == "state_ack") {
+            const long version = mg_json_get_long(json, "$.version", 0);
+            const auto v = static_cast<std::uint64_t>(version > 0 ? version : 0);
+            if (msg_type == "state_sync") {
+                std::string epoch;
+                char* e = mg_json_get_str(json, "$.epoch");
+                if (e != nullptr) {
+                    epoch = e;
+                    mg_free(e);
+                }
+                state_feed.Subscribe(c, v, epoch);
+            } else {
+                (void)state_feed.Ack(c, v);
+            }
+            return;
+        }
+
         std::string pub_topic;
         std::string payload;
 
@@ -490,37 +1226,45 @@ int GatewayCore::Run(const Args& args) {
         if (t != nullptr) mg_free(t);
         if (p != nullptr) mg_free(p);
 
+        ws_writer.Clear();
         if (pub_topic.empty()) {
-            const std::string resp = iotgw::core::common::json::Object({
-                {"type", iotgw::core::common::json::Quote("error")},
-                {"error", iotgw::core::common::json::Quote("missing_topic")},
-            });
-            mg_ws_send(c, resp.data(), resp.size(), WEBSOCKET_OP_TEXT);
-            return;
-        }
-
-        if (mqtt_client.IsOpen()) {
-            const bool ok = mqtt_client.Publish(pub_topic, payload, 0, false);
-            const std::string resp = iotgw::core::common::json::Object({
-                {"type", iotgw::core::common::json::Quote("mqtt_pub_ack")},
-                {"ok", iotgw::core::common::json::Bool(ok)},
-            });
-            mg_ws_send(c, resp.data(), resp.size(), WEBSOCKET_OP_TEXT);
+            ws_writer.BeginObject().Key("type").String("error").Key("error").String("missing_topic").EndObject();
+        } else if (mqtt_client.IsOpen() || mqtt_broker.IsListening()) {
+            const bool ok = publish_command(pub_topic, payload);
+            ws_writer.BeginObject().Key("type").String("mqtt_pub_ack").Key("ok").Bool(ok).EndObject();
         } else {
-            const std::string resp = iotgw::core::common::json::Object({
-                {"type", iotgw::core::common::json::Quote("error")},
-                {"error", iotgw::core::common::json::Quote("mqtt_not_connected")},
-            });
-            mg_ws_send(c, resp.data(), resp.size(), WEBSOCKET_OP_TEXT);
+            ws_writer.BeginObject().Key("type").String("error").Key("error").String("mqtt_not_connected").EndObject();
         }
+        (void)web_server.SendText(c, ws_writer.str());
     });
 
     std::int64_t last_heartbeat_ms = 0;
+    // Devices silent this long go offline; 0: once seen, a device stays online.
+    const std::int64_t offline_timeout_ms =
+        static_cast<std::int64_t>(cfg.GetDoubleOr("ingest.offline_timeout_s", 0.0) * 1000.0);
+    std::int64_t last_expiry_ms = 0;
 
     while (RunningFlag().load()) {
         web_server.Poll(50);
 
         const auto now = iotgw::core::common::time::NowUnixMs();
+        if (mqtt_enabled) mqtt_client.Poll(now);
+        for (auto& nc : named_clients) nc.client->Poll(now);
+        mqtt_bridge.Poll(now);
+        if (uplink_enabled) (void)uplink.Poll(now, publish_uplink);
+        if (thing_enabled) thing_model.Poll(now, publish_thing);
+        // Through the client's send queue, so a slow reader's state frames count against its limits;
+        // a refused frame is sent again after the feed's ack timeout.
+        state_feed.Poll(now, [&web_server](struct mg_connection* c, const std::string& frame) {
+            (void)web_server.SendText(c, frame);
+        });
+
+        if (offline_timeout_ms > 0 && now - last_expiry_ms >= 1000) {
+            last_expiry_ms = now;
+            const std::size_t expired = device_registry.ExpireOnline(now, offline_timeout_ms);
+            if (expired > 0) logger->Info(std::to_string(expired) + " device(s) went offline");
+        }
+
         if (last_heartbeat_ms == 0 || now - last_heartbeat_ms >= 10'000) {
             last_heartbeat_ms = now;
             logger->Debug("heartbeat");
@@ -529,6 +1273,8 @@ int GatewayCore::Run(const Args& args) {
         iotgw::core::common::time::SleepMs(50);
     }
 
+    // The partial interval goes out while the connection is still up.
+    if (uplink_enabled) (void)uplink.Flush(iotgw::core::common::time::NowUnixMs(), publish_uplink);
     logger->Info("iotgw stopping");
     logger->Flush();
     return 0;
@@ -1,8 +1,13 @@
 #include "core/device/manager/device_manager.hpp"
 #include "services/web_services/api/rest_api.hpp"
 
+#include <cstdint>
+#include <ctime>
 #include <string>
 
+#include "core/common/utils/time_utils.hpp"
+#include "core/device/codec/envelope_encoder.hpp"
+
 namespace iotgw {
 namespace services {
 namespace web_services {
@@ -10,187 +15,166 @@ namespace api {
 
 namespace {
 
-static bool IsMethod(const struct mg_http_message* hm, const char* method) {
-    return mg_strcmp(hm->method, mg_str(method)) == 0;
-}
-
-#include <ctime>
+using iotgw::core::common::time::NowUnixMs;
+using iotgw::core::device::model::FieldValue;
 
-// Helper to construct envelope payload
-static std::string MakeEnvelope(const std::string& id, const std::string& type, const std::string& data_json) {
-    std::time_t now = std::time(nullptr);
-    return "{\"device_id\":\"" + id + "\",\"type\":\"" + type + "\",\"data\":" + data_json +
-           ",\"ts\":" + std::to_string(now) + "}";
+// Command envelope in the device's own payload format.
+static std::string MakeCommand(const ApiContext& ctx, const std::string& id,
+                               const iotgw::core::device::model::FieldTable& data) {
+    auto format = iotgw::core::device::codec::PayloadFormat::kJson;
+    if (ctx.device_registry != nullptr) {
+        format = ctx.device_registry->PayloadFormatOf(ctx.device_registry->Find(id));
+    }
+    std::string out;
+    iotgw::core::device::codec::EncodeEnvelope(format, id, "actuator", data,
+                                               static_cast<std::int64_t>(std::time(nullptr)), out);
+    return out;
 }
 
-}  // namespace
-
-bool HandleControlApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                      const ApiContext& ctx) {
-    if (c == nullptr || hm == nullptr) return false;
-
-    // GET /status
-    if (IsMethod(hm, "GET") && rel_path == "/status") {
-        if (!ctx.device_registry) {
-            mg_http_reply(c, 500, "Content-Type: application/json\r\n", "{\"error\":\"no_registry\"}\n");
-            return true;
-        }
-
-        auto devices = ctx.device_registry->List();
-        std::string json_body = "{";
-        bool first = true;
-
-        auto add_field = [&](const std::string& key, const std::string& val) {
-            if (!first) json_body += ",";
-            first = false;
-            json_body += "\"" + key + "\":" + val;
-        };
-
-        for (const auto& d : devices) {
-            if (d.status.last_payload.empty()) continue;
+// Flat dashboard view of decoded device fields (see www/index.html).
+struct StatusField {
+    const char* device_id;
+    const char* field;
+    const char* key;
+    bool integer;
+};
+
+static const StatusField kStatusFields[] = {
+    {"temp", "value", "temp", false},   {"humi", "value", "humi", false},     {"light", "value", "light", false},
+    {"ir", "value", "ir", false},       {"led", "on", "led_on", true},        {"led", "br", "led_br", true},
+    {"motor", "on", "motor_on", true},  {"motor", "sp", "motor_sp", true},    {"motor", "dir", "motor_dir", true},
+    {"buzzer", "on", "buzzer", true},
+};
+
+static bool CanPublish(const ApiContext& ctx) {
+    return (ctx.mqtt_broker != nullptr && ctx.mqtt_broker->IsListening()) ||
+           (ctx.mqtt_client != nullptr && ctx.mqtt_client->IsOpen());
+}
 
-            struct mg_str json = mg_str(d.status.last_payload.c_str());
+// Local devices on the embedded broker and the upstream broker both receive the command.
+static bool PublishCommand(const ApiContext& ctx, const std::string& topic, const std::string& payload) {
+    bool ok = false;
+    if (ctx.mqtt_broker != nullptr && ctx.mqtt_broker->IsListening()) {
+        ok = ctx.mqtt_broker->Publish(topic, payload, 0, false) || ok;
+    }
+    if (ctx.mqtt_client != nullptr && ctx.mqtt_client->IsOpen()) {
+        ok = ctx.mqtt_client->Publish(topic, payload, 0, false) || ok;
+    }
+    return ok;
+}
 
-            // Unified Device Model Parsing: Look into $.data.*
-            // Also support fallback to flat JSON for backward compatibility if needed,
-            // but here we strictly follow the new schema for standard compliance.
+// GET /status
+static void HandleStatus(struct mg_connection* c, struct mg_http_message*, const RouteParams&,
+                         const ApiContext& ctx) {
+    if (!ctx.device_registry) {
+        ReplyJsonText(c, 500, "{\"error\":\"no_registry\"}");
+        return;
+    }
 
-            if (d.id == "temp" || d.id == "humi" || d.id == "light" || d.id == "ir") {
-                double val = 0;
-                // Try envelope format first: $.data.value
-                if (mg_json_get_num(json, "$.data.value", &val)) {
-                    add_field(d.id, std::to_string(val));
-                } else if (mg_json_get_num(json, "$.value", &val)) {  // Fallback
-                    add_field(d.id, std::to_string(val));
-                }
-            } else if (d.id == "led") {
-                double on = 0;
-                bool has_on = mg_json_get_num(json, "$.data.on", &on) || mg_json_get_num(json, "$.on", &on);
-                if (has_on) add_field("led_on", std::to_string((int)on));
-
-                double br = 0;
-                bool has_br = mg_json_get_num(json, "$.data.br", &br) || mg_json_get_num(json, "$.br", &br);
-                if (has_br) add_field("led_br", std::to_string((int)br));
-            } else if (d.id == "motor") {
-                double on = 0;
-                if (mg_json_get_num(json, "$.data.on", &on) || mg_json_get_num(json, "$.on", &on))
-                    add_field("motor_on", std::to_string((int)on));
-
-                double sp = 0;
-                if (mg_json_get_num(json, "$.data.sp", &sp) || mg_json_get_num(json, "$.sp", &sp))
-                    add_field("motor_sp", std::to_string((int)sp));
-
-                double dir = 0;
-                if (mg_json_get_num(json, "$.data.dir", &dir) || mg_json_get_num(json, "$.dir", &dir))
-                    add_field("motor_dir", std::to_string((int)dir));
-            } else if (d.id == "buzzer") {
-                double on = 0;
-                if (mg_json_get_num(json, "$.data.on", &on) || mg_json_get_num(json, "$.on", &on))
-                    add_field("buzzer", std::to_string((int)on));
-            }
+    auto& w = ResponseWriter();
+    w.BeginObject();
+    for (const auto& f : kStatusFields) {
+        const auto* d = ctx.device_registry->At(ctx.device_registry->Find(f.device_id));
+        double v = 0.0;
+        if (d == nullptr || !d->status.fields.GetNumber(f.field, v)) continue;
+        if (f.integer) {
+            w.Key(f.key).Int(static_cast<int>(v));
+        } else {
+            w.Key(f.key).Double(v);
         }
-        json_body += "}";
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", json_body.c_str());
-        return true;
     }
+    w.EndObject();
+    ReplyJson(c, 200, w);
+}
 
-    // POST /control
-    if (IsMethod(hm, "POST") && rel_path == "/control") {
-        std::string body(hm->body.buf, hm->body.len);
-        struct mg_str json = mg_str(body.c_str());
-
-        if (ctx.mqtt_client && ctx.mqtt_client->IsOpen()) {
-            // LED Control
-            double led_on = -1, led_br = -1;
-            mg_json_get_num(json, "$.payload.led_on", &led_on);
-            mg_json_get_num(json, "$.payload.led_br", &led_br);
-
-            if (led_on != -1 || led_br != -1) {
-                std::string data = "{";
-                if (led_on != -1) data += "\"on\": " + std::to_string((int)led_on);
-                if (led_on != -1 && led_br != -1) data += ", ";
-                if (led_br != -1) data += "\"br\": " + std::to_string((int)led_br);
-                data += "}";
-
-                std::string payload = MakeEnvelope("led", "actuator", data);
-
-                std::string topic = ctx.mqtt_topic_prefix + "cmd/led";
-                if (ctx.mqtt_client->Publish(topic, payload, 0, false)) {
-                    if (ctx.device_registry) {
-                        std::string out_id;
-                        iotgw::core::device::model::DeviceEntity d;
-                        if (ctx.device_registry->Get("led", d) && !d.telemetry_topic.empty()) {
-                            ctx.device_registry->UpdateFromTelemetryTopic(d.telemetry_topic, payload, 0, out_id);
-                        }
+// POST /control
+static void HandleControl(struct mg_connection* c, struct mg_http_message* hm, const RouteParams&,
+                          const ApiContext& ctx) {
+    std::string body(hm->body.buf, hm->body.len);
+    struct mg_str json = mg_str(body.c_str());
+
+    if (CanPublish(ctx)) {
+        // LED Control
+        double led_on = -1, led_br = -1;
+        mg_json_get_num(json, "$.payload.led_on", &led_on);
+        mg_json_get_num(json, "$.payload.led_br", &led_br);
+
+        if (led_on != -1 || led_br != -1) {
+            iotgw::core::device::model::FieldTable data;
+            if (led_on != -1) (void)data.Set("on", FieldValue::Number(static_cast<int>(led_on)));
+            if (led_br != -1) (void)data.Set("br", FieldValue::Number(static_cast<int>(led_br)));
+
+            std::string payload = MakeCommand(ctx, "led", data);
+
+            std::string topic = ctx.mqtt_topic_prefix + "cmd/led";
+            if (PublishCommand(ctx, topic, payload)) {
+                if (ctx.device_registry) {
+                    std::string out_id;
+                    iotgw::core::device::model::DeviceEntity d;
+                    if (ctx.device_registry->Get("led", d) && !d.telemetry_topic.empty()) {
+                        ctx.device_registry->UpdateFromTelemetryTopic(d.telemetry_topic, payload, NowUnixMs(), out_id);
                     }
                 }
             }
+        }
 
-            // Motor Control
-            double motor_on = -1, motor_sp = -1, motor_dir = -1;
-            mg_json_get_num(json, "$.payload.motor_on", &motor_on);
-            mg_json_get_num(json, "$.payload.motor_sp", &motor_sp);
-            mg_json_get_num(json, "$.payload.motor_dir", &motor_dir);
-
-            if (motor_on != -1 || motor_sp != -1 || motor_dir != -1) {
-                std::string data = "{";
-                bool first = true;
-                if (motor_on != -1) {
-                    data += "\"on\": " + std::to_string((int)motor_on);
-                    first = false;
-                }
-                if (motor_sp != -1) {
-                    if (!first) data += ", ";
-                    data += "\"sp\": " + std::to_string((int)motor_sp);
-                    first = false;
-                }
-                if (motor_dir != -1) {
-                    if (!first) data += ", ";
-                    data += "\"dir\": " + std::to_string((int)motor_dir);
-                }
-                data += "}";
-
-                std::string payload = MakeEnvelope("motor", "actuator", data);
-
-                std::string topic = ctx.mqtt_topic_prefix + "cmd/motor";
-                if (ctx.mqtt_client->Publish(topic, payload, 0, false)) {
-                    if (ctx.device_registry) {
-                        std::string out_id;
-                        iotgw::core::device::model::DeviceEntity d;
-                        if (ctx.device_registry->Get("motor", d) && !d.telemetry_topic.empty()) {
-                            ctx.device_registry->UpdateFromTelemetryTopic(d.telemetry_topic, payload, 0, out_id);
-                        }
+        // Motor Control
+        double motor_on = -1, motor_sp = -1, motor_dir = -1;
+        mg_json_get_num(json, "$.payload.motor_on", &motor_on);
+        mg_json_get_num(json, "$.payload.motor_sp", &motor_sp);
+        mg_json_get_num(json, "$.payload.motor_dir", &motor_dir);
+
+        if (motor_on != -1 || motor_sp != -1 || motor_dir != -1) {
+            iotgw::core::device::model::FieldTable data;
+            if (motor_on != -1) (void)data.Set("on", FieldValue::Number(static_cast<int>(motor_on)));
+            if (motor_sp != -1) (void)data.Set("sp", FieldValue::Number(static_cast<int>(motor_sp)));
+            if (motor_dir != -1) (void)data.Set("dir", FieldValue::Number(static_cast<int>(motor_dir)));
+
+            std::string payload = MakeCommand(ctx, "motor", data);
+
+            std::string topic = ctx.mqtt_topic_prefix + "cmd/motor";
+            if (PublishCommand(ctx, topic, payload)) {
+                if (ctx.device_registry) {
+                    std::string out_id;
+                    iotgw::core::device::model::DeviceEntity d;
+                    if (ctx.device_registry->Get("motor", d) && !d.telemetry_topic.empty()) {
+                        ctx.device_registry->UpdateFromTelemetryTopic(d.telemetry_topic, payload, NowUnixMs(), out_id);
                     }
                 }
             }
+        }
 
-            // Buzzer Control
-            double buzzer = -1;
-            mg_json_get_num(json, "$.payload.buzzer", &buzzer);
-            if (buzzer != -1) {
-                std::string data = "{\"on\": " + std::to_string((int)buzzer) + "}";
-                std::string payload = MakeEnvelope("buzzer", "actuator", data);
-
-                std::string topic = ctx.mqtt_topic_prefix + "cmd/buzzer";
-                if (ctx.mqtt_client->Publish(topic, payload, 0, false)) {
-                    if (ctx.device_registry) {
-                        std::string out_id;
-                        iotgw::core::device::model::DeviceEntity d;
-                        if (ctx.device_registry->Get("buzzer", d) && !d.telemetry_topic.empty()) {
-                            ctx.device_registry->UpdateFromTelemetryTopic(d.telemetry_topic, payload, 0, out_id);
-                        }
+        // Buzzer Control
+        double buzzer = -1;
+        mg_json_get_num(json, "$.payload.buzzer", &buzzer);
+        if (buzzer != -1) {
+            iotgw::core::device::model::FieldTable data;
+            (void)data.Set("on", FieldValue::Number(static_cast<int>(buzzer)));
+            std::string payload = MakeCommand(ctx, "buzzer", data);
+
+            std::string topic = ctx.mqtt_topic_prefix + "cmd/buzzer";
+            if (PublishCommand(ctx, topic, payload)) {
+                if (ctx.device_registry) {
+                    std::string out_id;
+                    iotgw::core::device::model::DeviceEntity d;
+                    if (ctx.device_registry->Get("buzzer", d) && !d.telemetry_topic.empty()) {
+                        ctx.device_registry->UpdateFromTelemetryTopic(d.telemetry_topic, payload, NowUnixMs(), out_id);
                     }
                 }
             }
-        } else {
-            // MQTT client not ready
         }
-
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\"}\n");
-        return true;
+    } else {
+        // Neither the embedded broker nor the upstream client is ready
     }
 
-    return false;
+    ReplyJsonText(c, 200, "{\"status\":\"ok\"}");
+}
+
+}  // namespace
+
+void RegisterControlRoutes(Router& r) {
+    (void)r.Add("GET", "/status", HandleStatus);
+    (void)r.Add("POST", "/control", HandleControl);
 }
 
 }  // namespace api
@@ -1,9 +1,13 @@
 #include "services/web_services/api/rest_api.hpp"
 
+#include <cstdint>
+#include <cstdlib>
 #include <ctime>
 #include <string>
+#include <vector>
 
-#include "core/common/utils/json_utils.hpp"
+#include "core/device/codec/envelope_encoder.hpp"
+#include "core/device/codec/telemetry_decoder.hpp"
 
 namespace iotgw {
 namespace services {
@@ -12,92 +16,187 @@ namespace api {
 
 namespace {
 
-static std::string MakeEnvelope(const std::string& id, const std::string& type, const std::string& data_json) {
-    std::time_t now = std::time(nullptr);
-    return "{\"device_id\":\"" + id + "\",\"type\":\"" + type + "\",\"data\":" + data_json +
-           ",\"ts\":" + std::to_string(now) + "}";
-}
-
 static std::string ToStdString(const struct mg_str& s) { return std::string(s.buf, s.len); }
 
-static bool IsMethod(const struct mg_http_message* hm, const char* method) {
-    return mg_strcmp(hm->method, mg_str(method)) == 0;
-}
-
-static bool StartsWith(const std::string& s, const std::string& prefix) {
-    return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
-}
-
-static bool EndsWith(const std::string& s, const std::string& suffix) {
-    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
-}
-
 static std::string DefaultCmdTopic(const std::string& mqtt_topic_prefix, const std::string& device_id) {
     if (mqtt_topic_prefix.empty()) return std::string("cmd/") + device_id;
     return mqtt_topic_prefix + "cmd/" + device_id;
 }
 
-}  // namespace
+static bool HasRegistry(struct mg_connection* c, const ApiContext& ctx) {
+    if (ctx.device_registry != nullptr) return true;
+    ReplyJsonText(c, 500, "{\"error\":\"device_registry_null\"}");
+    return false;
+}
 
-bool HandleDeviceApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                     const ApiContext& ctx) {
-    if (c == nullptr || hm == nullptr) return false;
-    if (ctx.device_registry == nullptr) {
-        mg_http_reply(c, 500, "Content-Type: application/json\r\n", "{\"error\":\"device_registry_null\"}\n");
-        return true;
+// Reads kind, transport, online, fields, limit and cursor; replies 400 on a bad value.
+// `paged` is set when the client asked for pages (limit or cursor).
+static bool ParseDeviceQuery(struct mg_connection* c, struct mg_http_message* hm,
+                             iotgw::core::device::manager::DeviceQuery& q,
+                             iotgw::core::device::manager::DeviceFieldMask& mask, bool& paged) {
+    using iotgw::core::device::manager::DeviceQuery;
+    char buf[256];
+    // mongoose reports a value too long for `buf` (or badly %-encoded) as -3; ignoring it
+    // would widen the query, e.g. restart a listing from the first page.
+    for (const char* name : {"kind", "transport", "online", "fields", "limit", "cursor"}) {
+        if (mg_http_get_var(&hm->query, name, buf, sizeof(buf)) != -3) continue;
+        auto& w = ResponseWriter();
+        w.BeginObject();
+        w.Key("error").String(std::string("bad_") + name);
+        w.EndObject();
+        ReplyJson(c, 400, w);
+        return false;
+    }
+    if (mg_http_get_var(&hm->query, "kind", buf, sizeof(buf)) > 0) q.kind = buf;
+    if (mg_http_get_var(&hm->query, "transport", buf, sizeof(buf)) > 0) q.transport = buf;
+    if (mg_http_get_var(&hm->query, "online", buf, sizeof(buf)) > 0) {
+        const std::string v = buf;
+        if (v == "true" || v == "1") {
+            q.online = DeviceQuery::Online::kOnline;
+        } else if (v == "false" || v == "0") {
+            q.online = DeviceQuery::Online::kOffline;
+        } else {
+            ReplyJsonText(c, 400, "{\"error\":\"bad_online\"}");
+            return false;
+        }
+    }
+    mask = iotgw::core::device::manager::kAllDeviceFields;
+    if (mg_http_get_var(&hm->query, "fields", buf, sizeof(buf)) > 0 &&
+        !iotgw::core::device::manager::DeviceRegistry::ParseFieldMask(buf, mask)) {
+        ReplyJsonText(c, 400, "{\"error\":\"unknown_field\"}");
+        return false;
+    }
+    paged = false;
+    if (mg_http_get_var(&hm->query, "limit", buf, sizeof(buf)) > 0) {
+        char* end = nullptr;
+        const long long n = std::strtoll(buf, &end, 10);
+        if (end == buf || *end != '\0' || n <= 0) {
+            ReplyJsonText(c, 400, "{\"error\":\"bad_limit\"}");
+            return false;
+        }
+        q.limit = static_cast<std::size_t>(n);
+        paged = true;
+    }
+    if (mg_http_get_var(&hm->query, "cursor", buf, sizeof(buf)) > 0) {
+        q.after = buf;
+        paged = true;
     }
+    return true;
+}
 
-    if (IsMethod(hm, "GET") && rel_path == "/devices") {
-        const std::string body = ctx.device_registry->ToJsonList();
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", body.c_str());
-        return true;
+// GET /devices: rendered once per registry revision. With a query, only the devices and
+// members asked for are rendered, walked from the registry's indexes.
+static void HandleDeviceList(struct mg_connection* c, struct mg_http_message* hm, const RouteParams&,
+                             const ApiContext& ctx) {
+    namespace manager = iotgw::core::device::manager;
+    if (!HasRegistry(c, ctx)) return;
+    const std::uint64_t revision = ctx.device_registry->Revision();
+    if (hm->query.len == 0) {
+        static CachedReply cache;
+        if (ReplyFromCache(c, hm, cache, "devices", revision)) return;
+        auto& w = ResponseWriter();
+        ctx.device_registry->WriteJsonList(w);
+        StoreAndReply(c, cache, "devices", revision, w);
+        return;
     }
 
-    if (IsMethod(hm, "GET") && StartsWith(rel_path, "/devices/")) {
-        const std::string id = rel_path.substr(std::string("/devices/").size());
-        std::string body;
-        if (!id.empty() && ctx.device_registry->ToJsonOne(id, body)) {
-            mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", body.c_str());
+    manager::DeviceQuery q;
+    manager::DeviceFieldMask mask = manager::kAllDeviceFields;
+    bool paged = false;
+    if (!ParseDeviceQuery(c, hm, q, mask, paged)) return;
+    // The tag is per URL, so the registry revision covers every query.
+    const std::string etag = MakeETag("devices", revision);
+    if (ReplyNotModified(c, hm, etag)) return;
+
+    static std::vector<manager::DeviceHandle> page;  // reused between requests
+    page.clear();
+    const bool more = ctx.device_registry->Select(q, page);
+    auto& w = ResponseWriter();
+    if (!paged) {
+        ctx.device_registry->WriteJsonList(page, mask, w);
+    } else {
+        w.BeginObject();
+        w.Key("devices");
+        ctx.device_registry->WriteJsonList(page, mask, w);
+        w.Key("next_cursor");
+        if (more && !page.empty()) {
+            w.String(ctx.device_registry->At(page.back())->id);
         } else {
-            mg_http_reply(c, 404, "Content-Type: application/json\r\n", "{\"error\":\"device_not_found\"}\n");
+            w.Null();
         }
-        return true;
+        w.EndObject();
     }
+    ReplyJsonTagged(c, 200, w.c_str(), etag);
+}
 
-    if (IsMethod(hm, "POST") && StartsWith(rel_path, "/actuators/") && EndsWith(rel_path, "/set")) {
-        const std::string base = std::string("/actuators/");
-        const std::string tail = std::string("/set");
-        const std::string id = rel_path.substr(base.size(), rel_path.size() - base.size() - tail.size());
-        if (id.empty()) {
-            mg_http_reply(c, 400, "Content-Type: application/json\r\n", "{\"error\":\"missing_id\"}\n");
-            return true;
-        }
+// GET /devices/{id}: tagged with the device's revision.
+static void HandleDeviceGet(struct mg_connection* c, struct mg_http_message* hm, const RouteParams& params,
+                            const ApiContext& ctx) {
+    if (!HasRegistry(c, ctx)) return;
+    const std::string id = params.String(0);
+    const auto h = ctx.device_registry->Find(id);
+    if (h == iotgw::core::device::manager::kInvalidDevice) {
+        ReplyJsonText(c, 404, "{\"error\":\"device_not_found\"}");
+        return;
+    }
+    const std::string etag = MakeETag("device", ctx.device_registry->RevisionOf(h));
+    if (ReplyNotModified(c, hm, etag)) return;
+    auto& w = ResponseWriter();
+    (void)ctx.device_registry->WriteJsonOne(id, w);
+    ReplyJsonTagged(c, 200, w.c_str(), etag);
+}
 
-        const std::string body_in = ToStdString(hm->body);
-        if (body_in.empty()) {
-            mg_http_reply(c, 400, "Content-Type: application/json\r\n", "{\"error\":\"empty_body\"}\n");
-            return true;
-        }
+// POST /actuators/{id}/set
+static void HandleActuatorSet(struct mg_connection* c, struct mg_http_message* hm, const RouteParams& params,
+                              const ApiContext& ctx) {
+    if (!HasRegistry(c, ctx)) return;
+    const std::string id = params.String(0);
+    const std::string body_in = ToStdString(hm->body);
+    if (body_in.empty()) {
+        ReplyJsonText(c, 400, "{\"error\":\"empty_body\"}");
+        return;
+    }
 
-        std::string cmd_topic;
-        if (!ctx.device_registry->GetCommandTopic(id, cmd_topic)) {
-            cmd_topic = DefaultCmdTopic(ctx.mqtt_topic_prefix, id);
-        }
+    std::string cmd_topic;
+    if (!ctx.device_registry->GetCommandTopic(id, cmd_topic)) {
+        cmd_topic = DefaultCmdTopic(ctx.mqtt_topic_prefix, id);
+    }
 
-        bool ok = false;
-        if (ctx.mqtt_client != nullptr && ctx.mqtt_client->IsOpen()) {
-            // Wrap the payload in a standard envelope
-            // Assumes body_in is a valid JSON object or value
-            std::string payload = MakeEnvelope(id, "cmd", body_in);
-            ok = ctx.mqtt_client->Publish(cmd_topic, payload, 0, false);
+    // Wrap the payload in a standard envelope. JSON devices get the body verbatim
+    // (assumed to be a JSON value); binary devices get its numbers and booleans.
+    namespace codec = iotgw::core::device::codec;
+    const auto ts = static_cast<std::int64_t>(std::time(nullptr));
+    const auto format = ctx.device_registry->PayloadFormatOf(ctx.device_registry->Find(id));
+    std::string payload;
+    if (format == codec::PayloadFormat::kJson) {
+        codec::EncodeJsonEnvelope(id, "cmd", body_in, ts, payload);
+    } else {
+        codec::DecodedTelemetry body;
+        if (!codec::DecodeTelemetry(body_in, body) || body.fields.Empty()) {
+            ReplyJsonText(c, 400, "{\"error\":\"unsupported_body\"}");
+            return;
         }
-
-        const std::string resp = iotgw::core::common::json::Object({{"ok", iotgw::core::common::json::Bool(ok)}});
-        mg_http_reply(c, ok ? 200 : 503, "Content-Type: application/json\r\n", "%s\n", resp.c_str());
-        return true;
+        codec::EncodeEnvelope(format, id, "cmd", body.fields, ts, payload);
+    }
+    bool ok = false;
+    if (ctx.mqtt_broker != nullptr && ctx.mqtt_broker->IsListening()) {
+        ok = ctx.mqtt_broker->Publish(cmd_topic, payload, 0, false) || ok;
+    }
+    if (ctx.mqtt_client != nullptr && ctx.mqtt_client->IsOpen()) {
+        ok = ctx.mqtt_client->Publish(cmd_topic, payload, 0, false) || ok;
     }
 
-    return false;
+    auto& w = ResponseWriter();
+    w.BeginObject().Key("ok").Bool(ok).EndObject();
+    ReplyJson(c, ok ? 200 : 503, w);
+}
+
+}  // namespace
+
+void RegisterDeviceRoutes(Router& r) {
+    (void)r.Add("GET", "/devices", HandleDeviceList);
+    (void)r.Add("GET", "/devices/{id}", HandleDeviceGet);
+    (void)r.Add("POST", "/actuators/{id}/set", HandleActuatorSet);
 }
 
 }  // namespace api
@@ -1,15 +1,30 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
 #include "mongoose.h"
 
 #include "core/common/logger/logger.hpp"
+#include "core/common/utils/json_writer.hpp"
 #include "core/control/rule_engine.hpp"
+#include "core/device/derived/virtual_sensors.hpp"
 #include "core/device/manager/device_manager.hpp"
 #include "core/device/protocol_adapters/mqtt_adapter/mqtt_adapter.hpp"
+#include "core/device/protocol_adapters/mqtt_adapter/mqtt_broker.hpp"
+#include "core/stream/anomaly_detector.hpp"
+#include "core/stream/spectral_analyzer.hpp"
+#include "core/stream/stream_store.hpp"
+#include "core/stream/window_stats.hpp"
+#include "core/uplink/thing_model.hpp"
+#include "core/uplink/uplink_aggregator.hpp"
 #include "services/system_services/camera/camera_manager.hpp"
+#include "services/web_services/api/router.hpp"
+#include "services/web_services/sse/event_stream.hpp"
+#include "services/web_services/websocket/state_feed.hpp"
+#include "services/web_services/websocket/ws_send_queue.hpp"
+#include "services/web_services/websocket/ws_subscriptions.hpp"
 
 namespace iotgw {
 namespace services {
@@ -19,6 +34,7 @@ namespace api {
 struct ApiContext {
     std::string base_path = "/api";
     std::string version;
+    std::string ws_path = "/ws";  // WebSocket endpoint, reported by GET /version for the dashboard
     std::string rules_automation_file;
     std::string rules_alarm_file;
     std::string mqtt_topic_prefix;
@@ -26,27 +42,97 @@ struct ApiContext {
     iotgw::core::device::manager::DeviceRegistry* device_registry = nullptr;
     iotgw::core::control::rule_engine::RuleEngine* rule_engine = nullptr;
     iotgw::core::device::protocol_adapters::mqtt::MqttClient* mqtt_client = nullptr;
+    iotgw::core::device::protocol_adapters::mqtt::MqttBroker* mqtt_broker = nullptr;
     iotgw::services::system_services::camera::CameraManager* camera_manager = nullptr;
+    const iotgw::core::device::derived::VirtualSensors* virtual_sensors = nullptr;
+    const iotgw::core::stream::StreamStore* stream_store = nullptr;
+    const iotgw::core::stream::WindowStats* stream_windows = nullptr;
+    const iotgw::core::stream::AnomalyDetector* anomaly_detector = nullptr;
+    const iotgw::core::stream::SpectralAnalyzer* spectral = nullptr;
+    const iotgw::core::uplink::UplinkAggregator* uplink = nullptr;
+    const iotgw::core::uplink::ThingModelUplink* thing_model = nullptr;
+    const iotgw::services::web_services::websocket::StateFeed* state_feed = nullptr;
+    const iotgw::services::web_services::websocket::WsSubscriptions* ws_subscriptions = nullptr;
+    const iotgw::services::web_services::websocket::WsSendQueues* ws_send_queues = nullptr;
+    iotgw::services::web_services::sse::EventStream* event_stream = nullptr;
 
     std::shared_ptr<iotgw::core::common::log::Logger> logger;
 };
 
 bool HandleHttpRequest(struct mg_connection* c, struct mg_http_message* hm, const ApiContext& ctx);
 
-bool HandleSystemApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                     const ApiContext& ctx);
+// A REST operation invoked without HTTP (WebSocket RPC). `path` is relative to the base path
+// ("/devices/temp") or includes it.
+struct ApiCall {
+    std::string method = "GET";
+    std::string path;
+    std::string query;
+    std::string body;
+};
+
+struct ApiCallResult {
+    int status = 0;
+    std::string body;  // JSON
+};
+
+// Runs `call` through the same handlers as HandleHttpRequest, capturing their reply.
+// False (status 404) if no handler takes it.
+bool CallApi(struct mg_connection* c, const ApiCall& call, const ApiContext& ctx, ApiCallResult& out);
+
+// {"type":"rpc",...} messages of a WebSocket client, answered through CallApi; see rpc_api.cpp.
+// False if `message` is not an RPC request; otherwise `reply` holds the response frame.
+bool HandleRpcMessage(struct mg_connection* c, const std::string& message, const ApiContext& ctx,
+                      iotgw::core::common::json::Writer& reply);
 
-bool HandleDeviceApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                     const ApiContext& ctx);
+// Cleared writer for a response body, reused across requests (the event loop is single-threaded).
+iotgw::core::common::json::Writer& ResponseWriter();
+void ReplyJson(struct mg_connection* c, int status, const iotgw::core::common::json::Writer& w);
+// Handlers reply only through these, so CallApi can capture the reply.
+void ReplyJsonText(struct mg_connection* c, int status, const char* json);
 
-bool HandleRuleApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                   const ApiContext& ctx);
+// Conditional GET. A resource whose rendering only changes with a revision counter
+// (DeviceRegistry::Revision, RuleEngine::Revision) is tagged "<kind>-<boot>-<revision>";
+// the boot id (time::BootId, shared with the state feed and event stream) keeps tags from
+// before a restart from matching.
+std::string MakeETag(const char* kind, std::uint64_t revision);
+// True (after replying 304) if the request's If-None-Match holds `etag`.
+bool ReplyNotModified(struct mg_connection* c, struct mg_http_message* hm, const std::string& etag);
+void ReplyJsonTagged(struct mg_connection* c, int status, const char* json, const std::string& etag);
+
+// A rendered body, kept while the revision it was rendered at is current:
+//   static CachedReply cache;
+//   if (ReplyFromCache(c, hm, cache, "devices", rev)) return;
+//   ... render into w ...
+//   StoreAndReply(c, cache, "devices", rev, w);
+struct CachedReply {
+    bool valid = false;
+    std::uint64_t revision = 0;
+    std::string etag;
+    std::string body;
+};
+// True if replied: 304 when the client already has `revision`, else the cached body
+// while it is at `revision`. False if the body must be rendered.
+bool ReplyFromCache(struct mg_connection* c, struct mg_http_message* hm, const CachedReply& cache,
+                    const char* kind, std::uint64_t revision);
+void StoreAndReply(struct mg_connection* c, CachedReply& cache, const char* kind, std::uint64_t revision,
+                   const iotgw::core::common::json::Writer& w);
+
+struct ReplyCacheStats {
+    std::uint64_t renders = 0;       // cached bodies (re)rendered
+    std::uint64_t hits = 0;          // served from a cached body
+    std::uint64_t not_modified = 0;  // 304s
+};
+const ReplyCacheStats& GetReplyCacheStats();
 
-bool HandleCameraApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                     const ApiContext& ctx);
+// The REST endpoints, compiled into one route tree on first use. Each *_api.cpp adds its own.
+const Router& ApiRoutes();
 
-bool HandleControlApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                      const ApiContext& ctx);
+void RegisterSystemRoutes(Router& r);
+void RegisterDeviceRoutes(Router& r);
+void RegisterRuleRoutes(Router& r);
+void RegisterCameraRoutes(Router& r);
+void RegisterControlRoutes(Router& r);
+void RegisterStreamRoutes(Router& r);
 
 }  // namespace api
 }  // namespace web_services
@@ -0,0 +1,110 @@
+#include "services/web_services/api/router.hpp"
+
+#include <cstring>
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace api {
+
+constexpr std::size_t RouteParams::kMax;
+
+Router::Router() : nodes_(1) {}
+
+int Router::MethodOf(struct mg_str method) {
+    switch (method.len) {
+        case 3:
+            if (std::memcmp(method.buf, "GET", 3) == 0) return kGet;
+            if (std::memcmp(method.buf, "PUT", 3) == 0) return kPut;
+            break;
+        case 4:
+            if (std::memcmp(method.buf, "POST", 4) == 0) return kPost;
+            break;
+        case 5:
+            if (std::memcmp(method.buf, "PATCH", 5) == 0) return kPatch;
+            break;
+        case 6:
+            if (std::memcmp(method.buf, "DELETE", 6) == 0) return kDelete;
+            break;
+        default:
+            break;
+    }
+    return -1;
+}
+
+bool Router::Add(const char* method, const char* path, RouteHandler handler) {
+    const int m = MethodOf(mg_str(method));
+    if (m < 0 || handler == nullptr || path == nullptr || path[0] != '/') return false;
+
+    std::uint32_t n = 0;
+    std::size_t params = 0;
+    const char* p = path;
+    while (*p != '\0') {
+        ++p;  // '/'
+        const char* end = std::strchr(p, '/');
+        if (end == nullptr) end = p + std::strlen(p);
+        const std::size_t len = static_cast<std::size_t>(end - p);
+        if (len == 0) return false;
+        if (p[0] == '{') {
+            if (len < 3 || p[len - 1] != '}' || ++params > RouteParams::kMax) return false;
+            if (nodes_[n].param < 0) {
+                nodes_[n].param = static_cast<std::int32_t>(nodes_.size());
+                nodes_.push_back(Node());
+            }
+            n = static_cast<std::uint32_t>(nodes_[n].param);
+        } else {
+            std::uint32_t next = 0;
+            for (const auto& lit : nodes_[n].literals) {
+                if (lit.first.size() == len && std::memcmp(lit.first.data(), p, len) == 0) next = lit.second;
+            }
+            if (next == 0) {
+                next = static_cast<std::uint32_t>(nodes_.size());
+                nodes_[n].literals.emplace_back(std::string(p, len), next);
+                nodes_.push_back(Node());
+            }
+            n = next;
+        }
+        p = end;
+    }
+    if (nodes_[n].handlers[m] != nullptr) return false;
+    nodes_[n].handlers[m] = handler;
+    ++routes_;
+    return true;
+}
+
+RouteHandler Router::Match(struct mg_str method, struct mg_str path, RouteParams& params) const {
+    params.count = 0;
+    const int m = MethodOf(method);
+    if (m < 0 || path.len == 0) return nullptr;
+    return MatchFrom(0, path.buf, path.buf + path.len, m, params);
+}
+
+RouteHandler Router::MatchFrom(std::uint32_t node, const char* p, const char* end, int method,
+                               RouteParams& params) const {
+    const Node& n = nodes_[node];
+    if (p == end) return n.handlers[method];
+    if (*p != '/') return nullptr;
+    ++p;
+    const void* slash = std::memchr(p, '/', static_cast<std::size_t>(end - p));
+    const char* seg_end = slash != nullptr ? static_cast<const char*>(slash) : end;
+    const std::size_t len = static_cast<std::size_t>(seg_end - p);
+
+    for (const auto& lit : n.literals) {
+        if (lit.first.size() != len || std::memcmp(lit.first.data(), p, len) != 0) continue;
+        const RouteHandler h = MatchFrom(lit.second, seg_end, end, method, params);
+        if (h != nullptr) return h;
+        break;
+    }
+    if (n.param >= 0 && len > 0 && params.count < RouteParams::kMax) {
+        params.values[params.count++] = mg_str_n(p, len);
+        const RouteHandler h = MatchFrom(static_cast<std::uint32_t>(n.param), seg_end, end, method, params);
+        if (h != nullptr) return h;
+        --params.count;
+    }
+    return nullptr;
+}
+
+}  // namespace api
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mongoose.h"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace api {
+
+struct ApiContext;
+
+// Path parameters of a matched route, in template order. They point into the request
+// URI and are valid while the request is.
+struct RouteParams {
+    static constexpr std::size_t kMax = 4;
+
+    struct mg_str values[kMax];
+    std::size_t count = 0;
+
+    struct mg_str operator[](std::size_t i) const { return i < count ? values[i] : mg_str_n("", 0); }
+    std::string String(std::size_t i) const {
+        const struct mg_str s = (*this)[i];
+        return std::string(s.buf, s.len);
+    }
+};
+
+using RouteHandler = void (*)(struct mg_connection* c, struct mg_http_message* hm, const RouteParams& params,
+                              const ApiContext& ctx);
+
+// REST routes compiled into a tree of path segments. A template is a method and a path
+// such as "/actuators/{id}/set", where "{name}" matches one non-empty segment. Match walks
+// the request path once, segment by segment, without copying it; literal segments win
+// over parameters, and a parameter is tried only if the literal branch has no route.
+class Router {
+public:
+    Router();
+
+    // False for an unsupported method, a malformed template, more than RouteParams::kMax
+    // parameters, or a route that is already taken.
+    bool Add(const char* method, const char* path, RouteHandler handler);
+
+    // Handler for `method` on `path` (relative to the API base path), nullptr if none.
+    RouteHandler Match(struct mg_str method, struct mg_str path, RouteParams& params) const;
+
+    std::size_t Size() const { return routes_; }
+
+private:
+    enum Method : std::uint8_t { kGet, kPost, kPut, kDelete, kPatch, kMethodCount };
+
+    struct Node {
+        std::vector<std::pair<std::string, std::uint32_t>> literals;  // segment -> child
+        std::int32_t param = -1;                                      // child for "{name}"
+        RouteHandler handlers[kMethodCount] = {};
+    };
+
+    static int MethodOf(struct mg_str method);
+    RouteHandler MatchFrom(std::uint32_t node, const char* p, const char* end, int method,
+                           RouteParams& params) const;
+
+private:
+    std::vector<Node> nodes_;  // [0]: root
+    std::size_t routes_ = 0;
+};
+
+}  // namespace api
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
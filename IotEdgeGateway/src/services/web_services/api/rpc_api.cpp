@@ -0,0 +1,144 @@
+#include "services/web_services/api/rest_api.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace api {
+
+// Request/response RPC over a WebSocket connection, for the REST operations without the
+// cost of an HTTP request each. Requests carry a client-chosen `id` echoed in the reply,
+// so a client may keep any number of calls in flight on one connection:
+//
+//   {"type":"rpc","id":7,"method":"devices.get","params":{"id":"temp"}}
+//   {"type":"rpc","id":8,"method":"actuator.set","params":{"id":"led","body":{"on":1}}}
+//   {"type":"rpc","id":"m1","http":"GET","path":"/streams/vib-1/ax","query":"last=10"}
+//
+//   {"type":"rpc_result","id":7,"status":200,"result":{...}}
+//
+// `result` is what the REST endpoint returns, `status` its HTTP status.
+
+namespace {
+
+struct RpcMethod {
+    const char* name;
+    const char* http;
+    const char* path;  // "{id}" is params.id
+};
+
+const RpcMethod kMethods[] = {
+    {"devices.list", "GET", "/devices"},
+    {"devices.get", "GET", "/devices/{id}"},
+    {"actuator.set", "POST", "/actuators/{id}/set"},
+    {"status", "GET", "/status"},
+    {"control", "POST", "/control"},
+    {"rules.list", "GET", "/rules"},
+    {"rules.reload", "POST", "/rules/reload"},
+    {"rules.enable", "POST", "/rules/{id}/enable"},
+    {"rules.disable", "POST", "/rules/{id}/disable"},
+    {"camera.status", "GET", "/camera/status"},
+    {"camera.start", "POST", "/camera/start"},
+    {"camera.stop", "POST", "/camera/stop"},
+    {"camera.snapshot", "POST", "/camera/snapshot"},
+    {"camera.record.start", "POST", "/camera/record/start"},
+    {"camera.record.stop", "POST", "/camera/record/stop"},
+    {"streams.list", "GET", "/streams"},
+    {"anomalies", "GET", "/anomalies"},
+    {"metrics", "GET", "/metrics"},
+};
+
+static std::string GetString(struct mg_str json, const char* path) {
+    std::string out;
+    char* s = mg_json_get_str(json, path);
+    if (s != nullptr) {
+        out = s;
+        mg_free(s);
+    }
+    return out;
+}
+
+// Raw JSON text of the value at `path`, empty if absent.
+static std::string GetRaw(struct mg_str json, const char* path) {
+    int len = 0;
+    const int off = mg_json_get(json, path, &len);
+    if (off < 0 || len <= 0) return std::string();
+    return std::string(json.buf + off, static_cast<std::size_t>(len));
+}
+
+static bool ResolveMethod(const std::string& name, const std::string& id, ApiCall& call) {
+    for (const auto& m : kMethods) {
+        if (name != m.name) continue;
+        call.method = m.http;
+        call.path = m.path;
+        const std::size_t pos = call.path.find("{id}");
+        if (pos != std::string::npos) {
+            if (id.empty()) return false;
+            call.path.replace(pos, 4, id);
+        }
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+bool HandleRpcMessage(struct mg_connection* c, const std::string& message, const ApiContext& ctx,
+                      iotgw::core::common::json::Writer& reply) {
+    const struct mg_str json = mg_str_n(message.data(), message.size());
+    if (GetString(json, "$.type") != "rpc") return false;
+
+    const std::string id = GetRaw(json, "$.id");
+    ApiCall call;
+    ApiCallResult result;
+    const std::string path = GetString(json, "$.path");
+    const std::string method = GetString(json, "$.method");
+    const std::string target = GetString(json, "$.params.id");
+    bool valid = true;
+    if (!path.empty()) {
+        const std::string http = GetString(json, "$.http");
+        if (!http.empty()) call.method = http;
+        const std::size_t q = path.find('?');
+        call.path = path.substr(0, q);
+        call.query = q != std::string::npos ? path.substr(q + 1) : GetString(json, "$.query");
+        call.body = GetRaw(json, "$.body");
+    } else if (target.find('/') != std::string::npos) {
+        // Pasted into the path, a '/' would shift the segments onto a different route.
+        valid = false;
+        result.status = 400;
+        result.body = "{\"error\":\"bad_id\"}";
+    } else if (ResolveMethod(method, target, call)) {
+        call.body = GetRaw(json, "$.params.body");
+        call.query = GetString(json, "$.params.query");
+    } else {
+        valid = false;
+        result.status = 400;
+        result.body = method.empty() ? "{\"error\":\"missing_method\"}" : "{\"error\":\"unknown_method\"}";
+    }
+    if (valid) (void)CallApi(c, call, ctx, result);
+
+    reply.Clear();
+    reply.BeginObject();
+    reply.Key("type").String("rpc_result");
+    reply.Key("id");
+    if (id.empty()) {
+        reply.Null();
+    } else {
+        reply.Raw(id);
+    }
+    reply.Key("status").Int(result.status);
+    reply.Key("result");
+    if (result.body.empty()) {
+        reply.Null();
+    } else {
+        reply.Raw(result.body);
+    }
+    reply.EndObject();
+    return true;
+}
+
+}  // namespace api
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
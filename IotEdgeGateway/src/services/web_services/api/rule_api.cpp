@@ -1,12 +1,12 @@
 #include "services/web_services/api/rest_api.hpp"
 
+#include <cstdint>
 #include <cstdlib>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "core/common/config/config_manager.hpp"
-#include "core/common/utils/json_utils.hpp"
 
 namespace iotgw {
 namespace services {
@@ -15,18 +15,6 @@ namespace api {
 
 namespace {
 
-static bool IsMethod(const struct mg_http_message* hm, const char* method) {
-    return mg_strcmp(hm->method, mg_str(method)) == 0;
-}
-
-static bool StartsWith(const std::string& s, const std::string& prefix) {
-    return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
-}
-
-static bool EndsWith(const std::string& s, const std::string& suffix) {
-    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
-}
-
 static bool TryParseDoubleStrict(const std::string& s, double& out) {
     if (s.empty()) return false;
     char* end = nullptr;
@@ -60,6 +48,7 @@ static bool LoadRulesFromFile(const std::string& file_path, const std::string& c
         if (rcfg.GetBool(base + "enabled", enabled)) r.enabled = enabled;
 
         (void)rcfg.GetString(base + "when.sensor_id", r.when.sensor_id);
+        (void)rcfg.GetString(base + "when.event", r.when.event);
         (void)rcfg.GetString(base + "when.op", r.when.op);
 
         std::string value_s;
@@ -90,62 +79,75 @@ static bool LoadRulesFromFile(const std::string& file_path, const std::string& c
     return true;
 }
 
-}  // namespace
+static bool HasRuleEngine(struct mg_connection* c, const ApiContext& ctx) {
+    if (ctx.rule_engine != nullptr) return true;
+    ReplyJsonText(c, 500, "{\"error\":\"rule_engine_null\"}");
+    return false;
+}
 
-bool HandleRuleApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                   const ApiContext& ctx) {
-    if (c == nullptr || hm == nullptr) return false;
-    if (ctx.rule_engine == nullptr) {
-        mg_http_reply(c, 500, "Content-Type: application/json\r\n", "{\"error\":\"rule_engine_null\"}\n");
-        return true;
+// GET /rules: rendered once per rule engine revision.
+static void HandleRuleList(struct mg_connection* c, struct mg_http_message* hm, const RouteParams&,
+                           const ApiContext& ctx) {
+    if (!HasRuleEngine(c, ctx)) return;
+    static CachedReply cache;
+    const std::uint64_t revision = ctx.rule_engine->Revision();
+    if (ReplyFromCache(c, hm, cache, "rules", revision)) return;
+    auto& w = ResponseWriter();
+    w.BeginArray();
+    for (const auto& r : ctx.rule_engine->Rules()) {
+        w.BeginObject();
+        w.Key("id").String(r.id);
+        w.Key("category").String(r.category);
+        w.Key("enabled").Bool(r.enabled);
+        w.Key("sensor_id").String(r.when.sensor_id);
+        if (!r.when.event.empty()) w.Key("event").String(r.when.event);
+        w.Key("op").String(r.when.op);
+        w.Key("value").Double(r.when.value);
+        w.EndObject();
     }
+    w.EndArray();
+    StoreAndReply(c, cache, "rules", revision, w);
+}
 
-    if (IsMethod(hm, "GET") && rel_path == "/rules") {
-        const auto& rs = ctx.rule_engine->Rules();
-        std::string body;
-        body.reserve(256 + rs.size() * 128);
-        body.push_back('[');
-        bool first = true;
-        for (const auto& r : rs) {
-            if (!first) body.push_back(',');
-            first = false;
-            body += iotgw::core::common::json::Object({
-                {"id", iotgw::core::common::json::Quote(r.id)},
-                {"category", iotgw::core::common::json::Quote(r.category)},
-                {"enabled", iotgw::core::common::json::Bool(r.enabled)},
-                {"sensor_id", iotgw::core::common::json::Quote(r.when.sensor_id)},
-                {"op", iotgw::core::common::json::Quote(r.when.op)},
-                {"value", iotgw::core::common::json::Number(r.when.value)},
-            });
-        }
-        body.push_back(']');
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", body.c_str());
-        return true;
-    }
+// POST /rules/reload
+static void HandleRuleReload(struct mg_connection* c, struct mg_http_message*, const RouteParams&,
+                             const ApiContext& ctx) {
+    if (!HasRuleEngine(c, ctx)) return;
+    std::vector<iotgw::core::control::rule_engine::Rule> rules;
+    (void)LoadRulesFromFile(ctx.rules_automation_file, "automation", rules);
+    (void)LoadRulesFromFile(ctx.rules_alarm_file, "alarm", rules);
+    ctx.rule_engine->Clear();
+    ctx.rule_engine->AddRules(std::move(rules));
+    ReplyJsonText(c, 200, "{\"ok\":true}");
+}
 
-    if (IsMethod(hm, "POST") && rel_path == "/rules/reload") {
-        std::vector<iotgw::core::control::rule_engine::Rule> rules;
-        (void)LoadRulesFromFile(ctx.rules_automation_file, "automation", rules);
-        (void)LoadRulesFromFile(ctx.rules_alarm_file, "alarm", rules);
-        ctx.rule_engine->Clear();
-        ctx.rule_engine->AddRules(std::move(rules));
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"ok\":true}\n");
-        return true;
-    }
+static void SetRuleEnabled(struct mg_connection* c, const RouteParams& params, const ApiContext& ctx, bool enable) {
+    if (!HasRuleEngine(c, ctx)) return;
+    const bool ok = ctx.rule_engine->SetEnabled(params.String(0), enable);
+    auto& w = ResponseWriter();
+    w.BeginObject().Key("ok").Bool(ok).EndObject();
+    ReplyJson(c, ok ? 200 : 404, w);
+}
 
-    if (IsMethod(hm, "POST") && StartsWith(rel_path, "/rules/") &&
-        (EndsWith(rel_path, "/enable") || EndsWith(rel_path, "/disable"))) {
-        const bool enable = EndsWith(rel_path, "/enable");
-        const std::string base = std::string("/rules/");
-        const std::string tail = enable ? std::string("/enable") : std::string("/disable");
-        const std::string id = rel_path.substr(base.size(), rel_path.size() - base.size() - tail.size());
-        const bool ok = !id.empty() && ctx.rule_engine->SetEnabled(id, enable);
-        const std::string body = iotgw::core::common::json::Object({{"ok", iotgw::core::common::json::Bool(ok)}});
-        mg_http_reply(c, ok ? 200 : 404, "Content-Type: application/json\r\n", "%s\n", body.c_str());
-        return true;
-    }
+// POST /rules/{id}/enable
+static void HandleRuleEnable(struct mg_connection* c, struct mg_http_message*, const RouteParams& params,
+                             const ApiContext& ctx) {
+    SetRuleEnabled(c, params, ctx, true);
+}
 
-    return false;
+// POST /rules/{id}/disable
+static void HandleRuleDisable(struct mg_connection* c, struct mg_http_message*, const RouteParams& params,
+                              const ApiContext& ctx) {
+    SetRuleEnabled(c, params, ctx, false);
+}
+
+}  // namespace
+
+void RegisterRuleRoutes(Router& r) {
+    (void)r.Add("GET", "/rules", HandleRuleList);
+    (void)r.Add("POST", "/rules/reload", HandleRuleReload);
+    (void)r.Add("POST", "/rules/{id}/enable", HandleRuleEnable);
+    (void)r.Add("POST", "/rules/{id}/disable", HandleRuleDisable);
 }
 
 }  // namespace api
@@ -0,0 +1,217 @@
+#include "services/web_services/api/rest_api.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace api {
+
+namespace {
+
+static void WriteWindow(iotgw::core::common::json::Writer& w, const iotgw::core::stream::Window* win) {
+    if (win == nullptr) {
+        w.Null();
+        return;
+    }
+    w.BeginObject();
+    w.Key("start_ms").Int(win->start_us / 1000);
+    w.Key("count").Uint(win->count);
+    w.Key("min").Double(win->min);
+    w.Key("max").Double(win->max);
+    w.Key("mean").Double(win->mean);
+    w.Key("rms").Double(win->rms);
+    w.EndObject();
+}
+
+static void WriteSpectrum(iotgw::core::common::json::Writer& w, const iotgw::core::stream::SpectralFeatures* f) {
+    if (f == nullptr) {
+        w.Null();
+        return;
+    }
+    w.BeginObject();
+    w.Key("ts").Int(f->ts_us / 1000);
+    w.Key("sample_rate_hz").Double(f->sample_rate_hz);
+    w.Key("rms").Double(f->rms);
+    w.Key("peak_hz").Double(f->peak_hz);
+    w.Key("peak_amplitude").Double(f->peak_amplitude);
+    w.Key("bands").BeginArray();
+    for (std::size_t j = 0; j < f->band_count; ++j) w.Double(f->band_energy[j]);
+    w.EndArray();
+    w.EndObject();
+}
+
+// GET /anomalies: detector counters, every sensor that has had outliers, and the latest events.
+static void HandleAnomalies(struct mg_connection* c, struct mg_http_message*, const RouteParams&,
+                            const ApiContext& ctx) {
+    if (ctx.anomaly_detector == nullptr) {
+        ReplyJsonText(c, 500, "{\"error\":\"anomaly_detector_null\"}");
+        return;
+    }
+    const auto& det = *ctx.anomaly_detector;
+    const auto& st = det.GetStats();
+    auto& w = ResponseWriter();
+    w.BeginObject();
+    w.Key("sensors").Uint(det.Size());
+    w.Key("samples").Uint(st.samples);
+    w.Key("outliers").Uint(st.outliers);
+    w.Key("events").Uint(st.events);
+    w.Key("refused").Uint(st.refused);
+    w.Key("flagged").BeginArray();
+    for (std::uint32_t s = 0; s < det.Size(); ++s) {
+        if (det.OutliersOf(s) == 0) continue;
+        w.BeginObject();
+        w.Key("sensor").String(det.NameOf(s));
+        w.Key("outliers").Uint(det.OutliersOf(s));
+        w.Key("samples").Uint(det.CountOf(s));
+        w.Key("mean").Double(det.MeanOf(s));
+        w.Key("stddev").Double(det.StddevOf(s));
+        w.Key("median").Double(det.MedianOf(s));
+        w.Key("mad").Double(det.MadOf(s));
+        w.EndObject();
+    }
+    w.EndArray();
+    w.Key("recent").BeginArray();
+    for (const auto& e : det.Recent()) {
+        w.BeginObject();
+        w.Key("sensor").String(det.NameOf(e.sensor));
+        w.Key("value").Double(e.value);
+        w.Key("z").Double(e.z);
+        w.Key("robust_z").Double(e.robust_z);
+        w.Key("flagged").Uint(e.flagged);
+        w.Key("ts").Int(e.ts_us / 1000);
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+    ReplyJson(c, 200, w);
+}
+
+// GET /stream?devices=a,b: the pushed frames as Server-Sent Events. EventSource cannot
+// set headers on its first request, so `last_event_id` may also come in the query.
+static void HandleEventStream(struct mg_connection* c, struct mg_http_message* hm, const RouteParams&,
+                              const ApiContext& ctx) {
+    if (ctx.event_stream == nullptr || !ctx.event_stream->Enabled()) {
+        ReplyJsonText(c, 404, "{\"error\":\"event_stream_disabled\"}");
+        return;
+    }
+    if (c->is_websocket) {  // through WebSocket RPC
+        ReplyJsonText(c, 400, "{\"error\":\"not_streamable\"}");
+        return;
+    }
+    char buf[512];
+    std::string devices;
+    if (mg_http_get_var(&hm->query, "devices", buf, sizeof(buf)) > 0) devices = buf;
+    std::string last_id;
+    const struct mg_str* hdr = mg_http_get_header(hm, "Last-Event-ID");
+    if (hdr != nullptr && hdr->len > 0 && hdr->len < sizeof(buf)) {
+        last_id.assign(hdr->buf, hdr->len);
+    } else if (mg_http_get_var(&hm->query, "last_event_id", buf, sizeof(buf)) > 0) {
+        last_id = buf;
+    }
+    if (!ctx.event_stream->Open(c, devices, last_id, static_cast<std::int64_t>(mg_millis()))) {
+        ReplyJsonText(c, 503, "{\"error\":\"too_many_streams\"}");
+    }
+}
+
+static bool HasStreamStore(struct mg_connection* c, const ApiContext& ctx) {
+    if (ctx.stream_store != nullptr) return true;
+    ReplyJsonText(c, 500, "{\"error\":\"stream_store_null\"}");
+    return false;
+}
+
+// GET /streams
+static void HandleStreamList(struct mg_connection* c, struct mg_http_message*, const RouteParams&,
+                             const ApiContext& ctx) {
+    if (!HasStreamStore(c, ctx)) return;
+    const auto& store = *ctx.stream_store;
+    const auto& st = store.GetStats();
+    auto& w = ResponseWriter();
+    w.BeginObject();
+    w.Key("samples").Uint(st.samples);
+    w.Key("blocks").Uint(st.blocks);
+    w.Key("refused").Uint(st.refused);
+    w.Key("window_ms").Int(ctx.stream_windows != nullptr ? ctx.stream_windows->WindowUs() / 1000 : 0);
+    w.Key("fft_size").Uint(ctx.spectral != nullptr ? ctx.spectral->FftSize() : 0);
+    w.Key("streams").BeginArray();
+    for (std::size_t i = 0; i < store.Size(); ++i) {
+        const auto id = static_cast<iotgw::core::stream::StreamId>(i);
+        const auto& ring = store.History(id);
+        w.BeginObject();
+        w.Key("device_id").String(store.DeviceOf(id));
+        w.Key("channel").String(store.ChannelOf(id));
+        w.Key("total").Uint(ring.Total());
+        w.Key("size").Uint(ring.Size());
+        w.Key("capacity").Uint(ring.Capacity());
+        w.Key("window");
+        WriteWindow(w, ctx.stream_windows != nullptr ? ctx.stream_windows->Last(id) : nullptr);
+        w.Key("spectrum");
+        WriteSpectrum(w, ctx.spectral != nullptr ? ctx.spectral->Last(id) : nullptr);
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+    ReplyJson(c, 200, w);
+}
+
+// GET /streams/{device_id}/{channel}?last=N
+static void HandleStreamGet(struct mg_connection* c, struct mg_http_message* hm, const RouteParams& params,
+                            const ApiContext& ctx) {
+    if (!HasStreamStore(c, ctx)) return;
+    const auto& store = *ctx.stream_store;
+    const auto id = store.Find(params.String(0), params.String(1));
+    if (id == iotgw::core::stream::kInvalidStream) {
+        ReplyJsonText(c, 404, "{\"error\":\"stream_not_found\"}");
+        return;
+    }
+
+    const auto& ring = store.History(id);
+    std::size_t last = 256;
+    char buf[24];
+    if (mg_http_get_var(&hm->query, "last", buf, sizeof(buf)) > 0) {
+        last = static_cast<std::size_t>(std::strtoull(buf, nullptr, 10));
+    }
+    if (last > ring.Capacity()) last = ring.Capacity();
+
+    // Copy buffers reused across requests (the event loop is single-threaded).
+    static std::vector<float> values;
+    static std::vector<std::int64_t> ts_us;
+    values.resize(last);
+    ts_us.resize(last);
+    const std::size_t n = ring.CopyLast(last, values.data(), ts_us.data());
+
+    auto& w = ResponseWriter();
+    w.BeginObject();
+    w.Key("device_id").String(store.DeviceOf(id));
+    w.Key("channel").String(store.ChannelOf(id));
+    w.Key("total").Uint(ring.Total());
+    w.Key("window");
+    WriteWindow(w, ctx.stream_windows != nullptr ? ctx.stream_windows->Last(id) : nullptr);
+    w.Key("spectrum");
+    WriteSpectrum(w, ctx.spectral != nullptr ? ctx.spectral->Last(id) : nullptr);
+    w.Key("ts_us").BeginArray();
+    for (std::size_t i = 0; i < n; ++i) w.Int(ts_us[i]);
+    w.EndArray();
+    w.Key("values").BeginArray();
+    for (std::size_t i = 0; i < n; ++i) w.Double(values[i]);
+    w.EndArray();
+    w.EndObject();
+    ReplyJson(c, 200, w);
+}
+
+}  // namespace
+
+void RegisterStreamRoutes(Router& r) {
+    (void)r.Add("GET", "/anomalies", HandleAnomalies);
+    (void)r.Add("GET", "/stream", HandleEventStream);
+    (void)r.Add("GET", "/streams", HandleStreamList);
+    (void)r.Add("GET", "/streams/{device_id}/{channel}", HandleStreamGet);
+}
+
+}  // namespace api
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
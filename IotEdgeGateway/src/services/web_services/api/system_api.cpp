@@ -1,8 +1,10 @@
 #include "services/web_services/api/rest_api.hpp"
 
+#include <cstdio>
+#include <cstring>
 #include <string>
 
-#include "core/common/utils/json_utils.hpp"
+#include "core/common/utils/time_utils.hpp"
 
 namespace iotgw {
 namespace services {
@@ -11,78 +13,364 @@ namespace api {
 
 namespace {
 
-static std::string ToStdString(const struct mg_str& s) { return std::string(s.buf, s.len); }
+const char* const kDefaultBasePath = "/api";
 
-static std::string NormalizeBasePath(std::string p) {
-    if (p.empty()) return std::string("/api");
-    if (p[0] != '/') p.insert(p.begin(), '/');
-    while (p.size() > 1 && p.back() == '/') p.pop_back();
-    return p;
+// `uri` below the base path ("/api"; "api/" and "" are taken as "/api"), as a view into `uri`.
+static bool StripBasePath(struct mg_str uri, const std::string& base_path, struct mg_str& out_rel) {
+    const char* base = base_path.empty() ? kDefaultBasePath : base_path.data();
+    std::size_t n = base_path.empty() ? std::strlen(kDefaultBasePath) : base_path.size();
+    while (n > 0 && base[n - 1] == '/') --n;
+    std::size_t skip = 0;
+    if (n > 0 && base[0] != '/') {
+        if (uri.len == 0 || uri.buf[0] != '/') return false;
+        skip = 1;
+    }
+    if (uri.len < skip + n || std::memcmp(uri.buf + skip, base, n) != 0) return false;
+    out_rel = mg_str_n(uri.buf + skip + n, uri.len - skip - n);
+    if (out_rel.len == 0) {
+        out_rel = mg_str_n("/", 1);
+        return true;
+    }
+    return out_rel.buf[0] == '/';
 }
 
-static bool StripBasePath(const std::string& uri, const std::string& base_path, std::string& out_rel) {
-    if (base_path.empty() || base_path == "/") {
-        out_rel = uri;
-        return true;
+// Set while CallApi runs a handler: the reply lands here instead of on the connection.
+static ApiCallResult* g_call = nullptr;
+
+static ReplyCacheStats g_cache_stats;
+
+static void Reply(struct mg_connection* c, int status, const char* json, const std::string* etag) {
+    if (g_call != nullptr) {
+        g_call->status = status;
+        g_call->body = json;
+        return;
     }
-    if (uri == base_path) {
-        out_rel = "/";
-        return true;
+    if (etag == nullptr) {
+        mg_http_reply(c, status, "Content-Type: application/json\r\n", "%s\n", json);
+        return;
     }
-    const std::string prefix = base_path + "/";
-    if (uri.size() >= prefix.size() && uri.compare(0, prefix.size(), prefix) == 0) {
-        out_rel = uri.substr(base_path.size());
-        if (out_rel.empty()) out_rel = "/";
-        return true;
+    // no-cache: clients may keep the body but revalidate it with If-None-Match.
+    const std::string headers =
+        "Content-Type: application/json\r\nCache-Control: no-cache\r\nETag: " + *etag + "\r\n";
+    mg_http_reply(c, status, headers.c_str(), "%s\n", json);
+}
+
+// If-None-Match: a list of tags (`"a", W/"b"`) or `*`.
+static bool HasETag(struct mg_http_message* hm, const std::string& etag) {
+    const struct mg_str* h = mg_http_get_header(hm, "If-None-Match");
+    if (h == nullptr || h->len == 0) return false;
+    if (h->len == 1 && h->buf[0] == '*') return true;
+    for (std::size_t i = 0; i + etag.size() <= h->len; ++i) {
+        if (std::memcmp(h->buf + i, etag.data(), etag.size()) == 0) return true;
     }
     return false;
 }
 
-static bool IsMethod(const struct mg_http_message* hm, const char* method) {
-    return mg_strcmp(hm->method, mg_str(method)) == 0;
+static bool Dispatch(struct mg_connection* c, struct mg_http_message* hm, struct mg_str rel_path,
+                     const ApiContext& ctx) {
+    RouteParams params;
+    const RouteHandler handler = ApiRoutes().Match(hm->method, rel_path, params);
+    if (handler == nullptr) return false;
+    handler(c, hm, params, ctx);
+    return true;
 }
 
-}  // namespace
-
-bool HandleHttpRequest(struct mg_connection* c, struct mg_http_message* hm, const ApiContext& ctx) {
-    if (c == nullptr || hm == nullptr) return false;
+// GET /health
+static void HandleHealth(struct mg_connection* c, struct mg_http_message*, const RouteParams&, const ApiContext&) {
+    ReplyJsonText(c, 200, "{\"status\":\"ok\"}");
+}
 
-    const std::string uri = ToStdString(hm->uri);
-    const std::string base_path = NormalizeBasePath(ctx.base_path);
+// GET /version
+static void HandleVersion(struct mg_connection* c, struct mg_http_message*, const RouteParams&,
+                          const ApiContext& ctx) {
+    auto& w = ResponseWriter();
+    w.BeginObject().Key("version").String(ctx.version).Key("ws_path").String(ctx.ws_path).EndObject();
+    ReplyJson(c, 200, w);
+}
 
-    std::string rel_path;
-    if (!StripBasePath(uri, base_path, rel_path)) {
-        if (base_path != "/api") {
-            if (!StripBasePath(uri, std::string("/api"), rel_path)) return false;
+// GET /metrics
+static void HandleMetrics(struct mg_connection* c, struct mg_http_message*, const RouteParams&,
+                          const ApiContext& ctx) {
+    auto& w = ResponseWriter();
+    w.BeginObject().Key("mqtt");
+    if (ctx.mqtt_client != nullptr) {
+        const auto& st = ctx.mqtt_client->GetStats();
+        const double per_pub =
+            st.publishes > 0 ? static_cast<double>(st.publish_bytes) / static_cast<double>(st.publishes) : 0.0;
+        w.BeginObject();
+        w.Key("version").Uint(ctx.mqtt_client->Version());
+        w.Key("open").Bool(ctx.mqtt_client->IsOpen());
+        w.Key("publishes").Uint(st.publishes);
+        w.Key("publish_bytes").Uint(st.publish_bytes);
+        w.Key("alias_hits").Uint(st.alias_hits);
+        w.Key("bytes_per_publish").Double(per_pub);
+        w.EndObject();
+    } else {
+        w.Null();
+    }
+    w.Key("telemetry");
+    if (ctx.device_registry != nullptr) {
+        namespace codec = iotgw::core::device::codec;
+        const auto& st = ctx.device_registry->GetIngestStats();
+        w.BeginObject();
+        w.Key("accepted").Uint(st.accepted);
+        w.Key("suppressed").Uint(st.suppressed);
+        w.Key("validated").Uint(st.validated);
+        w.Key("unknown_fields").Uint(st.unknown_fields);
+        w.Key("rejected").BeginObject();
+        for (std::size_t i = 1; i < codec::kVerdictCount; ++i) {
+            w.Key(codec::VerdictName(static_cast<codec::Verdict>(i))).Uint(st.rejected[i]);
+        }
+        w.EndObject();
+        w.EndObject();
+    } else {
+        w.Null();
+    }
+    w.Key("virtual_sensors");
+    if (ctx.virtual_sensors != nullptr) {
+        const auto& st = ctx.virtual_sensors->GetStats();
+        w.BeginObject();
+        w.Key("sensors").Uint(ctx.virtual_sensors->Size());
+        w.Key("input_updates").Uint(st.updates);
+        w.Key("evaluations").Uint(st.evaluations);
+        w.Key("skipped").Uint(st.skipped);
+        w.EndObject();
+    } else {
+        w.Null();
+    }
+    w.Key("uplink");
+    if (ctx.uplink != nullptr) {
+        const auto& st = ctx.uplink->GetStats();
+        w.BeginObject();
+        w.Key("interval_ms").Int(ctx.uplink->Options().interval_ms);
+        w.Key("batches").Uint(st.batches);
+        w.Key("failed").Uint(st.failed);
+        w.Key("devices").Uint(st.devices);
+        w.Key("samples").Uint(st.samples);
+        w.Key("raw_bytes").Uint(st.raw_bytes);
+        w.Key("payload_bytes").Uint(st.payload_bytes);
+        w.Key("bytes_per_sample");
+        if (st.published_samples > 0) {
+            w.Double(static_cast<double>(st.payload_bytes) / static_cast<double>(st.published_samples));
         } else {
-            return false;
+            w.Null();
         }
+        w.Key("compression_ratio");
+        if (st.payload_bytes > 0) {
+            w.Double(static_cast<double>(st.raw_bytes) / static_cast<double>(st.payload_bytes));
+        } else {
+            w.Null();
+        }
+        w.EndObject();
+    } else {
+        w.Null();
+    }
+    w.Key("state_feed");
+    if (ctx.state_feed != nullptr) {
+        const auto& st = ctx.state_feed->GetStats();
+        w.BeginObject();
+        w.Key("clients").Uint(ctx.state_feed->Clients());
+        w.Key("frames").Uint(st.frames);
+        w.Key("sends").Uint(st.sends);
+        w.Key("fields").Uint(st.fields);
+        w.Key("acks").Uint(st.acks);
+        w.Key("resends").Uint(st.resends);
+        w.EndObject();
+    } else {
+        w.Null();
+    }
+    w.Key("websocket");
+    if (ctx.ws_subscriptions != nullptr) {
+        w.BeginObject();
+        w.Key("clients").Uint(ctx.ws_subscriptions->Clients());
+        w.Key("filtered").Uint(ctx.ws_subscriptions->Filtered());
+        if (ctx.ws_send_queues != nullptr) {
+            const auto& q = *ctx.ws_send_queues;
+            const auto& st = q.GetStats();
+            const auto policy = q.GetOptions().policy;
+            w.Key("overflow").String(iotgw::services::web_services::websocket::OverflowPolicyName(policy));
+            w.Key("frames").Uint(st.frames);
+            w.Key("enqueued").Uint(st.enqueued);
+            w.Key("sent").Uint(st.sent);
+            w.Key("queued").Uint(q.QueuedFrames());
+            w.Key("dropped").Uint(st.dropped);
+            w.Key("coalesced").Uint(st.coalesced);
+            w.Key("disconnected").Uint(st.disconnected);
+            w.Key("rate_coalesced").Uint(st.rate_coalesced);
+            w.Key("flushes").Uint(st.flushes);
+            w.Key("backlog").BeginArray();
+            for (const auto& b : q.Backlogs()) {
+                w.BeginObject();
+                w.Key("id").Uint(b.id);
+                w.Key("frames").Uint(b.frames);
+                w.Key("bytes").Uint(b.bytes);
+                w.Key("send_buffer").Uint(b.send_buffer);
+                w.Key("peak_frames").Uint(b.peak_frames);
+                w.Key("dropped").Uint(b.dropped);
+                w.Key("coalesced").Uint(b.coalesced);
+                w.Key("max_rate_hz").Double(b.max_rate_hz);
+                w.Key("held").Uint(b.held);
+                w.Key("rate_coalesced").Uint(b.rate_coalesced);
+                w.EndObject();
+            }
+            w.EndArray();
+        }
+        w.EndObject();
+    } else {
+        w.Null();
+    }
+    const auto& cache_st = GetReplyCacheStats();
+    w.Key("http_cache").BeginObject();
+    w.Key("renders").Uint(cache_st.renders);
+    w.Key("hits").Uint(cache_st.hits);
+    w.Key("not_modified").Uint(cache_st.not_modified);
+    w.EndObject();
+    w.Key("event_stream");
+    if (ctx.event_stream != nullptr && ctx.event_stream->Enabled()) {
+        const auto& es = *ctx.event_stream;
+        const auto& st = es.GetStats();
+        w.BeginObject();
+        w.Key("clients").Uint(es.Clients());
+        w.Key("first_id").Uint(es.FirstId());
+        w.Key("last_id").Uint(es.LastId());
+        w.Key("events").Uint(st.events);
+        w.Key("sent").Uint(st.sent);
+        w.Key("gaps").Uint(st.gaps);
+        w.Key("missed").Uint(st.missed);
+        w.Key("heartbeats").Uint(st.heartbeats);
+        w.Key("refused").Uint(st.refused);
+        w.EndObject();
+    } else {
+        w.Null();
+    }
+    w.Key("thing_model");
+    if (ctx.thing_model != nullptr) {
+        const auto st = ctx.thing_model->GetStats();
+        w.BeginObject();
+        w.Key("posts").Uint(st.posts);
+        w.Key("properties").Uint(st.properties);
+        w.Key("acked").Uint(st.acked);
+        w.Key("rejected").Uint(st.rejected);
+        w.Key("last_code").Int(st.last_code);
+        w.Key("timeouts").Uint(st.timeouts);
+        w.Key("retries").Uint(st.retries);
+        w.Key("dropped").Uint(st.dropped);
+        w.Key("unknown_replies").Uint(st.unknown_replies);
+        w.Key("queued").Uint(st.queued);
+        w.Key("in_flight").Uint(st.in_flight);
+        w.EndObject();
+    } else {
+        w.Null();
     }
+    w.EndObject();
+    ReplyJson(c, 200, w);
+}
 
-    if (HandleSystemApi(c, hm, rel_path, ctx)) return true;
-    if (HandleDeviceApi(c, hm, rel_path, ctx)) return true;
-    if (HandleRuleApi(c, hm, rel_path, ctx)) return true;
-    if (HandleCameraApi(c, hm, rel_path, ctx)) return true;
-    if (HandleControlApi(c, hm, rel_path, ctx)) return true;
+}  // namespace
 
-    return false;
+iotgw::core::common::json::Writer& ResponseWriter() {
+    static iotgw::core::common::json::Writer w;
+    w.Clear();
+    return w;
 }
 
-bool HandleSystemApi(struct mg_connection* c, struct mg_http_message* hm, const std::string& rel_path,
-                     const ApiContext& ctx) {
-    if (IsMethod(hm, "GET") && rel_path == "/health") {
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "{\"status\":\"ok\"}\n");
-        return true;
+void ReplyJsonText(struct mg_connection* c, int status, const char* json) { Reply(c, status, json, nullptr); }
+
+void ReplyJsonTagged(struct mg_connection* c, int status, const char* json, const std::string& etag) {
+    Reply(c, status, json, &etag);
+}
+
+std::string MakeETag(const char* kind, std::uint64_t revision) {
+    const auto boot = static_cast<unsigned long long>(iotgw::core::common::time::BootId());
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "\"%s-%llx-%llu\"", kind, boot, static_cast<unsigned long long>(revision));
+    return buf;
+}
+
+bool ReplyNotModified(struct mg_connection* c, struct mg_http_message* hm, const std::string& etag) {
+    if (g_call != nullptr || !HasETag(hm, etag)) return false;
+    ++g_cache_stats.not_modified;
+    const std::string headers = "Cache-Control: no-cache\r\nETag: " + etag + "\r\n";
+    mg_http_reply(c, 304, headers.c_str(), "");
+    return true;
+}
+
+bool ReplyFromCache(struct mg_connection* c, struct mg_http_message* hm, const CachedReply& cache,
+                    const char* kind, std::uint64_t revision) {
+    const bool fresh = cache.valid && cache.revision == revision;
+    if (ReplyNotModified(c, hm, fresh ? cache.etag : MakeETag(kind, revision))) return true;
+    if (!fresh) return false;
+    ++g_cache_stats.hits;
+    Reply(c, 200, cache.body.c_str(), &cache.etag);
+    return true;
+}
+
+void StoreAndReply(struct mg_connection* c, CachedReply& cache, const char* kind, std::uint64_t revision,
+                   const iotgw::core::common::json::Writer& w) {
+    ++g_cache_stats.renders;
+    cache.valid = true;
+    cache.revision = revision;
+    cache.etag = MakeETag(kind, revision);
+    cache.body.assign(w.c_str(), w.size());
+    Reply(c, 200, cache.body.c_str(), &cache.etag);
+}
+
+const ReplyCacheStats& GetReplyCacheStats() { return g_cache_stats; }
+
+void ReplyJson(struct mg_connection* c, int status, const iotgw::core::common::json::Writer& w) {
+    ReplyJsonText(c, status, w.c_str());
+}
+
+const Router& ApiRoutes() {
+    static const Router routes = [] {
+        Router r;
+        RegisterSystemRoutes(r);
+        RegisterDeviceRoutes(r);
+        RegisterRuleRoutes(r);
+        RegisterCameraRoutes(r);
+        RegisterControlRoutes(r);
+        RegisterStreamRoutes(r);
+        return r;
+    }();
+    return routes;
+}
+
+bool HandleHttpRequest(struct mg_connection* c, struct mg_http_message* hm, const ApiContext& ctx) {
+    if (c == nullptr || hm == nullptr) return false;
+    struct mg_str rel_path;
+    // The default base path keeps working when another one is configured.
+    static const std::string kFallback;  // empty: kDefaultBasePath
+    if (!StripBasePath(hm->uri, ctx.base_path, rel_path) && !StripBasePath(hm->uri, kFallback, rel_path)) {
+        return false;
     }
+    return Dispatch(c, hm, rel_path, ctx);
+}
 
-    if (IsMethod(hm, "GET") && rel_path == "/version") {
-        const std::string body =
-            iotgw::core::common::json::Object({{"version", iotgw::core::common::json::Quote(ctx.version)}});
-        mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s\n", body.c_str());
-        return true;
+bool CallApi(struct mg_connection* c, const ApiCall& call, const ApiContext& ctx, ApiCallResult& out) {
+    out.status = 0;
+    out.body.clear();
+    struct mg_http_message hm{};
+    hm.method = mg_str_n(call.method.data(), call.method.size());
+    hm.uri = mg_str_n(call.path.data(), call.path.size());
+    hm.query = mg_str_n(call.query.data(), call.query.size());
+    hm.body = mg_str_n(call.body.data(), call.body.size());
+    struct mg_str rel_path;
+    if (!StripBasePath(hm.uri, ctx.base_path, rel_path)) rel_path = hm.uri;
+
+    g_call = &out;
+    const bool handled = Dispatch(c, &hm, rel_path, ctx);
+    g_call = nullptr;
+    if (!handled) {
+        out.status = 404;
+        out.body = "{\"error\":\"not_found\"}";
     }
+    return handled;
+}
 
-    return false;
+void RegisterSystemRoutes(Router& r) {
+    (void)r.Add("GET", "/health", HandleHealth);
+    (void)r.Add("GET", "/version", HandleVersion);
+    (void)r.Add("GET", "/metrics", HandleMetrics);
 }
 
 }  // namespace api
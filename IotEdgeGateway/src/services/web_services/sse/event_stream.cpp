@@ -0,0 +1,196 @@
+#include "services/web_services/sse/event_stream.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "core/common/utils/time_utils.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace sse {
+
+namespace {
+
+static void AppendUint(std::string& out, std::uint64_t v) {
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    out.append(p, static_cast<std::size_t>(buf + sizeof(buf) - p));
+}
+
+// One "data:" line per line of `data`; the client joins them back with '\n'.
+static void AppendData(std::string& out, const std::string& data) {
+    std::size_t start = 0;
+    for (;;) {
+        const std::size_t end = data.find('\n', start);
+        const std::size_t stop = end == std::string::npos ? data.size() : end;
+        std::size_t len = stop - start;
+        if (len > 0 && data[start + len - 1] == '\r') --len;
+        out.append("data: ", 6);
+        out.append(data, start, len);
+        out.push_back('\n');
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+}
+
+}  // namespace
+
+EventStream::EventStream(Options opt) : opt_(opt) {
+    log_.resize(opt_.log_size);
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "%llx", static_cast<unsigned long long>(iotgw::core::common::time::BootId()));
+    epoch_ = buf;
+}
+
+bool EventStream::Wants(const Client& cl, const std::string& device_id) {
+    return cl.devices.empty() || cl.devices.find(device_id) != cl.devices.end();
+}
+
+std::uint64_t EventStream::FirstId() const {
+    if (last_id_ == 0) return 1;
+    return last_id_ >= log_.size() ? last_id_ - log_.size() + 1 : 1;
+}
+
+std::uint64_t EventStream::Append(const std::string& device_id, const std::string& data, std::int64_t now_ms) {
+    if (log_.empty()) return 0;
+    const std::uint64_t id = ++last_id_;
+    Event& e = log_[id % log_.size()];
+    if (e.id != 0) {
+        // The event in this slot is about to go: charge it to the clients that still wanted it.
+        for (auto& cl : clients_) {
+            if (cl.next_id <= e.id && Wants(cl, e.device_id)) ++cl.lost;
+        }
+    }
+    e.id = id;
+    e.device_id = device_id;
+    e.wire.clear();  // keeps the slot's capacity
+    e.wire.append("id: ", 4);
+    e.wire += epoch_;
+    e.wire.push_back('-');
+    AppendUint(e.wire, id);
+    e.wire.push_back('\n');
+    AppendData(e.wire, data);
+    e.wire.push_back('\n');
+    ++stats_.events;
+    for (auto& cl : clients_) Pump(cl, now_ms);
+    return id;
+}
+
+bool EventStream::Open(struct mg_connection* c, const std::string& devices, const std::string& last_event_id,
+                       std::int64_t now_ms) {
+    if (log_.empty() || c == nullptr) return false;
+    if (Find(c) != nullptr) return true;
+    if (clients_.Size() >= opt_.max_clients) {
+        ++stats_.refused;
+        return false;
+    }
+    Client cl;
+    cl.c = c;
+    std::size_t start = 0;
+    while (start <= devices.size()) {
+        std::size_t end = devices.find(',', start);
+        if (end == std::string::npos) end = devices.size();
+        if (end > start) cl.devices.insert(devices.substr(start, end - start));
+        start = end + 1;
+    }
+    // An id from another run (or from the future) cannot be resumed: start afresh.
+    std::uint64_t resume = 0;
+    const std::size_t dash = last_event_id.find('-');
+    if (dash != std::string::npos && last_event_id.compare(0, dash, epoch_) == 0) {
+        resume = std::strtoull(last_event_id.c_str() + dash + 1, nullptr, 10);
+    }
+    cl.next_id = resume == 0 || resume > last_id_ ? last_id_ + 1 : resume + 1;
+    cl.last_write_ms = now_ms;
+    const std::uint64_t first = FirstId();
+    if (cl.next_id < first) {
+        // Gone before this connection existed: count them all, whichever devices they were for.
+        cl.lost = first - cl.next_id;
+        cl.lost_exact = cl.devices.empty();
+    }
+
+    mg_printf(c, "%s",
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: text/event-stream\r\n"
+              "Cache-Control: no-cache\r\n"
+              "Connection: keep-alive\r\n"
+              "X-Accel-Buffering: no\r\n"
+              "\r\n"
+              "retry: 3000\n\n");
+    const Handle h = clients_.Insert(std::move(cl));
+    static_assert(sizeof(Handle) <= sizeof(c->data), "mongoose connection data too small for a handle");
+    std::memcpy(c->data, &h, sizeof(h));
+    Pump(*clients_.Get(h), now_ms);
+    return true;
+}
+
+EventStream::Client* EventStream::Find(struct mg_connection* c) {
+    Handle h;
+    std::memcpy(&h, c->data, sizeof(h));
+    Client* cl = clients_.Get(h);
+    return cl != nullptr && cl->c == c ? cl : nullptr;
+}
+
+void EventStream::Drain(struct mg_connection* c, std::int64_t now_ms) {
+    Client* cl = Find(c);
+    if (cl != nullptr) Pump(*cl, now_ms);
+}
+
+void EventStream::Close(struct mg_connection* c) {
+    if (Find(c) == nullptr) return;
+    Handle h;
+    std::memcpy(&h, c->data, sizeof(h));
+    (void)clients_.Erase(h);
+    std::memset(c->data, 0, sizeof(h));
+}
+
+void EventStream::Pump(Client& cl, std::int64_t now_ms) {
+    struct mg_connection* c = cl.c;
+    if (c->is_closing || c->is_draining) return;
+    // Still flushing: it resumes from its cursor once the buffer drains.
+    if (c->send.len >= opt_.send_high_water) return;
+    const std::uint64_t first = FirstId();
+    if (cl.next_id < first) {
+        // Overtaken by the log. Only events for its devices count: if none of them were lost
+        // the client just skips ahead; otherwise it is told how many so it can reload state.
+        if (cl.lost > 0) {
+            std::string msg = "event: gap\ndata: {\"missed\":";
+            AppendUint(msg, cl.lost);
+            msg += ",\"next\":";
+            AppendUint(msg, first);
+            if (!cl.lost_exact) msg += ",\"exact\":false";
+            msg += "}\n\n";
+            mg_send(c, msg.data(), msg.size());
+            ++stats_.gaps;
+            stats_.missed += cl.lost;
+            cl.last_write_ms = now_ms;
+        }
+        cl.lost = 0;
+        cl.lost_exact = true;
+        cl.next_id = first;
+    }
+    while (cl.next_id <= last_id_ && c->send.len < opt_.send_high_water) {
+        const Event& e = log_[cl.next_id % log_.size()];
+        ++cl.next_id;
+        if (!Wants(cl, e.device_id)) continue;
+        mg_send(c, e.wire.data(), e.wire.size());
+        ++stats_.sent;
+        cl.last_write_ms = now_ms;
+    }
+    if (opt_.heartbeat_ms > 0 && now_ms - cl.last_write_ms >= opt_.heartbeat_ms) {
+        mg_send(c, ": ping\n\n", 8);
+        ++stats_.heartbeats;
+        cl.last_write_ms = now_ms;
+    }
+}
+
+}  // namespace sse
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
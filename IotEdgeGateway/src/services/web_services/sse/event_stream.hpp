@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "mongoose.h"
+
+#include "core/common/utils/slot_map.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace sse {
+
+// Server-Sent Events (`text/event-stream`) for HTTP clients that cannot use WebSocket.
+// Pushed frames go into a change log: a ring of the last `log_size` events, each numbered
+// by a sequence id and stored already in wire format. A client is nothing but a cursor
+// into that log plus its device filter, so a slow client costs no memory: it is fed while
+// its socket buffer is below `send_high_water`, and if the log overtakes it, it gets a
+// `gap` event and continues from the oldest event kept. Event ids are `<epoch>-<seq>`, the
+// epoch naming this run of the gateway: a client that reconnects with `Last-Event-ID` resumes
+// right after that event while it is still in the log, and starts afresh if the id is from
+// another run.
+class EventStream {
+public:
+    struct Options {
+        std::size_t log_size = 4096;  // 0: disabled
+        std::size_t send_high_water = 64 * 1024;
+        std::int64_t heartbeat_ms = 15000;  // comment line after this much silence
+        std::size_t max_clients = 256;
+    };
+
+    struct Stats {
+        std::uint64_t events = 0;
+        std::uint64_t sent = 0;  // events written to clients
+        std::uint64_t gaps = 0;
+        std::uint64_t missed = 0;  // events for a client's devices overwritten before it got to them
+        std::uint64_t heartbeats = 0;
+        std::uint64_t refused = 0;  // over max_clients
+    };
+
+    explicit EventStream(Options opt);
+
+    bool Enabled() const { return !log_.empty(); }
+
+    // Appends `data` (one JSON frame) about `device_id` (may be empty) to the log and
+    // pushes it to the clients that keep up. Returns the event id, 0 if disabled.
+    std::uint64_t Append(const std::string& device_id, const std::string& data, std::int64_t now_ms);
+
+    // Turns the HTTP connection `c` into an event stream: writes the response head and
+    // whatever of the log the client has not seen. `devices` is a comma-separated filter
+    // (empty: all); an empty `last_event_id`, or one not from this epoch, starts with the
+    // next event. False if the stream is disabled or full; nothing has been written then.
+    bool Open(struct mg_connection* c, const std::string& devices, const std::string& last_event_id,
+              std::int64_t now_ms);
+    // Feeds the client and sends heartbeats; call when the connection can write.
+    void Drain(struct mg_connection* c, std::int64_t now_ms);
+    void Close(struct mg_connection* c);
+
+    std::uint64_t FirstId() const;
+    std::uint64_t LastId() const { return last_id_; }
+    const std::string& Epoch() const { return epoch_; }
+    std::size_t Clients() const { return clients_.Size(); }
+    const Options& GetOptions() const { return opt_; }
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct Event {
+        std::uint64_t id = 0;
+        std::string device_id;
+        std::string wire;  // "id: <epoch>-<seq>\ndata: ..\n\n"
+    };
+
+    struct Client {
+        struct mg_connection* c = nullptr;
+        std::unordered_set<std::string> devices;  // empty: all
+        std::uint64_t next_id = 1;
+        std::int64_t last_write_ms = 0;
+        // Events for its devices overwritten at or after next_id; exact unless it resumed
+        // from before the log, when the devices of the lost events are no longer known.
+        std::uint64_t lost = 0;
+        bool lost_exact = true;
+    };
+
+    using Handle = iotgw::core::common::slot::SlotMap<Client>::Handle;
+
+    Client* Find(struct mg_connection* c);
+    static bool Wants(const Client& cl, const std::string& device_id);
+    void Pump(Client& cl, std::int64_t now_ms);
+
+private:
+    Options opt_;
+    std::vector<Event> log_;  // event id i at i % size
+    std::uint64_t last_id_ = 0;
+    std::string epoch_;
+    iotgw::core::common::slot::SlotMap<Client> clients_;
+    Stats stats_;
+};
+
+}  // namespace sse
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
@@ -0,0 +1,135 @@
+#include "services/web_services/websocket/state_feed.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "core/common/utils/time_utils.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace websocket {
+
+StateFeed::StateFeed(const iotgw::core::device::manager::DeviceRegistry& registry, Options opt)
+    : registry_(registry), opt_(opt) {
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "%llx", static_cast<unsigned long long>(iotgw::core::common::time::BootId()));
+    epoch_ = buf;
+}
+
+StateFeed::Client* StateFeed::FindClient(struct mg_connection* c) {
+    const auto it = index_.find(c);
+    return it != index_.end() ? &clients_[it->second] : nullptr;
+}
+
+void StateFeed::Subscribe(struct mg_connection* c, std::uint64_t version, const std::string& epoch) {
+    Client* client = FindClient(c);
+    if (client == nullptr) {
+        index_.emplace(c, clients_.size());
+        clients_.emplace_back();
+        client = &clients_.back();
+        client->c = c;
+    }
+    client->acked = epoch != epoch_ || version > registry_.Version() ? 0 : version;
+    client->waiting = false;
+}
+
+bool StateFeed::Ack(struct mg_connection* c, std::uint64_t version) {
+    Client* client = FindClient(c);
+    if (client == nullptr || !client->waiting || version != client->sent) return false;
+    client->acked = version;
+    client->waiting = false;
+    ++stats_.acks;
+    return true;
+}
+
+void StateFeed::Remove(struct mg_connection* c) {
+    const auto it = index_.find(c);
+    if (it == index_.end()) return;
+    const std::size_t i = it->second;
+    index_.erase(it);
+    if (i + 1 != clients_.size()) {
+        clients_[i] = clients_.back();
+        index_[clients_[i].c] = i;
+    }
+    clients_.pop_back();
+}
+
+const std::string& StateFeed::Encode(std::uint64_t from) {
+    changed_.clear();
+    registry_.ChangedSince(from, changed_);
+    writer_.Clear();
+    writer_.BeginObject();
+    writer_.Key("type").String("state");
+    writer_.Key("epoch").String(epoch_);
+    writer_.Key("from").Uint(from);
+    writer_.Key("version").Uint(registry_.Version());
+    writer_.Key("devices").BeginObject();
+    for (const auto h : changed_) {
+        const auto* d = registry_.At(h);
+        writer_.Key(d->id).BeginObject();
+        const auto& fields = d->status.fields;
+        for (std::size_t i = 0; i < fields.Size(); ++i) {
+            if (registry_.FieldVersionOf(h, i) <= from) continue;
+            const auto& v = fields.ValueAt(i);
+            writer_.Key(fields.NameAt(i), fields.NameLenAt(i));
+            if (v.type == iotgw::core::device::model::FieldType::kBool) {
+                writer_.Bool(v.number != 0.0);
+            } else {
+                writer_.Double(v.number);
+            }
+            ++stats_.fields;
+        }
+        writer_.EndObject();
+    }
+    writer_.EndObject();
+    writer_.Key("online").BeginObject();
+    for (const auto h : changed_) {
+        if (registry_.OnlineVersionOf(h) <= from) continue;
+        const auto* d = registry_.At(h);
+        writer_.Key(d->id).Bool(d->status.online);
+    }
+    writer_.EndObject();
+    writer_.EndObject();
+    ++stats_.frames;
+    return writer_.str();
+}
+
+void StateFeed::Poll(std::int64_t now_ms, const Send& send) {
+    if (clients_.empty() || !send || now_ms - last_poll_ms_ < opt_.min_interval_ms) return;
+    last_poll_ms_ = now_ms;
+    const std::uint64_t version = registry_.Version();
+
+    ready_.clear();
+    for (std::size_t i = 0; i < clients_.size(); ++i) {
+        Client& client = clients_[i];
+        if (client.waiting) {
+            if (now_ms - client.sent_ms < opt_.ack_timeout_ms) continue;
+            client.waiting = false;
+            ++stats_.resends;
+        }
+        if (client.acked < version) ready_.push_back(i);
+    }
+    if (ready_.empty()) return;
+
+    // One frame per distinct starting version, usually a single one.
+    std::sort(ready_.begin(), ready_.end(),
+              [this](std::size_t a, std::size_t b) { return clients_[a].acked < clients_[b].acked; });
+    for (std::size_t k = 0; k < ready_.size();) {
+        const std::uint64_t from = clients_[ready_[k]].acked;
+        const std::string& frame = Encode(from);
+        for (; k < ready_.size() && clients_[ready_[k]].acked == from; ++k) {
+            Client& client = clients_[ready_[k]];
+            send(client.c, frame);
+            client.sent = version;
+            client.sent_ms = now_ms;
+            client.waiting = true;
+            ++stats_.sends;
+        }
+    }
+}
+
+}  // namespace websocket
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mongoose.h"
+
+#include "core/common/utils/json_writer.hpp"
+#include "core/device/manager/device_manager.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace websocket {
+
+// Pushes device-state deltas to the WebSocket clients that ask for them with
+//
+//   {"type":"state_sync","version":0}
+//
+// Each frame carries only the fields changed after the version the client last
+// acknowledged (0: everything), read from the registry's change tracking, plus the
+// devices whose online flag flipped since then:
+//
+//   {"type":"state","epoch":"18f0c3a2b1e","from":12,"version":57,"devices":{"temp":{"value":23.5}},
+//    "online":{"temp":true}}
+//
+// Versions restart with the gateway, so they are only meaningful with the epoch that
+// came with them: a client resuming with {"type":"state_sync","epoch":..,"version":57}
+// continues from 57 if the epoch is current, and gets everything (from 0) otherwise.
+//
+// and the client answers {"type":"state_ack","version":57}. Until it does it gets no
+// further frame, so a client that falls behind receives one coalesced delta instead of
+// a backlog. Clients at the same version share one encoded frame; an idle registry
+// costs nothing per client.
+class StateFeed {
+public:
+    using Send = std::function<void(struct mg_connection* c, const std::string& frame)>;
+
+    struct Options {
+        std::int64_t min_interval_ms = 100;  // changes within this are coalesced into one frame
+        std::int64_t ack_timeout_ms = 5000;  // then the delta is sent again from the acked version
+    };
+
+    struct Stats {
+        std::uint64_t frames = 0;  // deltas encoded
+        std::uint64_t sends = 0;
+        std::uint64_t fields = 0;  // field values encoded
+        std::uint64_t acks = 0;
+        std::uint64_t resends = 0;  // after an ack timeout
+    };
+
+    StateFeed(const iotgw::core::device::manager::DeviceRegistry& registry, Options opt);
+
+    // A client asks for deltas after `version` of `epoch`. A version from another epoch
+    // (a gateway restart), or ahead of the registry, gets everything.
+    void Subscribe(struct mg_connection* c, std::uint64_t version, const std::string& epoch);
+    bool Ack(struct mg_connection* c, std::uint64_t version);
+    void Remove(struct mg_connection* c);
+
+    // Sends due deltas. Cheap when nothing changed.
+    void Poll(std::int64_t now_ms, const Send& send);
+
+    const std::string& Epoch() const { return epoch_; }
+    std::size_t Clients() const { return clients_.size(); }
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    struct Client {
+        struct mg_connection* c = nullptr;
+        std::uint64_t acked = 0;
+        std::uint64_t sent = 0;
+        std::int64_t sent_ms = 0;
+        bool waiting = false;  // for the ack of `sent`
+    };
+
+    Client* FindClient(struct mg_connection* c);
+    // The delta from `from` to the registry's current version.
+    const std::string& Encode(std::uint64_t from);
+
+private:
+    const iotgw::core::device::manager::DeviceRegistry& registry_;
+    Options opt_;
+    std::string epoch_;
+    std::vector<Client> clients_;
+    std::unordered_map<struct mg_connection*, std::size_t> index_;  // into clients_
+    std::int64_t last_poll_ms_ = 0;
+    std::vector<std::size_t> ready_;                                // scratch
+    std::vector<iotgw::core::device::manager::DeviceHandle> changed_;  // scratch
+    iotgw::core::common::json::Writer writer_;
+    Stats stats_;
+};
+
+}  // namespace websocket
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
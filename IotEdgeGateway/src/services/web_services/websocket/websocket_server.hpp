@@ -1,11 +1,16 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
 
 #include "core/common/logger/logger.hpp"
 #include "mongoose.h"
+#include "services/web_services/sse/event_stream.hpp"
+#include "services/web_services/websocket/ws_connection.hpp"
+#include "services/web_services/websocket/ws_send_queue.hpp"
+#include "services/web_services/websocket/ws_subscriptions.hpp"
 
 namespace iotgw {
 namespace services {
@@ -18,14 +23,22 @@ public:
         std::string listen_addr = "http://0.0.0.0:8080";
         std::string ws_path = "/ws";
         std::string www_root = "/etc/iotgw/www";
+        WsSendQueues::Options send_queue;
+        iotgw::services::web_services::sse::EventStream::Options event_stream;
     };
 
     using WsMessageHandler = std::function<void(struct mg_connection* c, const std::string& message)>;
 
     using HttpHandler = std::function<bool(struct mg_connection* c, struct mg_http_message* hm)>;
 
+    using WsCloseHandler = std::function<void(struct mg_connection* c)>;
+
     explicit MongooseServer(Options opt, std::shared_ptr<iotgw::core::common::log::Logger> logger)
-        : opt_(std::move(opt)), logger_(std::move(logger)) {
+        : opt_(std::move(opt)),
+          logger_(std::move(logger)),
+          subs_(conns_),
+          queues_(conns_, opt_.send_queue),
+          events_(opt_.event_stream) {
         mg_mgr_init(&mgr_);
     }
 
@@ -46,15 +59,46 @@ public:
 
     void SetWsMessageHandler(WsMessageHandler handler) { on_ws_msg_ = std::move(handler); }
     void SetHttpHandler(HttpHandler handler) { on_http_ = std::move(handler); }
+    void SetWsCloseHandler(WsCloseHandler handler) { on_ws_close_ = std::move(handler); }
 
+    // Broadcast frames are framed once and queued by reference on each connection (see WsSendQueues).
     void BroadcastText(const std::string& text) {
-        for (auto* c : ws_conns_) {
-            if (c != nullptr && c->is_websocket) {
-                mg_ws_send(c, text.data(), text.size(), WEBSOCKET_OP_TEXT);
-            }
+        if (conns_.Size() == 0) return;
+        const WsFrame frame = queues_.Encode(text);
+        const auto now_ms = static_cast<std::int64_t>(mg_millis());
+        for (auto& conn : conns_) (void)queues_.Enqueue(conn, frame, std::string(), now_ms);
+    }
+
+    // A reply for one client (RPC result, ack), queued like any other frame so it is held
+    // to the same high water and queue limits. False if `c` is not a WebSocket client or the
+    // overflow policy refused the frame.
+    bool SendText(struct mg_connection* c, const std::string& text) {
+        WsConnection* conn = conns_.Find(c);
+        if (conn == nullptr) return false;
+        return queues_.Enqueue(*conn, queues_.Encode(text), std::string(), static_cast<std::int64_t>(mg_millis()));
+    }
+
+    // Sends `text` to the clients subscribed to `topic` or `device_id` (see WsSubscriptions).
+    // A queued or rate-limited frame with the same non-empty `key` is superseded by this one.
+    // It also goes into the event stream log for SSE clients (see EventStream).
+    void Publish(const std::string& topic, const std::string& device_id, const std::string& text,
+                 const std::string& key = std::string()) {
+        if (events_.Enabled()) (void)events_.Append(device_id, text, static_cast<std::int64_t>(mg_millis()));
+        targets_.clear();
+        subs_.Match(topic, device_id, targets_);
+        if (targets_.empty()) return;
+        const WsFrame frame = queues_.Encode(text);
+        const auto now_ms = static_cast<std::int64_t>(mg_millis());
+        for (auto* c : targets_) {
+            WsConnection* conn = conns_.Find(c);
+            if (conn != nullptr) (void)queues_.Enqueue(*conn, frame, key, now_ms);
         }
     }
 
+    const WsSubscriptions& Subscriptions() const { return subs_; }
+    const WsSendQueues& SendQueues() const { return queues_; }
+    iotgw::services::web_services::sse::EventStream& Events() { return events_; }
+
 private:
     static void EventHandler(struct mg_connection* c, int ev, void* ev_data) {
         auto* self = static_cast<MongooseServer*>(c->fn_data);
@@ -83,24 +127,43 @@ private:
                 mg_http_serve_dir(c, hm, &opts);
             }
         } else if (ev == MG_EV_WS_OPEN) {
-            ws_conns_.push_back(c);
+            WsConnection* conn = conns_.Open(c, static_cast<std::int64_t>(mg_millis()));
+            subs_.Add(*conn);
+            queues_.Add(*conn);
         } else if (ev == MG_EV_WS_MSG) {
             struct mg_ws_message* wm = (struct mg_ws_message*)ev_data;
             const std::string msg(wm->data.buf, wm->data.len);
             if (logger_) logger_->Debug("WS message: " + msg);
-            if (on_ws_msg_) {
+            WsConnection* conn = conns_.Find(c);
+            std::string reply;
+            if (conn != nullptr && subs_.HandleControl(*conn, msg, reply)) {
+                // {"type":"subscribe",...,"max_rate":5}: the connection gets at most 5 releases per
+                // second, each carrying the latest frame of every topic/device held since the last.
+                double max_rate = 0.0;
+                if (mg_json_get_num(mg_str_n(msg.data(), msg.size()), "$.max_rate", &max_rate)) {
+                    queues_.SetMaxRate(*conn, max_rate);
+                }
+                (void)queues_.Enqueue(*conn, queues_.Encode(reply), std::string(),
+                                      static_cast<std::int64_t>(mg_millis()));
+            } else if (on_ws_msg_) {
                 on_ws_msg_(c, msg);
             } else {
                 mg_ws_send(c, wm->data.buf, wm->data.len, WEBSOCKET_OP_TEXT);
             }
+        } else if ((ev == MG_EV_POLL || ev == MG_EV_WRITE) && c->is_websocket) {
+            WsConnection* conn = conns_.Find(c);
+            if (conn != nullptr) queues_.Drain(*conn, static_cast<std::int64_t>(mg_millis()));
+        } else if ((ev == MG_EV_POLL || ev == MG_EV_WRITE) && !c->is_listening) {
+            events_.Drain(c, static_cast<std::int64_t>(mg_millis()));
         } else if (ev == MG_EV_CLOSE) {
-            if (c != nullptr && c->is_websocket && !ws_conns_.empty()) {
-                for (size_t i = 0; i < ws_conns_.size(); ++i) {
-                    if (ws_conns_[i] == c) {
-                        ws_conns_.erase(ws_conns_.begin() + static_cast<long>(i));
-                        break;
-                    }
-                }
+            WsConnection* conn = c->is_websocket ? conns_.Find(c) : nullptr;
+            if (conn != nullptr) {
+                if (on_ws_close_) on_ws_close_(c);
+                subs_.Remove(*conn);
+                queues_.Remove(*conn);
+                (void)conns_.Close(c);
+            } else if (!c->is_websocket) {
+                events_.Close(c);
             }
         }
     }
@@ -111,7 +174,12 @@ private:
     struct mg_mgr mgr_;
     HttpHandler on_http_;
     WsMessageHandler on_ws_msg_;
-    std::vector<struct mg_connection*> ws_conns_;
+    WsCloseHandler on_ws_close_;
+    WsConnections conns_;
+    WsSubscriptions subs_;
+    std::vector<struct mg_connection*> targets_;  // scratch for Publish
+    WsSendQueues queues_;
+    iotgw::services::web_services::sse::EventStream events_;
 };
 
 }  // namespace websocket
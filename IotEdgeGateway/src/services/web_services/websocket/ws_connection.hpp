@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mongoose.h"
+
+#include "core/common/utils/slot_map.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace websocket {
+
+// A complete server-to-client WebSocket frame (header + payload), encoded once and
+// shared by every connection it is queued on.
+using WsFrame = std::shared_ptr<const std::string>;
+
+// What WsSubscriptions keeps per client.
+struct WsSubscriptionState {
+    bool filtered = false;
+    std::size_t all_pos = 0;  // in WsSubscriptions' unfiltered list, while !filtered
+    std::vector<std::string> topics;
+    std::vector<std::string> devices;
+};
+
+// What WsSendQueues keeps per client.
+struct WsQueueState {
+    struct Entry {
+        WsFrame frame;
+        std::string key;
+    };
+
+    std::deque<Entry> entries;
+    std::size_t bytes = 0;
+    std::size_t peak_frames = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t coalesced = 0;
+    // Rate limit: latest frame per key since the last release, in first-arrival order.
+    double max_rate_hz = 0.0;
+    std::int64_t interval_ms = 0;
+    std::int64_t last_release_ms = 0;
+    std::vector<Entry> held;
+    std::unordered_map<std::string, std::size_t> held_index;
+    std::uint64_t rate_coalesced = 0;
+};
+
+struct WsConnection {
+    struct mg_connection* c = nullptr;
+    std::int64_t opened_ms = 0;
+    WsSubscriptionState subscriptions;
+    WsQueueState queue;
+};
+
+// The server's WebSocket clients, one slot each. The slot handle lives in the
+// connection's mongoose user data (`c->data`), so finding a client's state, opening
+// and closing are O(1) however many clients are connected.
+class WsConnections {
+public:
+    using Handle = iotgw::core::common::slot::SlotMap<WsConnection>::Handle;
+
+    WsConnection* Open(struct mg_connection* c, std::int64_t now_ms) {
+        if (Find(c) != nullptr) return Find(c);
+        WsConnection conn;
+        conn.c = c;
+        conn.opened_ms = now_ms;
+        const Handle h = conns_.Insert(std::move(conn));
+        std::memcpy(c->data, &h, sizeof(h));
+        return conns_.Get(h);
+    }
+
+    bool Close(struct mg_connection* c) {
+        if (Find(c) == nullptr) return false;
+        (void)conns_.Erase(HandleOf(c));
+        std::memset(c->data, 0, sizeof(Handle));
+        return true;
+    }
+
+    WsConnection* Find(struct mg_connection* c) {
+        WsConnection* conn = conns_.Get(HandleOf(c));
+        return conn != nullptr && conn->c == c ? conn : nullptr;
+    }
+    const WsConnection* Find(struct mg_connection* c) const { return const_cast<WsConnections*>(this)->Find(c); }
+
+    std::size_t Size() const { return conns_.Size(); }
+
+    std::vector<WsConnection>::iterator begin() { return conns_.begin(); }
+    std::vector<WsConnection>::iterator end() { return conns_.end(); }
+    std::vector<WsConnection>::const_iterator begin() const { return conns_.begin(); }
+    std::vector<WsConnection>::const_iterator end() const { return conns_.end(); }
+
+private:
+    static Handle HandleOf(const struct mg_connection* c) {
+        static_assert(sizeof(Handle) <= sizeof(c->data), "mongoose connection data too small for a handle");
+        Handle h;
+        std::memcpy(&h, c->data, sizeof(h));
+        return h;
+    }
+
+    iotgw::core::common::slot::SlotMap<WsConnection> conns_;
+};
+
+}  // namespace websocket
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
@@ -0,0 +1,195 @@
+#include "services/web_services/websocket/ws_send_queue.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace websocket {
+
+WsFrame EncodeWsFrame(const char* data, std::size_t len, int op) {
+    // RFC 6455 5.2; frames from the server are not masked.
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(len + 10);
+    frame->push_back(static_cast<char>(0x80 | (op & 0x0F)));
+    if (len < 126) {
+        frame->push_back(static_cast<char>(len));
+    } else if (len <= 0xFFFF) {
+        frame->push_back(static_cast<char>(126));
+        frame->push_back(static_cast<char>((len >> 8) & 0xFF));
+        frame->push_back(static_cast<char>(len & 0xFF));
+    } else {
+        frame->push_back(static_cast<char>(127));
+        const std::uint64_t n = len;
+        for (int shift = 56; shift >= 0; shift -= 8) frame->push_back(static_cast<char>((n >> shift) & 0xFF));
+    }
+    frame->append(data, len);
+    return frame;
+}
+
+const char* OverflowPolicyName(OverflowPolicy p) {
+    switch (p) {
+        case OverflowPolicy::kDropOldest:
+            return "drop_oldest";
+        case OverflowPolicy::kLatest:
+            return "latest";
+        case OverflowPolicy::kDisconnect:
+            return "disconnect";
+    }
+    return "drop_oldest";
+}
+
+bool ParseOverflowPolicy(const std::string& s, OverflowPolicy& out) {
+    if (s == "drop_oldest") {
+        out = OverflowPolicy::kDropOldest;
+    } else if (s == "latest") {
+        out = OverflowPolicy::kLatest;
+    } else if (s == "disconnect") {
+        out = OverflowPolicy::kDisconnect;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+WsFrame WsSendQueues::Encode(const std::string& text) {
+    ++stats_.frames;
+    return EncodeWsFrame(text.data(), text.size());
+}
+
+void WsSendQueues::Add(WsConnection& conn) {
+    conn.queue = WsQueueState();
+    SetRate(conn.queue, opt_.max_rate_hz);
+}
+
+void WsSendQueues::Remove(WsConnection& conn) {
+    queued_frames_ -= conn.queue.entries.size();
+    conn.queue = WsQueueState();
+}
+
+void WsSendQueues::SetRate(WsQueueState& q, double max_rate_hz) {
+    q.max_rate_hz = max_rate_hz > 0.0 ? max_rate_hz : 0.0;
+    q.interval_ms = q.max_rate_hz > 0.0 ? static_cast<std::int64_t>(1000.0 / q.max_rate_hz) : 0;
+}
+
+void WsSendQueues::SetMaxRate(WsConnection& conn, double max_rate_hz) {
+    SetRate(conn.queue, max_rate_hz > 0.0 ? max_rate_hz : opt_.max_rate_hz);
+}
+
+void WsSendQueues::PopFront(WsQueueState& q) {
+    q.bytes -= q.entries.front().frame->size();
+    q.entries.pop_front();
+    --queued_frames_;
+}
+
+bool WsSendQueues::Enqueue(WsConnection& conn, const WsFrame& frame, const std::string& key, std::int64_t now_ms) {
+    struct mg_connection* c = conn.c;
+    if (c->is_closing || !frame) return false;
+    WsQueueState& q = conn.queue;
+    ++stats_.enqueued;
+    if (q.interval_ms <= 0 || key.empty()) return Push(c, q, frame, key);
+
+    // Nothing held and the interval is over: no reason to wait.
+    if (q.held.empty() && now_ms - q.last_release_ms >= q.interval_ms) {
+        q.last_release_ms = now_ms;
+        return Push(c, q, frame, key);
+    }
+    const auto held = q.held_index.find(key);
+    if (held != q.held_index.end()) {
+        q.held[held->second].frame = frame;
+        ++q.rate_coalesced;
+        ++stats_.rate_coalesced;
+        return true;
+    }
+    // As many keys as a full queue: hand this one to the overflow policy instead.
+    if (q.held.size() >= opt_.max_frames) return Push(c, q, frame, key);
+    q.held_index.emplace(key, q.held.size());
+    q.held.push_back(WsQueueState::Entry{frame, key});
+    return true;
+}
+
+void WsSendQueues::Release(struct mg_connection* c, WsQueueState& q, std::int64_t now_ms) {
+    if (q.held.empty() || now_ms - q.last_release_ms < q.interval_ms) return;
+    q.last_release_ms = now_ms;
+    ++stats_.flushes;
+    for (const auto& e : q.held) {
+        if (!Push(c, q, e.frame, e.key)) break;  // disconnected
+    }
+    q.held.clear();
+    q.held_index.clear();
+}
+
+bool WsSendQueues::Push(struct mg_connection* c, WsQueueState& q, const WsFrame& frame, const std::string& key) {
+    if (q.entries.empty() && c->send.len < opt_.send_high_water) {
+        (void)mg_send(c, frame->data(), frame->size());
+        ++stats_.sent;
+        return true;
+    }
+
+    if (opt_.policy == OverflowPolicy::kLatest && !key.empty()) {
+        for (auto& e : q.entries) {
+            if (e.key != key) continue;
+            q.bytes = q.bytes - e.frame->size() + frame->size();
+            e.frame = frame;
+            ++q.coalesced;
+            ++stats_.coalesced;
+            return true;
+        }
+    }
+
+    while (!q.entries.empty() && (q.entries.size() >= opt_.max_frames || q.bytes + frame->size() > opt_.max_bytes)) {
+        if (opt_.policy == OverflowPolicy::kDisconnect) {
+            c->is_closing = 1;
+            ++stats_.disconnected;
+            queued_frames_ -= q.entries.size();
+            q.entries.clear();
+            q.bytes = 0;
+            return false;
+        }
+        PopFront(q);
+        ++q.dropped;
+        ++stats_.dropped;
+    }
+
+    q.entries.push_back(WsQueueState::Entry{frame, key});
+    q.bytes += frame->size();
+    ++queued_frames_;
+    if (q.entries.size() > q.peak_frames) q.peak_frames = q.entries.size();
+    return true;
+}
+
+void WsSendQueues::Drain(WsConnection& conn, std::int64_t now_ms) {
+    struct mg_connection* c = conn.c;
+    WsQueueState& q = conn.queue;
+    if (!q.held.empty() && !c->is_closing) Release(c, q, now_ms);
+    while (!q.entries.empty() && c->send.len < opt_.send_high_water && !c->is_closing) {
+        const WsFrame& frame = q.entries.front().frame;
+        (void)mg_send(c, frame->data(), frame->size());
+        ++stats_.sent;
+        PopFront(q);
+    }
+}
+
+std::vector<WsSendQueues::Backlog> WsSendQueues::Backlogs() const {
+    std::vector<Backlog> out;
+    out.reserve(conns_.Size());
+    for (const auto& conn : conns_) {
+        const WsQueueState& q = conn.queue;
+        Backlog b;
+        b.id = conn.c->id;
+        b.frames = q.entries.size();
+        b.bytes = q.bytes;
+        b.send_buffer = conn.c->send.len;
+        b.peak_frames = q.peak_frames;
+        b.dropped = q.dropped;
+        b.coalesced = q.coalesced;
+        b.max_rate_hz = q.max_rate_hz;
+        b.held = q.held.size();
+        b.rate_coalesced = q.rate_coalesced;
+        out.push_back(b);
+    }
+    return out;
+}
+
+}  // namespace websocket
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
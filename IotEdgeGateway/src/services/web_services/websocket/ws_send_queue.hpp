@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mongoose.h"
+
+#include "services/web_services/websocket/ws_connection.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace websocket {
+
+WsFrame EncodeWsFrame(const char* data, std::size_t len, int op = WEBSOCKET_OP_TEXT);
+
+// What to do with a frame for a client whose queue is full.
+enum class OverflowPolicy : std::uint8_t {
+    kDropOldest,  // discard the oldest queued frame
+    kLatest,      // replace the queued frame with the same key (same topic/device), else drop the oldest
+    kDisconnect,  // close the connection
+};
+
+const char* OverflowPolicyName(OverflowPolicy p);
+bool ParseOverflowPolicy(const std::string& s, OverflowPolicy& out);
+
+// Per-connection bounded send queues for broadcast frames. A frame is handed to
+// mongoose only while the connection's socket buffer is below `send_high_water`;
+// the rest wait here as references to the shared frame. A client that stops reading
+// therefore holds at most high_water bytes of socket buffer plus `max_frames`/`max_bytes`
+// of queue, whatever the broadcast rate.
+//
+// A client may also cap its update rate. Keyed frames for it are then held back and only
+// the latest per key (topic/device) is released, all together, once per 1/max_rate; unkeyed
+// frames (events) pass straight through.
+class WsSendQueues {
+public:
+    struct Options {
+        std::size_t max_frames = 256;
+        std::size_t max_bytes = 1024 * 1024;      // of queued frames, counted per connection
+        std::size_t send_high_water = 64 * 1024;  // mongoose send buffer level that stops draining
+        OverflowPolicy policy = OverflowPolicy::kDropOldest;
+        double max_rate_hz = 0.0;  // default per-client update rate; <= 0: unlimited
+    };
+
+    struct Stats {
+        std::uint64_t frames = 0;  // encoded, each shared by all its recipients
+        std::uint64_t enqueued = 0;
+        std::uint64_t sent = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t coalesced = 0;  // replaced by a newer frame with the same key
+        std::uint64_t disconnected = 0;
+        std::uint64_t rate_coalesced = 0;  // superseded while held back by a client's rate limit
+        std::uint64_t flushes = 0;         // rate-limited releases
+    };
+
+    struct Backlog {
+        unsigned long id = 0;  // mongoose connection id
+        std::size_t frames = 0;
+        std::size_t bytes = 0;
+        std::size_t send_buffer = 0;  // bytes in mongoose's send buffer
+        std::size_t peak_frames = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t coalesced = 0;
+        double max_rate_hz = 0.0;
+        std::size_t held = 0;  // keys waiting for the next rate-limited release
+        std::uint64_t rate_coalesced = 0;
+    };
+
+    WsSendQueues(WsConnections& conns, Options opt) : conns_(conns), opt_(opt) {}
+
+    void Add(WsConnection& conn);
+    void Remove(WsConnection& conn);
+
+    // A text frame for Enqueue on any number of connections.
+    WsFrame Encode(const std::string& text);
+
+    // Updates per second for the client's keyed frames; <= 0 restores the default.
+    void SetMaxRate(WsConnection& conn, double max_rate_hz);
+
+    // Sends `frame` now if the connection keeps up, otherwise queues it, applying the
+    // overflow policy. `key` (may be empty: never replaced) identifies frames that supersede
+    // each other under kLatest and the rate limit. False if the frame was not accepted.
+    bool Enqueue(WsConnection& conn, const WsFrame& frame, const std::string& key, std::int64_t now_ms);
+    // Releases rate-limited frames that are due and moves queued frames into the socket
+    // buffer; call when the connection can write.
+    void Drain(WsConnection& conn, std::int64_t now_ms);
+
+    const Options& GetOptions() const { return opt_; }
+    const Stats& GetStats() const { return stats_; }
+    std::size_t QueuedFrames() const { return queued_frames_; }
+    std::vector<Backlog> Backlogs() const;
+
+private:
+    static void SetRate(WsQueueState& q, double max_rate_hz);
+    // Into the queue (or straight to the socket), under the overflow policy.
+    bool Push(struct mg_connection* c, WsQueueState& q, const WsFrame& frame, const std::string& key);
+    void Release(struct mg_connection* c, WsQueueState& q, std::int64_t now_ms);
+    void PopFront(WsQueueState& q);
+
+private:
+    WsConnections& conns_;
+    Options opt_;
+    std::size_t queued_frames_ = 0;
+    Stats stats_;
+};
+
+}  // namespace websocket
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
@@ -0,0 +1,186 @@
+#include "services/web_services/websocket/ws_subscriptions.hpp"
+
+#include <algorithm>
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace websocket {
+
+constexpr std::size_t WsSubscriptions::kMaxPerClient;
+
+namespace {
+
+static bool EraseString(std::vector<std::string>& v, const std::string& s) {
+    const auto it = std::find(v.begin(), v.end(), s);
+    if (it == v.end()) return false;
+    v.erase(it);
+    return true;
+}
+
+}  // namespace
+
+void WsSubscriptions::Add(WsConnection& conn) {
+    conn.subscriptions = WsSubscriptionState();
+    conn.subscriptions.all_pos = all_.size();
+    all_.push_back(conn.c);
+}
+
+void WsSubscriptions::Remove(WsConnection& conn) {
+    ClearSubscriptions(conn);
+    SetFiltered(conn, true);
+    --filtered_;
+}
+
+void WsSubscriptions::SetFiltered(WsConnection& conn, bool filtered) {
+    WsSubscriptionState& s = conn.subscriptions;
+    if (s.filtered == filtered) return;
+    s.filtered = filtered;
+    if (filtered) {
+        // Swap-remove; the moved client learns its new position.
+        const std::size_t pos = s.all_pos;
+        all_[pos] = all_.back();
+        all_.pop_back();
+        if (pos < all_.size()) {
+            WsConnection* moved = conns_.Find(all_[pos]);
+            if (moved != nullptr) moved->subscriptions.all_pos = pos;
+        }
+        ++filtered_;
+    } else {
+        s.all_pos = all_.size();
+        all_.push_back(conn.c);
+        --filtered_;
+    }
+}
+
+void WsSubscriptions::ClearSubscriptions(WsConnection& conn) {
+    WsSubscriptionState& s = conn.subscriptions;
+    for (const auto& f : s.topics) (void)topics_.Erase(f, conn.c);
+    for (const auto& id : s.devices) {
+        const auto it = devices_.find(id);
+        if (it == devices_.end()) continue;
+        (void)it->second.erase(conn.c);
+        if (it->second.empty()) devices_.erase(it);
+    }
+    s.topics.clear();
+    s.devices.clear();
+}
+
+bool WsSubscriptions::SubscribeTopic(WsConnection& conn, const std::string& filter) {
+    WsSubscriptionState& s = conn.subscriptions;
+    if (filter.empty()) return false;
+    if (std::find(s.topics.begin(), s.topics.end(), filter) == s.topics.end()) {
+        if (s.topics.size() + s.devices.size() >= kMaxPerClient) return false;
+        if (!topics_.Insert(filter, conn.c)) return false;
+        s.topics.push_back(filter);
+    }
+    SetFiltered(conn, true);
+    return true;
+}
+
+bool WsSubscriptions::SubscribeDevice(WsConnection& conn, const std::string& device_id) {
+    WsSubscriptionState& s = conn.subscriptions;
+    if (device_id.empty()) return false;
+    if (std::find(s.devices.begin(), s.devices.end(), device_id) == s.devices.end()) {
+        if (s.topics.size() + s.devices.size() >= kMaxPerClient) return false;
+        (void)devices_[device_id].insert(conn.c);
+        s.devices.push_back(device_id);
+    }
+    SetFiltered(conn, true);
+    return true;
+}
+
+bool WsSubscriptions::UnsubscribeTopic(WsConnection& conn, const std::string& filter) {
+    if (!EraseString(conn.subscriptions.topics, filter)) return false;
+    (void)topics_.Erase(filter, conn.c);
+    return true;
+}
+
+bool WsSubscriptions::UnsubscribeDevice(WsConnection& conn, const std::string& device_id) {
+    if (!EraseString(conn.subscriptions.devices, device_id)) return false;
+    const auto d = devices_.find(device_id);
+    if (d != devices_.end()) {
+        (void)d->second.erase(conn.c);
+        if (d->second.empty()) devices_.erase(d);
+    }
+    return true;
+}
+
+void WsSubscriptions::SubscribeAll(WsConnection& conn) {
+    ClearSubscriptions(conn);
+    SetFiltered(conn, false);
+}
+
+bool WsSubscriptions::HandleControl(WsConnection& conn, const std::string& message, std::string& reply) {
+    const struct mg_str json = mg_str_n(message.data(), message.size());
+    char* type = mg_json_get_str(json, "$.type");
+    if (type == nullptr) return false;
+    const std::string t(type);
+    mg_free(type);
+    const bool subscribe = t == "subscribe";
+    if (!subscribe && t != "unsubscribe") return false;
+
+    std::size_t accepted = 0;
+    std::size_t rejected = 0;
+    bool all = false;
+    int len = 0;
+    if (subscribe && mg_json_get_bool(json, "$.all", &all) && all) {
+        SubscribeAll(conn);
+        ++accepted;
+    } else if (subscribe && (mg_json_get(json, "$.topics", &len) >= 0 || mg_json_get(json, "$.devices", &len) >= 0)) {
+        SetFiltered(conn, true);  // even with nothing accepted below
+    }
+    for (const char* list : {"topics", "devices"}) {
+        const bool topics = list[0] == 't';
+        for (std::size_t i = 0; i < kMaxPerClient; ++i) {
+            const std::string path = std::string("$.") + list + "[" + std::to_string(i) + "]";
+            char* v = mg_json_get_str(json, path.c_str());
+            if (v == nullptr) break;
+            const std::string value(v);
+            mg_free(v);
+            bool ok = false;
+            if (topics) {
+                ok = subscribe ? SubscribeTopic(conn, value) : UnsubscribeTopic(conn, value);
+            } else {
+                ok = subscribe ? SubscribeDevice(conn, value) : UnsubscribeDevice(conn, value);
+            }
+            ++(ok ? accepted : rejected);
+        }
+    }
+
+    writer_.Clear();
+    writer_.BeginObject();
+    writer_.Key("type").String("subscribe_ack");
+    writer_.Key("accepted").Uint(accepted);
+    writer_.Key("rejected").Uint(rejected);
+    writer_.Key("topics").Uint(conn.subscriptions.topics.size());
+    writer_.Key("devices").Uint(conn.subscriptions.devices.size());
+    writer_.EndObject();
+    reply = writer_.str();
+    return true;
+}
+
+void WsSubscriptions::Match(const std::string& topic, const std::string& device_id,
+                            std::vector<struct mg_connection*>& out) const {
+    out.insert(out.end(), all_.begin(), all_.end());
+    const std::size_t first = out.size();
+    if (!topic.empty()) {
+        topics_.ForEachMatch(topic, [&out](struct mg_connection* c, const iotgw::core::common::topic::TopicCaptures&) {
+            out.push_back(c);
+        });
+    }
+    if (!device_id.empty()) {
+        const auto it = devices_.find(device_id);
+        if (it != devices_.end()) out.insert(out.end(), it->second.begin(), it->second.end());
+    }
+    // A client matching several of its subscriptions still gets one copy.
+    if (out.size() - first > 1) {
+        std::sort(out.begin() + static_cast<std::ptrdiff_t>(first), out.end());
+        out.erase(std::unique(out.begin() + static_cast<std::ptrdiff_t>(first), out.end()), out.end());
+    }
+}
+
+}  // namespace websocket
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mongoose.h"
+
+#include "core/common/utils/json_writer.hpp"
+#include "core/common/utils/topic_trie.hpp"
+#include "services/web_services/websocket/ws_connection.hpp"
+
+namespace iotgw {
+namespace services {
+namespace web_services {
+namespace websocket {
+
+// Which WebSocket clients want which frames. A frame is about an MQTT topic, a device,
+// or both; a client subscribes to topic filters (`+`/`#`, as for MQTT) and device ids.
+// Clients that never subscribed get every frame, as before subscriptions existed; a client
+// that subscribed to nothing (or unsubscribed from everything) gets none of them.
+// All filters share one topic tree, so matching a frame costs its topic depth plus the
+// interested clients, not the number of clients. Per-client state lives in the client's
+// WsConnection.
+class WsSubscriptions {
+public:
+    static constexpr std::size_t kMaxPerClient = 64;  // filters + device ids
+
+    explicit WsSubscriptions(WsConnections& conns) : conns_(conns) {}
+
+    void Add(WsConnection& conn);
+    void Remove(WsConnection& conn);
+
+    // False for a malformed filter or one over kMaxPerClient.
+    // The first subscription stops the client's everything-feed.
+    bool SubscribeTopic(WsConnection& conn, const std::string& filter);
+    bool SubscribeDevice(WsConnection& conn, const std::string& device_id);
+    bool UnsubscribeTopic(WsConnection& conn, const std::string& filter);
+    bool UnsubscribeDevice(WsConnection& conn, const std::string& device_id);
+    // Drops the client's subscriptions and returns it to the everything-feed.
+    void SubscribeAll(WsConnection& conn);
+
+    // Control messages of the client:
+    //   {"type":"subscribe","topics":["iotgw/dev/telemetry/+"],"devices":["temp","cam0"]}
+    //   {"type":"unsubscribe","topics":[...],"devices":[...]}
+    //   {"type":"subscribe","all":true}
+    // A subscribe with a `topics` or `devices` array ends the everything-feed even if the
+    // arrays are empty, so a first {"type":"subscribe","topics":[]} means "nothing"; one without
+    // either (e.g. only `max_rate`) leaves the subscriptions as they are.
+    // False if `message` is not one; otherwise `reply` is the ack to send back:
+    //   {"type":"subscribe_ack","accepted":3,"rejected":0,"topics":1,"devices":2}
+    bool HandleControl(WsConnection& conn, const std::string& message, std::string& reply);
+
+    // Clients interested in a frame about `topic` and/or `device_id` (either may be empty),
+    // each once, appended to `out`.
+    void Match(const std::string& topic, const std::string& device_id, std::vector<struct mg_connection*>& out) const;
+
+    std::size_t Clients() const { return conns_.Size(); }
+    std::size_t Filtered() const { return filtered_; }
+
+private:
+    void ClearSubscriptions(WsConnection& conn);
+    void SetFiltered(WsConnection& conn, bool filtered);
+
+private:
+    WsConnections& conns_;
+    std::vector<struct mg_connection*> all_;  // unfiltered clients
+    std::size_t filtered_ = 0;
+    iotgw::core::common::json::Writer writer_;  // acks
+    iotgw::core::common::topic::TopicTrie<struct mg_connection*> topics_;
+    std::unordered_map<std::string, std::unordered_set<struct mg_connection*>> devices_;
+};
+
+}  // namespace websocket
+}  // namespace web_services
+}  // namespace services
+}  // namespace iotgw
@@ -0,0 +1,97 @@
+// POST /control records the commanded state as fresh telemetry of the actuator, so the
+// offline sweep that follows must not take the device for silent.
+//
+//   cmake -S . -B build -DIOTGW_BUILD_TESTS=ON && cmake --build build && ctest --test-dir build
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "mongoose.h"
+
+#include "core/common/utils/time_utils.hpp"
+#include "core/device/manager/device_manager.hpp"
+#include "core/device/protocol_adapters/mqtt_adapter/mqtt_broker.hpp"
+#include "services/web_services/api/rest_api.hpp"
+
+namespace {
+
+using iotgw::core::common::time::NowUnixMs;
+using iotgw::core::device::manager::DeviceRegistry;
+using iotgw::core::device::protocol_adapters::mqtt::MqttBroker;
+using iotgw::services::web_services::api::ApiCall;
+using iotgw::services::web_services::api::ApiCallResult;
+using iotgw::services::web_services::api::ApiContext;
+using iotgw::services::web_services::api::CallApi;
+
+const std::int64_t kOfflineTimeoutMs = 300000;
+
+int g_failures = 0;
+
+void Check(bool ok, const char* what) {
+    if (ok) return;
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+}
+
+void RegisterActuator(DeviceRegistry& registry, const char* id) {
+    iotgw::core::device::model::DeviceEntity d;
+    d.id = id;
+    d.kind = "actuator";
+    d.telemetry_topic = std::string("iotgw/dev/telemetry/") + id;
+    d.command_topic = std::string("iotgw/dev/cmd/") + id;
+    Check(registry.Register(d), "register actuator");
+}
+
+bool Online(const DeviceRegistry& registry, const char* id) {
+    const auto* d = registry.At(registry.Find(id));
+    return d != nullptr && d->status.online;
+}
+
+void TestCommandKeepsDeviceOnline(MqttBroker& broker) {
+    DeviceRegistry registry;
+    RegisterActuator(registry, "led");
+    RegisterActuator(registry, "motor");
+    RegisterActuator(registry, "buzzer");
+
+    ApiContext ctx;
+    ctx.mqtt_topic_prefix = "iotgw/dev/";
+    ctx.device_registry = &registry;
+    ctx.mqtt_broker = &broker;
+
+    ApiCall call;
+    call.method = "POST";
+    call.path = "/control";
+    call.body = "{\"payload\":{\"led_on\":1,\"motor_on\":1,\"buzzer\":1}}";
+    ApiCallResult result;
+    Check(CallApi(nullptr, call, ctx, result) && result.status == 200, "control handled");
+    Check(Online(registry, "led") && Online(registry, "motor") && Online(registry, "buzzer"),
+          "commanded devices online");
+
+    Check(registry.ExpireOnline(NowUnixMs(), kOfflineTimeoutMs) == 0, "nothing expired right after a command");
+    Check(Online(registry, "led"), "led still online");
+    Check(Online(registry, "motor"), "motor still online");
+    Check(Online(registry, "buzzer"), "buzzer still online");
+
+    // Still expires once the timeout has really passed.
+    Check(registry.ExpireOnline(NowUnixMs() + kOfflineTimeoutMs + 1000, kOfflineTimeoutMs) == 3,
+          "silent devices expire after the timeout");
+}
+
+}  // namespace
+
+int main() {
+    struct mg_mgr mgr;
+    mg_mgr_init(&mgr);
+    {
+        MqttBroker broker(&mgr, nullptr);
+        MqttBroker::Options opt;
+        opt.listen_url = "mqtt://127.0.0.1:0";
+        Check(broker.Start(opt), "broker listening");
+        if (broker.IsListening()) TestCommandKeepsDeviceOnline(broker);
+    }
+    mg_mgr_free(&mgr);
+    if (g_failures != 0) return 1;
+    std::printf("control_liveness_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+// Echo suppression of MqttBridge: only a message the destination subscribes to is
+// remembered, and each remembered copy is recognised once.
+//
+//   cmake -S . -B build -DIOTGW_BUILD_TESTS=ON && cmake --build build && ctest --test-dir build
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "core/device/protocol_adapters/mqtt_adapter/mqtt_bridge.hpp"
+
+namespace {
+
+using iotgw::core::device::protocol_adapters::mqtt::MqttBridge;
+
+int g_failures = 0;
+
+void Check(bool ok, const char* what) {
+    if (ok) return;
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    ++g_failures;
+}
+
+struct Published {
+    std::string topic;
+    std::string payload;
+};
+
+MqttBridge::Endpoint Capture(std::vector<Published>& out, bool echoes) {
+    MqttBridge::Endpoint ep;
+    auto* sink = &out;
+    ep.publish = [sink](const std::string& topic, const std::string& payload, std::uint8_t, std::uint32_t) {
+        sink->push_back(Published{topic, payload});
+        return true;
+    };
+    ep.echoes = echoes;
+    return ep;
+}
+
+MqttBridge::Rule Rule(const char* from, const char* to, const char* filter) {
+    MqttBridge::Rule r;
+    r.from = from;
+    r.to = to;
+    r.topic_filter = filter;
+    return r;
+}
+
+// Forwarded to an endpoint that nothing subscribes to there: an identical message that
+// later arrives on it is its own message, not an echo.
+void TestNoSubscriptionNoEcho() {
+    MqttBridge bridge;
+    std::vector<Published> local, cloud;
+    bridge.AddEndpoint("local", Capture(local, true));
+    bridge.AddEndpoint("cloud", Capture(cloud, true));
+    Check(bridge.AddRule(Rule("local", "cloud", "tele/#")), "add local->cloud");
+    Check(bridge.AddRule(Rule("cloud", "local", "cmd/#")), "add cloud->local");
+
+    Check(bridge.OnMessage("local", "tele/t", "{\"v\":1}", 1000), "tele/t forwarded");
+    bridge.Poll(1000);
+    Check(cloud.size() == 1, "tele/t published on cloud");
+    Check(!bridge.IsForwardedCopy("cloud", "tele/t", "{\"v\":1}", 1100), "tele/t on cloud is not an echo");
+}
+
+// An in-process endpoint never hands its own publishes back, even with a matching
+// reverse rule: a device repeating the same command is forwarded every time.
+void TestNonEchoingEndpoint() {
+    MqttBridge bridge;
+    std::vector<Published> up, embedded;
+    bridge.AddEndpoint("default", Capture(up, true));
+    bridge.AddEndpoint("embedded", Capture(embedded, false));
+    Check(bridge.AddRule(Rule("default", "embedded", "cmd/#")), "add default->embedded");
+    Check(bridge.AddRule(Rule("embedded", "default", "cmd/#")), "add embedded->default");
+
+    Check(bridge.OnMessage("default", "cmd/led", "{\"on\":1}", 1000), "cmd/led from default");
+    bridge.Poll(1000);
+    Check(embedded.size() == 1, "cmd/led published on embedded");
+    Check(bridge.OnMessage("embedded", "cmd/led", "{\"on\":1}", 1100), "identical cmd/led from embedded forwarded");
+    bridge.Poll(1100);
+    Check(up.size() == 1, "identical cmd/led published upstream");
+}
+
+// A subscription of the endpoint's own (AddSubscription) makes the copy an echo, once.
+void TestSubscribedEcho() {
+    MqttBridge bridge;
+    std::vector<Published> local, up;
+    bridge.AddEndpoint("embedded", Capture(local, false));
+    bridge.AddEndpoint("default", Capture(up, true));
+    Check(bridge.AddRule(Rule("embedded", "default", "tele/#")), "add embedded->default");
+    Check(bridge.AddSubscription("default", "tele/#"), "subscribe default tele/#");
+
+    Check(bridge.OnMessage("embedded", "tele/t", "{\"v\":2}", 1000), "tele/t from embedded");
+    bridge.Poll(1000);
+    Check(up.size() == 1, "tele/t published upstream");
+    Check(bridge.IsForwardedCopy("default", "tele/t", "{\"v\":2}", 1100), "first copy is an echo");
+    Check(!bridge.IsForwardedCopy("default", "tele/t", "{\"v\":2}", 1200), "second copy is not");
+}
+
+}  // namespace
+
+int main() {
+    TestNoSubscriptionNoEcho();
+    TestNonEchoingEndpoint();
+    TestSubscribedEcho();
+    if (g_failures != 0) return 1;
+    std::printf("mqtt_bridge_test: ok\n");
+    return 0;
+}
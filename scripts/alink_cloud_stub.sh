@@ -0,0 +1,54 @@
+#!/bin/bash
+
+# 本地云平台替身：订阅网关的 Alink 属性打包上报，并在 post_reply 话题上应答，
+# 用于在没有云平台账号时联调 cloud.thing_model（配合 broker: embedded 或本地 Mosquitto）。
+# 依赖 mosquitto-clients (mosquitto_sub / mosquitto_pub)。
+
+usage() {
+    echo "Usage: $0 [-h host] [-p port] [-c code] [-s skip_every]"
+    echo "  -h  Broker 地址，默认 127.0.0.1"
+    echo "  -p  Broker 端口，默认 1883"
+    echo "  -c  应答的 code，默认 200（非 200 时网关计入 rejected）"
+    echo "  -s  每 N 条上报不应答一次，用于验证超时重发，默认 0（全部应答）"
+    echo "Example: $0 -h 127.0.0.1 -p 1883 -s 5"
+}
+
+HOST=127.0.0.1
+PORT=1883
+CODE=200
+SKIP_EVERY=0
+
+while getopts "h:p:c:s:" opt; do
+    case $opt in
+        h) HOST=$OPTARG ;;
+        p) PORT=$OPTARG ;;
+        c) CODE=$OPTARG ;;
+        s) SKIP_EVERY=$OPTARG ;;
+        *) usage; exit 1 ;;
+    esac
+done
+
+if ! command -v mosquitto_sub &> /dev/null || ! command -v mosquitto_pub &> /dev/null; then
+    echo "Error: mosquitto_sub / mosquitto_pub not found."
+    echo "Please install it using: sudo apt-get install mosquitto-clients (Ubuntu/Debian) or brew install mosquitto (macOS)"
+    exit 1
+fi
+
+echo "Alink cloud stub on $HOST:$PORT (code=$CODE, skip_every=$SKIP_EVERY)"
+
+COUNT=0
+mosquitto_sub -h "$HOST" -p "$PORT" -v -t '/sys/+/+/thing/event/property/pack/post' | while read -r TOPIC PAYLOAD; do
+    COUNT=$((COUNT + 1))
+    ID=$(echo "$PAYLOAD" | sed -n 's/^{"id":"\([0-9]*\)".*/\1/p')
+    if [ -z "$ID" ]; then
+        echo "[$COUNT] no id: $PAYLOAD"
+        continue
+    fi
+    if [ "$SKIP_EVERY" -gt 0 ] && [ $((COUNT % SKIP_EVERY)) -eq 0 ]; then
+        echo "[$COUNT] id=$ID skipped"
+        continue
+    fi
+    REPLY="{\"code\":$CODE,\"data\":{},\"id\":\"$ID\",\"message\":\"success\",\"method\":\"thing.event.property.pack.post\",\"version\":\"1.0\"}"
+    mosquitto_pub -h "$HOST" -p "$PORT" -t "${TOPIC}_reply" -m "$REPLY"
+    echo "[$COUNT] id=$ID -> $CODE"
+done